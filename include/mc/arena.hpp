@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace memory
+{
+    // Bump allocator for short lived data that is released all at once. Individual deallocations are
+    // no-ops, everything goes away on `reset`, `rewind` or destruction. The blocks themselves are kept
+    // around when rewinding, so an arena that gets reused stops touching the heap once it is warm.
+    //
+    // Not thread safe: an arena either belongs to a single task, or to a single thread through
+    // `getThreadScratch`. It is a memory resource so std::pmr containers can live in it
+    class Arena final : public std::pmr::memory_resource
+    {
+    public:
+        static constexpr size_t kDefaultBlockSize = 1024 * 1024;
+
+        struct Marker
+        {
+            size_t block { 0 };
+            size_t offset { 0 };
+        };
+
+        explicit Arena(size_t blockSize = kDefaultBlockSize);
+
+        Arena(Arena const&)            = delete;
+        Arena& operator=(Arena const&) = delete;
+
+        Arena(Arena&&)            = delete;
+        Arena& operator=(Arena&&) = delete;
+
+        // Storage for `count` objects, left uninitialized. Only meant for types that don't need their
+        // destructor to run
+        template<typename T>
+            requires std::is_trivially_destructible_v<T>
+        [[nodiscard]] auto allocate(size_t count) -> std::span<T>
+        {
+            return { static_cast<T*>(do_allocate(count * sizeof(T), alignof(T))), count };
+        }
+
+        [[nodiscard]] auto getMarker() const -> Marker { return { m_current, m_offset }; }
+
+        // Frees everything allocated after `marker` was taken
+        void rewind(Marker marker);
+
+        void reset() { rewind({}); }
+
+        // Like `reset`, but hands the blocks back to the heap as well
+        void release();
+
+        // Bytes handed out since the last reset, including alignment padding
+        [[nodiscard]] auto getUsedSize() const -> size_t;
+
+        [[nodiscard]] auto getCapacity() const -> size_t;
+
+        // One arena per thread for scratch memory that doesn't outlive a function call, see `ArenaScope`.
+        // Must not be held across a co_await, the task might resume on another thread
+        [[nodiscard]] static auto getThreadScratch() -> Arena&;
+
+    private:
+        auto do_allocate(size_t bytes, size_t alignment) -> void* override;
+
+        void do_deallocate(void*, size_t, size_t) override {}
+
+        [[nodiscard]] auto do_is_equal(std::pmr::memory_resource const& other) const noexcept -> bool override
+        {
+            return this == &other;
+        }
+
+        struct Block
+        {
+            std::unique_ptr<std::byte[]> data;
+            size_t size { 0 };
+        };
+
+        std::vector<Block> m_blocks;
+        size_t m_blockSize { kDefaultBlockSize };
+
+        size_t m_current { 0 };
+        size_t m_offset { 0 };
+    };
+
+    // Rewinds the arena to where it was when the scope was entered
+    class ArenaScope
+    {
+    public:
+        explicit ArenaScope(Arena& arena = Arena::getThreadScratch())
+            : m_arena { &arena }, m_marker { arena.getMarker() }
+        {
+        }
+
+        ~ArenaScope() { m_arena->rewind(m_marker); }
+
+        ArenaScope(ArenaScope const&)            = delete;
+        ArenaScope& operator=(ArenaScope const&) = delete;
+
+        ArenaScope(ArenaScope&&)            = delete;
+        ArenaScope& operator=(ArenaScope&&) = delete;
+
+        [[nodiscard]] auto getArena() const -> Arena& { return *m_arena; }
+
+    private:
+        Arena* m_arena;
+        Arena::Marker m_marker;
+    };
+}  // namespace memory
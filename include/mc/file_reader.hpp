@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace io
+{
+    struct ReadRequest
+    {
+        std::filesystem::path path;
+
+        // Where the bytes end up. Reads past the end of the file are short, `ReadResult::bytesRead` says how
+        // much was read
+        std::span<std::byte> destination;
+
+        uint64_t offset { 0 };
+    };
+
+    struct ReadResult
+    {
+        size_t bytesRead { 0 };
+
+        // errno of the failed open or read, 0 on success
+        int error { 0 };
+
+        explicit operator bool() const { return error == 0; }
+    };
+
+    using ReadCallback = std::function<void(std::span<ReadResult const>)>;
+
+    // Whole files in request order, std::nullopt for the ones that couldn't be read
+    using FilesCallback = std::function<void(std::vector<std::optional<std::vector<std::byte>>>)>;
+
+    // Batched file reads. On Linux the requests go through an io_uring driven by a single thread,
+    // everywhere else (or when io_uring is unavailable at runtime) a small thread pool issues blocking reads
+    class FileReader
+    {
+    public:
+        static constexpr uint32_t kQueueDepth         = 256;
+        static constexpr uint32_t kNumFallbackThreads = 4;
+
+        FileReader();
+        ~FileReader();
+
+        FileReader(FileReader const&)            = delete;
+        FileReader& operator=(FileReader const&) = delete;
+
+        FileReader(FileReader&&)            = delete;
+        FileReader& operator=(FileReader&&) = delete;
+
+        // Process-wide reader, used by the asset loaders and the shader manager
+        static auto get() -> FileReader&;
+
+        // Returns immediately, `callback` runs on one of the reader's threads once every request completed,
+        // so it must not block on other reads. The destinations have to stay alive until then
+        void readAsync(std::vector<ReadRequest> requests, ReadCallback callback);
+
+        // Blocks until all requests completed, they are still submitted as one batch
+        auto read(std::vector<ReadRequest> requests) -> std::vector<ReadResult>;
+
+        // Same rules as `readAsync`, the file contents are handed over to the callback
+        void readFilesAsync(std::vector<std::filesystem::path> paths, FilesCallback callback);
+
+        // Reads whole files, std::nullopt for the ones that couldn't be read
+        auto readFiles(std::span<std::filesystem::path const> paths)
+            -> std::vector<std::optional<std::vector<std::byte>>>;
+
+        auto readFile(std::filesystem::path const& path) -> std::optional<std::vector<std::byte>>;
+
+        [[nodiscard]] auto usesIoUring() const -> bool { return m_ring.fd >= 0; }
+
+    private:
+        struct Batch;
+
+        struct Operation
+        {
+            Batch* batch { nullptr };
+            size_t index { 0 };
+            int fd { -1 };
+            size_t bytesRead { 0 };
+        };
+
+        struct Batch
+        {
+            std::vector<ReadRequest> requests;
+            std::vector<ReadResult> results;
+            std::vector<Operation> operations;
+            std::atomic<size_t> remaining { 0 };
+            ReadCallback callback;
+        };
+
+        // Mappings of the io_uring submission and completion queues, set up with raw syscalls
+        struct Ring
+        {
+            int fd { -1 };
+
+            void* submissionRing { nullptr };
+            void* completionRing { nullptr };
+            size_t submissionRingSize { 0 };
+            size_t completionRingSize { 0 };
+
+            uint32_t* submissionHead { nullptr };
+            uint32_t* submissionTail { nullptr };
+            uint32_t* submissionMask { nullptr };
+            uint32_t* submissionArray { nullptr };
+            uint32_t* completionHead { nullptr };
+            uint32_t* completionTail { nullptr };
+            uint32_t* completionMask { nullptr };
+
+            void* entries { nullptr };
+            void* completions { nullptr };
+            size_t entriesSize { 0 };
+
+            uint32_t numEntries { 0 };
+        };
+
+        auto setupRing() -> bool;
+        void destroyRing();
+
+        void ringWorker(std::stop_token stopToken);
+        void fallbackWorker(std::stop_token stopToken);
+
+        void completeOperation(Operation& operation, int error);
+
+        Ring m_ring;
+
+        std::deque<Operation*> m_pending;
+        std::mutex m_mutex;
+        std::condition_variable_any m_pendingCondition;
+
+        std::vector<std::jthread> m_workers;
+    };
+}  // namespace io
@@ -17,6 +17,7 @@ namespace renderer::backend
         friend void swap(Allocator& first, Allocator& second) noexcept
         {
             std::swap(first.m_allocator, second.m_allocator);
+            std::swap(first.m_hostVisibleVramSize, second.m_hostVisibleVramSize);
         }
 
         Allocator(Allocator&& other) noexcept : Allocator() { swap(*this, other); };
@@ -32,7 +33,11 @@ namespace renderer::backend
 
         [[nodiscard]] auto get() const -> VmaAllocator { return m_allocator; }
 
+        // Size of the largest heap that is both device local and host visible (ReBAR), 0 if there is none
+        [[nodiscard]] auto getHostVisibleVramSize() const -> VkDeviceSize { return m_hostVisibleVramSize; }
+
     private:
         VmaAllocator m_allocator {};
+        VkDeviceSize m_hostVisibleVramSize { 0 };
     };
 }  // namespace renderer::backend
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "device.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // Renderer-global bindless array of combined image samplers.
+    // Texture indices are handed out from a free list and stay stable until released,
+    // materials store those indices instead of relying on implied per-material slots.
+    class BindlessRegistry
+    {
+    public:
+        // Slot 0 always holds the placeholder texture, unused material textures point there
+        static constexpr uint32_t kPlaceholderIndex = 0;
+        static constexpr uint32_t kInvalidIndex     = std::numeric_limits<uint32_t>::max();
+
+        BindlessRegistry() = default;
+
+        explicit BindlessRegistry(Device& device);
+
+        BindlessRegistry(BindlessRegistry const&)            = delete;
+        BindlessRegistry& operator=(BindlessRegistry const&) = delete;
+
+        BindlessRegistry(BindlessRegistry&&)            = delete;
+        BindlessRegistry& operator=(BindlessRegistry&&) = delete;
+
+        void setPlaceholder(vk::ImageView imageView, vk::Sampler sampler);
+
+        [[nodiscard]] auto registerTexture(vk::ImageView imageView, vk::Sampler sampler) -> uint32_t;
+
+        // Repoints an already registered index, i.e when the underlying image was recreated
+        void updateTexture(uint32_t index, vk::ImageView imageView, vk::Sampler sampler);
+
+        // Makes the index sample the placeholder without giving it up
+        void resetToPlaceholder(uint32_t index);
+
+        // The index is recycled once no frame in flight can be referencing it anymore
+        void releaseTexture(uint32_t index);
+
+        // Samplers are deduplicated by their state, the registry owns them
+        [[nodiscard]] auto getSampler(vk::SamplerCreateInfo const& info) -> vk::Sampler;
+
+        // Flushes the pending descriptor writes and recycles retired indices,
+        // must be called once the frame's fence has been waited on
+        void beginFrame(uint64_t frameNumber);
+
+        [[nodiscard]] auto getLayout() const -> vk::raii::DescriptorSetLayout const& { return m_layout; }
+
+        [[nodiscard]] auto getDescriptorSet() const -> vk::DescriptorSet { return m_set; }
+
+        [[nodiscard]] auto getCapacity() const -> uint32_t { return m_capacity; }
+
+        [[nodiscard]] auto getNumTextures() const -> uint32_t
+        {
+            return m_nextIndex - static_cast<uint32_t>(m_freeIndices.size() + m_retiredIndices.size());
+        }
+
+        [[nodiscard]] auto getNumSamplers() const -> size_t { return m_samplers.size(); }
+
+    private:
+        struct SamplerKey
+        {
+            vk::Filter magFilter;
+            vk::Filter minFilter;
+            vk::SamplerMipmapMode mipmapMode;
+            vk::SamplerAddressMode addressModeU;
+            vk::SamplerAddressMode addressModeV;
+            vk::SamplerAddressMode addressModeW;
+            float mipLodBias;
+            float maxAnisotropy;
+            float minLod;
+            float maxLod;
+            vk::Bool32 anisotropyEnable;
+            vk::BorderColor borderColor;
+
+            bool operator==(SamplerKey const&) const = default;
+        };
+
+        struct SamplerKeyHash
+        {
+            auto operator()(SamplerKey const& key) const -> size_t;
+        };
+
+        struct RetiredIndex
+        {
+            uint32_t index;
+            uint64_t frameNumber;
+        };
+
+        void queueWrite(uint32_t index, vk::ImageView imageView, vk::Sampler sampler);
+
+        Device* m_device { nullptr };
+
+        vk::raii::DescriptorSetLayout m_layout { nullptr };
+        vk::raii::DescriptorPool m_pool { nullptr };
+        vk::DescriptorSet m_set { nullptr };
+
+        uint32_t m_capacity { 0 };
+        uint32_t m_nextIndex { kPlaceholderIndex + 1 };
+
+        std::vector<uint32_t> m_freeIndices;
+        std::vector<RetiredIndex> m_retiredIndices;
+
+        vk::DescriptorImageInfo m_placeholder {};
+
+        std::unordered_map<uint32_t, vk::DescriptorImageInfo> m_pendingWrites;
+
+        std::unordered_map<SamplerKey, vk::raii::Sampler, SamplerKeyHash> m_samplers;
+
+        uint64_t m_frameNumber { 0 };
+
+        std::mutex m_mutex;
+    };
+}  // namespace renderer::backend
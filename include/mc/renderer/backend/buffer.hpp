@@ -3,8 +3,13 @@
 #include "allocator.hpp"
 #include "resource.hpp"
 
+#include <mutex>
+#include <cstring>
 #include <ranges>
+#include <span>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #if DEBUG
 #    include "vk_checker.hpp"
@@ -18,11 +23,114 @@ namespace vi = std::ranges::views;
 
 namespace renderer::backend
 {
+    // For device local buffers the CPU fills or updates: they are mapped when VMA could place them in host
+    // visible VRAM (ReBAR), otherwise they end up in plain device local memory and need a staging copy
+    constexpr VmaAllocationCreateFlags kDirectUploadAllocFlags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    class Defragmenter;
+    class MemoryTelemetry;
+
+    // What the memory of a resource is used for, only used to break down memory usage
+    enum class MemoryCategory : uint8_t
+    {
+        geometry,
+        textures,
+        staging,
+        renderTargets,
+        other,
+
+        count
+    };
+
+    // Carves small buffers out of a few large ones through VMA virtual blocks, so thousands of tiny
+    // buffers don't each cost an allocation of their own. Blocks are added as they fill up
+    class BufferPool
+    {
+    public:
+        BufferPool(Device& device,
+                   Allocator& allocator,
+                   std::string name,
+                   vk::DeviceSize blockSize,
+                   vk::DeviceSize alignment,
+                   vk::BufferUsageFlags bufferUsage,
+                   VmaMemoryUsage memoryUsage,
+                   VmaAllocationCreateFlags allocFlags = 0);
+
+        ~BufferPool();
+
+        BufferPool(BufferPool const&)            = delete;
+        BufferPool& operator=(BufferPool const&) = delete;
+
+        BufferPool(BufferPool&&)            = delete;
+        BufferPool& operator=(BufferPool&&) = delete;
+
+        struct Suballocation
+        {
+            VkBuffer buffer { VK_NULL_HANDLE };
+            VmaAllocation blockAllocation { nullptr };
+            VmaAllocationInfo blockAllocInfo {};
+            // 0 unless the pool's usage includes eShaderDeviceAddress
+            vk::DeviceAddress blockAddress { 0 };
+
+            VmaVirtualBlock virtualBlock { nullptr };
+            VmaVirtualAllocation virtualAllocation { nullptr };
+            vk::DeviceSize offset { 0 };
+        };
+
+        [[nodiscard]] auto allocate(vk::DeviceSize size) -> Suballocation;
+
+        void free(VmaVirtualBlock virtualBlock, VmaVirtualAllocation virtualAllocation);
+
+        [[nodiscard]] auto getName() const -> std::string const& { return m_name; }
+
+        [[nodiscard]] auto getBlockSize() const -> vk::DeviceSize { return m_blockSize; }
+
+        [[nodiscard]] auto getBufferUsage() const -> vk::BufferUsageFlags { return m_bufferUsage; }
+
+        [[nodiscard]] auto getNumBlocks() -> size_t;
+
+        [[nodiscard]] auto getNumSuballocations() -> size_t;
+
+    private:
+        struct Block
+        {
+            VkBuffer buffer { VK_NULL_HANDLE };
+            VmaAllocation allocation { nullptr };
+            VmaAllocationInfo allocInfo {};
+            VmaVirtualBlock virtualBlock { nullptr };
+            vk::DeviceAddress address { 0 };
+        };
+
+        void createBlock();
+
+        void destroyBlock(Block& block);
+
+        Device* m_device { nullptr };
+        Allocator* m_allocator { nullptr };
+
+        std::string m_name;
+        vk::DeviceSize m_blockSize { 0 };
+        vk::DeviceSize m_alignment { 1 };
+
+        vk::BufferUsageFlags m_bufferUsage {};
+        VmaMemoryUsage m_memoryUsage { VMA_MEMORY_USAGE_UNKNOWN };
+        VmaAllocationCreateFlags m_allocFlags { 0 };
+
+        std::vector<Block> m_blocks;
+        size_t m_numSuballocations { 0 };
+
+        std::mutex m_mutex;
+    };
+
     // FIXME(aether) This name is misleading, GPUBuffer can be a cpu-only staging buffer
     class GPUBuffer : public ResourceBase
     {
         friend class ResourceAccessor<GPUBuffer>;
         friend class ResourceManagerBase<GPUBuffer>;
+        friend class Defragmenter;
+        friend class MemoryTelemetry;
 
         GPUBuffer() = default;
 
@@ -36,6 +144,15 @@ namespace renderer::backend
                   VmaMemoryUsage memoryUsage,
                   VmaAllocationCreateFlags allocFlags = 0);
 
+        // A range of one of the pool's blocks, the buffer handle is shared with the other suballocations
+        GPUBuffer(ResourceHandle const& handle,
+                  std::string const& name,
+                  Device& device,
+                  Allocator& allocator,
+
+                  BufferPool& pool,
+                  size_t allocSize);
+
     public:
         ~GPUBuffer();
 
@@ -47,6 +164,15 @@ namespace renderer::backend
             swap(first.allocator, second.allocator);
             swap(first.allocInfo, second.allocInfo);
             swap(first.allocation, second.allocation);
+            swap(first.memoryProperties, second.memoryProperties);
+            swap(first.size, second.size);
+            swap(first.usage, second.usage);
+            swap(first.deviceAddress, second.deviceAddress);
+            swap(first.category, second.category);
+            swap(first.pool, second.pool);
+            swap(first.virtualBlock, second.virtualBlock);
+            swap(first.virtualAllocation, second.virtualAllocation);
+            swap(first.offset, second.offset);
         }
 
         GPUBuffer(GPUBuffer&& other) noexcept : ResourceBase(std::move(other)) { swap(*this, other); };
@@ -87,6 +213,23 @@ namespace renderer::backend
         VkBuffer vulkanHandle { VK_NULL_HANDLE };
         VmaAllocation allocation { nullptr };
         VmaAllocationInfo allocInfo {};
+        VkMemoryPropertyFlags memoryProperties { 0 };
+
+        // What the buffer was created with, the defragmenter recreates it from these when it moves
+        vk::DeviceSize size { 0 };
+        vk::BufferUsageFlags usage {};
+
+        // 0 unless the buffer was created with eShaderDeviceAddress, changes when the buffer is moved
+        vk::DeviceAddress deviceAddress { 0 };
+
+        // Derived from the usage the buffer was created with
+        MemoryCategory category { MemoryCategory::other };
+
+        // Only set for suballocations, `allocation` then belongs to the pool's block
+        BufferPool* pool { nullptr };
+        VmaVirtualBlock virtualBlock { nullptr };
+        VmaVirtualAllocation virtualAllocation { nullptr };
+        vk::DeviceSize offset { 0 };
     };
 
     template<>
@@ -141,12 +284,64 @@ namespace renderer::backend
         [[nodiscard]] auto getMappedData() const -> void* { return get().allocInfo.pMappedData; }
 
         [[nodiscard]] auto getSize() const -> size_t { return get().allocInfo.size; }
+
+        // Where the buffer starts inside its Vulkan buffer, only suballocations have a non zero offset
+        [[nodiscard]] auto getOffset() const -> vk::DeviceSize { return get().offset; }
+
+        [[nodiscard]] auto isSuballocated() const -> bool { return get().pool; }
+
+        [[nodiscard]] auto getCategory() const -> MemoryCategory { return get().category; }
+
+        // Not cached by the users on purpose, defragmentation can move the buffer to another address
+        [[nodiscard]] auto getDeviceAddress() const -> vk::DeviceAddress
+        {
+            MC_ASSERT_MSG(get().deviceAddress, "Buffer '{}' has no device address", getName());
+
+            return get().deviceAddress;
+        }
+
+        [[nodiscard]] auto isHostVisible() const -> bool
+        {
+            return get().memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        }
+
+        [[nodiscard]] auto isDeviceLocal() const -> bool
+        {
+            return get().memoryProperties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        }
+
+        // Writes through the persistent mapping and flushes when the memory isn't host coherent
+        void write(std::span<std::byte const> data, vk::DeviceSize offset = 0) const
+        {
+            MC_ASSERT_MSG(getMappedData(), "Buffer '{}' is not mapped", getName());
+            MC_ASSERT(offset + data.size() <= getSize());
+
+            std::memcpy(static_cast<std::byte*>(getMappedData()) + offset, data.data(), data.size());
+
+            flush(offset, data.size());
+        }
+
+        // Makes host writes through the mapping visible to the device, a no-op for host coherent memory
+        void flush(vk::DeviceSize offset, vk::DeviceSize size) const
+        {
+            MC_ASSERT(vmaFlushAllocation(*get().allocator, get().allocation, get().offset + offset, size) ==
+                      VK_SUCCESS);
+        }
+
+        // Makes device writes visible to reads through the mapping, a no-op for host coherent memory
+        void invalidate(vk::DeviceSize offset, vk::DeviceSize size) const
+        {
+            MC_ASSERT(vmaInvalidateAllocation(
+                          *get().allocator, get().allocation, get().offset + offset, size) == VK_SUCCESS);
+        }
     };
 
     template<>
     class ResourceManager<GPUBuffer> final : public ResourceManagerBase<GPUBuffer>
     {
         friend class ResourceManagerBase<GPUBuffer>;
+        friend class Defragmenter;
+        friend class MemoryTelemetry;
 
         std::tuple<Device&, Allocator&> m_extraConstructionParams;
 
@@ -156,27 +351,21 @@ namespace renderer::backend
 
         auto getAllActiveBuffersInfo()
         {
-            return m_resources | vi::enumerate |
-                   // Only active resources
+            // Suballocations are listed through their pool instead
+            return getLiveResources() |
                    vi::filter(
-                       [this](auto const& indexed_res)
+                       [](GPUBuffer const& buffer)
                        {
-                           auto const& [index, res] = indexed_res;
-                           return !rn::contains(m_dormantIndices, index);
+                           return !buffer.pool;
                        }) |
-                   // Retrieve their name + size
                    vi::transform(
-                       [](auto const& indexed_res) -> std::pair<std::string_view, uint64_t>
+                       [](GPUBuffer const& buffer) -> std::pair<std::string_view, uint64_t>
                        {
-                           // works if I just return the name as a string_view
-                           // link error otherwise :/
-                           auto const& [index, res] = indexed_res;
-
-                           return { res.resource.allocInfo.pName, res.resource.allocInfo.size };
+                           return { buffer.allocInfo.pName, buffer.allocInfo.size };
                        });
         }
 
-        ResourceManager(ResourceManager&&)            = default;
+        ResourceManager(ResourceManager&&)            = delete;
         ResourceManager& operator=(ResourceManager&&) = delete;
 
         ResourceManager(ResourceManager const&)            = delete;
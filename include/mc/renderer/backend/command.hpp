@@ -28,6 +28,7 @@ namespace renderer::backend
             swap(first.m_pool, second.m_pool);
             swap(first.m_oneTime, second.m_oneTime);
             swap(first.m_queue, second.m_queue);
+            swap(first.m_submitted, second.m_submitted);
         }
 
         ScopedCommandBuffer(ScopedCommandBuffer&& other) noexcept : ScopedCommandBuffer()
@@ -48,10 +49,15 @@ namespace renderer::backend
 
         void flush();
 
+        // Ends and submits the commands without waiting for them, the command buffer is freed when this
+        // object dies, so it has to be kept alive until the returned fence signaled
+        [[nodiscard]] auto submit() -> vk::raii::Fence;
+
     private:
         Device const* m_device { nullptr };
 
         bool m_oneTime { false };
+        bool m_submitted { false };
 
         vk::Queue m_queue { nullptr };
 
@@ -104,6 +110,8 @@ namespace renderer::backend
         void resetPools(uint32_t frameIndex);
 
         vk::CommandBuffer getCommandBuffer(uint32_t frame, uint32_t threadIndex, bool begin);
+
+        // Every thread has to use its own `threadIndex`, pools must only be touched by one thread at a time
         vk::CommandBuffer getSecondaryCommandBuffer(uint32_t frame, uint32_t threadIndex);
 
     private:
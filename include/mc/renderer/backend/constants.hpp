@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 
 #include <vulkan/vulkan_raii.hpp>
@@ -8,8 +9,61 @@ namespace renderer::backend
 {
     constexpr uint32_t kNumThreads                = 4;
     constexpr uint32_t kNumFramesInFlight         = 2;
-    constexpr uint32_t kNumSecondaryBuffers       = 2;
-    constexpr uint32_t kMaxBindlessResources      = 1024;
+    constexpr uint32_t kNumSecondaryBuffers       = 32;
+    constexpr uint32_t kMaxBindlessResources      = 1 << 16;  // Clamped to the device limits at runtime
     constexpr vk::Format kDepthStencilFormat      = vk::Format::eD32Sfloat;
+    constexpr vk::Format kDrawImageFormat         = vk::Format::eR16G16B16A16Sfloat;
     constexpr vk::SampleCountFlagBits kMaxSamples = vk::SampleCountFlagBits::e4;
+
+    // Persistently mapped memory all uploads are staged through, bigger uploads get a buffer of their own
+    constexpr vk::DeviceSize kStagingRingSize  = 64 * 1024 * 1024;
+    constexpr vk::DeviceSize kStagingAlignment = 16;
+
+    // Size of each frame's region of the per-frame allocator
+    constexpr vk::DeviceSize kFrameDataRegionSize = 4 * 1024 * 1024;
+
+    // Size of each frame's region of the readback ring, bigger readbacks get a buffer of their own
+    constexpr vk::DeviceSize kReadbackRegionSize = 4 * 1024 * 1024;
+
+    // Geometry passes are recorded into at most `kMaxDrawRecordChunks` secondary command buffers in parallel,
+    // each with at least `kMinDrawsPerRecordChunk` draws, twice that with the depth pre-pass. A single worker
+    // may end up recording every chunk of both passes, `kNumSecondaryBuffers` has to cover that
+    constexpr uint32_t kMaxDrawRecordChunks    = 8;
+    constexpr uint32_t kMinDrawsPerRecordChunk = 256;
+    static_assert(kNumSecondaryBuffers >= 4 * kMaxDrawRecordChunks);
+
+    // Draws tested per workgroup of the culling pass, must match the local size in cull.comp
+    constexpr uint32_t kCullWorkgroupSize = 64;
+
+    // Resolution of the CPU culler's software occlusion buffer, the width must be a multiple of 8
+    constexpr uint32_t kOcclusionBufferWidth  = 256;
+    constexpr uint32_t kOcclusionBufferHeight = 144;
+
+    // Automatically picked occluders have at most `kMaxOccluderTriangles` triangles each and
+    // `kOccluderTriangleBudget` together. Meshes of nodes named as occluders are always taken
+    constexpr uint32_t kMaxOccluderTriangles   = 4096;
+    constexpr uint32_t kOccluderTriangleBudget = 16384;
+
+    // Small per-mesh uniform buffers are suballocated from blocks of this size
+    constexpr vk::DeviceSize kUniformPoolBlockSize = 4 * 1024 * 1024;
+
+    // Defragmentation starts once this much of VMA's memory blocks sits unused between allocations,
+    // checked every few hundred frames. Each pass moves at most `kDefragmentationBytesPerPass`
+    constexpr vk::DeviceSize kDefragmentationThreshold    = 64 * 1024 * 1024;
+    constexpr vk::DeviceSize kDefragmentationBytesPerPass = 16 * 1024 * 1024;
+    constexpr uint64_t kDefragmentationCheckInterval      = 600;
+
+    // Per-category memory totals walk every resource, so they are only refreshed every few frames.
+    // A snapshot of all memory telemetry is appended to its dump file once per interval
+    constexpr uint64_t kMemoryTelemetrySampleInterval           = 30;
+    constexpr std::chrono::seconds kMemoryTelemetryDumpInterval = std::chrono::seconds(60);
+
+    // Per-category image memory budgets as fractions of VMA's budget for the device local heap,
+    // re-derived every frame since the driver's budget moves with the other processes. 0 is unbounded
+    constexpr float kTextureMemoryBudget      = 0.5f;
+    constexpr float kRenderTargetMemoryBudget = 0.25f;
+
+    // Evicted textures that come back into view are reloaded from their CPU copies, at most this much of
+    // them per frame
+    constexpr vk::DeviceSize kTextureReloadBytesPerFrame = 16 * 1024 * 1024;
 }  // namespace renderer::backend
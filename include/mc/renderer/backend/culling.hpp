@@ -0,0 +1,283 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "constants.hpp"
+#include "depth_pyramid.hpp"
+#include "descriptor.hpp"
+#include "device.hpp"
+#include "draw_bucket.hpp"
+#include "frame_allocator.hpp"
+#include "gltf/mesh.hpp"
+#include "occlusion_rasterizer.hpp"
+#include "pipeline.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <TaskScheduler.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // Left, right, bottom, top and the two depth planes of a view-projection matrix as (normal, distance).
+    // Normals point inwards and are left unnormalized, only the sign of a distance is meaningful
+    [[nodiscard]] auto extractFrustumPlanes(glm::mat4 const& viewProj) -> std::array<glm::vec4, 6>;
+
+    // Orders the draws of every bucket by the distance of their bounds to the camera: front to back for the
+    // depth tested buckets so hidden surfaces fail the depth test before shading, back to front for the
+    // blended ones so they composite correctly. Unbounded draws sort as if they were at the origin
+    class DrawSorter
+    {
+    public:
+        DrawSorter() = default;
+
+        DrawSorter(DrawSorter const&)            = delete;
+        DrawSorter& operator=(DrawSorter const&) = delete;
+
+        DrawSorter(DrawSorter&&)            = delete;
+        DrawSorter& operator=(DrawSorter&&) = delete;
+
+        // `draws` is ordered by bucket already, their `firstInstance` indexes `primitives`
+        void setScene(std::span<vk::DrawIndexedIndirectCommand const> draws,
+                      std::span<PrimitiveShaderData const> primitives,
+                      DrawBuckets const& buckets);
+
+        void sort(glm::vec3 cameraPos);
+
+        // Indices into the draws, every bucket keeps its range
+        [[nodiscard]] auto getOrder() const -> std::span<uint32_t const> { return m_order; }
+
+        [[nodiscard]] auto getBuckets() const -> DrawBuckets const& { return m_buckets; }
+
+    private:
+        std::vector<glm::vec3> m_centers;
+        std::vector<float> m_distances;
+        std::vector<uint32_t> m_order;
+
+        DrawBuckets m_buckets {};
+    };
+
+    enum class CullPhase : uint32_t
+    {
+        // Draws that were visible last frame and are still in the frustum
+        early,
+        // Everything else in the frustum that isn't hidden behind the depth pyramid of the early draws
+        late,
+    };
+
+    // Two-phase frustum and occlusion culling on the GPU. The early phase draws what was visible last frame,
+    // the depth pyramid is built from that, then the late phase tests the remaining draws against it and
+    // draws the ones that turned visible. Visibility is remembered per draw for the next frame.
+    //
+    // Each phase compacts the draws of every bucket into the bucket's range of an indirect buffer together
+    // with their count, in roughly the sorted order. Blended draws all wait for the late phase and keep their
+    // exact order, hidden ones are left in place as empty draws. Every frame in flight gets its own output,
+    // the next frame's pass can't overwrite draws the previous one still reads
+    class DrawCuller
+    {
+    public:
+        DrawCuller() = default;
+
+        DrawCuller(Device& device, ResourceManager<GPUBuffer>& bufferManager, FrameAllocator& frameData);
+
+        DrawCuller(DrawCuller const&)            = delete;
+        DrawCuller& operator=(DrawCuller const&) = delete;
+
+        DrawCuller(DrawCuller&&)            = delete;
+        DrawCuller& operator=(DrawCuller&&) = delete;
+
+        // Grows the output buffers to hold `maxDraws` draws per frame, the old ones are retired. Every draw
+        // starts out as invisible
+        void reserve(uint32_t maxDraws);
+
+        // The late phase tests against `pyramid`, the device has to be idle
+        void setDepthPyramid(DepthPyramid const& pyramid);
+
+        // Culls the commands of `drawCommands` in the order of `sorter`, their `firstInstance` indexes
+        // `primitives`. The compute shader writes of the visible draw and count buffers have to be made
+        // visible to `draw`'s indirect reads. The late phase must follow the early one in the same frame,
+        // after the depth pyramid was built
+        void record(vk::CommandBuffer cmdBuf,
+                    CullPhase phase,
+                    uint32_t frameIndex,
+                    glm::mat4 const& viewProj,
+                    vk::DeviceAddress primitives,
+                    vk::DeviceAddress drawCommands,
+                    DrawSorter const& sorter);
+
+        // Draws whatever of `bucket` survived `phase` of the last `record`
+        void draw(vk::CommandBuffer cmdBuf, CullPhase phase, DrawBucket bucket) const;
+
+        // Holds the commands `draw` reads, written by `record`
+        [[nodiscard]] auto getVisibleDrawBuffer() const -> vk::Buffer { return m_visibleDraws; }
+
+        // Where the number of visible draws of the current frame ends up, a uint32_t per phase and bucket
+        [[nodiscard]] auto getDrawCountBuffer() const -> vk::Buffer { return m_drawCounts; }
+
+        [[nodiscard]] auto getDrawCountOffset() const -> vk::DeviceSize
+        {
+            return getCountOffset(CullPhase::early, DrawBucket::opaque);
+        }
+
+        [[nodiscard]] static constexpr auto getDrawCountSize() -> vk::DeviceSize
+        {
+            return kNumPhases * kNumDrawBuckets * sizeof(uint32_t);
+        }
+
+    private:
+        struct PushConstants
+        {
+            vk::DeviceAddress primitiveBuffer;
+            vk::DeviceAddress drawCommands;
+            vk::DeviceAddress drawOrder;
+            vk::DeviceAddress visibleDraws;
+            vk::DeviceAddress drawCount;
+            vk::DeviceAddress visibility;
+            vk::DeviceAddress cullData;
+            uint32_t numDraws;
+            CullPhase phase;
+        };
+
+        // Read by the shader through its address, see `extractFrustumPlanes`
+        struct CullData
+        {
+            std::array<glm::vec4, 6> frustumPlanes;
+            glm::mat4 viewProj;
+            glm::vec2 pyramidSize;
+            uint32_t pyramidLevels;
+            uint32_t pad;
+            // End of every bucket's range in the draw order
+            std::array<uint32_t, kNumDrawBuckets> bucketEnds;
+        };
+
+        static constexpr uint32_t kNumPhases = 2;
+
+        // Output slot of the current frame's `phase`
+        [[nodiscard]] auto getRegion(CullPhase phase) const -> uint32_t
+        {
+            return m_frameIndex * kNumPhases + static_cast<uint32_t>(phase);
+        }
+
+        [[nodiscard]] auto getVisibleDrawsOffset(CullPhase phase) const -> vk::DeviceSize
+        {
+            return getRegion(phase) * m_maxDraws * sizeof(vk::DrawIndexedIndirectCommand);
+        }
+
+        [[nodiscard]] auto getCountOffset(CullPhase phase, DrawBucket bucket) const -> vk::DeviceSize
+        {
+            return (getRegion(phase) * kNumDrawBuckets + static_cast<uint32_t>(bucket)) * sizeof(uint32_t);
+        }
+
+        Device* m_device { nullptr };
+        ResourceManager<GPUBuffer>* m_bufferManager { nullptr };
+        FrameAllocator* m_frameData { nullptr };
+
+        vk::raii::DescriptorSetLayout m_descriptorLayout { nullptr };
+        DescriptorAllocator m_descriptorAllocator;
+        vk::DescriptorSet m_pyramidDescriptors { nullptr };
+
+        PipelineLayout m_pipelineLayout;
+        ComputePipeline m_pipeline;
+
+        ResourceAccessor<GPUBuffer> m_visibleDraws;
+        ResourceAccessor<GPUBuffer> m_drawCounts;
+
+        // A uint32_t per draw, non-zero if the late phase of the previous frame found it visible
+        ResourceAccessor<GPUBuffer> m_visibility;
+        bool m_clearVisibility { false };
+
+        vk::Extent2D m_pyramidExtent {};
+        uint32_t m_pyramidLevels { 0 };
+
+        // Pushed by the early phase, the late phase reuses them
+        vk::DeviceAddress m_cullData { 0 };
+        vk::DeviceAddress m_drawOrder { 0 };
+        DrawBuckets m_buckets {};
+
+        uint32_t m_maxDraws { 0 };
+        uint32_t m_frameIndex { 0 };
+    };
+
+    // Where the CPU culler put this frame's visible draws, ready for `drawIndexedIndirect`
+    struct CpuCullResult
+    {
+        vk::Buffer buffer { nullptr };
+        vk::DeviceSize offset { 0 };
+
+        uint32_t numVisible { 0 };
+
+        // Visible draws of every bucket, counted in draws from `offset`
+        DrawBuckets buckets {};
+    };
+
+    // CPU counterpart of `DrawCuller` for devices where GPU driven culling isn't desirable. The bounds are
+    // kept as a structure of arrays and tested 8 at a time with AVX2, spread over the enkiTS workers.
+    // Visible draws are written into the per-frame allocator, nothing has to wait for the GPU to reuse it
+    class CpuDrawCuller
+    {
+    public:
+        CpuDrawCuller() = default;
+
+        CpuDrawCuller(enki::TaskScheduler& scheduler, FrameAllocator& frameData);
+
+        CpuDrawCuller(CpuDrawCuller const&)            = delete;
+        CpuDrawCuller& operator=(CpuDrawCuller const&) = delete;
+
+        CpuDrawCuller(CpuDrawCuller&&)            = delete;
+        CpuDrawCuller& operator=(CpuDrawCuller&&) = delete;
+
+        // `primitives` is indexed by the `firstInstance` of the draws
+        void setScene(std::span<vk::DrawIndexedIndirectCommand const> draws,
+                      std::span<PrimitiveShaderData const> primitives);
+
+        // Must be called from a thread enkiTS knows about, the caller helps out until every batch is tested.
+        // Draws in the frustum are also tested against `occlusion` if given, which has to be rendered with
+        // the same matrix already. The visible draws are written in the order of `sorter`
+        [[nodiscard]] auto cull(glm::mat4 const& viewProj,
+                                DrawSorter const& sorter,
+                                OcclusionRasterizer const* occlusion = nullptr) -> CpuCullResult;
+
+        [[nodiscard]] auto getNumDraws() const -> uint32_t { return static_cast<uint32_t>(m_draws.size()); }
+
+        // Appends the primitive (`firstInstance`) of every draw the last `cull` wrote, without reading back
+        // the output
+        void getVisiblePrimitives(std::vector<uint32_t>& primitives) const;
+
+        // Wall clock time of the last `cull` in milliseconds
+        [[nodiscard]] auto getLastCullTime() const -> double { return m_lastCullTime; }
+
+    private:
+        struct CullTask final : enki::ITaskSet
+        {
+            // The range is in batches of 8 draws
+            void ExecuteRange(enki::TaskSetPartition range, uint32_t threadNum) override;
+
+            CpuDrawCuller* culler { nullptr };
+        };
+
+        void cullBatches(uint32_t firstBatch, uint32_t lastBatch);
+
+        enki::TaskScheduler* m_scheduler { nullptr };
+        FrameAllocator* m_frameData { nullptr };
+
+        CullTask m_task;
+
+        std::vector<vk::DrawIndexedIndirectCommand> m_draws;
+
+        // World space bounds of each draw, padded to a multiple of 8 entries
+        std::vector<float> m_minX, m_minY, m_minZ;
+        std::vector<float> m_maxX, m_maxY, m_maxZ;
+
+        // State of the running `cull`. A bit per draw, each batch has its own byte so workers never share one
+        std::array<glm::vec4, 6> m_planes {};
+        OcclusionRasterizer const* m_occlusion { nullptr };
+        std::vector<uint8_t> m_visible;
+
+        double m_lastCullTime { 0.0 };
+    };
+}  // namespace renderer::backend
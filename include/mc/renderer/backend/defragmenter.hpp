@@ -0,0 +1,123 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "buffer.hpp"
+#include "device.hpp"
+#include "image.hpp"
+#include "upload.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // Compacts VMA's default pools a little every few frames, so long sessions of loading and unloading
+    // scenes don't keep growing the number of mostly empty memory blocks.
+    //
+    // Moved resources keep their handle, only the Vulkan objects inside of them are replaced. Buffers
+    // get a new device address (see `ResourceAccessor<GPUBuffer>::getDeviceAddress`), image owners are
+    // told through their eviction callback (`ImageEviction::moved`) so they can repoint their descriptors.
+    //
+    // Only resources the frame loop can move safely are touched: unmapped buffers that aren't pool blocks,
+    // and textures. Everything else is skipped and stays where it is
+    class Defragmenter
+    {
+    public:
+        Defragmenter() = default;
+
+        Defragmenter(Device& device,
+                     Allocator& allocator,
+                     UploadManager& uploadManager,
+                     ResourceManager<GPUBuffer>& bufferManager,
+                     ResourceManager<Image>& imageManager);
+
+        ~Defragmenter();
+
+        Defragmenter(Defragmenter const&)            = delete;
+        Defragmenter& operator=(Defragmenter const&) = delete;
+
+        Defragmenter(Defragmenter&&)            = delete;
+        Defragmenter& operator=(Defragmenter&&) = delete;
+
+        // Does nothing if defragmentation is already running
+        void start();
+
+        // Finishes the pass that no frame in flight can be using the old memory of anymore, and starts
+        // defragmenting on its own every `kDefragmentationCheckInterval` frames if the blocks got too sparse.
+        // Must be called once the frame's fence has been waited on
+        void beginFrame(uint64_t frameNumber);
+
+        // Starts the next pass and records its copies, must come before anything else in the frame uses
+        // the moved resources. Passes only start while the upload manager is idle, so nothing being moved
+        // is still owned by the transfer queue or about to be written to
+        void recordMoves(vk::CommandBuffer cmdBuf);
+
+        [[nodiscard]] auto isRunning() const -> bool { return m_context; }
+
+        // Totals over every run since startup
+        [[nodiscard]] auto getBytesMoved() const -> vk::DeviceSize { return m_bytesMoved; }
+
+        [[nodiscard]] auto getBytesFreed() const -> vk::DeviceSize { return m_bytesFreed; }
+
+        [[nodiscard]] auto getNumBlocksFreed() const -> uint64_t { return m_numBlocksFreed; }
+
+    private:
+        // The accessors keep the resources alive until the pass ends, the pointers are stable since
+        // resources never move inside their managers
+        struct BufferMove
+        {
+            ResourceAccessor<GPUBuffer> accessor;
+            GPUBuffer* buffer { nullptr };
+            VkBuffer oldBuffer { VK_NULL_HANDLE };
+        };
+
+        struct ImageMove
+        {
+            ResourceAccessor<Image> accessor;
+            Image* image { nullptr };
+            VkImage oldImage { VK_NULL_HANDLE };
+            vk::raii::ImageView oldImageView { nullptr };
+        };
+
+        // Swaps in a Vulkan buffer bound to the move's destination, returns false if the buffer has to
+        // stay where it is
+        auto moveBuffer(GPUBuffer& buffer, VmaAllocation dstAllocation) -> bool;
+
+        auto moveImage(Image& image, VmaAllocation dstAllocation) -> bool;
+
+        // Copies the contents of every resource moved in this pass from the old objects to the new ones
+        void recordCopies(vk::CommandBuffer cmdBuf);
+
+        void endPass();
+
+        void finish();
+
+        // Memory inside of VMA's blocks that no allocation uses
+        [[nodiscard]] auto getUnusedBytes() const -> vk::DeviceSize;
+
+        Device* m_device { nullptr };
+        Allocator* m_allocator { nullptr };
+        UploadManager* m_uploadManager { nullptr };
+        ResourceManager<GPUBuffer>* m_bufferManager { nullptr };
+        ResourceManager<Image>* m_imageManager { nullptr };
+
+        VmaDefragmentationContext m_context { nullptr };
+
+        // Owned by VMA between the beginning and the end of a pass
+        VmaDefragmentationPassMoveInfo m_pass {};
+        bool m_passRunning { false };
+        uint64_t m_passFrame { 0 };
+
+        std::vector<BufferMove> m_bufferMoves;
+        std::vector<ImageMove> m_imageMoves;
+
+        uint64_t m_frameNumber { 0 };
+
+        vk::DeviceSize m_bytesMoved { 0 };
+        vk::DeviceSize m_bytesFreed { 0 };
+        uint64_t m_numBlocksFreed { 0 };
+    };
+}  // namespace renderer::backend
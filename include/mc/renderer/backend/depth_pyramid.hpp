@@ -0,0 +1,77 @@
+#pragma once
+
+#include "descriptor.hpp"
+#include "device.hpp"
+#include "image.hpp"
+#include "pipeline.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // Hierarchical depth buffer for occlusion culling. Every texel holds the farthest depth (the smallest
+    // one with reverse-Z) of the texels it covers in the level below, level 0 reduces the samples of the
+    // multisampled depth buffer. Lives in the general layout, sampled by the culling pass with texelFetch
+    class DepthPyramid
+    {
+    public:
+        DepthPyramid() = default;
+
+        DepthPyramid(Device& device, ResourceManager<Image>& imageManager);
+
+        DepthPyramid(DepthPyramid const&)            = delete;
+        DepthPyramid& operator=(DepthPyramid const&) = delete;
+
+        DepthPyramid(DepthPyramid&&)            = delete;
+        DepthPyramid& operator=(DepthPyramid&&) = delete;
+
+        // Recreates the pyramid to match the depth image of `depthView`, which must be sampleable. The old
+        // views are destroyed right away, so the device has to be idle
+        void resize(vk::ImageView depthView, vk::Extent2D depthExtent);
+
+        // Reduces the depth image into the pyramid. The depth image is expected in the shader read-only
+        // layout, visible to compute shaders. The pyramid is ready for compute shader reads afterwards
+        void record(vk::CommandBuffer cmdBuf);
+
+        // Covers every level
+        [[nodiscard]] auto getImageView() const -> vk::ImageView { return m_pyramid.getImageView(); }
+
+        [[nodiscard]] auto getSampler() const -> vk::Sampler { return m_sampler; }
+
+        [[nodiscard]] auto getExtent() const -> vk::Extent2D { return m_pyramid.getDimensions(); }
+
+        [[nodiscard]] auto getNumLevels() const -> uint32_t { return m_pyramid.getMipLevels(); }
+
+    private:
+        struct PushConstants
+        {
+            uint32_t srcWidth;
+            uint32_t srcHeight;
+            uint32_t dstWidth;
+            uint32_t dstHeight;
+        };
+
+        Device* m_device { nullptr };
+        ResourceManager<Image>* m_imageManager { nullptr };
+
+        vk::raii::Sampler m_sampler { nullptr };
+
+        vk::raii::DescriptorSetLayout m_descriptorLayout { nullptr };
+        DescriptorAllocator m_descriptorAllocator;
+
+        PipelineLayout m_pipelineLayout;
+        // Level 0 comes from the multisampled depth buffer, every other level from the one below it
+        ComputePipeline m_initPipeline;
+        ComputePipeline m_reducePipeline;
+
+        ResourceAccessor<Image> m_pyramid;
+        vk::Extent2D m_depthExtent {};
+
+        // One single-level view and descriptor set per level, the set reads the level below
+        std::vector<vk::raii::ImageView> m_levelViews;
+        std::vector<vk::DescriptorSet> m_levelDescriptors;
+    };
+}  // namespace renderer::backend
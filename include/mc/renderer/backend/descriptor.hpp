@@ -20,7 +20,8 @@ namespace renderer::backend
         auto setBinding(uint32_t binding,
                         vk::DescriptorType type,
                         vk::ShaderStageFlags stages,
-                        uint32_t count = 1) -> DescriptorLayoutBuilder&
+                        uint32_t count                   = 1,
+                        vk::DescriptorBindingFlags flags = {}) -> DescriptorLayoutBuilder&
         {
             // If we get the same binding again, ensure that only the stage flags differ
             if (m_bindings.find(binding) == m_bindings.end())
@@ -28,11 +29,14 @@ namespace renderer::backend
                 m_bindings[binding] = {
                     .binding = binding, .descriptorType = type, .descriptorCount = count, .stageFlags = stages
                 };
+
+                m_bindingFlags[binding] = flags;
             }
             else
             {
                 MC_ASSERT(m_bindings[binding].descriptorType == type);
                 MC_ASSERT(m_bindings[binding].descriptorCount == count);
+                MC_ASSERT(m_bindingFlags[binding] == flags);
 
                 m_bindings[binding].stageFlags |= stages;
             }
@@ -40,7 +44,11 @@ namespace renderer::backend
             return *this;
         };
 
-        void clear() { m_bindings.clear(); };
+        void clear()
+        {
+            m_bindings.clear();
+            m_bindingFlags.clear();
+        };
 
         auto build(vk::raii::Device const& device,
                    vk::DescriptorSetLayoutCreateFlags flags =
@@ -48,6 +56,7 @@ namespace renderer::backend
 
     private:
         std::unordered_map<uint32_t, vk::DescriptorSetLayoutBinding> m_bindings;
+        std::unordered_map<uint32_t, vk::DescriptorBindingFlags> m_bindingFlags;
     };
 
     struct DescriptorWriter
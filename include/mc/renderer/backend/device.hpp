@@ -78,6 +78,9 @@ namespace renderer::backend
             return m_sampleCount;
         };
 
+        // VK_EXT_memory_budget, heap usage and budgets come from the driver when it is enabled
+        [[nodiscard]] auto isMemoryBudgetSupported() const -> bool { return m_memoryBudgetSupported; }
+
     private:
         void selectPhysicalDevice(Instance& instance, Surface& surface);
         void selectLogicalDevice();
@@ -89,6 +92,8 @@ namespace renderer::backend
 
         vk::SampleCountFlagBits m_sampleCount { vk::SampleCountFlagBits::e1 };
 
+        bool m_memoryBudgetSupported { false };
+
         QueueFamilyIndices m_queueFamilyIndices {};
 
         vk::raii::Queue m_mainQueue { nullptr };
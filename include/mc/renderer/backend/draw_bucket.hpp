@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace renderer::backend
+{
+    // Draws that share pipeline state. A model's draws are ordered by bucket and drawn in this order, so the
+    // opaque ones fill the depth buffer before anything is tested against it or blended over it
+    enum class DrawBucket : uint32_t
+    {
+        opaque,
+        opaqueDoubleSided,
+        mask,
+        maskDoubleSided,
+        blend,
+        blendDoubleSided,
+    };
+
+    constexpr uint32_t kNumDrawBuckets = 6;
+
+    [[nodiscard]] constexpr auto isDoubleSided(DrawBucket bucket) -> bool
+    {
+        return static_cast<uint32_t>(bucket) % 2 == 1;
+    }
+
+    [[nodiscard]] constexpr auto isOpaque(DrawBucket bucket) -> bool
+    {
+        return bucket <= DrawBucket::opaqueDoubleSided;
+    }
+
+    [[nodiscard]] constexpr auto isMasked(DrawBucket bucket) -> bool
+    {
+        return bucket == DrawBucket::mask || bucket == DrawBucket::maskDoubleSided;
+    }
+
+    [[nodiscard]] constexpr auto isBlended(DrawBucket bucket) -> bool { return bucket >= DrawBucket::blend; }
+
+    // Contiguous draws of a list
+    struct DrawRange
+    {
+        uint32_t first { 0 };
+        uint32_t count { 0 };
+    };
+
+    // Range of every bucket, indexed by `DrawBucket`
+    using DrawBuckets = std::array<DrawRange, kNumDrawBuckets>;
+}  // namespace renderer::backend
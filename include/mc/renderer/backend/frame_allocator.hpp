@@ -0,0 +1,85 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "constants.hpp"
+#include "device.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // Where a per-frame allocation ended up, `data` stays writable until the frame is submitted
+    struct FrameAllocation
+    {
+        void* data { nullptr };
+
+        vk::Buffer buffer { nullptr };
+        vk::DeviceSize offset { 0 };
+        vk::DeviceSize size { 0 };
+
+        vk::DeviceAddress address { 0 };
+    };
+
+    // Bump allocator over one persistently mapped buffer, split into a region per frame in flight.
+    // A region is only reset once the fence of the frame that last used it signalled, so nothing handed out
+    // here is overwritten while the GPU might still be reading it.
+    // Meant for uniforms, dynamic instance data and culling inputs that are rewritten every frame
+    class FrameAllocator
+    {
+    public:
+        FrameAllocator() = default;
+
+        FrameAllocator(Device& device, ResourceManager<GPUBuffer>& bufferManager, vk::DeviceSize regionSize);
+
+        FrameAllocator(FrameAllocator const&)            = delete;
+        FrameAllocator& operator=(FrameAllocator const&) = delete;
+
+        FrameAllocator(FrameAllocator&&)            = delete;
+        FrameAllocator& operator=(FrameAllocator&&) = delete;
+
+        // Must be called once the fence of the frame slot has been waited on
+        void beginFrame(uint32_t frameIndex);
+
+        // Makes everything written this frame visible to the device, called right before the submission
+        void endFrame();
+
+        // Offsets are aligned to the device's uniform and storage buffer offset alignment at least
+        [[nodiscard]] auto allocate(vk::DeviceSize size, vk::DeviceSize alignment = 0) -> FrameAllocation;
+
+        template<typename T>
+            requires std::is_trivially_copyable_v<T>
+        [[nodiscard]] auto push(T const& value) -> FrameAllocation
+        {
+            FrameAllocation allocation = allocate(sizeof(T), alignof(T));
+
+            std::memcpy(allocation.data, &value, sizeof(T));
+
+            return allocation;
+        }
+
+        [[nodiscard]] auto getBuffer() const -> vk::Buffer { return m_buffer; }
+
+        [[nodiscard]] auto getRegionSize() const -> vk::DeviceSize { return m_regionSize; }
+
+        // How much of the current frame's region is in use
+        [[nodiscard]] auto getUsedSize() const -> vk::DeviceSize { return m_head - getRegionStart(); }
+
+    private:
+        [[nodiscard]] auto getRegionStart() const -> vk::DeviceSize { return m_frameIndex * m_regionSize; }
+
+        ResourceAccessor<GPUBuffer> m_buffer;
+        std::byte* m_data { nullptr };
+        vk::DeviceAddress m_address { 0 };
+
+        vk::DeviceSize m_regionSize { 0 };
+        vk::DeviceSize m_minAlignment { 1 };
+
+        uint32_t m_frameIndex { 0 };
+        vk::DeviceSize m_head { 0 };
+    };
+}  // namespace renderer::backend
@@ -19,7 +19,7 @@ namespace renderer::backend
 
         BoundingBox(glm::vec3 min, glm::vec3 max) : min(min), max(max) {};
 
-        BoundingBox getAABB(glm::mat4 m);
+        BoundingBox getAABB(glm::mat4 m) const;
 
         static auto calcNodeHeirarchyBB(std::vector<Node*> const& nodes) -> std::pair<Dimensions, glm::mat4>;
 
@@ -1,12 +1,17 @@
 #pragma once
 
+#include "../bindless.hpp"
 #include "../buffer.hpp"
-#include "../command.hpp"
 #include "../device.hpp"
 #include "../image.hpp"
 #include "../resource.hpp"
+#include "../task.hpp"
+#include "../upload.hpp"
 
 #include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
 
 #include <tiny_gltf.h>
 #include <vulkan/vulkan.hpp>
@@ -22,25 +27,89 @@ namespace renderer::backend
         vk::SamplerAddressMode addressModeW;
     };
 
+    enum class TextureEncoding : uint8_t
+    {
+        // RGBA8 with the mip chain box filtered on the CPU, KTX2 files get transcoded to a supported block
+        // format along with their own mip levels
+        automatic,
+        // Two channel BC5 with the mip chain built on the CPU, the shader reconstructs the z component
+        normalMapBC5,
+    };
+
+    // One of the images a texture is made of, reloads read and decode it again rather than keeping the
+    // decoded mip chain around
+    struct TextureSource
+    {
+        std::string uri;
+
+        // Empty for images embedded in the glTF, their still encoded bytes are kept instead
+        std::filesystem::path path;
+        std::vector<std::byte> embedded;
+    };
+
     struct GlTFTexture
     {
+        struct MipLevel
+        {
+            vk::Extent2D extent;
+            vk::DeviceSize offset;
+        };
+
+        // The mip chain as uploaded, built (and possibly block compressed) on the CPU
+        struct MipChain
+        {
+            std::string name;
+            vk::Format format;
+            TextureEncoding encoding;
+            std::vector<unsigned char> data;
+            std::vector<MipLevel> levels;
+        };
+
         GlTFTexture() = default;
 
-        ~GlTFTexture() = default;
+        ~GlTFTexture();
 
+        // `sources` are the images `gltfimage` was decoded from, a packed occlusion/roughness/metallic
+        // texture has two of them (occlusion first)
         GlTFTexture(Device& device,
-                    CommandManager& cmdManager,
-                    ResourceManager<GPUBuffer>& bufferManager,
+                    UploadManager& uploadManager,
                     ResourceManager<Image>& imgManager,
-                    tinygltf::Image& gltfimage,
-                    std::filesystem::path path,
-                    TextureSampler textureSampler);
+                    BindlessRegistry& bindlessRegistry,
+                    tinygltf::Image const& gltfimage,
+                    std::vector<TextureSource> sources,
+                    TextureSampler textureSampler,
+                    TextureEncoding requestedEncoding = TextureEncoding::automatic);
 
         GlTFTexture(GlTFTexture const&)            = delete;
         GlTFTexture& operator=(GlTFTexture const&) = delete;
 
-        GlTFTexture(GlTFTexture&&)            = default;
-        GlTFTexture& operator=(GlTFTexture&&) = default;
+        friend void swap(GlTFTexture& first, GlTFTexture& second) noexcept
+        {
+            using std::swap;
+
+            swap(first.texture, second.texture);
+            swap(first.layout, second.layout);
+            swap(first.sampler, second.sampler);
+            swap(first.bindlessIndex, second.bindlessIndex);
+            swap(first.encoding, second.encoding);
+            swap(first.firstMip, second.firstMip);
+            swap(first.m_sources, second.m_sources);
+            swap(first.m_requestedEncoding, second.m_requestedEncoding);
+            swap(first.m_levels, second.m_levels);
+            swap(first.m_size, second.m_size);
+            swap(first.m_device, second.m_device);
+            swap(first.m_bindlessRegistry, second.m_bindlessRegistry);
+        }
+
+        GlTFTexture(GlTFTexture&& other) noexcept : GlTFTexture() { swap(*this, other); }
+
+        GlTFTexture& operator=(GlTFTexture&& other) noexcept
+        {
+            GlTFTexture temp { std::move(other) };
+            swap(*this, temp);
+
+            return *this;
+        }
 
         // TODO(aether) currently, this class handles everything from uploading to compressing
         // differ that to the Texture class instead
@@ -48,14 +117,58 @@ namespace renderer::backend
 
         vk::ImageLayout layout {};
 
-        vk::raii::Sampler sampler { nullptr };
+        // Owned and deduplicated by the bindless registry
+        vk::Sampler sampler { nullptr };
+
+        uint32_t bindlessIndex { BindlessRegistry::kInvalidIndex };
+
+        // The encoding that was actually used, BC5 falls back to RGBA8 when the device can't sample it
+        TextureEncoding encoding { TextureEncoding::automatic };
+
+        // Levels the image manager dropped from the top before evicting the image, reloads start there
+        // unless the budget has room for the whole chain again
+        uint32_t firstMip { 0 };
+
+        // Reads the sources through the file reader and rebuilds the mip chain on the executor's workers.
+        // The chain is empty if a source couldn't be read or decoded anymore
+        auto loadMipChain(TaskExecutor& executor) const -> Task<MipChain>;
+
+        // Recreates the evicted image from a chain `loadMipChain` built, starting at `firstMip`. The
+        // descriptor stays on the placeholder, the image can't be sampled before the upload got acquired
+        auto reload(MipChain const& mipChain,
+                    UploadManager& uploadManager,
+                    ResourceManager<Image>& imageManager) -> UploadToken;
+
+        // Bytes of the mip chain from `firstLevel` on, `reload` uploads the ones from `firstMip` on
+        [[nodiscard]] auto getMipChainSize(uint32_t firstLevel) const -> vk::DeviceSize;
 
     private:
+        static auto buildMipChain(Device const& device,
+                                  tinygltf::Image const& gltfimage,
+                                  TextureEncoding requestedEncoding) -> MipChain;
+
+        // Uploads the levels of the chain from `firstLevel` on into a new image
+        auto uploadMipChain(MipChain const& mipChain,
+                            UploadManager& uploadManager,
+                            ResourceManager<Image>& imageManager,
+                            uint32_t firstLevel) -> UploadToken;
+
+        std::vector<TextureSource> m_sources;
+        TextureEncoding m_requestedEncoding { TextureEncoding::automatic };
+
+        // Layout of the full chain, `getMipChainSize` works without the pixels
+        std::vector<MipLevel> m_levels;
+        vk::DeviceSize m_size { 0 };
+
         Device* m_device { nullptr };
-        Allocator* m_allocator { nullptr };
-        CommandManager* m_commandManager { nullptr };
+        BindlessRegistry* m_bindlessRegistry { nullptr };
     };
 
+    // R = occlusion, G = roughness, B = metallic, laid out the way glTF already expects them. Both images
+    // need 8 bits per channel and the same size, the metallic/roughness one at least three channels
+    auto packOrmImage(tinygltf::Image const& occlusion,
+                      tinygltf::Image const& metallicRoughness) -> tinygltf::Image;
+
     // We use a custom image loading function with tinyglTF, so we can do custom stuff loading ktx textures
     bool loadImageDataFunc(tinygltf::Image* image,
                            int const imageIndex,
@@ -1,19 +1,33 @@
 #pragma once
 
+#include "../bindless.hpp"
 #include "../buffer.hpp"
 #include "../command.hpp"
 #include "../descriptor.hpp"
+#include "../draw_bucket.hpp"
 #include "../image.hpp"
+#include "../occlusion_rasterizer.hpp"
+#include "../scene_bvh.hpp"
+#include "../task.hpp"
+#include "../upload.hpp"
 #include "animation.hpp"
 #include "gltfTextures.hpp"
 #include "material.hpp"
 #include "mesh.hpp"
 #include "node.hpp"
 
+#include <mc/arena.hpp>
+
 #include <glm/ext/matrix_float4x4.hpp>
 #include <glm/ext/quaternion_double.hpp>
 #include <glm/ext/vector_float4.hpp>
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <span>
 #include <tiny_gltf.h>
+#include <unordered_map>
 
 namespace renderer::backend
 {
@@ -26,36 +40,47 @@ namespace renderer::backend
               CommandManager& cmdManager,
               ResourceManager<Image>& imageManager,
               ResourceManager<GPUBuffer>& bufferManager,
-              vk::DescriptorSetLayout materialDescriptorSetLayout,
-              vk::ImageView dummyImage,
-              vk::Sampler dummySampler)
+              BufferPool& uniformPool,
+              UploadManager& uploadManager,
+              BindlessRegistry& bindlessRegistry)
             : m_device { &device },
               m_cmdManager { &cmdManager },
               m_imageManager { &imageManager },
               m_bufferManager { &bufferManager },
-              m_materialDescriptorSetLayout { materialDescriptorSetLayout },
-              m_dummyImage { dummyImage },
-              m_dummySampler { dummySampler }
+              m_uniformPool { &uniformPool },
+              m_uploadManager { &uploadManager },
+              m_bindlessRegistry { &bindlessRegistry }
         {
         }
 
-        void loadFromFile(std::string filename, float scale = 1.0f);
+        // Baking packs occlusion/roughness/metallic into one texture and encodes normal maps as BC5.
+        // The loading itself runs on the executor's workers, the model must not be touched until it finished
+        auto loadFromFile(TaskExecutor& executor,
+                          std::string filename,
+                          float scale               = 1.0f,
+                          bool bakeMaterialTextures = true) -> Task<void>;
+
+        // Keeps the textures of the materials of `primitives` (indices into `primitiveData`) from being
+        // evicted by the image manager, evicted ones get requested for reloading
+        void markTexturesUsed(std::span<uint32_t const> primitives);
 
-        Model(Model&&)            = default;
-        Model& operator=(Model&&) = default;
+        // Starts loading requested textures again within a per-frame byte budget, uploads the ones the
+        // executor finished and swaps in those whose upload a frame acquired. Called once per frame by the
+        // render loop, before the bindless registry's writes
+        void streamTextures();
+
+        // The eviction callbacks of the textures point back at the model
+        Model(Model&&)            = delete;
+        Model& operator=(Model&&) = delete;
 
         Model(Model const&)            = delete;
         Model& operator=(Model const&) = delete;
 
-        ResourceAccessor<GPUBuffer> indices, vertices, materialBuffer, drawIndirectBuffer,
+        // The device addresses of these are read through the accessors every frame,
+        // defragmentation may move the buffers. `positions` repeats the vertex positions as packed vec3s
+        ResourceAccessor<GPUBuffer> indices, vertices, positions, materialBuffer, drawIndirectBuffer,
             primitiveDataBuffer;
 
-        vk::DescriptorSet bindlessMaterialDescriptorSet { nullptr };
-
-        vk::DeviceSize vertexBufferAddress { 0 };
-        vk::DeviceSize materialBufferAddress { 0 };
-        vk::DeviceSize primitiveDataBufferAddress { 0 };
-
         glm::mat4 aabb;
 
         uint64_t triangleCount { 0 };
@@ -65,10 +90,22 @@ namespace renderer::backend
 
         std::vector<Skin*> skins;
 
+        // Ordered by `DrawBucket`, `drawBuckets` holds the range of each
         std::vector<vk::DrawIndexedIndirectCommand> drawIndirectCommands;
         std::vector<PrimitiveShaderData> primitiveData;
+        DrawBuckets drawBuckets {};
+
+        // World space bounds of the primitives, items are indices into `primitiveData`. Refit when
+        // animations move nodes
+        SceneBvh bvh;
+
+        // CPU copies of the meshes that hide the most, for the software occlusion buffer
+        std::vector<OccluderMesh> occluders;
 
         std::vector<GlTFTexture> textures;
+        // Indices into `textures` whose memory got evicted, they are sampled as the placeholder until
+        // their reload got acquired
+        std::vector<uint32_t> evictedTextures;
         std::vector<TextureSampler> textureSamplers;
         std::vector<Material> materials;
         std::vector<Animation> animations;
@@ -76,10 +113,11 @@ namespace renderer::backend
 
         BoundingBox::Dimensions dimensions;
 
+        // Filled by the mesh conversion, the geometry lives in the load's arena until it's uploaded
         struct LoaderInfo
         {
-            uint32_t* indexBuffer;
-            Vertex* vertexBuffer;
+            std::span<uint32_t> indexBuffer;
+            std::span<Vertex> vertexBuffer;
             size_t indexPos  = 0;
             size_t vertexPos = 0;
         };
@@ -110,7 +148,35 @@ namespace renderer::backend
 
         void createMaterialBuffer();
 
-        void loadTextures(tinygltf::Model& gltfModel);
+        // Nodes, meshes, skins and animations, along with the indirect draw data
+        auto loadMeshes(tinygltf::Model const& gltfModel,
+                        float scale,
+                        memory::Arena& arena,
+                        LoaderInfo& loaderInfo,
+                        size_t& vertexCount,
+                        size_t& indexCount) -> Task<void>;
+
+        static auto decodeImage(tinygltf::Image& image, int imageIndex, std::vector<std::byte> encoded)
+            -> Task<void>;
+
+        // tinygltf leaves external images alone, they are read here in a single batch
+        auto readExternalImages(TaskExecutor& executor,
+                                tinygltf::Model const& gltfModel,
+                                std::unordered_map<int, std::vector<std::byte>>& encodedImages) -> Task<void>;
+
+        // `imageSources` has one entry for every image of the glTF file
+        void loadTextures(tinygltf::Model& gltfModel,
+                          bool bakeMaterialTextures,
+                          std::span<TextureSource const> imageSources);
+
+        // How many material slots reference each texture
+        static auto countTextureReferences(tinygltf::Model const& gltfModel) -> std::vector<uint32_t>;
+
+        // Adds a packed texture for every material that samples occlusion and metallic/roughness
+        // from different images, and repoints both of the material's slots to it. Returns the occlusion and
+        // metallic/roughness images of every packed image
+        static auto packOcclusionRoughnessMetallic(tinygltf::Model& gltfModel)
+            -> std::map<int, std::array<int, 2>>;
 
         auto getVkWrapMode(int32_t wrapMode) -> vk::SamplerAddressMode;
 
@@ -122,7 +188,16 @@ namespace renderer::backend
 
         void loadAnimations(tinygltf::Model& gltfModel);
 
-        void setupDescriptors();
+        // Base color/diffuse, metallic-roughness/specular-glossiness, occlusion, emissive, normal
+        auto getMaterialTextures(Material const& material) const -> std::array<GlTFTexture*, 5>;
+
+        void onTextureEvicted(uint32_t textureIndex, ImageEviction eviction);
+
+        // Opts the texture's image into the texture budget with the eviction callback
+        void setTextureResidency(uint32_t textureIndex);
+
+        // Runs on the executor, hands the rebuilt mip chain over to `streamTextures`
+        auto loadTextureMipChain(uint32_t textureIndex) -> Task<void>;
 
         void updateAnimation(uint32_t index, float time);
 
@@ -132,15 +207,58 @@ namespace renderer::backend
 
         void preparePrimitiveIndirectData(Node* node);
 
+        // Needs the materials. Primitives whose matrix mirrors them have their winding flipped, they are
+        // treated as double-sided rather than culled wrong
+        void sortDrawsIntoBuckets();
+
+        // Current world space bounds of every primitive, in the order of `primitiveData`
+        auto computePrimitiveBounds() const -> std::vector<BoundingBox>;
+
+        // Needs the draws and the materials, and the geometry before the arena is released. Opaque
+        // primitives of nodes with "occluder" in their name come first, the rest of the budget goes to the
+        // biggest bounds among the cheap enough ones
+        void selectOccluders(LoaderInfo const& loaderInfo);
+
         Device* m_device { nullptr };
         CommandManager* m_cmdManager { nullptr };
         ResourceManager<Image>* m_imageManager { nullptr };
         ResourceManager<GPUBuffer>* m_bufferManager { nullptr };
+        BufferPool* m_uniformPool { nullptr };
+        UploadManager* m_uploadManager { nullptr };
+
+        BindlessRegistry* m_bindlessRegistry { nullptr };
+
+        // The one the model was loaded with, evicted textures are read and decoded again on it
+        TaskExecutor* m_executor { nullptr };
+
+        // Evicted textures that were marked as used since, `streamTextures` drains it. A texture stays
+        // requested until its reload is uploaded, those that failed to load again are never requested again
+        std::vector<uint32_t> m_requestedTextures;
+        std::vector<bool> m_reloadRequested;
+
+        struct LoadedTexture
+        {
+            uint32_t texture;
+            GlTFTexture::MipChain mipChain;
+        };
+
+        // Mip chains the executor finished, waiting for `streamTextures` to upload them
+        std::vector<LoadedTexture> m_loadedTextures;
+        std::mutex m_loadedTexturesMutex;
+
+        // Loads still running on the executor, the destructor waits for them
+        std::atomic<uint32_t> m_numTextureLoads { 0 };
 
-        DescriptorAllocator m_materialDescriptorAllocator {};
-        vk::DescriptorSetLayout m_materialDescriptorSetLayout { nullptr };
+        // Bytes of the chains being loaded, they count against the texture budget ahead of their upload
+        vk::DeviceSize m_loadingTextureBytes { 0 };
+
+        // Reloads waiting for the main queue to acquire their upload
+        struct TextureReload
+        {
+            uint32_t texture;
+            UploadToken upload;
+        };
 
-        vk::ImageView m_dummyImage { nullptr };
-        vk::Sampler m_dummySampler { nullptr };
+        std::vector<TextureReload> m_textureReloads;
     };
 }  // namespace renderer::backend
@@ -13,6 +13,22 @@ namespace renderer::backend
         specularGlossiness = 1
     };
 
+    // Mirrors the MaterialFeatures_* flags in shaders/common.glsl, the shader skips every absent map
+    enum MaterialFeatures : int
+    {
+        MaterialFeatures_ColorTexture            = 1 << 0,
+        MaterialFeatures_NormalTexture           = 1 << 1,
+        MaterialFeatures_RoughnessTexture        = 1 << 2,
+        MaterialFeatures_OcclusionTexture        = 1 << 3,
+        MaterialFeatures_EmissiveTexture         = 1 << 4,
+        MaterialFeatures_TangentVertexAttribute  = 1 << 5,
+        MaterialFeatures_TexcoordVertexAttribute = 1 << 6,
+        // Occlusion is in the red channel of the metallic/roughness texture, one fetch covers both
+        MaterialFeatures_PackedOcclusion         = 1 << 7,
+        // Two channel normal map, z has to be reconstructed
+        MaterialFeatures_NormalTextureBC5        = 1 << 8,
+    };
+
     struct alignas(16) ShaderMaterial
     {
         glm::vec4 baseColorFactor;
@@ -36,6 +52,13 @@ namespace renderer::backend
         float alphaMaskCutoff;
 
         int flags;
+
+        // Indices into the global bindless texture array
+        uint32_t colorTextureIndex;
+        uint32_t physicalDescriptorTextureIndex;
+        uint32_t occlusionTextureIndex;
+        uint32_t emissiveTextureIndex;
+        uint32_t normalTextureIndex;
     };
 
     struct Material
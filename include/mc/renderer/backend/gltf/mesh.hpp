@@ -50,17 +50,26 @@ namespace renderer::backend
         vk::DrawIndexedIndirectCommand drawCommand;
     };
 
+    // Matches `Primitive` in common.glsl, the bounds are the world space AABB the culling pass tests.
+    // `firstIndex` repeats the draw's, the visibility resolve finds the triangles through it
     struct alignas(16) PrimitiveShaderData
     {
         glm::mat4 matrix;
+        glm::vec3 boundsMin;
         uint32_t materialIndex;
+        glm::vec3 boundsMax;
+        uint32_t firstIndex;
     };
 
     struct Mesh
     {
         Mesh() = default;
 
-        Mesh(ResourceManager<GPUBuffer>& bufferManager, glm::mat4 matrix);
+        // Static meshes only get space for their matrix, the joint matrices are left out of their buffer
+        Mesh(ResourceManager<GPUBuffer>& bufferManager,
+             BufferPool& uniformPool,
+             glm::mat4 matrix,
+             bool skinned);
         ~Mesh() = default;
 
         Mesh(Mesh const&)            = delete;
@@ -80,6 +89,7 @@ namespace renderer::backend
 
         struct UniformBuffer
         {
+            // Suballocated from the uniform pool
             ResourceAccessor<GPUBuffer> buffer;
             VkDescriptorBufferInfo descriptor;
             VkDescriptorSet descriptorSet;
@@ -5,7 +5,11 @@
 #include "mc/asserts.hpp"
 #include "resource.hpp"
 
+#include <array>
+#include <atomic>
+#include <functional>
 #include <string_view>
+#include <vector>
 
 #include <glm/ext/vector_uint2.hpp>
 #include <vk_mem_alloc.h>
@@ -14,12 +18,42 @@
 
 namespace renderer::backend
 {
+    class Defragmenter;
+    class MemoryTelemetry;
+
+    // Images are budgeted per category, only evictable ones are ever touched by the manager
+    enum class ImageCategory : uint8_t
+    {
+        renderTarget,
+        texture,
+        other,
+
+        count
+    };
+
+    enum class ImageEviction : uint8_t
+    {
+        // The top mip level was dropped, the image (and view) got recreated at half the resolution
+        droppedMip,
+        // The image memory was released entirely, the resource itself stays valid and can be restored
+        evicted,
+        // Defragmentation moved the image to other memory, same contents but the view was recreated
+        moved,
+    };
+
+    // Lets the owner of an image swap its descriptors to something else (i.e a placeholder)
+    // when the manager evicts or degrades it
+    using ImageEvictionCallback = std::function<void(ResourceHandle const&, ImageEviction)>;
+
     class Image : public ResourceBase
     {
         // What if I put this in ResourceBase with a template
         // what does resourcemanager even want from Image
         friend class ResourceAccessor<Image>;
         friend class ResourceManagerBase<Image>;
+        friend class ResourceManager<Image>;
+        friend class Defragmenter;
+        friend class MemoryTelemetry;
 
         Image() = default;
 
@@ -52,6 +86,12 @@ namespace renderer::backend
             swap(first.mipLevels, second.mipLevels);
             swap(first.dimensions, second.dimensions);
             swap(first.imageView, second.imageView);
+            swap(first.category, second.category);
+            swap(first.evictable, second.evictable);
+            swap(first.lastUsedFrame, second.lastUsedFrame);
+            swap(first.memorySize, second.memorySize);
+            swap(first.onEvicted, second.onEvicted);
+            swap(first.moving, second.moving);
         }
 
         Image(Image&& other) noexcept : ResourceBase(std::move(other)) { swap(*this, other); };
@@ -65,10 +105,12 @@ namespace renderer::backend
             return *this;
         }
 
-        static void transition(vk::CommandBuffer cmdBuf,
-                               vk::Image image,
-                               vk::ImageLayout currentLayout,
-                               vk::ImageLayout newLayout);
+        // Scales the first level of `src` onto the first level of `dst`, both in the transfer layouts
+        static void blit(vk::CommandBuffer cmdBuf,
+                         vk::Image src,
+                         vk::Extent2D srcSize,
+                         vk::Image dst,
+                         vk::Extent2D dstSize);
 
         void createImage(vk::Format format,
                          vk::ImageTiling tiling,
@@ -101,6 +143,15 @@ namespace renderer::backend
         vk::Extent2D dimensions { 0, 0 };
 
         std::string_view name {};
+
+        ImageCategory category { ImageCategory::other };
+        bool evictable { false };
+        uint64_t lastUsedFrame { 0 };
+        vk::DeviceSize memorySize { 0 };
+        ImageEvictionCallback onEvicted {};
+
+        // Set while a defragmentation pass is moving the image, the old memory must stay put until it ends
+        bool moving { false };
     };
 
     template<>
@@ -155,27 +206,35 @@ namespace renderer::backend
 
         void copyTo(vk::CommandBuffer cmdBuf, vk::Image dst, vk::Extent2D dstSize, vk::Extent2D offset);
 
-        static void transition(vk::CommandBuffer cmdBuf,
-                               vk::Image image,
-                               vk::ImageLayout currentLayout,
-                               vk::ImageLayout newLayout)
-        {
-            Image::transition(cmdBuf, image, currentLayout, newLayout);
-        };
+        // The old image is retired rather than destroyed, frames in flight may still be using it
+        void resize(VkExtent2D dimensions);
 
-        void resize(VkExtent2D dimensions)
-        {
-            get().dimensions = dimensions;
+        // Opts the image into the budget of `category`, the manager may evict it if `evictable` is set
+        void setResidency(ImageCategory category,
+                          bool evictable,
+                          ImageEvictionCallback onEvicted = {});
 
-            get().destroy();
-            get().create();
-        }
+        // Marks the image as used in the manager's current frame,
+        // least recently used images are the first ones to be evicted
+        void markUsed();
+
+        [[nodiscard]] auto isResident() const -> bool { return get().imageHandle; }
+
+        // Recreates the memory of an evicted image, the contents are undefined and need to be uploaded again
+        void restore();
+
+        [[nodiscard]] auto getMemorySize() const -> vk::DeviceSize { return get().memorySize; }
+
+        [[nodiscard]] auto getCategory() const -> ImageCategory { return get().category; }
     };
 
     template<>
     class ResourceManager<Image> final : public ResourceManagerBase<Image>
     {
         friend class ResourceManagerBase<Image>;
+        friend class ResourceAccessor<Image>;
+        friend class Defragmenter;
+        friend class MemoryTelemetry;
 
         std::tuple<std::reference_wrapper<Device>, std::reference_wrapper<Allocator>>
             m_extraConstructionParams;
@@ -184,10 +243,115 @@ namespace renderer::backend
         ResourceManager(Device& device, Allocator& allocator)
             : m_extraConstructionParams { std::tie(device, allocator) } {};
 
-        ResourceManager(ResourceManager&&)            = default;
-        ResourceManager& operator=(ResourceManager&&) = default;
+        ResourceManager(ResourceManager&&)            = delete;
+        ResourceManager& operator=(ResourceManager&&) = delete;
 
         ResourceManager(ResourceManager const&)            = delete;
         ResourceManager& operator=(ResourceManager const&) = delete;
+
+        // The budget is a fraction of VMA's budget for the device local heap, 0 means the category is
+        // unbounded. It is enforced at the start of the next frame
+        void setBudget(ImageCategory category, float fractionOfHeap);
+
+        // The budget in bytes as of the current frame
+        [[nodiscard]] auto getBudget(ImageCategory category) const -> vk::DeviceSize
+        {
+            return m_budgets[static_cast<size_t>(category)];
+        }
+
+        // Memory currently held by resident images of this category, external memory included
+        [[nodiscard]] auto getUsage(ImageCategory category) const -> vk::DeviceSize
+        {
+            return m_usage[static_cast<size_t>(category)].load(std::memory_order_relaxed) +
+                   m_externalUsage[static_cast<size_t>(category)].bytes;
+        }
+
+        // Image memory the manager doesn't own, like the render graph's transient blocks. It counts against
+        // the category's budget and shows up in the telemetry, but is never evicted
+        void setExternalUsage(ImageCategory category, vk::DeviceSize bytes, uint32_t count)
+        {
+            m_externalUsage[static_cast<size_t>(category)] = { .bytes = bytes, .count = count };
+        }
+
+        [[nodiscard]] auto getNumEvicted() const -> uint64_t { return m_numEvicted; }
+
+        [[nodiscard]] auto getCurrentFrame() const -> uint64_t { return m_currentFrame; }
+
+        // Must be called once the frame's fence has been waited on, this is where the budgets get enforced
+        // and retired images are destroyed
+        void beginFrame(uint64_t frameNumber);
+
+        // Records the copies of the mip levels dropped by `beginFrame`, must come before anything else in
+        // the frame samples the degraded images
+        void recordMipDrops(vk::CommandBuffer cmdBuf);
+
+    private:
+        // The levels of `src` below the first one, still to be copied into `dst`
+        struct MipDrop
+        {
+            vk::Image src;
+            vk::Image dst;
+            vk::Extent2D srcDimensions;
+            uint32_t srcMipLevels;
+            vk::ImageAspectFlags aspectFlags;
+        };
+
+        // Derives the budgets in bytes from the current heap budget
+        void updateBudgets();
+
+        // Scans every live image, only ever run once per frame
+        void enforceBudgets();
+
+        // Frees at least `bytesToFree` from `category` if possible, returns how much was actually freed
+        auto evict(ImageCategory category, vk::DeviceSize bytesToFree) -> vk::DeviceSize;
+
+        // Recreates the image without its top mip level, returns the amount of memory freed. The old image
+        // is retired, its contents are copied over by `recordMipDrops`
+        auto dropTopMip(Image& image) -> vk::DeviceSize;
+
+        void resize(Image& image, vk::Extent2D dimensions);
+
+        void restore(Image& image);
+
+        void setCategory(Image& image, ImageCategory category);
+
+        // Images are created and released on any thread, the counters are the only state they share
+        void onCreated(Image& image) override { addUsage(image); }
+
+        void onReleased(Image& image) override { removeUsage(image); }
+
+        void addUsage(Image const& image)
+        {
+            m_usage[static_cast<size_t>(image.category)].fetch_add(image.memorySize,
+                                                                   std::memory_order_relaxed);
+        }
+
+        void removeUsage(Image const& image)
+        {
+            m_usage[static_cast<size_t>(image.category)].fetch_sub(image.memorySize,
+                                                                   std::memory_order_relaxed);
+        }
+
+        // Hands the memory of `image` to the retired list, the image stays valid but is no longer resident
+        void retireMemory(Image& image);
+
+        struct ExternalUsage
+        {
+            vk::DeviceSize bytes { 0 };
+            uint32_t count { 0 };
+        };
+
+        std::array<float, static_cast<size_t>(ImageCategory::count)> m_budgetFractions {};
+        std::array<vk::DeviceSize, static_cast<size_t>(ImageCategory::count)> m_budgets {};
+        std::array<ExternalUsage, static_cast<size_t>(ImageCategory::count)> m_externalUsage {};
+
+        // Bytes of the resident images of every category, updated wherever an image gains or loses memory
+        // or changes its category
+        std::array<std::atomic<vk::DeviceSize>, static_cast<size_t>(ImageCategory::count)> m_usage {};
+
+        uint64_t m_currentFrame { 0 };
+        uint64_t m_numEvicted { 0 };
+
+        std::vector<MipDrop> m_mipDrops;
     };
 }  // namespace renderer::backend
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "buffer.hpp"
+#include "image.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    struct HeapUsage
+    {
+        // Reported by the driver through VK_EXT_memory_budget, estimated by VMA otherwise
+        vk::DeviceSize usage { 0 };
+        vk::DeviceSize budget { 0 };
+        vk::DeviceSize peakUsage { 0 };
+
+        // What VMA itself holds in this heap
+        vk::DeviceSize blockBytes { 0 };
+        vk::DeviceSize allocationBytes { 0 };
+        uint32_t blockCount { 0 };
+        uint32_t allocationCount { 0 };
+
+        vk::DeviceSize size { 0 };
+        bool deviceLocal { false };
+    };
+
+    struct CategoryUsage
+    {
+        vk::DeviceSize bytes { 0 };
+        vk::DeviceSize peakBytes { 0 };
+        uint32_t count { 0 };
+    };
+
+    // Samples GPU heap budgets, the memory held by each category of resources and the resident memory of
+    // the process, keeping track of the peaks. Every `kMemoryTelemetryDumpInterval` a snapshot is appended
+    // to a JSON lines file, so memory growth over long sessions can be looked at after the fact
+    class MemoryTelemetry
+    {
+    public:
+        MemoryTelemetry() = default;
+
+        MemoryTelemetry(Allocator& allocator,
+                        ResourceManager<GPUBuffer>& bufferManager,
+                        ResourceManager<Image>& imageManager,
+                        std::filesystem::path dumpPath);
+
+        MemoryTelemetry(MemoryTelemetry const&)            = delete;
+        MemoryTelemetry& operator=(MemoryTelemetry const&) = delete;
+
+        MemoryTelemetry(MemoryTelemetry&&)            = delete;
+        MemoryTelemetry& operator=(MemoryTelemetry&&) = delete;
+
+        // Heap budgets are refreshed every frame, the per-category totals every
+        // `kMemoryTelemetrySampleInterval` frames since those walk every resource. Frame loop only
+        void update(uint64_t frameNumber);
+
+        // Appends a snapshot to the dump file right away
+        void dump();
+
+        [[nodiscard]] auto getHeaps() const -> std::span<HeapUsage const> { return m_heaps; }
+
+        [[nodiscard]] auto getCategory(MemoryCategory category) const -> CategoryUsage const&
+        {
+            return m_categories[static_cast<size_t>(category)];
+        }
+
+        // Resident set of the whole process, 0 where that can't be queried
+        [[nodiscard]] auto getHostMemory() const -> uint64_t { return m_hostMemory; }
+
+        [[nodiscard]] auto getPeakHostMemory() const -> uint64_t { return m_peakHostMemory; }
+
+        [[nodiscard]] static auto getCategoryName(MemoryCategory category) -> std::string_view;
+
+    private:
+        void sampleHeaps();
+
+        void sampleCategories();
+
+        void sampleHostMemory();
+
+        [[nodiscard]] auto toJson() const -> std::string;
+
+        Allocator* m_allocator { nullptr };
+        ResourceManager<GPUBuffer>* m_bufferManager { nullptr };
+        ResourceManager<Image>* m_imageManager { nullptr };
+
+        std::filesystem::path m_dumpPath;
+        std::chrono::steady_clock::time_point m_lastDump {};
+
+        std::vector<HeapUsage> m_heaps;
+        std::array<CategoryUsage, static_cast<size_t>(MemoryCategory::count)> m_categories {};
+
+        uint64_t m_hostMemory { 0 };
+        uint64_t m_peakHostMemory { 0 };
+
+        uint64_t m_frameNumber { 0 };
+    };
+}  // namespace renderer::backend
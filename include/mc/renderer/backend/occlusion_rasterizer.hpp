@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <TaskScheduler.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace renderer::backend
+{
+    // World space triangles of a mesh that hides what's behind it
+    struct OccluderMesh
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+    };
+
+    // A primitive that may end up as an occluder
+    struct OccluderCandidate
+    {
+        uint32_t numTriangles;
+
+        // World space, the candidates covering the most area are picked first
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+
+        // Cut out or see-through surfaces don't hide what's behind them, skinned ones move away from the
+        // copy taken of them
+        bool opaque;
+        bool skinned;
+
+        // Part of a node named as an occluder, taken whatever its size
+        bool designated;
+    };
+
+    // The candidates worth rasterizing: the designated ones, then the largest ones that fit in the triangle
+    // budget. Returns indices into `candidates`, shared by the renderer and the occlusion_benchmark target
+    auto selectOccluders(std::span<OccluderCandidate const> candidates) -> std::vector<uint32_t>;
+
+    // World space copy of the vertices `indices` references, `getPosition` gives a vertex's local position
+    template<typename Vertex, typename Projection = std::identity>
+    auto makeOccluderMesh(std::span<uint32_t const> indices,
+                          std::span<Vertex const> vertices,
+                          glm::mat4 const& matrix,
+                          Projection getPosition = {}) -> OccluderMesh
+    {
+        OccluderMesh occluder;
+        occluder.indices.reserve(indices.size());
+
+        // Only the vertices the primitive references, the indices may address a much larger buffer
+        std::unordered_map<uint32_t, uint32_t> remap;
+
+        for (uint32_t index : indices)
+        {
+            auto const [it, inserted] =
+                remap.try_emplace(index, static_cast<uint32_t>(occluder.positions.size()));
+
+            if (inserted)
+            {
+                glm::vec3 const position = std::invoke(getPosition, vertices[index]);
+
+                occluder.positions.push_back(matrix * glm::vec4(position, 1.f));
+            }
+
+            occluder.indices.push_back(it->second);
+        }
+
+        return occluder;
+    }
+
+    // Renders a few occluders into a small depth buffer on the CPU, so bounding boxes can be tested against
+    // it without the GPU's depth buffer. Depth is reverse-Z like on the GPU, texels no occluder covers stay
+    // at 0 and never hide anything. Only texels a triangle covers entirely are written, with the farthest
+    // depth it has within them, so boxes at the edges of occluders stay visible. Only needs enkiTS, no
+    // device, the occlusion_benchmark target drives it on its own.
+    //
+    // Setup spreads the triangles over the workers and bins them into bands of rows, every band is then
+    // rasterized by a single worker 8 texels at a time with AVX2
+    class OcclusionRasterizer
+    {
+    public:
+        OcclusionRasterizer() = default;
+
+        explicit OcclusionRasterizer(enki::TaskScheduler& scheduler);
+
+        OcclusionRasterizer(OcclusionRasterizer const&)            = delete;
+        OcclusionRasterizer& operator=(OcclusionRasterizer const&) = delete;
+
+        OcclusionRasterizer(OcclusionRasterizer&&)            = delete;
+        OcclusionRasterizer& operator=(OcclusionRasterizer&&) = delete;
+
+        void setOccluders(std::span<OccluderMesh const> occluders);
+
+        // Must be called from a thread enkiTS knows about, the caller helps out until the buffer is done
+        void render(glm::mat4 const& viewProj);
+
+        // Conservative: false only if the box is behind the occluders of the last `render` on every texel
+        // it covers. Safe to call from several threads at once
+        [[nodiscard]] auto isVisible(glm::vec3 boundsMin, glm::vec3 boundsMax) const -> bool;
+
+        [[nodiscard]] auto hasOccluders() const -> bool { return !m_indices.empty(); }
+
+        [[nodiscard]] auto getNumTriangles() const -> uint32_t
+        {
+            return static_cast<uint32_t>(m_indices.size() / 3);
+        }
+
+        // Wall clock time of the last `render` in milliseconds
+        [[nodiscard]] auto getLastRenderTime() const -> double { return m_lastRenderTime; }
+
+    private:
+        // Screen space triangle, the edge functions and the depth plane are moved by half a texel so that
+        // they can be evaluated at texel centers. A texel is covered entirely when all three edge functions
+        // are non-negative there, the depth plane then gives the farthest depth within it
+        struct Triangle
+        {
+            // x and y coefficients and the constant of each edge function, and of the depth plane
+            std::array<glm::vec3, 3> edges;
+            glm::vec3 depth;
+
+            // Texels that may be covered, inclusive. Empty if nothing is to be drawn
+            int32_t minX, minY, maxX, maxY;
+        };
+
+        struct SetupTask final : enki::ITaskSet
+        {
+            void ExecuteRange(enki::TaskSetPartition range, uint32_t threadNum) override;
+
+            OcclusionRasterizer* rasterizer { nullptr };
+        };
+
+        struct RasterTask final : enki::ITaskSet
+        {
+            // The range is in bands
+            void ExecuteRange(enki::TaskSetPartition range, uint32_t threadNum) override;
+
+            OcclusionRasterizer* rasterizer { nullptr };
+        };
+
+        void setupTriangles(uint32_t first, uint32_t last, uint32_t threadNum);
+
+        void rasterizeBand(uint32_t band);
+
+        enki::TaskScheduler* m_scheduler { nullptr };
+
+        SetupTask m_setupTask;
+        RasterTask m_rasterTask;
+
+        // All occluders merged, the indices address `m_positions` directly
+        std::vector<glm::vec3> m_positions;
+        std::vector<uint32_t> m_indices;
+
+        // State of the last `render`
+        glm::mat4 m_viewProj { 1.f };
+        std::vector<Triangle> m_triangles;
+        // Indices into `m_triangles` by worker and band, workers never touch each other's bins
+        std::vector<std::vector<std::vector<uint32_t>>> m_bins;
+        std::vector<float> m_depth;
+
+        double m_lastRenderTime { 0.0 };
+    };
+}  // namespace renderer::backend
@@ -45,7 +45,7 @@ namespace renderer::backend
         auto enableBlending(bool enable = true) -> GraphicsPipelineConfig&;
         auto blendingSetAlphaBlend() -> GraphicsPipelineConfig&;
         auto blendingSetAdditiveBlend() -> GraphicsPipelineConfig&;
-        auto setBlendingWriteMask(vk::ColorComponentFlagBits mask) -> GraphicsPipelineConfig&;
+        auto setBlendingWriteMask(vk::ColorComponentFlags mask) -> GraphicsPipelineConfig&;
 
         auto setDepthStencilSettings(bool enable,
                                      vk::CompareOp compareOp,
@@ -132,6 +132,7 @@ namespace renderer::backend
             vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB |
             vk::ColorComponentFlagBits::eA;
         vk::BlendFactor srcColorBlendFactor = vk::BlendFactor::eOne;  // Additive blending by default
+        vk::BlendFactor dstColorBlendFactor = vk::BlendFactor::eDstAlpha;
 
         // Dynamic rendering
         std::optional<vk::Format> colorAttachmentFormat;
@@ -210,10 +211,11 @@ namespace renderer::backend
         ComputePipeline()  = default;
         ~ComputePipeline() = default;
 
-        explicit ComputePipeline(Device const& device,
-                                 PipelineLayout const& layout,
-                                 std::filesystem::path const& path,
-                                 std::string_view entryPoint);
+        // `shaders` must hold a single, already built compute shader
+        ComputePipeline(Device const& device,
+                        std::string_view name,
+                        PipelineLayout const& layout,
+                        ShaderManager const& shaders);
 
         ComputePipeline(ComputePipeline const&)                    = delete;
         auto operator=(ComputePipeline const&) -> ComputePipeline& = delete;
@@ -221,9 +223,6 @@ namespace renderer::backend
         ComputePipeline(ComputePipeline&&)                    = default;
         auto operator=(ComputePipeline&&) -> ComputePipeline& = default;
 
-        [[nodiscard]] auto setShader(std::filesystem::path const& path,
-                                     std::string_view entryPoint) -> ComputePipeline&;
-
         [[nodiscard]] operator vk::Pipeline() const { return m_pipeline; }
 
         [[nodiscard]] auto get() const -> vk::Pipeline { return m_pipeline; }
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "constants.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // Called on the render thread once the data arrived, before the readback reports being ready
+    using ReadbackCallback = std::function<void(std::span<std::byte const>)>;
+
+    // Completion of a readback. Can be copied around and polled from any thread, the data stays valid for as
+    // long as any copy of the readback is alive
+    class Readback
+    {
+    public:
+        Readback() = default;
+
+        // The default readback never completes
+        explicit operator bool() const { return m_state != nullptr; }
+
+        [[nodiscard]] auto isReady() const -> bool
+        {
+            return m_state && m_state->ready.load(std::memory_order_acquire);
+        }
+
+        // Empty until the readback is ready. Images are tightly packed rows of `getExtent()` texels
+        [[nodiscard]] auto getData() const -> std::span<std::byte const>
+        {
+            return isReady() ? std::span<std::byte const>(m_state->data) : std::span<std::byte const> {};
+        }
+
+        [[nodiscard]] auto getExtent() const -> vk::Extent2D { return m_state->extent; }
+
+        [[nodiscard]] auto getFormat() const -> vk::Format { return m_state->format; }
+
+    private:
+        friend class ReadbackManager;
+
+        struct State
+        {
+            std::vector<std::byte> data;
+
+            vk::Extent2D extent {};
+            vk::Format format { vk::Format::eUndefined };
+
+            std::atomic<bool> ready { false };
+        };
+
+        std::shared_ptr<State> m_state;
+    };
+
+    // Copies buffer ranges and images into persistently mapped host memory as part of the frame's command
+    // buffer. Like the per-frame allocator, the memory is split into a region per frame in flight. A readback
+    // completes once the render loop comes back around to its frame slot and waited on that slot's fence.
+    // Nothing ever waits on the GPU, results simply show up `kNumFramesInFlight` frames later
+    class ReadbackManager
+    {
+    public:
+        ReadbackManager() = default;
+
+        ReadbackManager(ResourceManager<GPUBuffer>& bufferManager, vk::DeviceSize regionSize);
+
+        ReadbackManager(ReadbackManager const&)            = delete;
+        ReadbackManager& operator=(ReadbackManager const&) = delete;
+
+        ReadbackManager(ReadbackManager&&)            = delete;
+        ReadbackManager& operator=(ReadbackManager&&) = delete;
+
+        // Completes the readbacks of the frame that last used this slot, must be called once the slot's fence
+        // has been waited on
+        void beginFrame(uint32_t frameIndex);
+
+        // Anything that wrote to `src` earlier in `cmdBuf` is waited on
+        auto readBuffer(vk::CommandBuffer cmdBuf,
+                        vk::Buffer src,
+                        vk::DeviceSize offset,
+                        vk::DeviceSize size,
+                        ReadbackCallback callback = {}) -> Readback;
+
+        // Reads mip level 0 of a single sampled image. `layout` is the image's current layout, it is back in
+        // that layout once the copy is done. `aspect` is a single aspect, the depth of D24 formats arrives in
+        // 4 bytes and stencil in 1 byte per texel
+        auto readImage(vk::CommandBuffer cmdBuf,
+                       vk::Image src,
+                       vk::ImageLayout layout,
+                       vk::Extent2D extent,
+                       vk::Format format,
+                       vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor,
+                       ReadbackCallback callback   = {}) -> Readback;
+
+        [[nodiscard]] auto getNumPending() const -> size_t;
+
+    private:
+        struct Pending
+        {
+            std::shared_ptr<Readback::State> state;
+            ReadbackCallback callback;
+
+            vk::DeviceSize offset { 0 };
+            vk::DeviceSize size { 0 };
+
+            // Readbacks that don't fit into the frame's region get a buffer of their own
+            std::optional<ResourceAccessor<GPUBuffer>> dedicated;
+        };
+
+        struct Destination
+        {
+            vk::Buffer buffer;
+            vk::DeviceSize offset;
+        };
+
+        // Reserves space in the current frame's region (or a dedicated buffer) for `pending`
+        auto allocate(Pending& pending) -> Destination;
+
+        // Makes the copies visible to the host once the frame's fence signalled
+        static void recordHostBarrier(vk::CommandBuffer cmdBuf);
+
+        ResourceManager<GPUBuffer>* m_bufferManager { nullptr };
+
+        ResourceAccessor<GPUBuffer> m_buffer;
+        std::byte const* m_data { nullptr };
+
+        vk::DeviceSize m_regionSize { 0 };
+        vk::DeviceSize m_head { 0 };
+        uint32_t m_frameIndex { 0 };
+
+        std::array<std::vector<Pending>, kNumFramesInFlight> m_pending;
+    };
+}  // namespace renderer::backend
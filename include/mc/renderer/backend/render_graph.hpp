@@ -0,0 +1,242 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "device.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // How a pass touches a resource. Each usage implies the stages, accesses and image layout the graph
+    // synchronizes against
+    enum class ResourceUsage : uint8_t
+    {
+        // Loaded or cleared, blended and stored, also as the resolve target of a rendering
+        colorAttachment,
+        // Tested and written, a depth test without writes still stores the attachment
+        depthAttachment,
+        fragmentSampled,
+        computeSampled,
+        computeStorageRead,
+        computeStorageWrite,
+        indirectRead,
+        transferSrc,
+        transferDst,
+    };
+
+    // Index of an image or buffer declared in the current frame's graph
+    using RenderGraphResource = uint32_t;
+
+    struct ResourceAccess
+    {
+        RenderGraphResource resource;
+        ResourceUsage usage;
+    };
+
+    // Images owned by the graph, only valid between the passes that use them
+    struct TransientImageDesc
+    {
+        vk::Extent2D extent;
+        vk::Format format;
+        vk::SampleCountFlagBits samples { vk::SampleCountFlagBits::e1 };
+
+        auto operator==(TransientImageDesc const&) const -> bool = default;
+    };
+
+    // Images that outlive the frame, like the swapchain's
+    struct ImportedImage
+    {
+        vk::Image image;
+        vk::ImageView view;
+        vk::ImageAspectFlags aspect { vk::ImageAspectFlagBits::eColor };
+
+        // The layout the image is in before the graph's passes, the first barrier also waits for
+        // `waitStages`, e.g. those of the semaphore the image was acquired with
+        vk::ImageLayout layout { vk::ImageLayout::eUndefined };
+        vk::PipelineStageFlags2 waitStages {};
+
+        // Left as is if undefined
+        vk::ImageLayout finalLayout { vk::ImageLayout::eUndefined };
+    };
+
+    // A frame's passes with the resources they read and write. The graph records one batched barrier in
+    // front of every pass, with only the stages and accesses involved, and skips passes whose results
+    // nothing needs.
+    //
+    // Transient images are placed in memory blocks by their lifetimes, images whose passes don't overlap
+    // share a block. Their contents never survive the frame. Passes are declared again every frame, the
+    // images and memory stay around for as long as the declared ones match
+    class RenderGraph
+    {
+    public:
+        RenderGraph() = default;
+
+        RenderGraph(Device& device, Allocator& allocator);
+
+        RenderGraph(RenderGraph const&)            = delete;
+        RenderGraph& operator=(RenderGraph const&) = delete;
+
+        RenderGraph(RenderGraph&&)            = delete;
+        RenderGraph& operator=(RenderGraph&&) = delete;
+
+        ~RenderGraph();
+
+        // Drops the last frame's passes and resources
+        void reset();
+
+        [[nodiscard]] auto createImage(std::string_view name, TransientImageDesc const& desc)
+            -> RenderGraphResource;
+
+        [[nodiscard]] auto importImage(std::string_view name, ImportedImage const& image)
+            -> RenderGraphResource;
+
+        // Accesses from outside the graph are synchronized by whoever owns the buffer. Null buffers are fine,
+        // there is nothing to synchronize for them
+        [[nodiscard]] auto importBuffer(std::string_view name, vk::Buffer buffer) -> RenderGraphResource;
+
+        // Passes run in the order they were added. A resource may be listed more than once, e.g. cleared and
+        // then written by a shader. Passes with side effects the graph can't see, like readbacks, are never
+        // culled
+        void addPass(std::string_view name,
+                     std::vector<ResourceAccess> accesses,
+                     std::function<void(vk::CommandBuffer)> record,
+                     bool hasSideEffects = false);
+
+        // Culls the passes and places the transient images. Returns whether they were recreated, which waits
+        // for the device to be idle, descriptors referencing their views have to be written again
+        [[nodiscard]] auto compile() -> bool;
+
+        // Records every pass that survived `compile`
+        void execute(vk::CommandBuffer cmdBuf);
+
+        // Transient images only exist after `compile`
+        [[nodiscard]] auto getImage(RenderGraphResource resource) const -> vk::Image;
+
+        [[nodiscard]] auto getImageView(RenderGraphResource resource) const -> vk::ImageView;
+
+        [[nodiscard]] auto getNumCulledPasses() const -> uint32_t { return m_numCulledPasses; }
+
+        // Of the last `execute`
+        [[nodiscard]] auto getNumBarriers() const -> uint32_t { return m_numBarriers; }
+
+        [[nodiscard]] auto getTransientMemory() const -> vk::DeviceSize { return m_transientMemory; }
+
+        [[nodiscard]] auto getNumMemoryBlocks() const -> uint32_t
+        {
+            return static_cast<uint32_t>(m_blocks.size());
+        }
+
+        // What the transient images would take with a block each
+        [[nodiscard]] auto getUnaliasedMemory() const -> vk::DeviceSize { return m_unaliasedMemory; }
+
+    private:
+        // Synchronization state of an image or buffer, transient images share the state of their block
+        struct ResourceState
+        {
+            vk::ImageLayout layout { vk::ImageLayout::eUndefined };
+
+            // The last write, later accesses have to wait for it unless it's visible to them already
+            vk::PipelineStageFlags2 writeStages {};
+            vk::AccessFlags2 writeAccess {};
+            vk::PipelineStageFlags2 visibleStages {};
+            vk::AccessFlags2 visibleAccess {};
+
+            // Reads since the last write, the next write waits for them
+            vk::PipelineStageFlags2 readStages {};
+        };
+
+        struct Resource
+        {
+            std::string name;
+            bool isBuffer { false };
+            bool isImported { false };
+
+            TransientImageDesc desc {};
+            vk::ImageUsageFlags usage {};
+
+            vk::Image image { nullptr };
+            vk::ImageView view { nullptr };
+            vk::Buffer buffer { nullptr };
+            vk::ImageAspectFlags aspect { vk::ImageAspectFlagBits::eColor };
+            vk::ImageLayout finalLayout { vk::ImageLayout::eUndefined };
+
+            // Index into `m_transients` for transient images
+            uint32_t transient { 0 };
+
+            // Live passes using the resource, set by `compile`
+            uint32_t firstPass { ~0u };
+            uint32_t lastPass { 0 };
+
+            ResourceState state {};
+        };
+
+        struct Pass
+        {
+            std::string name;
+            std::vector<ResourceAccess> accesses;
+            std::function<void(vk::CommandBuffer)> record;
+            bool hasSideEffects;
+            bool culled;
+        };
+
+        // What a transient image was created for, the images are reused as long as this doesn't change
+        struct TransientKey
+        {
+            TransientImageDesc desc;
+            vk::ImageUsageFlags usage;
+            uint32_t firstPass;
+            uint32_t lastPass;
+
+            auto operator==(TransientKey const&) const -> bool = default;
+        };
+
+        struct Transient
+        {
+            vk::raii::Image image { nullptr };
+            vk::raii::ImageView view { nullptr };
+            uint32_t block { 0 };
+        };
+
+        struct MemoryBlock
+        {
+            VmaAllocation allocation { nullptr };
+            ResourceState state {};
+        };
+
+        void cullPasses();
+
+        void computeLifetimes();
+
+        // Recreates the transient images and their memory blocks for `keys`, the device has to be idle
+        void allocateTransients(std::vector<TransientKey> const& keys);
+
+        void releaseTransients();
+
+        // The state an access synchronizes against, the block's one for transient images
+        auto getState(Resource& resource) -> ResourceState&;
+
+        Device* m_device { nullptr };
+        Allocator* m_allocator { nullptr };
+
+        std::vector<Resource> m_resources;
+        std::vector<Pass> m_passes;
+
+        std::vector<TransientKey> m_transientKeys;
+        std::vector<Transient> m_transients;
+        std::vector<MemoryBlock> m_blocks;
+
+        uint32_t m_numTransients { 0 };
+        uint32_t m_numCulledPasses { 0 };
+        uint32_t m_numBarriers { 0 };
+
+        vk::DeviceSize m_transientMemory { 0 };
+        vk::DeviceSize m_unaliasedMemory { 0 };
+    };
+}  // namespace renderer::backend
@@ -1,18 +1,31 @@
 #pragma once
 
 #include "allocator.hpp"
+#include "bindless.hpp"
 #include "buffer.hpp"
 #include "command.hpp"
 #include "constants.hpp"
+#include "culling.hpp"
+#include "defragmenter.hpp"
+#include "depth_pyramid.hpp"
 #include "descriptor.hpp"
+#include "frame_allocator.hpp"
 #include "device.hpp"
 #include "gltf/loader.hpp"
 #include "image.hpp"
 #include "instance.hpp"
+#include "memory_telemetry.hpp"
 #include "pipeline.hpp"
+#include "readback.hpp"
+#include "render_graph.hpp"
 #include "surface.hpp"
 #include "swapchain.hpp"
+#include "task.hpp"
 #include "texture.hpp"
+#include "upload.hpp"
+#include "visibility_buffer.hpp"
+
+#include <optional>
 
 #include <GLFW/glfw3.h>
 #include <TaskScheduler.h>
@@ -28,8 +41,10 @@ namespace renderer::backend
     struct GPUDrawPushConstants
     {
         vk::DeviceAddress vertexBuffer {};
+        vk::DeviceAddress positionBuffer {};
         vk::DeviceAddress materialBuffer {};
         vk::DeviceAddress primitiveBuffer {};
+        vk::DeviceAddress indexBuffer {};
     };
 
     struct alignas(16) GPUSceneData
@@ -46,6 +61,17 @@ namespace renderer::backend
         float screenHeight {};
     };
 
+    // What a geometry pass renders
+    enum class GeometryPass
+    {
+        // Shades every bucket, after the depth pre-pass if that's enabled
+        forward,
+        // Only the IDs of the opaque and masked buckets' triangles, see `VisibilityBuffer`
+        visibility,
+        // Shades the blended buckets over the resolved visibility buffer and resolves the draw image
+        blended,
+    };
+
     struct FrameResources
     {
         vk::raii::Semaphore imageAvailableSemaphore { nullptr };
@@ -89,14 +115,36 @@ namespace renderer::backend
             scheduleSwapchainUpdate();
         }
 
+        void toggleCpuCulling() { m_cpuCulling = !m_cpuCulling; }
+
+        void toggleSoftwareOcclusion() { m_softwareOcclusion = !m_softwareOcclusion; }
+
+        void toggleDepthPrePass() { m_depthPrePass = !m_depthPrePass; }
+
+        void toggleVisibilityBuffer() { m_visibilityRendering = !m_visibilityRendering; }
+
+        // Casts a ray from the camera through `cursor`, in framebuffer pixels, and remembers the primitive
+        // whose bounds it enters first
+        void pickPrimitive(glm::vec2 cursor);
+
         uint32_t getCurrentFrameIndex() const { return m_currentFrame; }
 
     private:
         void initImgui(GLFWwindow* window);
         void renderImgui(vk::CommandBuffer cmdBuf, vk::ImageView targetImage);
+        // Declares the frame's passes in the render graph, which records them with their barriers
         void recordCommandBuffer(uint32_t imageIndex);
 
-        void drawGeometry(vk::CommandBuffer cmdBuf);
+        // The early pass clears the render targets, the last one resolves the draw image. The draws are split
+        // into chunks recorded on the enkiTS workers and executed in order
+        void drawGeometry(vk::CommandBuffer cmdBuf, CullPhase phase, GeometryPass pass);
+
+        // Shades the visibility buffer into the draw image, one full screen triangle
+        void resolveVisibility(vk::CommandBuffer cmdBuf);
+
+        // Records one chunk of the pass set up in `m_drawRecording` into a secondary command buffer
+        // from the pool of `threadIndex`
+        void recordDrawChunk(uint32_t chunk, uint32_t threadIndex);
 
         void initDescriptors();
 
@@ -109,6 +157,7 @@ namespace renderer::backend
         void renderNode(vk::CommandBuffer cmdBuf, Node* node);
 
         enki::TaskScheduler m_scheduler;
+        TaskExecutor m_taskExecutor { m_scheduler };
 
         Instance m_instance;
         Surface m_surface;
@@ -117,24 +166,116 @@ namespace renderer::backend
         Allocator m_allocator;
         DescriptorAllocator m_descriptorAllocator;
         CommandManager m_commandManager;
+        BindlessRegistry m_bindlessRegistry;
 
+        // Outlives the buffer manager, its suballocations are GPUBuffer resources
+        BufferPool m_uniformPool;
         ResourceManager<GPUBuffer> m_buffers;
+        UploadManager m_uploads;
         ResourceManager<Image> m_images;
         ResourceManager<Texture> m_textures;
+        FrameAllocator m_frameData;
+        ReadbackManager m_readbacks;
+        DepthPyramid m_depthPyramid;
+        VisibilityBuffer m_visibilityBuffer;
+        RenderGraph m_renderGraph;
+        DrawSorter m_drawSorter;
+        DrawCuller m_drawCuller;
+        OcclusionRasterizer m_occlusionRasterizer;
+        CpuDrawCuller m_cpuDrawCuller;
+        Defragmenter m_defragmenter;
+        MemoryTelemetry m_memoryTelemetry;
+
+        struct DrawRecordTask final : enki::ITaskSet
+        {
+            // The range is in chunks
+            void ExecuteRange(enki::TaskSetPartition range, uint32_t threadNum) override;
+
+            RendererBackend* backend { nullptr };
+        };
+
+        DrawRecordTask m_drawRecordTask;
+
+        // State of the geometry pass being recorded
+        struct DrawRecording
+        {
+            CullPhase phase;
+            GeometryPass pass;
+            vk::CommandBufferBeginInfo beginInfo;
+            vk::Extent2D extent;
+
+            // Only the CPU culler's draws are split, the GPU culler's count lives on the GPU
+            uint32_t numDraws;
+            uint32_t drawsPerChunk;
+
+            // With the depth pre-pass the first `numChunks` chunks record it, the rest the shading
+            uint32_t numChunks;
+            bool depthPrePass;
+        } m_drawRecording {};
+
+        std::array<vk::CommandBuffer, 2 * kMaxDrawRecordChunks> m_drawChunks {};
+
+        // Transient images of the frame being recorded, they only exist within its render graph
+        struct FrameTargets
+        {
+            RenderGraphResource drawImage;
+            RenderGraphResource drawImageResolve;
+            RenderGraphResource depthImage;
+            // Only declared with visibility rendering
+            RenderGraphResource visibilityImage;
+        } m_frameTargets {};
 
-        ResourceAccessor<Image> m_drawImage {}, m_drawImageResolve {}, m_depthImage {};
         vk::DescriptorSet m_sceneDataDescriptors { nullptr };
-        vk::raii::DescriptorSetLayout m_sceneDataDescriptorLayout { nullptr },
-            m_textureArrayDescriptorLayout { nullptr };
+        vk::raii::DescriptorSetLayout m_sceneDataDescriptorLayout { nullptr };
 
         vk::raii::DescriptorPool m_imGuiPool { nullptr };
 
         PipelineLayout m_pipelineLayout;
-        GraphicsPipeline m_pipeline;
+        std::array<GraphicsPipeline, kNumDrawBuckets> m_bucketPipelines;
+
+        // Only for the opaque buckets, indexed like them. The pre-pass lays down depth from the position
+        // stream, the equal depth pipelines shade what it left visible
+        std::array<GraphicsPipeline, 2> m_depthPrePassPipelines;
+        std::array<GraphicsPipeline, 2> m_equalDepthPipelines;
+
+        // Indexed like the opaque and masked buckets, the blended ones are shaded forward after the resolve
+        std::array<GraphicsPipeline, 4> m_visibilityPipelines;
+
+        // Reads the visibility buffer from a third descriptor set
+        PipelineLayout m_visibilityResolveLayout;
+        GraphicsPipeline m_visibilityResolvePipeline;
+
+        // Camera state of the latest update, only turned into GPU data once the frame's fence signalled
+        struct SceneView
+        {
+            glm::vec3 cameraPos;
+            glm::mat4 view;
+            glm::mat4 projection;
+        } m_sceneView {};
+
+        // Dynamic offset of this frame's scene data inside the per-frame allocator
+        uint32_t m_sceneDataOffset { 0 };
+
+        // Culls on the CPU instead of the GPU, the result is recorded before the geometry pass
+        bool m_cpuCulling { false };
+        CpuCullResult m_cpuCullResult {};
+
+        // Indices into the scene's `primitiveData` inside the frustum, only kept around to reuse the memory
+        std::vector<uint32_t> m_visiblePrimitives;
 
-        ResourceAccessor<GPUBuffer> m_gpuSceneDataBuffer {};
+        // The CPU culler also tests against the scene's occluders
+        bool m_softwareOcclusion { true };
 
-        Model m_scene {};
+        // Every geometry pass first renders its draws depth only, then shades them with an equal depth test
+        bool m_depthPrePass { false };
+
+        // The geometry passes only write triangle IDs, shading happens once per pixel afterwards. Replaces
+        // the depth pre-pass, which has nothing left to save
+        bool m_visibilityRendering { false };
+
+        std::optional<uint32_t> m_pickedPrimitive;
+
+        Model m_scene;
 
         std::array<FrameResources, kNumFramesInFlight> m_frameResources {};
 
@@ -151,6 +292,8 @@ namespace renderer::backend
         {
             uint64_t triangleCount;
             uint64_t drawCount;
+            // Draws that survived frustum culling, read back a few frames late
+            uint64_t visibleDrawCount;
         } m_stats {};
 
         uint32_t m_currentFrame  = 0;
@@ -158,6 +301,9 @@ namespace renderer::backend
 
         uint64_t m_frameCount {};
 
+        // Uploads whose ownership the current frame acquired, its submission waits on them
+        UploadToken m_acquiredUploads {};
+
         float m_animationTimer = 0.0f;
 
         bool m_animate = true;
@@ -1,12 +1,24 @@
 #pragma once
 
+#include "constants.hpp"
 #include "mc/asserts.hpp"
 #include "mc/logger.hpp"
 
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <format>
+#include <functional>
 #include <limits>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 // TODO(aether) There is one pretty big design issue with reference counting accessors
@@ -19,19 +31,15 @@
 
 namespace renderer::backend
 {
+    // Index of the resource's slot in the lower 32 bits and the generation of that slot in the upper ones,
+    // a handle outlived by its resource stops being valid once the slot is reused
     class ResourceHandle
     {
         template<typename T>
         friend class ResourceManagerBase;
 
-        ResourceHandle(uint64_t index, uint64_t creationNumber, [[maybe_unused]] std::string const& name = {})
-            : m_index { index },
-              m_creationNumber { creationNumber }
-#if DEBUG
-              ,
-              m_name { name }
-#endif
-              {};
+        ResourceHandle(uint32_t index, uint32_t generation)
+            : m_value { static_cast<uint64_t>(generation) << 32 | index } {};
 
     public:
         ResourceHandle() = default;
@@ -42,39 +50,30 @@ namespace renderer::backend
         ResourceHandle(ResourceHandle const&)            = default;
         ResourceHandle& operator=(ResourceHandle const&) = default;
 
-        bool operator==(ResourceHandle const& rhs) const { return m_creationNumber == rhs.m_creationNumber; }
+        bool operator==(ResourceHandle const& rhs) const = default;
 
-        bool hasInitialized() const { return m_creationNumber != invalidCreationNumber; };
+        bool hasInitialized() const { return m_value != invalidValue; };
 
         operator uint64_t() const { return this->getIndex(); }
 
         operator bool() const { return this->hasInitialized(); }
 
-        std::string_view getName() const
-        {
-#if DEBUG
-            return m_name;
-#else
-            return {};
-#endif
-        }
+        // The packed index and generation
+        uint64_t getValue() const { return m_value; }
 
-        static constexpr uint64_t invalidCreationNumber = std::numeric_limits<uint64_t>::max();
+        static constexpr uint64_t invalidValue = std::numeric_limits<uint64_t>::max();
 
     private:
-        uint64_t getIndex() const
+        uint32_t getIndex() const
         {
             MC_ASSERT_MSG(this->hasInitialized(), "Attempted to access an uninitialized handle");
 
-            return m_index;
+            return static_cast<uint32_t>(m_value);
         }
 
-        uint64_t m_index          = 0;
-        uint64_t m_creationNumber = invalidCreationNumber;
+        uint32_t getGeneration() const { return static_cast<uint32_t>(m_value >> 32); }
 
-#if DEBUG
-        std::string m_name;
-#endif
+        uint64_t m_value = invalidValue;
     };
 
     template<typename Resource>
@@ -92,13 +91,7 @@ namespace renderer::backend
         friend class ResourceManagerBase<Resource>;
 
     public:
-        virtual ~ResourceAccessorBase()
-        {
-            if (m_manager)
-            {
-                m_manager->decrementRefCount(m_handle);
-            }
-        }
+        virtual ~ResourceAccessorBase() { release(); }
 
         ResourceHandle const& getHandle() const { return m_handle; }
 
@@ -120,14 +113,11 @@ namespace renderer::backend
             }
         }
 
+        // The reference moves along with the accessor, the count stays the same
         ResourceAccessorBase(ResourceAccessorBase&& rhs) noexcept
             : m_manager { std::exchange(rhs.m_manager, nullptr) },
               m_handle { std::exchange(rhs.m_handle, {}) }
         {
-            if (m_manager)
-            {
-                m_manager->incrementRefCount(m_handle);
-            }
         }
 
         ResourceAccessorBase& operator=(ResourceAccessorBase const& rhs) noexcept
@@ -137,14 +127,17 @@ namespace renderer::backend
                 return *this;
             }
 
-            m_manager = rhs.m_manager;
-            m_handle  = rhs.m_handle;
-
-            if (m_manager)
+            // Taken before the old reference is dropped in case both refer to the same resource
+            if (rhs.m_manager)
             {
-                m_manager->incrementRefCount(m_handle);
+                rhs.m_manager->incrementRefCount(rhs.m_handle);
             }
 
+            release();
+
+            m_manager = rhs.m_manager;
+            m_handle  = rhs.m_handle;
+
             return *this;
         }
 
@@ -155,15 +148,23 @@ namespace renderer::backend
                 return *this;
             }
 
+            release();
+
             m_manager = std::exchange(rhs.m_manager, nullptr);
             m_handle  = std::exchange(rhs.m_handle, {});
 
+            return *this;
+        }
+
+        void release()
+        {
             if (m_manager)
             {
-                m_manager->incrementRefCount(m_handle);
+                m_manager->decrementRefCount(m_handle);
             }
 
-            return *this;
+            m_manager = nullptr;
+            m_handle  = {};
         }
 
         auto get() -> Resource& { return m_manager->getResource(m_handle); }
@@ -201,6 +202,12 @@ namespace renderer::backend
         ResourceHandle m_handle {};
     };
 
+    // Generational slot map. Slots live in fixed size pages that never move, so creating resources from
+    // worker threads never invalidates references held by other threads. Released slots go into one of
+    // a few free lists picked by thread, creation and release only ever contend on one of those.
+    //
+    // Iterating the live resources is not synchronized with creation and destruction, that is left to
+    // the thread running the frame loop
     template<typename Resource>
     class ResourceManagerBase
     {
@@ -213,140 +220,401 @@ namespace renderer::backend
             requires(ResourceManager<Resource>& manager, ResourceHandle handle) {
                 ResourceAccessor<Resource>(manager, handle);
             }, "An accessor for this resource is not present");
+
         ResourceManagerBase() = default;
 
     public:
-        virtual ~ResourceManagerBase() = default;
+        virtual ~ResourceManagerBase()
+        {
+            m_retired.clear();
+
+            for (auto& page : m_pages)
+            {
+                // Live resources are destroyed with the page, their accessors must not outlive the manager
+                delete[] page.load(std::memory_order_acquire);
+            }
+        }
 
         ResourceManagerBase(ResourceManagerBase const&)            = delete;
         ResourceManagerBase& operator=(ResourceManagerBase const&) = delete;
 
-        ResourceManagerBase(ResourceManagerBase&&)            = default;
-        ResourceManagerBase& operator=(ResourceManagerBase&&) = default;
+        ResourceManagerBase(ResourceManagerBase&&)            = delete;
+        ResourceManagerBase& operator=(ResourceManagerBase&&) = delete;
 
+        // Thread-safe
         template<typename Self, typename... Args>
         auto create(this Self&& self, std::string const& name, Args&&... args) -> ResourceAccessor<Resource>
         {
-            if (size_t dormResources = self.m_dormantIndices.size(); dormResources > 100)
-            {
-                logger::warn("Resource manager has an unexpected amount of inactive resources: {}",
-                             dormResources);
-            }
-
             auto createResource = [](auto&&... args)
             {
                 return Resource(std::forward<decltype(args)>(args)...);
             };
 
-            if (self.m_dormantIndices.empty())
-            {
-                RefCountedResource& res = self.m_resources.emplace_back(RefCountedResource {
-                    .resource = std::apply(
-                        createResource,
-                        std::tuple_cat(std::make_tuple(ResourceHandle(
-                                           self.m_resources.size(), self.m_creationCounter++, name)),
-                                       std::tie(name),
-                                       self.m_extraConstructionParams,
-                                       std::forward_as_tuple(std::forward<Args>(args)...))),
-                });
-
-                return ResourceAccessor<Resource>(*dynamic_cast<ResourceManager<Resource>*>(&self),
-                                                  res.resource.getHandle());
-            }
-            else
-            {
-                RefCountedResource& dormantResource = self.m_resources[self.m_dormantIndices.back()] = {
-                    .resource = std::apply(
-                        createResource,
-                        std::tuple_cat(std::make_tuple(ResourceHandle(
-                                           self.m_dormantIndices.back(), self.m_creationCounter++, name)),
-                                       std::tie(name),
-                                       self.m_extraConstructionParams,
-                                       std::forward_as_tuple(std::forward<Args>(args)...))),
-                };
-
-                self.m_dormantIndices.pop_back();
-
-                return ResourceAccessor<Resource>(*dynamic_cast<ResourceManager<Resource>*>(&self),
-                                                  dormantResource.resource.getHandle());
-            }
+            uint32_t const index = self.acquireSlot();
+            Slot& slot           = self.getSlot(index);
+
+            uint32_t const generation = getGeneration(slot.state.load(std::memory_order_acquire));
+            ResourceHandle const handle(index, generation);
+
+            auto params = std::tuple_cat(std::make_tuple(handle),
+                                         std::tie(name),
+                                         self.m_extraConstructionParams,
+                                         std::forward_as_tuple(std::forward<Args>(args)...));
+
+            slot.resource.emplace(std::apply(createResource, std::move(params)));
+
+            self.onCreated(*slot.resource);
+
+#if DEBUG
+            slot.name = name;
+#endif
+
+            // References can only be taken while the count is above 0, this one is handed over to the
+            // returned accessor
+            slot.state.store(packState(generation, 1), std::memory_order_release);
+            slot.alive.store(true, std::memory_order_release);
+            self.m_numLive.fetch_add(1, std::memory_order_relaxed);
+
+            ResourceAccessor<Resource> accessor(static_cast<ResourceManager<Resource>&>(self), handle);
+
+            slot.state.fetch_sub(1, std::memory_order_acq_rel);
+
+            return accessor;
         };
 
+        // Releases the resource even if accessors to it are left, those become stale and no longer count.
+        // It is retired like any other, the frames in flight may still use it
         void destroy(ResourceHandle const& handle)
-
         {
             MC_ASSERT(isValid(handle));
 
-            m_resources[handle.getIndex()] = {};
-            m_dormantIndices.push_back(handle.getIndex());
+            Slot& slot     = getSlot(handle.getIndex());
+            uint64_t state = slot.state.load(std::memory_order_relaxed);
+
+            do
+            {
+                if (getGeneration(state) != handle.getGeneration())
+                {
+                    return;
+                }
+            } while (!slot.state.compare_exchange_weak(state,
+                                                       packState(handle.getGeneration() + 1, 0),
+                                                       std::memory_order_acq_rel,
+                                                       std::memory_order_relaxed));
+
+            releaseSlot(handle.getIndex(), slot);
         };
 
         auto access(ResourceHandle const& handle) -> ResourceAccessor<Resource>
-
         {
             MC_ASSERT(isValid(handle));
 
-            return ResourceAccessor<Resource>(*dynamic_cast<ResourceManager<Resource>*>(this), handle);
+            return ResourceAccessor<Resource>(static_cast<ResourceManager<Resource>&>(*this), handle);
         };
 
         bool isValid(ResourceHandle const& handle) const
         {
-            return handle.hasInitialized() && handle.getIndex() <= m_resources.size() &&
-                   m_resources[handle.getIndex()].resource.m_handle == handle;
+            if (!handle.hasInitialized() ||
+                handle.getIndex() >= m_numSlots.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+
+            Slot const* slot = findSlot(handle.getIndex());
+
+            return slot && slot->alive.load(std::memory_order_acquire) &&
+                   getGeneration(slot->state.load(std::memory_order_acquire)) == handle.getGeneration();
         };
 
-        size_t getNumResources() { return m_resources.size(); };
+        // Slots ever handed out, live or not
+        size_t getNumResources() const { return m_numSlots.load(std::memory_order_relaxed); };
+
+        size_t getNumActiveResources() const { return m_numLive.load(std::memory_order_relaxed); };
+
+        size_t getNumRetiredResources()
+        {
+            std::lock_guard lock(m_retiredMutex);
+
+            return m_retired.size();
+        };
+
+        // Destroys the resources retired at least `kNumFramesInFlight` frames ago,
+        // must be called once the frame's fence has been waited on
+        void collectGarbage(uint64_t frameNumber)
+        {
+            m_frameNumber.store(frameNumber, std::memory_order_relaxed);
 
-        size_t getNumActiveResources() { return m_resources.size() - m_dormantIndices.size(); };
+            std::lock_guard lock(m_retiredMutex);
+
+            std::erase_if(m_retired,
+                          [frameNumber](RetiredResource const& retired)
+                          {
+                              return retired.frameNumber + kNumFramesInFlight <= frameNumber;
+                          });
+        }
+
+    protected:
+        // Lets managers keep track of their resources, both run on whichever thread created or released it
+        virtual void onCreated(Resource&) {}
+
+        virtual void onReleased(Resource&) {}
+
+        // Keeps the resource alive until none of the frames in flight can be using it anymore
+        void retire(Resource&& resource)
+        {
+            std::lock_guard lock(m_retiredMutex);
+
+            m_retired.push_back({
+                .resource    = std::move(resource),
+                .frameNumber = m_frameNumber.load(std::memory_order_relaxed),
+            });
+        }
+
+        // Every live resource in slot order
+        auto getLiveResources() const
+        {
+            return std::views::iota(0u, m_numSlots.load(std::memory_order_acquire)) |
+                   std::views::transform(
+                       [this](uint32_t index)
+                       {
+                           return findSlot(index);
+                       }) |
+                   std::views::filter(
+                       [](Slot* slot)
+                       {
+                           return slot && slot->alive.load(std::memory_order_acquire);
+                       }) |
+                   std::views::transform(
+                       [](Slot* slot) -> Resource&
+                       {
+                           return *slot->resource;
+                       });
+        }
 
     private:
-        struct RefCountedResource
+        static constexpr uint32_t kSlotsPerPage = 512;
+        static constexpr uint32_t kMaxPages     = 2048;
+        static constexpr uint32_t kNumShards    = 8;
+
+        struct Slot
         {
-            Resource resource {};
-            uint32_t refCount = 0;
+            std::optional<Resource> resource;
 
-            operator Resource&() { return resource; }
+            // Generation in the upper 32 bits and the number of references in the lower ones. Both change
+            // in one step, so a stale handle can never take or drop a reference to the slot's next resource
+            std::atomic<uint64_t> state { 0 };
+            std::atomic<bool> alive { false };
+
+#if DEBUG
+            // Kept after the slot is released so stale handles can still be reported by name
+            std::string name;
+#endif
         };
 
-        Resource& getResource(ResourceHandle const& handle)
+        struct alignas(64) FreeList
         {
-            MC_ASSERT_MSG(isValid(handle),
-                          "Attempted to access {}",
-                          handle.hasInitialized()
-                              ? std::format("a deleted handle (previously named '{}')", handle.getName())
-                              : "an uninitialized handle");
+            std::mutex mutex;
+            std::vector<uint32_t> indices;
+        };
+
+        struct RetiredResource
+        {
+            Resource resource;
+            uint64_t frameNumber;
+        };
 
-            return m_resources[handle.getIndex()];
+        static constexpr auto packState(uint32_t generation, uint32_t refCount) -> uint64_t
+        {
+            return static_cast<uint64_t>(generation) << 32 | refCount;
         }
 
-        RefCountedResource& getRefCoutedResource(ResourceHandle const& handle)
+        static constexpr auto getGeneration(uint64_t state) -> uint32_t
+        {
+            return static_cast<uint32_t>(state >> 32);
+        }
+
+        static constexpr auto getRefCount(uint64_t state) -> uint32_t { return static_cast<uint32_t>(state); }
+
+        auto getShard() -> FreeList&
+        {
+            return m_freeLists[std::hash<std::thread::id> {}(std::this_thread::get_id()) % kNumShards];
+        }
+
+        auto acquireSlot() -> uint32_t
+        {
+            FreeList& own = getShard();
+
+            {
+                std::lock_guard lock(own.mutex);
+
+                if (!own.indices.empty())
+                {
+                    uint32_t const index = own.indices.back();
+                    own.indices.pop_back();
+
+                    return index;
+                }
+            }
+
+            // Slots released by other threads, without waiting on anyone currently using their lists
+            for (FreeList& other : m_freeLists)
+            {
+                std::unique_lock lock(other.mutex, std::try_to_lock);
+
+                if (lock.owns_lock() && !other.indices.empty())
+                {
+                    uint32_t const index = other.indices.back();
+                    other.indices.pop_back();
+
+                    return index;
+                }
+            }
+
+            uint32_t const index = m_numSlots.fetch_add(1, std::memory_order_acq_rel);
+
+            MC_ASSERT_MSG(index < kSlotsPerPage * kMaxPages, "Resource manager ran out of slots");
+
+            // Until the page exists the slot is simply skipped by lookups and iteration
+            allocatePage(index / kSlotsPerPage);
+
+            return index;
+        }
+
+        // The generation of the slot has to be bumped already. Iteration skips the slot before its resource
+        // moves to the retired list
+        void releaseSlot(uint32_t index, Slot& slot)
+        {
+            slot.alive.store(false, std::memory_order_release);
+
+            onReleased(*slot.resource);
+
+            retire(std::move(*slot.resource));
+            slot.resource.reset();
+
+            m_numLive.fetch_sub(1, std::memory_order_relaxed);
+
+            FreeList& own = getShard();
+
+            std::lock_guard lock(own.mutex);
+
+            own.indices.push_back(index);
+        }
+
+        void allocatePage(uint32_t pageIndex)
+        {
+            if (m_pages[pageIndex].load(std::memory_order_acquire))
+            {
+                return;
+            }
+
+            Slot* page      = new Slot[kSlotsPerPage];
+            Slot* available = nullptr;
+
+            if (!m_pages[pageIndex].compare_exchange_strong(
+                    available, page, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                delete[] page;
+            }
+        }
+
+        auto findSlot(uint32_t index) const -> Slot*
+        {
+            Slot* page = m_pages[index / kSlotsPerPage].load(std::memory_order_acquire);
+
+            return page ? &page[index % kSlotsPerPage] : nullptr;
+        }
+
+        auto getSlot(uint32_t index) const -> Slot&
+        {
+            Slot* slot = findSlot(index);
+
+            MC_ASSERT(slot);
+
+            return *slot;
+        }
+
+        auto getSlotName([[maybe_unused]] uint32_t index) const -> std::string_view
+        {
+#if DEBUG
+            return getSlot(index).name;
+#else
+            return {};
+#endif
+        }
+
+        Resource& getResource(ResourceHandle const& handle)
         {
             MC_ASSERT_MSG(isValid(handle),
                           "Attempted to access {}",
                           handle.hasInitialized()
-                              ? std::format("a deleted handle (previously named '{}')", handle.getName())
+                              ? std::format("a deleted handle (previously named '{}')",
+                                            getSlotName(handle.getIndex()))
                               : "an uninitialized handle");
 
-            return m_resources[handle.getIndex()];
+            return *getSlot(handle.getIndex()).resource;
         }
 
         auto getExtraConstructionParams() { return std::make_tuple(); };
 
-        void incrementRefCount(ResourceHandle const& handle) { getRefCoutedResource(handle).refCount++; }
+        // Fails if the resource was released in the meantime, the accessor is stale then and its decrement
+        // is ignored as well
+        void incrementRefCount(ResourceHandle const& handle)
+        {
+            Slot& slot     = getSlot(handle.getIndex());
+            uint64_t state = slot.state.load(std::memory_order_relaxed);
+
+            do
+            {
+                if (getGeneration(state) != handle.getGeneration() || getRefCount(state) == 0)
+                {
+                    MC_ASSERT_MSG(false,
+                                  "Attempted to reference a released resource (previously named '{}')",
+                                  getSlotName(handle.getIndex()));
+
+                    return;
+                }
+            } while (!slot.state.compare_exchange_weak(
+                state, state + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+        }
 
         void decrementRefCount(ResourceHandle const& handle)
         {
-            if (--getRefCoutedResource(handle).refCount == 0)
+            Slot& slot     = getSlot(handle.getIndex());
+            uint64_t state = slot.state.load(std::memory_order_relaxed);
+            uint64_t next  = 0;
+
+            do
             {
-                destroy(handle);
-            };
+                // Stale, the resource was destroyed and the slot may already hold another one
+                if (getGeneration(state) != handle.getGeneration() || getRefCount(state) == 0)
+                {
+                    return;
+                }
+
+                // The last reference invalidates the handle in the same step
+                next = getRefCount(state) == 1 ? packState(handle.getGeneration() + 1, 0) : state - 1;
+            } while (!slot.state.compare_exchange_weak(
+                state, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+            if (getRefCount(next) == 0)
+            {
+                // The frames in flight may still be using the underlying objects
+                releaseSlot(handle.getIndex(), slot);
+            }
         };
 
-        std::vector<RefCountedResource> m_resources;
+        std::array<std::atomic<Slot*>, kMaxPages> m_pages {};
+
+        std::atomic<uint32_t> m_numSlots { 0 };
+        std::atomic<size_t> m_numLive { 0 };
+
+        std::array<FreeList, kNumShards> m_freeLists {};
 
-        std::vector<uint32_t> m_dormantIndices;
+        // Resources whose last accessor went away, see `collectGarbage`
+        std::vector<RetiredResource> m_retired;
+        std::mutex m_retiredMutex;
 
-        uint64_t m_creationCounter { 0 };
+        std::atomic<uint64_t> m_frameNumber { 0 };
     };
 
     // To allow specific resources to extend managers via partial specialization and inheritence
@@ -358,8 +626,8 @@ namespace renderer::backend
         std::tuple<> m_extraConstructionParams {};
 
     public:
-        ResourceManager(ResourceManager&&)            = default;
-        ResourceManager& operator=(ResourceManager&&) = default;
+        ResourceManager(ResourceManager&&)            = delete;
+        ResourceManager& operator=(ResourceManager&&) = delete;
 
         ResourceManager(ResourceManager const&)            = delete;
         ResourceManager& operator=(ResourceManager const&) = delete;
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "gltf/boundingBox.hpp"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace renderer::backend
+{
+    // Bounding volume hierarchy over world space boxes, built with the binned surface area heuristic.
+    // Items are the indices of the boxes passed to `build`. Moving items only refits the boxes of the
+    // tree, which keeps its shape, so it should be rebuilt once things moved far.
+    //
+    // Items without valid bounds are kept outside the tree. Every volume query returns them and rays
+    // never hit them
+    class SceneBvh
+    {
+    public:
+        struct RayHit
+        {
+            uint32_t item;
+            // Along the ray direction, 0 if the origin is inside the item's box
+            float distance;
+        };
+
+        SceneBvh() = default;
+
+        SceneBvh(SceneBvh const&)            = delete;
+        SceneBvh& operator=(SceneBvh const&) = delete;
+
+        SceneBvh(SceneBvh&&)            = default;
+        SceneBvh& operator=(SceneBvh&&) = default;
+
+        void build(std::span<BoundingBox const> bounds);
+
+        // Takes effect with the next `refit`. Items keep whether they are bounded from the last `build`
+        void setBounds(uint32_t item, BoundingBox const& bounds);
+
+        // Recomputes every node's box from the current item bounds
+        void refit();
+
+        // Items that are at least partially inside, `planes` as returned by `extractFrustumPlanes`
+        void queryFrustum(std::array<glm::vec4, 6> const& planes, std::vector<uint32_t>& items) const;
+
+        // Items whose boxes overlap the given one
+        void queryBox(glm::vec3 boundsMin, glm::vec3 boundsMax, std::vector<uint32_t>& items) const;
+
+        // Items whose boxes overlap the sphere
+        void querySphere(glm::vec3 center, float radius, std::vector<uint32_t>& items) const;
+
+        // The item whose box the ray enters first, boxes containing the origin are skipped. `direction`
+        // doesn't need to be normalized, the distance is in multiples of it
+        [[nodiscard]] auto raycast(glm::vec3 origin,
+                                   glm::vec3 direction,
+                                   float maxDistance = std::numeric_limits<float>::max()) const
+            -> std::optional<RayHit>;
+
+        [[nodiscard]] auto getNumNodes() const -> uint32_t { return static_cast<uint32_t>(m_nodes.size()); }
+
+        [[nodiscard]] auto getNumItems() const -> uint32_t { return static_cast<uint32_t>(m_bounds.size()); }
+
+    private:
+        // Leaves have a count and reference `m_items`, inner nodes have two children next to each other.
+        // Children always come after their parent
+        struct Node
+        {
+            glm::vec3 min;
+            uint32_t first;
+            glm::vec3 max;
+            uint32_t count;
+        };
+
+        // Splits `nodeIndex` if that is cheaper than keeping it a leaf
+        void subdivide(uint32_t nodeIndex);
+
+        void updateNodeBounds(Node& node) const;
+
+        // Every item below `nodeIndex`, without testing anything
+        void appendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& items) const;
+
+        // Calls `nodeTest` on nodes and leaf items, returns what it accepted. `nodeTest` returns whether the
+        // box is outside, partially or completely inside
+        template <typename NodeTest>
+        void query(NodeTest&& nodeTest, std::vector<uint32_t>& items) const;
+
+        std::vector<Node> m_nodes;
+
+        // Bounded items, ordered so that every leaf references a contiguous range
+        std::vector<uint32_t> m_items;
+        std::vector<uint32_t> m_unboundedItems;
+
+        std::vector<BoundingBox> m_bounds;
+    };
+}  // namespace renderer::backend
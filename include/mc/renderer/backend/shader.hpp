@@ -2,11 +2,14 @@
 
 #include <filesystem>
 #include <fstream>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "device.hpp"
 #include "mc/asserts.hpp"
+#include "mc/file_reader.hpp"
 
 #define SPIRV_CROSS_EXCEPTIONS_TO_ASSERTIONS
 #include <shaderc/shaderc.h>
@@ -73,22 +76,15 @@ namespace renderer::backend
 
             auto& result = m_includeResults[requested_source];
 
-            std::ifstream file(path, std::ios::ate | std::ios::binary);
+            auto file = io::FileReader::get().readFile(path);
 
-            MC_ASSERT_MSG(file.is_open(),
+            MC_ASSERT_MSG(file,
                           "{} can't be opened (included by shader {})",
                           requested_source,
                           requesting_source);
 
-            auto fileSize = file.tellg();
-            file.seekg(0);
-
-            std::string& includeContent = m_includeContents.emplace_back();
-            includeContent.resize(static_cast<std::size_t>(fileSize));
-
-            file.read(reinterpret_cast<char*>(includeContent.data()), fileSize);
-
-            file.close();
+            std::string& includeContent = m_includeContents.emplace_back(
+                reinterpret_cast<char const*>(file->data()), file->size());
 
             result.content            = includeContent.data();
             result.source_name        = requested_source;
@@ -154,6 +150,16 @@ namespace renderer::backend
             return *this;
         };
 
+        // Defined for every shader of this manager
+        ShaderManager& addDefine(std::string name, std::string value = {})
+        {
+            m_dirty = true;
+
+            m_defines.emplace_back(std::move(name), std::move(value));
+
+            return *this;
+        };
+
         void build();
 
         std::vector<vk::PipelineShaderStageCreateInfo> const& getShaderStages() const
@@ -176,6 +182,7 @@ namespace renderer::backend
         bool m_dirty = true;
 
         std::vector<ShaderDescription> m_shaderDescriptions;
+        std::vector<std::pair<std::string, std::string>> m_defines;
 
         std::vector<vk::raii::ShaderModule> m_shaderModules {};
         std::vector<vk::PipelineShaderStageCreateInfo> m_shaderStageInfos {};
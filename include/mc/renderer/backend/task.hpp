@@ -0,0 +1,487 @@
+#pragma once
+
+#include "command.hpp"
+#include "mc/file_reader.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <TaskScheduler.h>
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // Hands coroutines over to the enkiTS workers
+    class TaskExecutor
+    {
+    public:
+        TaskExecutor() = default;
+
+        explicit TaskExecutor(enki::TaskScheduler& scheduler) : m_scheduler { &scheduler } {}
+
+        TaskExecutor(TaskExecutor const&)            = delete;
+        TaskExecutor& operator=(TaskExecutor const&) = delete;
+
+        TaskExecutor(TaskExecutor&&)            = delete;
+        TaskExecutor& operator=(TaskExecutor&&) = delete;
+
+        struct ScheduleAwaiter
+        {
+            TaskExecutor* executor;
+
+            [[nodiscard]] auto await_ready() const noexcept -> bool { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle) const { executor->resumeOnWorker(handle); }
+
+            void await_resume() const noexcept {}
+        };
+
+        // `co_await executor.schedule()` continues the coroutine on one of the worker threads
+        [[nodiscard]] auto schedule() -> ScheduleAwaiter { return { this }; }
+
+        // Can be called from any thread, threads enkiTS doesn't know about get registered as external ones
+        void resumeOnWorker(std::coroutine_handle<> handle);
+
+        // Blocks for at most the given timeout in nanoseconds, eTimeout while the GPU isn't there yet
+        using GpuWait = std::function<vk::Result(uint64_t timeout)>;
+
+        // Hands the wait over to the executor's waiter thread, which resumes the coroutine on a worker
+        // once the wait stopped timing out. No worker is parked in the meantime
+        void resumeAfter(GpuWait wait, std::coroutine_handle<> handle, vk::Result& result);
+
+        [[nodiscard]] auto getScheduler() const -> enki::TaskScheduler& { return *m_scheduler; }
+
+        // The waiter thread resumes coroutines as an external task thread
+        static constexpr uint32_t kNumExternalThreads = 1;
+
+    private:
+        struct ResumeTask final : enki::ITaskSet
+        {
+            void ExecuteRange(enki::TaskSetPartition range, uint32_t threadNum) override;
+
+            std::coroutine_handle<> handle {};
+
+            // Set from the moment the task is handed out until it starts running, enkiTS considers
+            // a task that was never added to the pipe complete as well
+            std::atomic<bool> pending { false };
+        };
+
+        enki::TaskScheduler* m_scheduler { nullptr };
+
+        struct PendingWait
+        {
+            GpuWait wait;
+            std::coroutine_handle<> handle;
+            vk::Result* result;
+        };
+
+        void runGpuWaits(std::stop_token stop);
+
+        // Tasks are recycled once enkiTS is done with them, enkiTS doesn't own the task sets
+        std::vector<std::unique_ptr<ResumeTask>> m_tasks;
+        std::mutex m_mutex;
+
+        // Waits queued since the waiter thread last looked, it owns them afterwards
+        std::vector<PendingWait> m_newGpuWaits;
+        std::mutex m_gpuWaitMutex;
+        std::condition_variable_any m_gpuWaitCondition;
+
+        // Started with the first wait, declared last so it is joined before anything it uses goes away
+        std::jthread m_gpuWaiter;
+    };
+
+    // `co_await`s to the result of a GPU wait without blocking the awaiting thread
+    struct GpuWaitAwaiter
+    {
+        TaskExecutor& executor;
+        TaskExecutor::GpuWait wait;
+
+        vk::Result result { vk::Result::eTimeout };
+
+        // Work that is already done doesn't go through the waiter thread
+        [[nodiscard]] auto await_ready() -> bool
+        {
+            result = wait(0);
+
+            return result != vk::Result::eTimeout;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            executor.resumeAfter(std::move(wait), handle, result);
+        }
+
+        [[nodiscard]] auto await_resume() const noexcept -> vk::Result { return result; }
+    };
+
+    template<typename T = void>
+    class Task;
+
+    namespace detail
+    {
+        struct PromiseBase
+        {
+            struct FinalAwaiter
+            {
+                [[nodiscard]] auto await_ready() const noexcept -> bool { return false; }
+
+                template<typename Promise>
+                auto await_suspend(std::coroutine_handle<Promise> handle) const noexcept
+                    -> std::coroutine_handle<>
+                {
+                    if (auto continuation = handle.promise().continuation)
+                    {
+                        return continuation;
+                    }
+
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            // Tasks are lazy, they only start running once they are awaited
+            [[nodiscard]] auto initial_suspend() const noexcept -> std::suspend_always { return {}; }
+
+            [[nodiscard]] auto final_suspend() const noexcept -> FinalAwaiter { return {}; }
+
+            // Nothing in the codebase recovers from exceptions, they abort like a failed assert would
+            void unhandled_exception() const noexcept { std::terminate(); }
+
+            std::coroutine_handle<> continuation {};
+        };
+
+        template<typename T>
+        struct Promise : PromiseBase
+        {
+            auto get_return_object() -> Task<T>;
+
+            template<typename U>
+            void return_value(U&& value)
+            {
+                result.emplace(std::forward<U>(value));
+            }
+
+            std::optional<T> result;
+        };
+
+        template<>
+        struct Promise<void> : PromiseBase
+        {
+            auto get_return_object() -> Task<void>;
+
+            void return_void() const noexcept {}
+        };
+
+        // Fire and forget coroutine, the frame destroys itself when it finishes
+        struct DetachedTask
+        {
+            struct promise_type
+            {
+                auto get_return_object() -> DetachedTask
+                {
+                    return { std::coroutine_handle<promise_type>::from_promise(*this) };
+                }
+
+                [[nodiscard]] auto initial_suspend() const noexcept -> std::suspend_always { return {}; }
+
+                [[nodiscard]] auto final_suspend() const noexcept -> std::suspend_never { return {}; }
+
+                void return_void() const noexcept {}
+
+                void unhandled_exception() const noexcept { std::terminate(); }
+            };
+
+            void start() { std::exchange(handle, nullptr).resume(); }
+
+            std::coroutine_handle<promise_type> handle;
+        };
+    }  // namespace detail
+
+    // Lazily started coroutine, awaiting it runs it on the awaiting thread until it reaches its first
+    // suspension point (i.e `co_await executor.schedule()`), the awaiter is resumed wherever it finishes
+    template<typename T>
+    class [[nodiscard]] Task
+    {
+    public:
+        using promise_type = detail::Promise<T>;
+
+        Task() = default;
+
+        explicit Task(std::coroutine_handle<promise_type> handle) : m_handle { handle } {}
+
+        ~Task()
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+            }
+        }
+
+        Task(Task&& other) noexcept : m_handle { std::exchange(other.m_handle, nullptr) } {}
+
+        Task& operator=(Task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (m_handle)
+                {
+                    m_handle.destroy();
+                }
+
+                m_handle = std::exchange(other.m_handle, nullptr);
+            }
+
+            return *this;
+        }
+
+        Task(Task const&)            = delete;
+        Task& operator=(Task const&) = delete;
+
+        auto operator co_await() && noexcept
+        {
+            struct Awaiter
+            {
+                std::coroutine_handle<promise_type> handle;
+
+                [[nodiscard]] auto await_ready() const noexcept -> bool { return !handle || handle.done(); }
+
+                auto await_suspend(std::coroutine_handle<> continuation) const noexcept
+                    -> std::coroutine_handle<>
+                {
+                    handle.promise().continuation = continuation;
+
+                    return handle;
+                }
+
+                auto await_resume() const -> T
+                {
+                    if constexpr (!std::is_void_v<T>)
+                    {
+                        return std::move(*handle.promise().result);
+                    }
+                }
+            };
+
+            return Awaiter { m_handle };
+        }
+
+    private:
+        std::coroutine_handle<promise_type> m_handle {};
+    };
+
+    namespace detail
+    {
+        template<typename T>
+        auto Promise<T>::get_return_object() -> Task<T>
+        {
+            return Task<T> { std::coroutine_handle<Promise<T>>::from_promise(*this) };
+        }
+
+        inline auto Promise<void>::get_return_object() -> Task<void>
+        {
+            return Task<void> { std::coroutine_handle<Promise<void>>::from_promise(*this) };
+        }
+
+        // Counts the tasks of a `whenAll` plus the awaiting coroutine itself,
+        // whoever arrives last resumes the awaiter
+        struct WhenAllLatch
+        {
+            explicit WhenAllLatch(size_t numTasks) : count { numTasks + 1 } {}
+
+            auto arrive() -> bool { return count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+            std::atomic<size_t> count;
+            std::coroutine_handle<> continuation {};
+        };
+
+        struct WhenAllAwaiter
+        {
+            WhenAllLatch& latch;
+            std::vector<DetachedTask>& tasks;
+
+            [[nodiscard]] auto await_ready() const noexcept -> bool { return false; }
+
+            auto await_suspend(std::coroutine_handle<> continuation) -> bool
+            {
+                latch.continuation = continuation;
+
+                for (DetachedTask& task : tasks)
+                {
+                    task.start();
+                }
+
+                return !latch.arrive();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        template<typename T>
+        auto runWhenAllTask(TaskExecutor& executor,
+                            Task<T> task,
+                            WhenAllLatch& latch,
+                            std::optional<T>& result) -> DetachedTask
+        {
+            co_await executor.schedule();
+
+            result.emplace(co_await std::move(task));
+
+            if (latch.arrive())
+            {
+                latch.continuation.resume();
+            }
+        }
+
+        inline auto runWhenAllTask(TaskExecutor& executor, Task<void> task, WhenAllLatch& latch)
+            -> DetachedTask
+        {
+            co_await executor.schedule();
+
+            co_await std::move(task);
+
+            if (latch.arrive())
+            {
+                latch.continuation.resume();
+            }
+        }
+
+        template<typename T>
+        auto runSyncWaitTask(Task<T> task, std::optional<T>& result, std::binary_semaphore& done)
+            -> DetachedTask
+        {
+            result.emplace(co_await std::move(task));
+
+            done.release();
+        }
+
+        inline auto runSyncWaitTask(Task<void> task, std::binary_semaphore& done) -> DetachedTask
+        {
+            co_await std::move(task);
+
+            done.release();
+        }
+
+        inline auto runDetachedTask(Task<void> task) -> DetachedTask
+        {
+            co_await std::move(task);
+        }
+    }  // namespace detail
+
+    // Runs every task on the executor at the same time, finishes once all of them did
+    template<typename T>
+    auto whenAll(TaskExecutor& executor, std::vector<Task<T>> tasks) -> Task<std::vector<T>>
+    {
+        std::vector<std::optional<T>> results(tasks.size());
+        detail::WhenAllLatch latch { tasks.size() };
+
+        std::vector<detail::DetachedTask> runners;
+        runners.reserve(tasks.size());
+
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            runners.push_back(detail::runWhenAllTask(executor, std::move(tasks[i]), latch, results[i]));
+        }
+
+        co_await detail::WhenAllAwaiter { latch, runners };
+
+        std::vector<T> values;
+        values.reserve(results.size());
+
+        for (std::optional<T>& result : results)
+        {
+            values.push_back(std::move(*result));
+        }
+
+        co_return values;
+    }
+
+    inline auto whenAll(TaskExecutor& executor, std::vector<Task<void>> tasks) -> Task<void>
+    {
+        detail::WhenAllLatch latch { tasks.size() };
+
+        std::vector<detail::DetachedTask> runners;
+        runners.reserve(tasks.size());
+
+        for (Task<void>& task : tasks)
+        {
+            runners.push_back(detail::runWhenAllTask(executor, std::move(task), latch));
+        }
+
+        co_await detail::WhenAllAwaiter { latch, runners };
+    }
+
+    // Blocks the calling thread until the task finished, must not be called from inside a task
+    template<typename T>
+    auto syncWait(Task<T> task) -> T
+    {
+        std::binary_semaphore done { 0 };
+
+        if constexpr (std::is_void_v<T>)
+        {
+            detail::runSyncWaitTask(std::move(task), done).start();
+
+            done.acquire();
+        }
+        else
+        {
+            std::optional<T> result;
+
+            detail::runSyncWaitTask(std::move(task), result, done).start();
+
+            done.acquire();
+
+            return std::move(*result);
+        }
+    }
+
+    // Starts the task on the calling thread and returns at its first suspension point, nobody waits for it.
+    // Whatever it references has to outlive it
+    inline void detach(Task<void> task)
+    {
+        detail::runDetachedTask(std::move(task)).start();
+    }
+
+    // Reads whole files through the batched reader, resuming on the executor once all of them are in
+    struct ReadFilesAwaiter
+    {
+        TaskExecutor& executor;
+        std::vector<std::filesystem::path> paths;
+
+        std::vector<std::optional<std::vector<std::byte>>> files {};
+
+        [[nodiscard]] auto await_ready() const noexcept -> bool { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle);
+
+        auto await_resume() -> std::vector<std::optional<std::vector<std::byte>>> { return std::move(files); }
+    };
+
+    [[nodiscard]] inline auto readFiles(TaskExecutor& executor, std::vector<std::filesystem::path> paths)
+        -> ReadFilesAwaiter
+    {
+        return { executor, std::move(paths) };
+    }
+
+    // Resumes on a worker once the fence is signaled, neither the awaiting thread nor a worker blocks
+    auto waitForFence(TaskExecutor& executor, vk::Device device, vk::Fence fence) -> Task<vk::Result>;
+
+    // Submits the command buffer and finishes once the GPU executed it, anything the commands reference
+    // has to outlive the returned task
+    auto submitAndWait(TaskExecutor& executor, Device const& device, ScopedCommandBuffer cmdBuf)
+        -> Task<void>;
+}  // namespace renderer::backend
@@ -4,6 +4,7 @@
 #include "command.hpp"
 #include "image.hpp"
 #include "resource.hpp"
+#include "upload.hpp"
 
 namespace renderer::backend
 {
@@ -53,20 +54,18 @@ namespace renderer::backend
 
         Texture(ResourceHandle const& handle,
                 std::string const& name,
-                Device& device,
-                CommandManager& commandManager,
+                UploadManager& uploadManager,
                 ResourceManager<Image>& imageManager,
-                ResourceManager<GPUBuffer>& bufferManager,
                 StbiWrapper const& stbiImage);
 
+        // The upload is only queued, the returned texture is usable once the upload manager
+        // got to it (see `uploadToken`)
         Texture(ResourceHandle const& handle,
                 std::string const& name,
-                Device& device,
-                CommandManager& commandManager,
+                UploadManager& uploadManager,
                 ResourceManager<Image>& imageManager,
-                ResourceManager<GPUBuffer>& bufferManager,
                 vk::Extent2D dimensions,
-                void* data,
+                void const* data,
                 size_t dataSize);
 
     public:
@@ -83,6 +82,8 @@ namespace renderer::backend
         uint32_t mipLevels { 0 };
 
         ResourceAccessor<Image> image;
+
+        UploadToken uploadToken {};
     };
 
     template<>
@@ -114,6 +115,8 @@ namespace renderer::backend
 
         [[nodiscard]] auto getMipLevels() const -> uint32_t { return get().mipLevels; }
 
+        [[nodiscard]] auto getUploadToken() const -> UploadToken { return get().uploadToken; }
+
         [[nodiscard]] operator bool() const { return get().image; }
 
         [[nodiscard]] bool operator==(std::nullptr_t) const { return !get().image; }
@@ -124,21 +127,15 @@ namespace renderer::backend
     {
         friend class ResourceManagerBase<Texture>;
 
-        std::tuple<std::reference_wrapper<Device>,
-                   std::reference_wrapper<CommandManager>,
-                   std::reference_wrapper<ResourceManager<Image>>,
-                   std::reference_wrapper<ResourceManager<GPUBuffer>>>
+        std::tuple<std::reference_wrapper<UploadManager>, std::reference_wrapper<ResourceManager<Image>>>
             m_extraConstructionParams;
 
     public:
-        ResourceManager(Device& device,
-                        CommandManager& commandManager,
-                        ResourceManager<Image>& imageManager,
-                        ResourceManager<GPUBuffer>& bufferManager)
-            : m_extraConstructionParams { std::tie(device, commandManager, imageManager, bufferManager) } {};
-
-        ResourceManager(ResourceManager&&)            = default;
-        ResourceManager& operator=(ResourceManager&&) = default;
+        ResourceManager(UploadManager& uploadManager, ResourceManager<Image>& imageManager)
+            : m_extraConstructionParams { std::tie(uploadManager, imageManager) } {};
+
+        ResourceManager(ResourceManager&&)            = delete;
+        ResourceManager& operator=(ResourceManager&&) = delete;
 
         ResourceManager(ResourceManager const&)            = delete;
         ResourceManager& operator=(ResourceManager const&) = delete;
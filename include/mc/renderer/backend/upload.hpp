@@ -0,0 +1,194 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "device.hpp"
+#include "task.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // Completion of an upload, a value of the upload manager's timeline semaphore
+    struct UploadToken
+    {
+        uint64_t value { 0 };
+
+        // The default token has nothing to wait for
+        explicit operator bool() const { return value != 0; }
+    };
+
+    // Uploads go through a persistently mapped staging ring and get recorded into batches that are submitted
+    // on the transfer queue. Every batch signals the next value of a timeline semaphore.
+    //
+    // Resources written by an upload belong to the transfer queue family until the main queue acquires them,
+    // the renderer records those barriers at the start of every frame through `recordAcquireBarriers`
+    class UploadManager
+    {
+    public:
+        UploadManager() = default;
+
+        UploadManager(Device& device, ResourceManager<GPUBuffer>& bufferManager);
+
+        ~UploadManager();
+
+        UploadManager(UploadManager const&)            = delete;
+        UploadManager& operator=(UploadManager const&) = delete;
+
+        UploadManager(UploadManager&&)            = delete;
+        UploadManager& operator=(UploadManager&&) = delete;
+
+        // `data` is copied before this returns
+        auto uploadBuffer(vk::Buffer dst, std::span<std::byte const> data, vk::DeviceSize dstOffset = 0)
+            -> UploadToken;
+
+        // Writes straight into the buffer when it is host visible (see `kDirectUploadAllocFlags`),
+        // the returned token has nothing to wait for then. Stages the data like the overload above otherwise
+        auto uploadBuffer(ResourceAccessor<GPUBuffer> const& dst,
+                          std::span<std::byte const> data,
+                          vk::DeviceSize dstOffset = 0) -> UploadToken;
+
+        // The copy regions are relative to the start of `data`, every mip level of the image ends up
+        // in eShaderReadOnlyOptimal
+        auto uploadImage(vk::Image dst,
+                         std::span<std::byte const> data,
+                         std::span<vk::BufferImageCopy const> regions) -> UploadToken;
+
+        // Only uploads the first level, the remaining ones of the `mipLevels` are blitted from it on the main
+        // queue right after the frame's acquire barriers. The format has to support linear filtering in blits
+        auto uploadImageMipChain(vk::Image dst,
+                                 vk::Extent2D dimensions,
+                                 uint32_t mipLevels,
+                                 std::span<std::byte const> data) -> UploadToken;
+
+        // Submits everything recorded so far, uploads are otherwise only submitted once per frame or when
+        // the staging ring runs out of space
+        auto flush() -> UploadToken;
+
+        [[nodiscard]] auto isComplete(UploadToken token) const -> bool;
+
+        // The upload completed and a frame recorded its acquire barriers, anything submitted after that
+        // frame can use the resource
+        [[nodiscard]] auto isAcquired(UploadToken token) const -> bool
+        {
+            return token.value <= m_acquiredValue.load(std::memory_order_acquire);
+        }
+
+        // Nothing recording, in flight or waiting for the main queue to acquire it.
+        // Doesn't block, a manager that is busy on another thread just isn't idle
+        [[nodiscard]] auto isIdle() -> bool;
+
+        // Blocks the calling thread, submits the batch containing the upload if it is still recording
+        void wait(UploadToken token);
+
+        // Same as `wait`, but the executor's waiter thread waits instead of the calling thread
+        auto waitAsync(TaskExecutor& executor, UploadToken token) -> Task<void>;
+
+        // Called by the render loop once per frame, never blocks on uploads in progress
+        void beginFrame();
+
+        // Records the acquiring half of the ownership transfers of every upload that completed so far,
+        // followed by the generation of their mip chains. The frame's submission has to wait on the returned
+        // token
+        auto recordAcquireBarriers(vk::CommandBuffer cmdBuf) -> UploadToken;
+
+        [[nodiscard]] auto getSemaphore() const -> vk::Semaphore { return m_timeline; }
+
+    private:
+        // An image whose levels below the first still have to be generated by the main queue
+        struct MipChain
+        {
+            vk::Image image;
+            vk::Extent2D dimensions;
+            uint32_t mipLevels;
+        };
+
+        struct Batch
+        {
+            vk::raii::CommandBuffer cmdBuf { nullptr };
+
+            uint64_t value { 0 };
+
+            // Where the ring's head was after the last allocation of this batch, the tail moves there once
+            // the batch completed
+            uint64_t ringEnd { 0 };
+
+            // Uploads larger than the whole ring get a staging buffer of their own
+            std::vector<ResourceAccessor<GPUBuffer>> dedicatedStaging;
+
+            // Recorded right before the batch is submitted, these release ownership to the main queue family
+            std::vector<vk::BufferMemoryBarrier2> bufferTransfers;
+            std::vector<vk::ImageMemoryBarrier2> imageTransfers;
+
+            std::vector<MipChain> mipChains;
+        };
+
+        struct Staging
+        {
+            vk::Buffer buffer;
+            vk::DeviceSize offset;
+        };
+
+        // Copies `data` into the ring (or a dedicated buffer) and returns where it ended up,
+        // may submit the current batch and wait for older ones to free up space
+        auto stage(std::unique_lock<std::mutex>& lock, std::span<std::byte const> data) -> Staging;
+
+        auto getCurrentBatch() -> Batch&;
+
+        // Submits the batch containing the upload if it is still recording
+        void submitUpTo(UploadToken token);
+
+        void submitCurrentBatch();
+
+        void retireCompletedBatches();
+
+        // Every level below the first goes from undefined to eShaderReadOnlyOptimal
+        static void recordMipChains(vk::CommandBuffer cmdBuf, std::span<MipChain const> mipChains);
+
+        [[nodiscard]] auto getCompletedValue() const -> uint64_t;
+
+        Device* m_device { nullptr };
+        ResourceManager<GPUBuffer>* m_bufferManager { nullptr };
+
+        ResourceAccessor<GPUBuffer> m_stagingRing;
+        std::byte* m_ringData { nullptr };
+
+        // Monotonic positions, the physical offset is the position modulo the ring size
+        uint64_t m_ringHead { 0 };
+        uint64_t m_ringTail { 0 };
+
+        // False when the transfer and main queues come from the same family, no ownership transfer then
+        bool m_transferOwnership { false };
+        uint32_t m_transferFamily { 0 };
+        uint32_t m_mainFamily { 0 };
+
+        vk::raii::CommandPool m_commandPool { nullptr };
+        vk::raii::Semaphore m_timeline { nullptr };
+
+        std::optional<Batch> m_currentBatch;
+        std::deque<Batch> m_inFlight;
+
+        uint64_t m_nextValue { 1 };
+        uint64_t m_lastSubmittedValue { 0 };
+
+        std::mutex m_mutex;
+
+        // Completed batches hand their acquire barriers over to the render loop,
+        // this has its own lock so recording them never waits on an upload in progress
+        std::vector<vk::BufferMemoryBarrier2> m_readyBufferAcquires;
+        std::vector<vk::ImageMemoryBarrier2> m_readyImageAcquires;
+        std::vector<MipChain> m_readyMipChains;
+        uint64_t m_readyValue { 0 };
+        std::mutex m_acquireMutex;
+
+        // Highest value handed out by `recordAcquireBarriers`, batches complete in order
+        std::atomic<uint64_t> m_acquiredValue { 0 };
+    };
+}  // namespace renderer::backend
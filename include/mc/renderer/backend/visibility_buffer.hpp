@@ -0,0 +1,51 @@
+#pragma once
+
+#include "descriptor.hpp"
+#include "device.hpp"
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace renderer::backend
+{
+    // IDs of the nearest opaque or masked triangle of every sample, rendered instead of shading each draw.
+    // A texel holds the primitive index plus one, zero where nothing was drawn, and the triangle within
+    // the primitive's draw. The material resolve fetches them through `getDescriptorSet`, so shading only
+    // runs once per covered pixel no matter how much overdraw there was. The image itself is a transient
+    // of the render graph
+    class VisibilityBuffer
+    {
+    public:
+        static constexpr vk::Format kFormat = vk::Format::eR32G32Uint;
+
+        VisibilityBuffer() = default;
+
+        explicit VisibilityBuffer(Device& device);
+
+        VisibilityBuffer(VisibilityBuffer const&)            = delete;
+        VisibilityBuffer& operator=(VisibilityBuffer const&) = delete;
+
+        VisibilityBuffer(VisibilityBuffer&&)            = delete;
+        VisibilityBuffer& operator=(VisibilityBuffer&&) = delete;
+
+        // Points the descriptor set at a new image, the old set is freed right away, so the device has to be
+        // idle
+        void setImageView(vk::ImageView view);
+
+        // A single multisampled image, sampled in the shader read-only layout
+        [[nodiscard]] auto getDescriptorLayout() const -> vk::DescriptorSetLayout
+        {
+            return m_descriptorLayout;
+        }
+
+        [[nodiscard]] auto getDescriptorSet() const -> vk::DescriptorSet { return m_descriptorSet; }
+
+    private:
+        Device* m_device { nullptr };
+
+        vk::raii::Sampler m_sampler { nullptr };
+
+        vk::raii::DescriptorSetLayout m_descriptorLayout { nullptr };
+        DescriptorAllocator m_descriptorAllocator;
+        vk::DescriptorSet m_descriptorSet { nullptr };
+    };
+}  // namespace renderer::backend
@@ -17,9 +17,11 @@ namespace renderer
         void onRender(AppRenderEvent const& /* unused */);
         void onUpdate(AppUpdateEvent const& event);
         void onKeyPress(KeyPressEvent const& event);
+        void onMouseButton(MouseButtonEvent const& event);
         void onFramebufferResize(WindowFramebufferResizeEvent const& event);
 
     private:
+        window::Window& m_window;
         Camera& m_camera;
 
         backend::RendererBackend m_backend;
@@ -84,6 +84,8 @@ namespace window
 
         void toggleCursor() { m_cursorDisabled ? enableCursor() : disableCursor(); }
 
+        [[nodiscard]] auto isCursorDisabled() const -> bool { return m_cursorDisabled; }
+
         auto getRefreshRate() const -> uint32_t { return m_refreshRate; }
 
     private:
@@ -1,17 +1,23 @@
 #extension GL_EXT_buffer_reference : require
-#extension GL_EXT_scalar_block_layout : require
 
-uint MaterialFeatures_ColorTexture     = 1 << 0;
-uint MaterialFeatures_NormalTexture    = 1 << 1;
-uint MaterialFeatures_RoughnessTexture = 1 << 2;
-uint MaterialFeatures_OcclusionTexture = 1 << 3;
-uint MaterialFeatures_EmissiveTexture =  1 << 4;
-uint MaterialFeatures_TangentVertexAttribute = 1 << 5;
-uint MaterialFeatures_TexcoordVertexAttribute = 1 << 6;
+const uint MaterialFeatures_ColorTexture            = 1u << 0;
+const uint MaterialFeatures_NormalTexture           = 1u << 1;
+const uint MaterialFeatures_RoughnessTexture        = 1u << 2;
+const uint MaterialFeatures_OcclusionTexture        = 1u << 3;
+const uint MaterialFeatures_EmissiveTexture         = 1u << 4;
+const uint MaterialFeatures_TangentVertexAttribute  = 1u << 5;
+const uint MaterialFeatures_TexcoordVertexAttribute = 1u << 6;
+// Occlusion lives in the red channel of the metallic/roughness texture
+const uint MaterialFeatures_PackedOcclusion         = 1u << 7;
+// Two channel normal map, z is reconstructed in the shader
+const uint MaterialFeatures_NormalTextureBC5        = 1u << 8;
 
 struct Primitive {
     mat4 matrix;
+    vec3 boundsMin;
     uint materialIndex;
+    vec3 boundsMax;
+    uint firstIndex;
 };
 
 struct Vertex {
@@ -51,12 +57,28 @@ struct Material {
     float alphaMaskCutoff;
 
     int flags;
+
+    uint colorTextureIndex;
+    uint physicalDescriptorTextureIndex;
+    uint occlusionTextureIndex;
+    uint emissiveTextureIndex;
+    uint normalTextureIndex;
 };
 
 layout(buffer_reference, std430) readonly buffer VertexBuffer {
 	Vertex vertices[];
 };
 
+// Just the positions of `VertexBuffer`, tightly packed for depth only passes. A vec3 array would be padded
+// to 16 bytes under std430, so the components are read one by one, see `loadPosition`
+layout(buffer_reference, std430) readonly buffer PositionBuffer {
+	float positions[];
+};
+
+layout(buffer_reference, std430) readonly buffer IndexBuffer {
+	uint indices[];
+};
+
 layout(buffer_reference, std430) readonly buffer MaterialBuffer {
 	Material materials[];
 };
@@ -68,10 +90,19 @@ layout(buffer_reference, std430) readonly buffer PrimitiveBuffer {
 layout(push_constant) uniform PushConstants
 {
     VertexBuffer vertexBuffer;
+    PositionBuffer positionBuffer;
     MaterialBuffer materialBuffer;
     PrimitiveBuffer primitiveBuffer;
+    // Only read by the visibility resolve, the draws bind it as their index buffer
+    IndexBuffer indexBuffer;
 };
 
+vec3 loadPosition(uint vertexIndex) {
+    return vec3(positionBuffer.positions[vertexIndex * 3],
+                positionBuffer.positions[vertexIndex * 3 + 1],
+                positionBuffer.positions[vertexIndex * 3 + 2]);
+}
+
 layout(set = 0, binding = 0) uniform SceneData {
     mat4 view;
     mat4 proj;
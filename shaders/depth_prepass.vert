@@ -0,0 +1,14 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.glsl"
+
+// Has to match vs.vert exactly, the main pass after this one only shades fragments of equal depth
+invariant gl_Position;
+
+void main() {
+    Primitive primitive = primitiveBuffer.primitives[gl_InstanceIndex];
+
+    gl_Position = scene.viewProj * primitive.matrix * vec4(loadPosition(uint(gl_VertexIndex)), 1.0);
+}
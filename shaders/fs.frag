@@ -4,8 +4,7 @@
 #extension GL_EXT_nonuniform_qualifier : enable
 
 #include "common.glsl"
-
-layout (set = 1, binding = 0) uniform sampler2D textures[];
+#include "shading.glsl"
 
 layout (location = 0) in vec2 vTexcoord0;
 layout (location = 1) in vec2 vTexcoord1;
@@ -33,25 +32,24 @@ void main() {
 
     Material material = materialBuffer.materials[primitive.materialIndex];
 
-    vec4 diffSample     = texture(textures[nonuniformEXT((primitive.materialIndex * 5) + 0)],
-                                  material.colorTextureSet > 0 ? vTexcoord1 : vTexcoord0);
-
-    vec3 metRoughSample = texture(textures[nonuniformEXT((primitive.materialIndex * 5) + 1)],
-                                  material.physicalDescriptorTextureSet > 0 ? vTexcoord1 : vTexcoord0).rgb;
-
-    vec4 occlSample     = texture(textures[nonuniformEXT((primitive.materialIndex * 5) + 2)],
-                                  material.occlusionTextureSet > 0 ? vTexcoord1 : vTexcoord0);
-
-    vec4 emisSample     = texture(textures[nonuniformEXT((primitive.materialIndex * 5) + 3)],
-                                  material.emissiveTextureSet > 0 ? vTexcoord1 : vTexcoord0);
-
-    vec3 normalSample   = texture(textures[nonuniformEXT((primitive.materialIndex * 5) + 4)],
-                                  material.normalTextureSet > 0 ? vTexcoord1 : vTexcoord0).rgb;
-
-    frag_color = diffSample;
-
-    if (material.colorTextureSet != -1) {
-        frag_color *= material.baseColorFactor;
+    // The gradients are taken before anything could be discarded
+    SurfaceInputs surface = SurfaceInputs(vTexcoord0,
+                                          dFdx(vTexcoord0),
+                                          dFdy(vTexcoord0),
+                                          vTexcoord1,
+                                          dFdx(vTexcoord1),
+                                          dFdy(vTexcoord1),
+                                          vNormal,
+                                          vTangent);
+
+    vec4 baseColor = sampleBaseColor(material, surface);
+
+#ifdef ALPHA_TEST
+    // Only compiled into the masked buckets' pipelines, discarding anywhere else would cost early depth tests
+    if (baseColor.a < material.alphaMaskCutoff) {
+        discard;
     }
-}
+#endif
 
+    frag_color = shadeSurface(material, surface, baseColor);
+}
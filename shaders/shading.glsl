@@ -0,0 +1,60 @@
+// Material evaluation of the forward and the visibility buffer paths. Needs common.glsl included before it,
+// nested includes aren't supported, and GL_EXT_nonuniform_qualifier enabled
+
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+// The texture coordinates come with their screen space gradients, the visibility resolve has no
+// neighbouring fragments to derive them from
+struct SurfaceInputs {
+    vec2 texcoord0;
+    vec2 texcoord0Ddx;
+    vec2 texcoord0Ddy;
+    vec2 texcoord1;
+    vec2 texcoord1Ddx;
+    vec2 texcoord1Ddy;
+    vec3 normal;
+    vec4 tangent;
+};
+
+bool hasFeature(Material material, uint feature) {
+    return (uint(material.flags) & feature) != 0;
+}
+
+vec4 sampleMaterialTexture(uint textureIndex, int textureSet, SurfaceInputs surface) {
+    if (textureSet > 0) {
+        return textureGrad(textures[nonuniformEXT(textureIndex)],
+                           surface.texcoord1, surface.texcoord1Ddx, surface.texcoord1Ddy);
+    }
+
+    return textureGrad(textures[nonuniformEXT(textureIndex)],
+                       surface.texcoord0, surface.texcoord0Ddx, surface.texcoord0Ddy);
+}
+
+vec4 sampleBaseColor(Material material, SurfaceInputs surface) {
+    vec4 baseColor = material.baseColorFactor;
+
+    if (hasFeature(material, MaterialFeatures_ColorTexture)) {
+        baseColor *= sampleMaterialTexture(material.colorTextureIndex, material.colorTextureSet, surface);
+    }
+
+    return baseColor;
+}
+
+// Tangent space normal of the material's normal map, BC5 ones only store x and y
+vec3 sampleTangentNormal(Material material, SurfaceInputs surface) {
+    vec3 normalSample = sampleMaterialTexture(material.normalTextureIndex,
+                                              material.normalTextureSet, surface).rgb;
+
+    if (hasFeature(material, MaterialFeatures_NormalTextureBC5)) {
+        vec2 xy = normalSample.rg * 2.0 - 1.0;
+
+        return vec3(xy, sqrt(clamp(1.0 - dot(xy, xy), 0.0, 1.0)));
+    }
+
+    return normalSample * 2.0 - 1.0;
+}
+
+// Unlit, the surface is its base color
+vec4 shadeSurface(Material material, SurfaceInputs surface, vec4 baseColor) {
+    return baseColor;
+}
@@ -0,0 +1,41 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : enable
+
+#include "common.glsl"
+
+#ifdef ALPHA_TEST
+#include "shading.glsl"
+
+layout (location = 0) in vec2 vTexcoord0;
+layout (location = 1) in vec2 vTexcoord1;
+#endif
+
+layout (location = 2) in flat uint vPrimitiveIndex;
+
+// See VisibilityBuffer
+layout (location = 0) out uvec2 ids;
+
+void main() {
+#ifdef ALPHA_TEST
+    Primitive primitive = primitiveBuffer.primitives[vPrimitiveIndex];
+
+    Material material = materialBuffer.materials[primitive.materialIndex];
+
+    // Only the coverage is needed here, the resolve shades what's left
+    SurfaceInputs surface;
+    surface.texcoord0    = vTexcoord0;
+    surface.texcoord0Ddx = dFdx(vTexcoord0);
+    surface.texcoord0Ddy = dFdy(vTexcoord0);
+    surface.texcoord1    = vTexcoord1;
+    surface.texcoord1Ddx = dFdx(vTexcoord1);
+    surface.texcoord1Ddy = dFdy(vTexcoord1);
+
+    if (sampleBaseColor(material, surface).a < material.alphaMaskCutoff) {
+        discard;
+    }
+#endif
+
+    ids = uvec2(vPrimitiveIndex + 1, gl_PrimitiveID);
+}
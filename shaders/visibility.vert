@@ -0,0 +1,33 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.glsl"
+
+#ifdef ALPHA_TEST
+layout (location = 0) out vec2 vTexcoord0;
+layout (location = 1) out vec2 vTexcoord1;
+#endif
+
+layout (location = 2) out flat uint vPrimitiveIndex;
+
+// Same depth as vs.vert, the blended draws are tested against it
+invariant gl_Position;
+
+void main() {
+    Primitive primitive = primitiveBuffer.primitives[gl_InstanceIndex];
+
+    // Only the masked draws need more than the position
+#ifdef ALPHA_TEST
+    Vertex vertex = vertexBuffer.vertices[gl_VertexIndex];
+
+    gl_Position = scene.viewProj * primitive.matrix * vec4(vertex.pos, 1.0);
+
+    vTexcoord0 = vertex.uv0;
+    vTexcoord1 = vertex.uv1;
+#else
+    gl_Position = scene.viewProj * primitive.matrix * vec4(loadPosition(uint(gl_VertexIndex)), 1.0);
+#endif
+
+    vPrimitiveIndex = gl_InstanceIndex;
+}
@@ -0,0 +1,137 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : enable
+
+#include "common.glsl"
+#include "shading.glsl"
+
+// Primitive index plus one and triangle of every sample, see VisibilityBuffer
+layout (set = 2, binding = 0) uniform usampler2DMS visibilityBuffer;
+
+layout (location = 0) out vec4 frag_color;
+
+// Perspective correct, with how much they change one pixel to the right and one pixel down
+struct Barycentrics {
+    vec3 lambda;
+    vec3 ddx;
+    vec3 ddy;
+};
+
+Barycentrics computeBarycentrics(vec4 clip0, vec4 clip1, vec4 clip2, vec2 ndc, vec2 ndcPerPixel) {
+    vec3 invW = 1.0 / vec3(clip0.w, clip1.w, clip2.w);
+
+    vec2 ndc0 = clip0.xy * invW.x;
+    vec2 ndc1 = clip1.xy * invW.y;
+    vec2 ndc2 = clip2.xy * invW.z;
+
+    // Gradients of the screen space barycentrics, each divided by its vertex's w so that interpolating
+    // them gives the numerators of the perspective correct ones
+    float invDet = 1.0 / determinant(mat2(ndc2 - ndc1, ndc0 - ndc1));
+
+    vec3 ddx = vec3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * invDet * invW;
+    vec3 ddy = vec3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * invDet * invW;
+
+    float ddxSum = ddx.x + ddx.y + ddx.z;
+    float ddySum = ddy.x + ddy.y + ddy.z;
+
+    vec2 delta = ndc - ndc0;
+
+    vec3 numerator   = vec3(invW.x, 0.0, 0.0) + delta.x * ddx + delta.y * ddy;
+    float interpInvW = invW.x + delta.x * ddxSum + delta.y * ddySum;
+
+    Barycentrics result;
+    result.lambda = numerator / interpInvW;
+
+    ddx    *= ndcPerPixel.x;
+    ddy    *= ndcPerPixel.y;
+    ddxSum *= ndcPerPixel.x;
+    ddySum *= ndcPerPixel.y;
+
+    result.ddx = (numerator + ddx) / (interpInvW + ddxSum) - result.lambda;
+    result.ddy = (numerator + ddy) / (interpInvW + ddySum) - result.lambda;
+
+    return result;
+}
+
+// The same material evaluation as fs.frag, with the attributes interpolated by hand
+vec4 shadeTriangle(uvec2 ids, vec2 ndc, vec2 ndcPerPixel) {
+    Primitive primitive = primitiveBuffer.primitives[ids.x - 1];
+
+    Material material = materialBuffer.materials[primitive.materialIndex];
+
+    uint firstIndex = primitive.firstIndex + ids.y * 3;
+
+    Vertex v0 = vertexBuffer.vertices[indexBuffer.indices[firstIndex]];
+    Vertex v1 = vertexBuffer.vertices[indexBuffer.indices[firstIndex + 1]];
+    Vertex v2 = vertexBuffer.vertices[indexBuffer.indices[firstIndex + 2]];
+
+    mat4 modelViewProj = scene.viewProj * primitive.matrix;
+
+    Barycentrics barycentrics = computeBarycentrics(modelViewProj * vec4(v0.pos, 1.0),
+                                                    modelViewProj * vec4(v1.pos, 1.0),
+                                                    modelViewProj * vec4(v2.pos, 1.0),
+                                                    ndc,
+                                                    ndcPerPixel);
+
+    mat3x2 texcoords0 = mat3x2(v0.uv0, v1.uv0, v2.uv0);
+    mat3x2 texcoords1 = mat3x2(v0.uv1, v1.uv1, v2.uv1);
+
+    vec3 normal  = mat3(v0.normal, v1.normal, v2.normal) * barycentrics.lambda;
+    vec3 tangent = mat3(v0.tangent.xyz, v1.tangent.xyz, v2.tangent.xyz) * barycentrics.lambda;
+
+    SurfaceInputs surface;
+    surface.texcoord0    = texcoords0 * barycentrics.lambda;
+    surface.texcoord0Ddx = texcoords0 * barycentrics.ddx;
+    surface.texcoord0Ddy = texcoords0 * barycentrics.ddy;
+    surface.texcoord1    = texcoords1 * barycentrics.lambda;
+    surface.texcoord1Ddx = texcoords1 * barycentrics.ddx;
+    surface.texcoord1Ddy = texcoords1 * barycentrics.ddy;
+    surface.normal       = normal;
+    surface.tangent      = vec4(tangent, v0.tangent.w);
+
+    return shadeSurface(material, surface, sampleBaseColor(material, surface));
+}
+
+void main() {
+    vec2 screenSize  = vec2(scene.screenWidth, scene.screenHeight);
+    vec2 ndc         = gl_FragCoord.xy / screenSize * 2.0 - 1.0;
+    vec2 ndcPerPixel = 2.0 / screenSize;
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    vec4 color       = vec4(0.0);
+    uint coverage    = 0;
+    uint numCovered  = 0;
+    uvec2 shadedIds  = uvec2(0);
+    vec4 shadedColor = vec4(0.0);
+
+    // Samples of the same triangle share its shading, only pixels on edges shade more than once. Every
+    // triangle is shaded at the pixel center
+    for (int i = 0; i < textureSamples(visibilityBuffer); ++i) {
+        uvec2 ids = texelFetch(visibilityBuffer, pixel, i).xy;
+
+        if (ids.x == 0) {
+            continue;
+        }
+
+        if (ids != shadedIds) {
+            shadedIds   = ids;
+            shadedColor = shadeTriangle(ids, ndc, ndcPerPixel);
+        }
+
+        color    += shadedColor;
+        coverage |= 1u << i;
+        ++numCovered;
+    }
+
+    // Nothing was drawn here, the clear color stays
+    if (numCovered == 0) {
+        discard;
+    }
+
+    // Uncovered samples keep the clear color, so resolving the draw image blends it into the edges
+    gl_SampleMask[0] = int(coverage);
+
+    frag_color = color / float(numCovered);
+}
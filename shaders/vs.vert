@@ -12,9 +12,12 @@ layout (location = 4) out vec4 vPosition;
 layout (location = 5) out vec4 vColor;
 layout (location = 6) out flat uint vPrimitiveIndex;
 
+// The depth pre-pass computes the same position, the main pass then only shades equal depths
+invariant gl_Position;
+
 void main() {
     Vertex vertex = vertexBuffer.vertices[gl_VertexIndex];
-    Primitive primitive = primitiveBuffer.primitives[gl_DrawID];
+    Primitive primitive = primitiveBuffer.primitives[gl_InstanceIndex];
 
     gl_Position = scene.viewProj * primitive.matrix * vec4(vertex.pos, 1.0);
 
@@ -25,5 +28,5 @@ void main() {
     vTexcoord1 = vertex.uv1;
     vTangent = vertex.tangent;
 
-    vPrimitiveIndex = gl_DrawID;
+    vPrimitiveIndex = gl_InstanceIndex;
 }
@@ -0,0 +1,104 @@
+#include <mc/arena.hpp>
+#include <mc/asserts.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+namespace memory
+{
+    Arena::Arena(size_t blockSize) : m_blockSize { blockSize } {}
+
+    void Arena::rewind(Marker marker)
+    {
+        MC_ASSERT(marker.block < m_blocks.size() || (marker.block == 0 && marker.offset == 0));
+        MC_ASSERT(marker.block < m_current || (marker.block == m_current && marker.offset <= m_offset));
+
+        m_current = marker.block;
+        m_offset  = marker.offset;
+    }
+
+    void Arena::release()
+    {
+        m_blocks.clear();
+
+        m_current = 0;
+        m_offset  = 0;
+    }
+
+    auto Arena::getUsedSize() const -> size_t
+    {
+        size_t used = m_offset;
+
+        for (size_t i = 0; i < m_current; ++i)
+        {
+            used += m_blocks[i].size;
+        }
+
+        return used;
+    }
+
+    auto Arena::getCapacity() const -> size_t
+    {
+        size_t capacity = 0;
+
+        for (Block const& block : m_blocks)
+        {
+            capacity += block.size;
+        }
+
+        return capacity;
+    }
+
+    auto Arena::getThreadScratch() -> Arena&
+    {
+        thread_local Arena scratch;
+
+        return scratch;
+    }
+
+    auto Arena::do_allocate(size_t bytes, size_t alignment) -> void*
+    {
+        MC_ASSERT(std::has_single_bit(alignment));
+
+        auto alignedOffset = [&](Block const& block, size_t offset) -> size_t
+        {
+            auto const address = reinterpret_cast<uintptr_t>(block.data.get()) + offset;
+
+            return offset + ((alignment - address % alignment) % alignment);
+        };
+
+        if (m_current < m_blocks.size())
+        {
+            if (size_t const offset = alignedOffset(m_blocks[m_current], m_offset);
+                offset + bytes <= m_blocks[m_current].size)
+            {
+                m_offset = offset + bytes;
+
+                return m_blocks[m_current].data.get() + offset;
+            }
+
+            ++m_current;
+        }
+
+        // Blocks left over from before a rewind are reused when they are big enough, anything in between
+        // that is too small gets a bigger block inserted in front of it
+        if (m_current == m_blocks.size() ||
+            alignedOffset(m_blocks[m_current], 0) + bytes > m_blocks[m_current].size)
+        {
+            size_t const size = std::max(m_blockSize, bytes + alignment);
+
+            m_blocks.insert(m_blocks.begin() + static_cast<ptrdiff_t>(m_current),
+                            Block {
+                                .data = std::make_unique_for_overwrite<std::byte[]>(size),
+                                .size = size,
+                            });
+        }
+
+        size_t const offset = alignedOffset(m_blocks[m_current], 0);
+
+        m_offset = offset + bytes;
+
+        return m_blocks[m_current].data.get() + offset;
+    }
+}  // namespace memory
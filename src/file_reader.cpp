@@ -0,0 +1,534 @@
+#include <mc/asserts.hpp>
+#include <mc/file_reader.hpp>
+#include <mc/logger.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <thread>
+
+#if MC_HAS_IO_URING
+#    include <fcntl.h>
+#    include <linux/io_uring.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+namespace io
+{
+    FileReader::FileReader()
+    {
+#if MC_HAS_IO_URING
+        if (setupRing())
+        {
+            logger::debug("File reader is using io_uring ({} entries)", m_ring.numEntries);
+
+            m_workers.emplace_back([this](std::stop_token stopToken) { ringWorker(stopToken); });
+
+            return;
+        }
+#endif
+
+        logger::debug("File reader is using {} blocking threads", kNumFallbackThreads);
+
+        for (uint32_t i = 0; i < kNumFallbackThreads; ++i)
+        {
+            m_workers.emplace_back([this](std::stop_token stopToken) { fallbackWorker(stopToken); });
+        }
+    }
+
+    FileReader::~FileReader()
+    {
+        // Workers drain whatever is still queued before they exit
+        for (std::jthread& worker : m_workers)
+        {
+            worker.request_stop();
+        }
+
+        m_workers.clear();
+
+        destroyRing();
+    }
+
+    auto FileReader::get() -> FileReader&
+    {
+        static FileReader reader;
+
+        return reader;
+    }
+
+    void FileReader::readAsync(std::vector<ReadRequest> requests, ReadCallback callback)
+    {
+        if (requests.empty())
+        {
+            if (callback)
+            {
+                callback({});
+            }
+
+            return;
+        }
+
+        auto* batch = new Batch;
+
+        batch->requests = std::move(requests);
+        batch->callback = std::move(callback);
+        batch->results.resize(batch->requests.size());
+        batch->operations.resize(batch->requests.size());
+        batch->remaining = batch->requests.size();
+
+        {
+            std::lock_guard lock(m_mutex);
+
+            for (size_t i = 0; i < batch->operations.size(); ++i)
+            {
+                batch->operations[i].batch = batch;
+                batch->operations[i].index = i;
+
+                m_pending.push_back(&batch->operations[i]);
+            }
+        }
+
+        m_pendingCondition.notify_all();
+    }
+
+    auto FileReader::read(std::vector<ReadRequest> requests) -> std::vector<ReadResult>
+    {
+        std::promise<std::vector<ReadResult>> promise;
+
+        auto future = promise.get_future();
+
+        readAsync(std::move(requests),
+                  [&promise](std::span<ReadResult const> results)
+                  {
+                      promise.set_value({ results.begin(), results.end() });
+                  });
+
+        return future.get();
+    }
+
+    void FileReader::readFilesAsync(std::vector<std::filesystem::path> paths, FilesCallback callback)
+    {
+        struct PendingFiles
+        {
+            std::vector<std::optional<std::vector<std::byte>>> files;
+            std::vector<size_t> requestFiles;
+            FilesCallback callback;
+        };
+
+        auto pending = std::make_shared<PendingFiles>();
+
+        pending->files.resize(paths.size());
+        pending->callback = std::move(callback);
+
+        std::vector<ReadRequest> requests;
+
+        requests.reserve(paths.size());
+        pending->requestFiles.reserve(paths.size());
+
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            std::error_code error;
+
+            auto const fileSize = std::filesystem::file_size(paths[i], error);
+
+            if (error)
+            {
+                continue;
+            }
+
+            pending->files[i].emplace(fileSize);
+
+            requests.push_back({ .path = std::move(paths[i]), .destination = *pending->files[i] });
+            pending->requestFiles.push_back(i);
+        }
+
+        readAsync(std::move(requests),
+                  [pending](std::span<ReadResult const> results)
+                  {
+                      for (size_t i = 0; i < results.size(); ++i)
+                      {
+                          std::optional<std::vector<std::byte>>& file =
+                              pending->files[pending->requestFiles[i]];
+
+                          if (results[i])
+                          {
+                              file->resize(results[i].bytesRead);
+                          }
+                          else
+                          {
+                              file.reset();
+                          }
+                      }
+
+                      pending->callback(std::move(pending->files));
+                  });
+    }
+
+    auto FileReader::readFiles(std::span<std::filesystem::path const> paths)
+        -> std::vector<std::optional<std::vector<std::byte>>>
+    {
+        std::promise<std::vector<std::optional<std::vector<std::byte>>>> promise;
+
+        auto future = promise.get_future();
+
+        readFilesAsync({ paths.begin(), paths.end() },
+                       [&promise](std::vector<std::optional<std::vector<std::byte>>> files)
+                       {
+                           promise.set_value(std::move(files));
+                       });
+
+        return future.get();
+    }
+
+    auto FileReader::readFile(std::filesystem::path const& path) -> std::optional<std::vector<std::byte>>
+    {
+        return std::move(readFiles({ &path, 1 })[0]);
+    }
+
+    void FileReader::completeOperation(Operation& operation, int error)
+    {
+#if MC_HAS_IO_URING
+        if (operation.fd >= 0)
+        {
+            close(operation.fd);
+        }
+#endif
+
+        Batch* batch = operation.batch;
+
+        batch->results[operation.index] = { .bytesRead = operation.bytesRead, .error = error };
+
+        if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::unique_ptr<Batch> finished { batch };
+
+            if (finished->callback)
+            {
+                finished->callback(finished->results);
+            }
+        }
+    }
+
+    void FileReader::fallbackWorker(std::stop_token stopToken)
+    {
+        while (true)
+        {
+            Operation* operation = nullptr;
+
+            {
+                std::unique_lock lock(m_mutex);
+
+                if (!m_pendingCondition.wait(lock, stopToken, [this] { return !m_pending.empty(); }))
+                {
+                    return;
+                }
+
+                operation = m_pending.front();
+                m_pending.pop_front();
+            }
+
+            ReadRequest const& request = operation->batch->requests[operation->index];
+
+            std::ifstream file(request.path, std::ios::binary);
+
+            if (!file.is_open())
+            {
+                completeOperation(*operation, ENOENT);
+
+                continue;
+            }
+
+            file.seekg(static_cast<std::streamoff>(request.offset));
+            file.read(reinterpret_cast<char*>(request.destination.data()),
+                      static_cast<std::streamsize>(request.destination.size()));
+
+            operation->bytesRead = static_cast<size_t>(file.gcount());
+
+            completeOperation(*operation, file.bad() ? EIO : 0);
+        }
+    }
+
+#if MC_HAS_IO_URING
+    auto FileReader::setupRing() -> bool
+    {
+        io_uring_params params {};
+
+        m_ring.fd = static_cast<int>(syscall(__NR_io_uring_setup, kQueueDepth, &params));
+
+        if (m_ring.fd < 0)
+        {
+            logger::warn("io_uring is unavailable ({}), falling back to blocking reads",
+                         std::strerror(errno));
+
+            return false;
+        }
+
+        auto map = [this](size_t size, off_t offset) -> void*
+        {
+            void* memory =
+                mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring.fd, offset);
+
+            return memory == MAP_FAILED ? nullptr : memory;
+        };
+
+        m_ring.numEntries = params.sq_entries;
+
+        m_ring.submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        m_ring.completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        // Since 5.4 both rings live in the same mapping
+        bool const singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+
+        if (singleMapping)
+        {
+            m_ring.submissionRingSize = std::max(m_ring.submissionRingSize, m_ring.completionRingSize);
+            m_ring.completionRingSize = m_ring.submissionRingSize;
+        }
+
+        m_ring.submissionRing = map(m_ring.submissionRingSize, IORING_OFF_SQ_RING);
+        m_ring.completionRing =
+            singleMapping ? m_ring.submissionRing : map(m_ring.completionRingSize, IORING_OFF_CQ_RING);
+
+        m_ring.entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_ring.entries     = map(m_ring.entriesSize, IORING_OFF_SQES);
+
+        if (!m_ring.submissionRing || !m_ring.completionRing || !m_ring.entries)
+        {
+            logger::warn("Could not map the io_uring queues, falling back to blocking reads");
+
+            destroyRing();
+
+            return false;
+        }
+
+        auto* submission = static_cast<std::byte*>(m_ring.submissionRing);
+        auto* completion = static_cast<std::byte*>(m_ring.completionRing);
+
+        m_ring.submissionHead  = reinterpret_cast<uint32_t*>(submission + params.sq_off.head);
+        m_ring.submissionTail  = reinterpret_cast<uint32_t*>(submission + params.sq_off.tail);
+        m_ring.submissionMask  = reinterpret_cast<uint32_t*>(submission + params.sq_off.ring_mask);
+        m_ring.submissionArray = reinterpret_cast<uint32_t*>(submission + params.sq_off.array);
+        m_ring.completionHead  = reinterpret_cast<uint32_t*>(completion + params.cq_off.head);
+        m_ring.completionTail  = reinterpret_cast<uint32_t*>(completion + params.cq_off.tail);
+        m_ring.completionMask  = reinterpret_cast<uint32_t*>(completion + params.cq_off.ring_mask);
+        m_ring.completions     = completion + params.cq_off.cqes;
+
+        return true;
+    }
+
+    void FileReader::destroyRing()
+    {
+        if (m_ring.entries)
+        {
+            munmap(m_ring.entries, m_ring.entriesSize);
+        }
+
+        if (m_ring.completionRing && m_ring.completionRing != m_ring.submissionRing)
+        {
+            munmap(m_ring.completionRing, m_ring.completionRingSize);
+        }
+
+        if (m_ring.submissionRing)
+        {
+            munmap(m_ring.submissionRing, m_ring.submissionRingSize);
+        }
+
+        if (m_ring.fd >= 0)
+        {
+            close(m_ring.fd);
+        }
+
+        m_ring = {};
+    }
+
+    void FileReader::ringWorker(std::stop_token stopToken)
+    {
+        // A single read is capped so `len` fits, anything bigger is continued like a short read
+        constexpr size_t kMaxReadSize = 1 << 30;
+
+        auto* entries     = static_cast<io_uring_sqe*>(m_ring.entries);
+        auto* completions = static_cast<io_uring_cqe*>(m_ring.completions);
+
+        uint32_t inFlight = 0;
+
+        std::vector<Operation*> batch;
+        std::vector<Operation*> unfinished;
+
+        while (true)
+        {
+            {
+                std::unique_lock lock(m_mutex);
+
+                // Only sleep on the condition when there is nothing left to reap
+                if (inFlight == 0 &&
+                    !m_pendingCondition.wait(lock, stopToken, [this] { return !m_pending.empty(); }))
+                {
+                    return;
+                }
+
+                while (!m_pending.empty() && inFlight + batch.size() < m_ring.numEntries)
+                {
+                    batch.push_back(m_pending.front());
+                    m_pending.pop_front();
+                }
+            }
+
+            uint32_t submissionTail = *m_ring.submissionTail;
+
+            for (Operation* operation : batch)
+            {
+                ReadRequest const& request = operation->batch->requests[operation->index];
+
+                uint32_t const index = submissionTail & *m_ring.submissionMask;
+
+                io_uring_sqe& entry = entries[index];
+
+                entry           = {};
+                entry.user_data = reinterpret_cast<uint64_t>(operation);
+
+                if (operation->fd < 0)
+                {
+                    // The kernel opens the file as well, the read is submitted once the open completed
+                    entry.opcode     = IORING_OP_OPENAT;
+                    entry.fd         = AT_FDCWD;
+                    entry.addr       = reinterpret_cast<uint64_t>(request.path.c_str());
+                    entry.open_flags = O_RDONLY | O_CLOEXEC;
+                }
+                else
+                {
+                    std::span<std::byte> destination = request.destination.subspan(operation->bytesRead);
+
+                    entry.opcode = IORING_OP_READ;
+                    entry.fd     = operation->fd;
+                    entry.addr   = reinterpret_cast<uint64_t>(destination.data());
+                    entry.len    = static_cast<uint32_t>(std::min(destination.size(), kMaxReadSize));
+                    entry.off    = request.offset + operation->bytesRead;
+                }
+
+                m_ring.submissionArray[index] = index;
+
+                ++submissionTail;
+                ++inFlight;
+            }
+
+            batch.clear();
+
+            std::atomic_ref(*m_ring.submissionTail).store(submissionTail, std::memory_order_release);
+
+            if (inFlight == 0)
+            {
+                continue;
+            }
+
+            // Submits everything the kernel hasn't consumed yet and waits for at least one completion
+            uint32_t const toSubmit =
+                submissionTail - std::atomic_ref(*m_ring.submissionHead).load(std::memory_order_acquire);
+
+            long const entered =
+                syscall(__NR_io_uring_enter, m_ring.fd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+            if (entered < 0 && errno != EINTR)
+            {
+                int const error = errno;
+
+                logger::error("io_uring_enter failed: {}", std::strerror(error));
+
+                // Nothing the kernel didn't consume will ever run, those operations are taken back and
+                // fail with the error instead of being submitted again and again
+                uint32_t const consumed =
+                    std::atomic_ref(*m_ring.submissionHead).load(std::memory_order_acquire);
+
+                for (uint32_t i = consumed; i != submissionTail; ++i)
+                {
+                    io_uring_sqe const& entry = entries[m_ring.submissionArray[i & *m_ring.submissionMask]];
+
+                    --inFlight;
+
+                    completeOperation(*reinterpret_cast<Operation*>(entry.user_data), error);
+                }
+
+                submissionTail = consumed;
+
+                std::atomic_ref(*m_ring.submissionTail).store(submissionTail, std::memory_order_release);
+
+                // The ones it did consume still complete and are reaped below, without waiting on them
+                // the loop would spin until they did
+                if (inFlight > 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+
+            uint32_t head = *m_ring.completionHead;
+            uint32_t const completionTail =
+                std::atomic_ref(*m_ring.completionTail).load(std::memory_order_acquire);
+
+            for (; head != completionTail; ++head)
+            {
+                io_uring_cqe const& entry = completions[head & *m_ring.completionMask];
+
+                auto* operation = reinterpret_cast<Operation*>(entry.user_data);
+
+                --inFlight;
+
+                if (entry.res == -EAGAIN || entry.res == -EINTR)
+                {
+                    unfinished.push_back(operation);
+
+                    continue;
+                }
+
+                if (entry.res < 0)
+                {
+                    completeOperation(*operation, -entry.res);
+
+                    continue;
+                }
+
+                // Without a descriptor this was the open, the first read goes out with the next submission
+                if (operation->fd < 0)
+                {
+                    operation->fd = entry.res;
+
+                    unfinished.push_back(operation);
+
+                    continue;
+                }
+
+                operation->bytesRead += static_cast<size_t>(entry.res);
+
+                ReadRequest const& request = operation->batch->requests[operation->index];
+
+                // A read of 0 bytes means the end of the file was reached
+                if (entry.res == 0 || operation->bytesRead == request.destination.size())
+                {
+                    completeOperation(*operation, 0);
+                }
+                else
+                {
+                    unfinished.push_back(operation);
+                }
+            }
+
+            std::atomic_ref(*m_ring.completionHead).store(head, std::memory_order_release);
+
+            if (!unfinished.empty())
+            {
+                std::lock_guard lock(m_mutex);
+
+                m_pending.insert(m_pending.begin(), unfinished.begin(), unfinished.end());
+
+                unfinished.clear();
+            }
+        }
+    }
+#else
+    void FileReader::destroyRing() {}
+#endif
+}  // namespace io
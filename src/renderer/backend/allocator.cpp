@@ -1,17 +1,55 @@
+#include <mc/logger.hpp>
 #include <mc/renderer/backend/allocator.hpp>
+#include <mc/utils.hpp>
+
+#include <algorithm>
 
 namespace renderer::backend
 {
     Allocator::Allocator(Instance const& instance, Device const& device)
     {
         VmaAllocatorCreateInfo allocatorInfo = {
-            .flags          = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT,
-            .physicalDevice = *device.getPhysical(),
-            .device         = *device.get(),
-            .instance       = static_cast<vk::Instance>(instance),
+            .flags            = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT,
+            .physicalDevice   = *device.getPhysical(),
+            .device           = *device.get(),
+            .instance         = static_cast<vk::Instance>(instance),
+            .vulkanApiVersion = vk::ApiVersion13,
         };
 
+        if (device.isMemoryBudgetSupported())
+        {
+            allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+        }
+
         vmaCreateAllocator(&allocatorInfo, &m_allocator);
+
+        VkPhysicalDeviceMemoryProperties const* memoryProperties = nullptr;
+        vmaGetMemoryProperties(m_allocator, &memoryProperties);
+
+        constexpr VkMemoryPropertyFlags hostVisibleVram =
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+
+        for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; ++i)
+        {
+            VkMemoryType const& type = memoryProperties->memoryTypes[i];
+
+            if ((type.propertyFlags & hostVisibleVram) == hostVisibleVram)
+            {
+                m_hostVisibleVramSize =
+                    std::max(m_hostVisibleVramSize, memoryProperties->memoryHeaps[type.heapIndex].size);
+            }
+        }
+
+        // Without resizable BAR the window into VRAM is usually 256MiB, VMA keeps bigger buffers out of it
+        if (m_hostVisibleVramSize > 0)
+        {
+            logger::info("Host visible device local memory: {}",
+                         utils::largeSizeToHumanReadable(static_cast<float>(m_hostVisibleVramSize)));
+        }
+        else
+        {
+            logger::info("No host visible device local memory, buffer updates go through staging copies");
+        }
     }
 
     Allocator::~Allocator()
@@ -0,0 +1,245 @@
+#include <mc/asserts.hpp>
+#include <mc/logger.hpp>
+#include <mc/renderer/backend/bindless.hpp>
+#include <mc/renderer/backend/constants.hpp>
+#include <mc/renderer/backend/descriptor.hpp>
+#include <mc/renderer/backend/vk_checker.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <ranges>
+
+namespace rn = std::ranges;
+namespace vi = std::ranges::views;
+
+namespace renderer::backend
+{
+    BindlessRegistry::BindlessRegistry(Device& device) : m_device { &device }
+    {
+        auto properties = device.getPhysical()
+                              .getProperties2<vk::PhysicalDeviceProperties2,
+                                              vk::PhysicalDeviceDescriptorIndexingProperties>()
+                              .get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+
+        m_capacity = std::min({ kMaxBindlessResources,
+                                properties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                properties.maxDescriptorSetUpdateAfterBindSamplers,
+                                properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                properties.maxPerStageDescriptorUpdateAfterBindSamplers });
+
+        logger::debug("Bindless texture registry can hold {} textures", m_capacity);
+
+        m_layout = DescriptorLayoutBuilder()
+                       .setBinding(0,
+                                   vk::DescriptorType::eCombinedImageSampler,
+                                   vk::ShaderStageFlagBits::eFragment,
+                                   m_capacity,
+                                   vk::DescriptorBindingFlagBits::ePartiallyBound |
+                                       vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+                                       vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending |
+                                       vk::DescriptorBindingFlagBits::eVariableDescriptorCount)
+                       .build(device, vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool);
+
+        auto poolSize = vk::DescriptorPoolSize()
+                            .setType(vk::DescriptorType::eCombinedImageSampler)
+                            .setDescriptorCount(m_capacity);
+
+        m_pool =
+            device->createDescriptorPool(vk::DescriptorPoolCreateInfo()
+                                             .setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+                                             .setMaxSets(1)
+                                             .setPoolSizes(poolSize)) >>
+            ResultChecker();
+
+        auto variableCountInfo = vk::DescriptorSetVariableDescriptorCountAllocateInfo().setDescriptorCounts(
+            m_capacity);
+
+        vk::DescriptorSetLayout layout = m_layout;
+
+        m_set = (vk::Device(device).allocateDescriptorSets({
+                     .pNext              = &variableCountInfo,
+                     .descriptorPool     = m_pool,
+                     .descriptorSetCount = 1,
+                     .pSetLayouts        = &layout,
+                 }) >>
+                 ResultChecker())[0];
+    }
+
+    void BindlessRegistry::setPlaceholder(vk::ImageView imageView, vk::Sampler sampler)
+    {
+        std::lock_guard lock(m_mutex);
+
+        m_placeholder = vk::DescriptorImageInfo {
+            .sampler     = sampler,
+            .imageView   = imageView,
+            .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        };
+
+        m_pendingWrites[kPlaceholderIndex] = m_placeholder;
+    }
+
+    auto BindlessRegistry::registerTexture(vk::ImageView imageView, vk::Sampler sampler) -> uint32_t
+    {
+        std::lock_guard lock(m_mutex);
+
+        uint32_t index = kInvalidIndex;
+
+        if (!m_freeIndices.empty())
+        {
+            index = m_freeIndices.back();
+            m_freeIndices.pop_back();
+        }
+        else
+        {
+            MC_ASSERT_MSG(m_nextIndex < m_capacity,
+                          "Bindless texture registry is full ({} textures)",
+                          m_capacity);
+
+            index = m_nextIndex++;
+        }
+
+        queueWrite(index, imageView, sampler);
+
+        return index;
+    }
+
+    void BindlessRegistry::updateTexture(uint32_t index, vk::ImageView imageView, vk::Sampler sampler)
+    {
+        std::lock_guard lock(m_mutex);
+
+        MC_ASSERT(index != kPlaceholderIndex && index < m_nextIndex);
+
+        queueWrite(index, imageView, sampler);
+    }
+
+    void BindlessRegistry::resetToPlaceholder(uint32_t index)
+    {
+        std::lock_guard lock(m_mutex);
+
+        MC_ASSERT(index != kPlaceholderIndex && index < m_nextIndex);
+
+        m_pendingWrites[index] = m_placeholder;
+    }
+
+    void BindlessRegistry::releaseTexture(uint32_t index)
+    {
+        std::lock_guard lock(m_mutex);
+
+        MC_ASSERT(index != kPlaceholderIndex && index < m_nextIndex);
+
+        // Anything still sampling this index until it gets recycled will just see the placeholder
+        m_pendingWrites[index] = m_placeholder;
+        m_retiredIndices.push_back({ .index = index, .frameNumber = m_frameNumber });
+    }
+
+    auto BindlessRegistry::getSampler(vk::SamplerCreateInfo const& info) -> vk::Sampler
+    {
+        std::lock_guard lock(m_mutex);
+
+        SamplerKey key {
+            .magFilter        = info.magFilter,
+            .minFilter        = info.minFilter,
+            .mipmapMode       = info.mipmapMode,
+            .addressModeU     = info.addressModeU,
+            .addressModeV     = info.addressModeV,
+            .addressModeW     = info.addressModeW,
+            .mipLodBias       = info.mipLodBias,
+            .maxAnisotropy    = info.anisotropyEnable ? info.maxAnisotropy : 0.f,
+            .minLod           = info.minLod,
+            .maxLod           = info.maxLod,
+            .anisotropyEnable = info.anisotropyEnable,
+            .borderColor      = info.borderColor,
+        };
+
+        if (auto it = m_samplers.find(key); it != m_samplers.end())
+        {
+            return it->second;
+        }
+
+        auto [it, _] = m_samplers.emplace(key, (*m_device)->createSampler(info) >> ResultChecker());
+
+        return it->second;
+    }
+
+    void BindlessRegistry::beginFrame(uint64_t frameNumber)
+    {
+        std::lock_guard lock(m_mutex);
+
+        m_frameNumber = frameNumber;
+
+        // Indices released at least `kNumFramesInFlight` frames ago are no longer referenced by the GPU
+        auto [first, last] = rn::remove_if(m_retiredIndices,
+                                           [this](RetiredIndex const& retired)
+                                           {
+                                               if (retired.frameNumber + kNumFramesInFlight > m_frameNumber)
+                                               {
+                                                   return false;
+                                               }
+
+                                               m_freeIndices.push_back(retired.index);
+
+                                               return true;
+                                           });
+
+        m_retiredIndices.erase(first, last);
+
+        if (m_pendingWrites.empty())
+        {
+            return;
+        }
+
+        std::vector<vk::WriteDescriptorSet> writes;
+        writes.reserve(m_pendingWrites.size());
+
+        for (auto& [index, imageInfo] : m_pendingWrites)
+        {
+            writes.push_back(vk::WriteDescriptorSet {
+                .dstSet          = m_set,
+                .dstBinding      = 0,
+                .dstArrayElement = index,
+                .descriptorCount = 1,
+                .descriptorType  = vk::DescriptorType::eCombinedImageSampler,
+                .pImageInfo      = &imageInfo,
+            });
+        }
+
+        (*m_device)->updateDescriptorSets(writes, {});
+
+        m_pendingWrites.clear();
+    }
+
+    void BindlessRegistry::queueWrite(uint32_t index, vk::ImageView imageView, vk::Sampler sampler)
+    {
+        m_pendingWrites[index] = vk::DescriptorImageInfo {
+            .sampler     = sampler,
+            .imageView   = imageView,
+            .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        };
+    }
+
+    auto BindlessRegistry::SamplerKeyHash::operator()(SamplerKey const& key) const -> size_t
+    {
+        size_t hash = 0;
+
+        auto combine = [&hash](auto const& value)
+        {
+            hash ^= std::hash<std::remove_cvref_t<decltype(value)>> {}(value) + 0x9e3779b9 + (hash << 6) +
+                    (hash >> 2);
+        };
+
+        combine(std::to_underlying(key.magFilter));
+        combine(std::to_underlying(key.minFilter));
+        combine(std::to_underlying(key.mipmapMode));
+        combine(std::to_underlying(key.addressModeU));
+        combine(std::to_underlying(key.addressModeV));
+        combine(std::to_underlying(key.addressModeW));
+        combine(key.mipLodBias);
+        combine(key.maxAnisotropy);
+        combine(key.minLod);
+        combine(key.maxLod);
+        combine(key.anisotropyEnable);
+        combine(std::to_underlying(key.borderColor));
+
+        return hash;
+    }
+}  // namespace renderer::backend
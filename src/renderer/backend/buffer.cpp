@@ -7,6 +7,201 @@
 
 namespace renderer::backend
 {
+    namespace
+    {
+        auto categorize(vk::BufferUsageFlags usage) -> MemoryCategory
+        {
+            constexpr vk::BufferUsageFlags geometryUsage =
+                vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer |
+                vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+
+            // Per-frame and per-mesh uniforms are tiny, they don't count as geometry even with an address
+            if (usage & vk::BufferUsageFlagBits::eUniformBuffer)
+            {
+                return MemoryCategory::other;
+            }
+
+            if (usage == vk::BufferUsageFlagBits::eTransferSrc)
+            {
+                return MemoryCategory::staging;
+            }
+
+            return usage & geometryUsage ? MemoryCategory::geometry : MemoryCategory::other;
+        }
+    }  // namespace
+
+    BufferPool::BufferPool(Device& device,
+                           Allocator& allocator,
+                           std::string name,
+                           vk::DeviceSize blockSize,
+                           vk::DeviceSize alignment,
+                           vk::BufferUsageFlags bufferUsage,
+                           VmaMemoryUsage memoryUsage,
+                           VmaAllocationCreateFlags allocFlags)
+        : m_device { &device },
+          m_allocator { &allocator },
+          m_name { std::move(name) },
+          m_blockSize { blockSize },
+          m_alignment { alignment },
+          m_bufferUsage { bufferUsage },
+          m_memoryUsage { memoryUsage },
+          m_allocFlags { allocFlags }
+    {
+    }
+
+    BufferPool::~BufferPool()
+    {
+        MC_ASSERT_MSG(m_numSuballocations == 0,
+                      "Buffer pool '{}' destroyed with {} live suballocations",
+                      m_name,
+                      m_numSuballocations);
+
+        for (Block& block : m_blocks)
+        {
+            destroyBlock(block);
+        }
+    }
+
+    auto BufferPool::allocate(vk::DeviceSize size) -> Suballocation
+    {
+        MC_ASSERT_MSG(size <= m_blockSize,
+                      "Allocation of {} bytes doesn't fit in the blocks of buffer pool '{}'",
+                      size,
+                      m_name);
+
+        VmaVirtualAllocationCreateInfo allocCreateInfo {
+            .size      = size,
+            .alignment = m_alignment,
+        };
+
+        std::lock_guard lock(m_mutex);
+
+        // The newest block is the most likely to have space left
+        for (Block& block : m_blocks | vi::reverse)
+        {
+            Suballocation suballocation {
+                .buffer          = block.buffer,
+                .blockAllocation = block.allocation,
+                .blockAllocInfo  = block.allocInfo,
+                .blockAddress    = block.address,
+                .virtualBlock    = block.virtualBlock,
+            };
+
+            if (vmaVirtualAllocate(block.virtualBlock,
+                                   &allocCreateInfo,
+                                   &suballocation.virtualAllocation,
+                                   &suballocation.offset) == VK_SUCCESS)
+            {
+                ++m_numSuballocations;
+
+                return suballocation;
+            }
+        }
+
+        createBlock();
+
+        Block& block = m_blocks.back();
+
+        Suballocation suballocation {
+            .buffer          = block.buffer,
+            .blockAllocation = block.allocation,
+            .blockAllocInfo  = block.allocInfo,
+            .blockAddress    = block.address,
+            .virtualBlock    = block.virtualBlock,
+        };
+
+        MC_ASSERT(vmaVirtualAllocate(block.virtualBlock,
+                                     &allocCreateInfo,
+                                     &suballocation.virtualAllocation,
+                                     &suballocation.offset) == VK_SUCCESS);
+
+        ++m_numSuballocations;
+
+        return suballocation;
+    }
+
+    void BufferPool::free(VmaVirtualBlock virtualBlock, VmaVirtualAllocation virtualAllocation)
+    {
+        std::lock_guard lock(m_mutex);
+
+        vmaVirtualFree(virtualBlock, virtualAllocation);
+
+        --m_numSuballocations;
+
+        // Keep one block around so a pool that empties and refills doesn't churn allocations
+        if (m_blocks.size() > 1 && vmaIsVirtualBlockEmpty(virtualBlock))
+        {
+            auto it = rn::find(m_blocks, virtualBlock, &Block::virtualBlock);
+
+            MC_ASSERT(it != m_blocks.end());
+
+            destroyBlock(*it);
+
+            m_blocks.erase(it);
+        }
+    }
+
+    auto BufferPool::getNumBlocks() -> size_t
+    {
+        std::lock_guard lock(m_mutex);
+
+        return m_blocks.size();
+    }
+
+    auto BufferPool::getNumSuballocations() -> size_t
+    {
+        std::lock_guard lock(m_mutex);
+
+        return m_numSuballocations;
+    }
+
+    void BufferPool::createBlock()
+    {
+        Block& block = m_blocks.emplace_back();
+
+        vk::BufferCreateInfo bufferInfo = {
+            .size  = m_blockSize,
+            .usage = m_bufferUsage,
+        };
+
+        VmaAllocationCreateInfo vmaAllocInfo = {
+            .flags = m_allocFlags,
+            .usage = m_memoryUsage,
+        };
+
+        MC_ASSERT(vmaCreateBuffer(m_allocator->get(),
+                                  &static_cast<VkBufferCreateInfo&>(bufferInfo),
+                                  &vmaAllocInfo,
+                                  &block.buffer,
+                                  &block.allocation,
+                                  &block.allocInfo) == VK_SUCCESS);
+
+#if DEBUG
+        vmaSetAllocationName(*m_allocator, block.allocation, m_name.c_str());
+
+        vmaGetAllocationInfo(*m_allocator, block.allocation, &block.allocInfo);
+#endif
+
+        if (m_bufferUsage & vk::BufferUsageFlagBits::eShaderDeviceAddress)
+        {
+            block.address =
+                m_device->get().getBufferAddress(vk::BufferDeviceAddressInfo().setBuffer(block.buffer));
+        }
+
+        VmaVirtualBlockCreateInfo virtualBlockInfo {
+            .size = m_blockSize,
+        };
+
+        MC_ASSERT(vmaCreateVirtualBlock(&virtualBlockInfo, &block.virtualBlock) == VK_SUCCESS);
+    }
+
+    void BufferPool::destroyBlock(Block& block)
+    {
+        vmaDestroyVirtualBlock(block.virtualBlock);
+
+        vmaDestroyBuffer(*m_allocator, block.buffer, block.allocation);
+    }
+
     GPUBuffer::GPUBuffer(ResourceHandle const& handle,
                          std::string const& name,
                          Device& device,
@@ -15,11 +210,18 @@ namespace renderer::backend
                          vk::BufferUsageFlags bufferUsage,
                          VmaMemoryUsage memoryUsage,
                          VmaAllocationCreateFlags allocFlags)
-        : ResourceBase { handle }, device { &device }, allocator { &allocator }
+        : ResourceBase { handle },
+          device { &device },
+          allocator { &allocator },
+          size { allocSize },
+          // The defragmenter moves buffers with a copy, any buffer may end up on either side of one
+          usage { bufferUsage | vk::BufferUsageFlagBits::eTransferSrc |
+                  vk::BufferUsageFlagBits::eTransferDst },
+          category { categorize(bufferUsage) }
     {
         vk::BufferCreateInfo bufferInfo = {
-            .size  = allocSize,
-            .usage = bufferUsage,
+            .size  = size,
+            .usage = usage,
         };
 
         VmaAllocationCreateInfo vmaAllocInfo = {
@@ -33,9 +235,59 @@ namespace renderer::backend
                                   &vulkanHandle,
                                   &allocation,
                                   &allocInfo) == VK_SUCCESS);
+
+        vmaGetAllocationMemoryProperties(allocator, allocation, &memoryProperties);
+
+        if (usage & vk::BufferUsageFlagBits::eShaderDeviceAddress)
+        {
+            deviceAddress =
+                device.get().getBufferAddress(vk::BufferDeviceAddressInfo().setBuffer(vulkanHandle));
+        }
+
         setName(name);
     }
 
+    GPUBuffer::GPUBuffer(ResourceHandle const& handle,
+                         [[maybe_unused]] std::string const& name,
+                         Device& device,
+                         Allocator& allocator,
+                         BufferPool& pool,
+                         size_t allocSize)
+        : ResourceBase { handle },
+          device { &device },
+          allocator { &allocator },
+          size { allocSize },
+          usage { pool.getBufferUsage() },
+          category { categorize(pool.getBufferUsage()) },
+          pool { &pool }
+    {
+        BufferPool::Suballocation suballocation = pool.allocate(allocSize);
+
+        vulkanHandle      = suballocation.buffer;
+        allocation        = suballocation.blockAllocation;
+        virtualBlock      = suballocation.virtualBlock;
+        virtualAllocation = suballocation.virtualAllocation;
+        offset            = suballocation.offset;
+
+        if (suballocation.blockAddress != 0)
+        {
+            deviceAddress = suballocation.blockAddress + offset;
+        }
+
+        vmaGetAllocationMemoryProperties(allocator, allocation, &memoryProperties);
+
+        // Describes the range rather than the whole block, the name stays the pool's since
+        // naming the allocation would rename every other suballocation as well
+        allocInfo        = suballocation.blockAllocInfo;
+        allocInfo.offset = suballocation.blockAllocInfo.offset + offset;
+        allocInfo.size   = allocSize;
+
+        if (allocInfo.pMappedData)
+        {
+            allocInfo.pMappedData = static_cast<std::byte*>(allocInfo.pMappedData) + offset;
+        }
+    }
+
     GPUBuffer::~GPUBuffer()
     {
         if (vulkanHandle == nullptr)
@@ -43,7 +295,14 @@ namespace renderer::backend
             return;
         }
 
-        vmaDestroyBuffer(*allocator, vulkanHandle, allocation);
+        if (pool)
+        {
+            pool->free(virtualBlock, virtualAllocation);
+        }
+        else
+        {
+            vmaDestroyBuffer(*allocator, vulkanHandle, allocation);
+        }
 
         vulkanHandle = nullptr;
     }
@@ -34,7 +34,7 @@ namespace renderer::backend
 
     ScopedCommandBuffer::~ScopedCommandBuffer()
     {
-        if (!*m_handle)
+        if (!*m_handle || m_submitted)
         {
             return;
         }
@@ -84,6 +84,24 @@ namespace renderer::backend
         }
     }
 
+    auto ScopedCommandBuffer::submit() -> vk::raii::Fence
+    {
+        MC_ASSERT(!m_submitted);
+
+        m_handle.end();
+
+        std::array cmdSubmits { vk::CommandBufferSubmitInfo().setCommandBuffer(m_handle) };
+        std::array submits { vk::SubmitInfo2().setCommandBufferInfos(cmdSubmits) };
+
+        vk::raii::Fence fence = m_device->get().createFence(vk::FenceCreateInfo {}).value();
+
+        MC_ASSERT(m_queue.submit2(submits, fence) == vk::Result::eSuccess);
+
+        m_submitted = true;
+
+        return fence;
+    }
+
     CommandManager::CommandManager(Device const& device, uint32_t numThreads)
         : numPoolsPerFrame { numThreads }
     {
@@ -129,27 +147,24 @@ namespace renderer::backend
             uint32_t const thread_index = (i / numCommandBuffersPerThread) % numPoolsPerFrame;
             uint32_t const pool_index   = poolFromIndices(frame_index, thread_index);
 
-            i++;
-
             primaryBuffers.push_back(
                 std::move((device->allocateCommandBuffers(vk::CommandBufferAllocateInfo()
                                                               .setCommandPool(commandPools[pool_index])
                                                               .setLevel(vk::CommandBufferLevel::ePrimary)
                                                               .setCommandBufferCount(1)) >>
                            ResultChecker())[0]));
-        };
-
-        for (uint32_t i = 0; i < totalPrimaryBuffers; i++)
-
-            for (uint32_t poolIndex : vi::iota(0u, totalPools))
-            {
-                rn::move(device->allocateCommandBuffers(vk::CommandBufferAllocateInfo()
-                                                            .setCommandPool(commandPools[poolIndex])
-                                                            .setLevel(vk::CommandBufferLevel::eSecondary)
-                                                            .setCommandBufferCount(kNumSecondaryBuffers)) >>
-                             ResultChecker(),
-                         std::back_inserter(secondaryBuffers));
-            }
+        }
+
+        // Pool `i` owns the secondary buffers starting at `i * kNumSecondaryBuffers`
+        for (uint32_t poolIndex : vi::iota(0u, totalPools))
+        {
+            rn::move(device->allocateCommandBuffers(vk::CommandBufferAllocateInfo()
+                                                        .setCommandPool(commandPools[poolIndex])
+                                                        .setLevel(vk::CommandBufferLevel::eSecondary)
+                                                        .setCommandBufferCount(kNumSecondaryBuffers)) >>
+                         ResultChecker(),
+                     std::back_inserter(secondaryBuffers));
+        }
     }
 
     void CommandManager::resetPools(uint32_t frameIndex)
@@ -0,0 +1,469 @@
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/culling.hpp>
+#include <mc/renderer/backend/shader.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_access.hpp>
+#include <immintrin.h>
+#include <tracy/Tracy.hpp>
+
+namespace renderer::backend
+{
+    namespace
+    {
+        constexpr uint32_t kBatchSize = 8;
+
+        // Batches a worker takes at once
+        constexpr uint32_t kBatchesPerRange = 32;
+    }  // namespace
+
+    auto extractFrustumPlanes(glm::mat4 const& viewProj) -> std::array<glm::vec4, 6>
+    {
+        // Gribb/Hartmann: a point is inside when -w <= x, y <= w and 0 <= z <= w in clip space. The lens
+        // is reverse-Z with near and far swapped, so z >= 0 is the far plane and z <= w the near one.
+        // Both are finite, every user tests all six planes
+        glm::vec4 const x = glm::row(viewProj, 0);
+        glm::vec4 const y = glm::row(viewProj, 1);
+        glm::vec4 const z = glm::row(viewProj, 2);
+        glm::vec4 const w = glm::row(viewProj, 3);
+
+        return { w + x, w - x, w + y, w - y, z, w - z };
+    }
+
+    void DrawSorter::setScene(std::span<vk::DrawIndexedIndirectCommand const> draws,
+                              std::span<PrimitiveShaderData const> primitives,
+                              DrawBuckets const& buckets)
+    {
+        m_buckets = buckets;
+
+        m_centers.clear();
+        m_centers.reserve(draws.size());
+
+        for (vk::DrawIndexedIndirectCommand const& draw : draws)
+        {
+            PrimitiveShaderData const& primitive = primitives[draw.firstInstance];
+
+            // Unbounded primitives span lowest() to max(), which cancel out
+            m_centers.push_back((primitive.boundsMin + primitive.boundsMax) * 0.5f);
+        }
+
+        m_distances.resize(draws.size());
+
+        m_order.resize(draws.size());
+        std::iota(m_order.begin(), m_order.end(), 0u);
+    }
+
+    void DrawSorter::sort(glm::vec3 cameraPos)
+    {
+        ZoneScopedN("Draw sorting");
+
+        for (size_t i = 0; i < m_centers.size(); ++i)
+        {
+            glm::vec3 const offset = m_centers[i] - cameraPos;
+
+            m_distances[i] = glm::dot(offset, offset);
+        }
+
+        auto distance = [this](uint32_t draw) { return m_distances[draw]; };
+
+        for (uint32_t bucket = 0; bucket < kNumDrawBuckets; ++bucket)
+        {
+            auto const draws = std::span(m_order).subspan(m_buckets[bucket].first, m_buckets[bucket].count);
+
+            if (isBlended(static_cast<DrawBucket>(bucket)))
+            {
+                std::ranges::sort(draws, std::ranges::greater {}, distance);
+            }
+            else
+            {
+                std::ranges::sort(draws, std::ranges::less {}, distance);
+            }
+        }
+    }
+
+    DrawCuller::DrawCuller(Device& device,
+                           ResourceManager<GPUBuffer>& bufferManager,
+                           FrameAllocator& frameData)
+        : m_device { &device }, m_bufferManager { &bufferManager }, m_frameData { &frameData }
+    {
+        m_descriptorLayout =
+            DescriptorLayoutBuilder()
+                // The depth pyramid, every level of it
+                .setBinding(0, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute)
+                .build(device);
+
+        std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
+            { vk::DescriptorType::eCombinedImageSampler, 1 },
+        };
+
+        m_descriptorAllocator = DescriptorAllocator(device, 1, sizes);
+        m_pyramidDescriptors  = m_descriptorAllocator.allocate(device, m_descriptorLayout);
+
+        ShaderManager shaders(device);
+        shaders.addShader("cull.comp");
+        shaders.build();
+
+        m_pipelineLayout = PipelineLayout(
+            device,
+            PipelineLayoutConfig()
+                .setDescriptorSetLayouts({ m_descriptorLayout })
+                .setPushConstantSettings(sizeof(PushConstants), vk::ShaderStageFlagBits::eCompute));
+
+        m_pipeline = ComputePipeline(device, "draw_cull", m_pipelineLayout, shaders);
+
+        m_drawCounts = bufferManager.create("Visible draw counts",
+                                            kNumFramesInFlight * getDrawCountSize(),
+                                            vk::BufferUsageFlagBits::eIndirectBuffer |
+                                                vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                                vk::BufferUsageFlagBits::eTransferDst |
+                                                vk::BufferUsageFlagBits::eTransferSrc,
+                                            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+                                            0);
+    }
+
+    void DrawCuller::reserve(uint32_t maxDraws)
+    {
+        if (maxDraws <= m_maxDraws)
+        {
+            return;
+        }
+
+        m_maxDraws = maxDraws;
+
+        m_visibleDraws = m_bufferManager->create(
+            "Visible draws",
+            kNumFramesInFlight * kNumPhases * maxDraws * sizeof(vk::DrawIndexedIndirectCommand),
+            vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            0);
+
+        m_visibility = m_bufferManager->create(
+            "Draw visibility",
+            maxDraws * sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            0);
+
+        m_clearVisibility = true;
+    }
+
+    void DrawCuller::setDepthPyramid(DepthPyramid const& pyramid)
+    {
+        m_pyramidExtent = pyramid.getExtent();
+        m_pyramidLevels = pyramid.getNumLevels();
+
+        DescriptorWriter writer;
+
+        writer.writeImage(0,
+                          pyramid.getImageView(),
+                          pyramid.getSampler(),
+                          vk::ImageLayout::eGeneral,
+                          vk::DescriptorType::eCombinedImageSampler);
+        writer.updateSet(*m_device, m_pyramidDescriptors);
+    }
+
+    void DrawCuller::record(vk::CommandBuffer cmdBuf,
+                            CullPhase phase,
+                            uint32_t frameIndex,
+                            glm::mat4 const& viewProj,
+                            vk::DeviceAddress primitives,
+                            vk::DeviceAddress drawCommands,
+                            DrawSorter const& sorter)
+    {
+        auto const numDraws = static_cast<uint32_t>(sorter.getOrder().size());
+
+        MC_ASSERT(frameIndex < kNumFramesInFlight);
+        MC_ASSERT_MSG(numDraws <= m_maxDraws, "Culling {} draws with room for {}", numDraws, m_maxDraws);
+        MC_ASSERT_MSG(m_pyramidLevels > 0, "Culling without a depth pyramid");
+
+        if (phase == CullPhase::early)
+        {
+            m_frameIndex = frameIndex;
+
+            cmdBuf.fillBuffer(m_drawCounts, getDrawCountOffset(), getDrawCountSize(), 0);
+
+            if (m_clearVisibility)
+            {
+                cmdBuf.fillBuffer(m_visibility, 0, vk::WholeSize, 0);
+
+                m_clearVisibility = false;
+            }
+
+            m_buckets = sorter.getBuckets();
+
+            std::array<uint32_t, kNumDrawBuckets> bucketEnds {};
+
+            for (uint32_t bucket = 0; bucket < kNumDrawBuckets; ++bucket)
+            {
+                bucketEnds[bucket] = m_buckets[bucket].first + m_buckets[bucket].count;
+            }
+
+            m_cullData = m_frameData
+                             ->push(CullData {
+                                 .frustumPlanes = extractFrustumPlanes(viewProj),
+                                 .viewProj      = viewProj,
+                                 .pyramidSize   = { m_pyramidExtent.width, m_pyramidExtent.height },
+                                 .pyramidLevels = m_pyramidLevels,
+                                 .bucketEnds    = bucketEnds,
+                             })
+                             .address;
+
+            FrameAllocation const order =
+                m_frameData->allocate(numDraws * sizeof(uint32_t), sizeof(uint32_t));
+            std::memcpy(order.data, sorter.getOrder().data(), numDraws * sizeof(uint32_t));
+
+            m_drawOrder = order.address;
+        }
+
+        MC_ASSERT(frameIndex == m_frameIndex);
+
+        // The counts were cleared above and the visibility is written by the previous late phase. Last
+        // frame's indirect reads of the outputs were against another region
+        vk::MemoryBarrier2 const beginBarrier {
+            .srcStageMask  = vk::PipelineStageFlagBits2::eClear | vk::PipelineStageFlagBits2::eComputeShader,
+            .srcAccessMask = vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eShaderStorageWrite,
+            .dstStageMask  = vk::PipelineStageFlagBits2::eComputeShader,
+            .dstAccessMask =
+                vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+        };
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(beginBarrier));
+
+        // The shader picks each draw's count from the bucket's index
+        vk::DeviceAddress const drawCounts =
+            m_drawCounts.getDeviceAddress() + getCountOffset(phase, DrawBucket::opaque);
+
+        if (numDraws > 0)
+        {
+            PushConstants const pushConstants {
+                .primitiveBuffer = primitives,
+                .drawCommands    = drawCommands,
+                .drawOrder       = m_drawOrder,
+                .visibleDraws    = m_visibleDraws.getDeviceAddress() + getVisibleDrawsOffset(phase),
+                .drawCount       = drawCounts,
+                .visibility      = m_visibility.getDeviceAddress(),
+                .cullData        = m_cullData,
+                .numDraws        = numDraws,
+                .phase           = phase,
+            };
+
+            cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline);
+            cmdBuf.bindDescriptorSets(
+                vk::PipelineBindPoint::eCompute, m_pipelineLayout, 0, m_pyramidDescriptors, {});
+            cmdBuf.pushConstants(m_pipelineLayout,
+                                 vk::ShaderStageFlagBits::eCompute,
+                                 0,
+                                 sizeof(PushConstants),
+                                 &pushConstants);
+            cmdBuf.dispatch((numDraws + kCullWorkgroupSize - 1) / kCullWorkgroupSize, 1, 1);
+        }
+    }
+
+    void DrawCuller::draw(vk::CommandBuffer cmdBuf, CullPhase phase, DrawBucket bucket) const
+    {
+        DrawRange const range = m_buckets[static_cast<uint32_t>(bucket)];
+
+        if (m_maxDraws == 0 || range.count == 0)
+        {
+            return;
+        }
+
+        vk::DeviceSize const offset =
+            getVisibleDrawsOffset(phase) + (range.first * sizeof(vk::DrawIndexedIndirectCommand));
+
+        // Blended draws are all written in place by the late phase, the hidden ones draw nothing
+        if (isBlended(bucket))
+        {
+            if (phase == CullPhase::late)
+            {
+                cmdBuf.drawIndexedIndirect(
+                    m_visibleDraws, offset, range.count, sizeof(vk::DrawIndexedIndirectCommand));
+            }
+
+            return;
+        }
+
+        cmdBuf.drawIndexedIndirectCount(m_visibleDraws,
+                                        offset,
+                                        m_drawCounts,
+                                        getCountOffset(phase, bucket),
+                                        range.count,
+                                        sizeof(vk::DrawIndexedIndirectCommand));
+    }
+
+    CpuDrawCuller::CpuDrawCuller(enki::TaskScheduler& scheduler, FrameAllocator& frameData)
+        : m_scheduler { &scheduler }, m_frameData { &frameData }
+    {
+        m_task.culler = this;
+    }
+
+    void CpuDrawCuller::setScene(std::span<vk::DrawIndexedIndirectCommand const> draws,
+                                 std::span<PrimitiveShaderData const> primitives)
+    {
+        m_draws.assign(draws.begin(), draws.end());
+
+        // The padding is never visible, the batch mask drops it
+        size_t const paddedSize = (draws.size() + kBatchSize - 1) / kBatchSize * kBatchSize;
+
+        for (std::vector<float>* component : { &m_minX, &m_minY, &m_minZ, &m_maxX, &m_maxY, &m_maxZ })
+        {
+            component->assign(paddedSize, 0.f);
+        }
+
+        for (size_t i = 0; i < draws.size(); ++i)
+        {
+            PrimitiveShaderData const& primitive = primitives[draws[i].firstInstance];
+
+            m_minX[i] = primitive.boundsMin.x;
+            m_minY[i] = primitive.boundsMin.y;
+            m_minZ[i] = primitive.boundsMin.z;
+            m_maxX[i] = primitive.boundsMax.x;
+            m_maxY[i] = primitive.boundsMax.y;
+            m_maxZ[i] = primitive.boundsMax.z;
+        }
+
+        m_visible.assign(paddedSize / kBatchSize, 0);
+    }
+
+    auto CpuDrawCuller::cull(glm::mat4 const& viewProj,
+                             DrawSorter const& sorter,
+                             OcclusionRasterizer const* occlusion) -> CpuCullResult
+    {
+        ZoneScopedN("CPU frustum culling");
+
+        auto timerStart = std::chrono::high_resolution_clock::now();
+
+        uint32_t const numDraws = getNumDraws();
+
+        if (numDraws == 0)
+        {
+            return {};
+        }
+
+        MC_ASSERT(sorter.getOrder().size() == numDraws);
+
+        FrameAllocation const output = m_frameData->allocate(
+            numDraws * sizeof(vk::DrawIndexedIndirectCommand), alignof(vk::DrawIndexedIndirectCommand));
+
+        m_planes    = extractFrustumPlanes(viewProj);
+        m_occlusion = occlusion;
+
+        m_task.m_SetSize  = static_cast<uint32_t>(m_visible.size());
+        m_task.m_MinRange = kBatchesPerRange;
+
+        m_scheduler->AddTaskSetToPipe(&m_task);
+        m_scheduler->WaitforTask(&m_task);
+
+        CpuCullResult result {
+            .buffer = output.buffer,
+            .offset = output.offset,
+        };
+
+        // Compacted in sorted order on this thread, the output is written front to back exactly once
+        auto* draws = static_cast<vk::DrawIndexedIndirectCommand*>(output.data);
+
+        for (uint32_t bucket = 0; bucket < kNumDrawBuckets; ++bucket)
+        {
+            DrawRange const range = sorter.getBuckets()[bucket];
+
+            result.buckets[bucket].first = result.numVisible;
+
+            for (uint32_t draw : sorter.getOrder().subspan(range.first, range.count))
+            {
+                if ((m_visible[draw / kBatchSize] >> (draw % kBatchSize)) & 1)
+                {
+                    draws[result.numVisible++] = m_draws[draw];
+                }
+            }
+
+            result.buckets[bucket].count = result.numVisible - result.buckets[bucket].first;
+        }
+
+        m_lastCullTime =
+            std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - timerStart)
+                .count();
+
+        return result;
+    }
+
+    void CpuDrawCuller::getVisiblePrimitives(std::vector<uint32_t>& primitives) const
+    {
+        for (uint32_t draw = 0; draw < getNumDraws(); ++draw)
+        {
+            if ((m_visible[draw / kBatchSize] >> (draw % kBatchSize)) & 1)
+            {
+                primitives.push_back(m_draws[draw].firstInstance);
+            }
+        }
+    }
+
+    void CpuDrawCuller::CullTask::ExecuteRange(enki::TaskSetPartition range, uint32_t)
+    {
+        culler->cullBatches(range.start, range.end);
+    }
+
+    void CpuDrawCuller::cullBatches(uint32_t firstBatch, uint32_t lastBatch)
+    {
+        uint32_t const numDraws = getNumDraws();
+
+        for (uint32_t batch = firstBatch; batch < lastBatch; ++batch)
+        {
+            uint32_t const first = batch * kBatchSize;
+
+            __m256 const minX = _mm256_loadu_ps(m_minX.data() + first);
+            __m256 const minY = _mm256_loadu_ps(m_minY.data() + first);
+            __m256 const minZ = _mm256_loadu_ps(m_minZ.data() + first);
+            __m256 const maxX = _mm256_loadu_ps(m_maxX.data() + first);
+            __m256 const maxY = _mm256_loadu_ps(m_maxY.data() + first);
+            __m256 const maxZ = _mm256_loadu_ps(m_maxZ.data() + first);
+
+            __m256 outside = _mm256_setzero_ps();
+
+            for (glm::vec4 const& plane : m_planes)
+            {
+                // The plane is the same for all 8 boxes, so is the choice of the corner furthest along
+                // its normal. If that corner is behind the plane, the whole box is
+                __m256 const cornerX = plane.x > 0.f ? maxX : minX;
+                __m256 const cornerY = plane.y > 0.f ? maxY : minY;
+                __m256 const cornerZ = plane.z > 0.f ? maxZ : minZ;
+
+                __m256 distance = _mm256_set1_ps(plane.w);
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.x), cornerX));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.y), cornerY));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), cornerZ));
+
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+            }
+
+            uint32_t const valid = numDraws - first >= kBatchSize ? 0xFF : (1u << (numDraws - first)) - 1;
+
+            uint32_t mask    = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & valid;
+            uint32_t visible = mask;
+
+            while (m_occlusion != nullptr && mask != 0)
+            {
+                uint32_t const lane = std::countr_zero(mask);
+                uint32_t const draw = first + lane;
+
+                mask &= mask - 1;
+
+                glm::vec3 const boundsMin { m_minX[draw], m_minY[draw], m_minZ[draw] };
+                glm::vec3 const boundsMax { m_maxX[draw], m_maxY[draw], m_maxZ[draw] };
+
+                if (!m_occlusion->isVisible(boundsMin, boundsMax))
+                {
+                    visible &= ~(1u << lane);
+                }
+            }
+
+            m_visible[batch] = static_cast<uint8_t>(visible);
+        }
+    }
+}  // namespace renderer::backend
@@ -0,0 +1,401 @@
+#include <mc/asserts.hpp>
+#include <mc/logger.hpp>
+#include <mc/renderer/backend/constants.hpp>
+#include <mc/renderer/backend/defragmenter.hpp>
+#include <mc/renderer/backend/vk_checker.hpp>
+#include <mc/utils.hpp>
+
+#include <algorithm>
+#include <span>
+#include <unordered_map>
+#include <utility>
+
+namespace renderer::backend
+{
+    Defragmenter::Defragmenter(Device& device,
+                               Allocator& allocator,
+                               UploadManager& uploadManager,
+                               ResourceManager<GPUBuffer>& bufferManager,
+                               ResourceManager<Image>& imageManager)
+        : m_device { &device },
+          m_allocator { &allocator },
+          m_uploadManager { &uploadManager },
+          m_bufferManager { &bufferManager },
+          m_imageManager { &imageManager }
+    {
+    }
+
+    Defragmenter::~Defragmenter()
+    {
+        if (m_passRunning)
+        {
+            vk::Device(*m_device).waitIdle() >> ResultChecker();
+
+            endPass();
+        }
+
+        if (m_context)
+        {
+            finish();
+        }
+    }
+
+    void Defragmenter::start()
+    {
+        if (m_context)
+        {
+            return;
+        }
+
+        VmaDefragmentationInfo const info {
+            .flags           = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+            .maxBytesPerPass = kDefragmentationBytesPerPass,
+        };
+
+        vmaBeginDefragmentation(*m_allocator, &info, &m_context) >> ResultChecker();
+
+        logger::info("Defragmenting, {} of the memory blocks are unused",
+                     utils::largeSizeToHumanReadable(static_cast<float>(getUnusedBytes())));
+    }
+
+    void Defragmenter::beginFrame(uint64_t frameNumber)
+    {
+        m_frameNumber = frameNumber;
+
+        if (m_passRunning && m_passFrame + kNumFramesInFlight <= frameNumber)
+        {
+            endPass();
+        }
+
+        if (!m_context && frameNumber > 0 && frameNumber % kDefragmentationCheckInterval == 0 &&
+            getUnusedBytes() >= kDefragmentationThreshold)
+        {
+            start();
+        }
+    }
+
+    void Defragmenter::recordMoves(vk::CommandBuffer cmdBuf)
+    {
+        if (!m_context || m_passRunning || !m_uploadManager->isIdle())
+        {
+            return;
+        }
+
+        if (vmaBeginDefragmentationPass(*m_allocator, m_context, &m_pass) == VK_SUCCESS)
+        {
+            // Nothing left to move
+            finish();
+
+            return;
+        }
+
+        // The allocations VMA proposes to move are all it knows about, the resources they belong to are
+        // looked up here. Anything else (pool blocks, staging buffers, retired resources) stays put
+        std::unordered_map<VmaAllocation, GPUBuffer*> buffers;
+        std::unordered_map<VmaAllocation, Image*> images;
+
+        for (GPUBuffer& buffer : m_bufferManager->getLiveResources())
+        {
+            // Mapped buffers are written by the CPU at any time, those writes would land in the old memory
+            if (buffer.vulkanHandle && !buffer.pool && !buffer.allocInfo.pMappedData)
+            {
+                buffers.emplace(buffer.allocation, &buffer);
+            }
+        }
+
+        for (Image& image : m_imageManager->getLiveResources())
+        {
+            // Textures are the only images with a known layout and an owner that can repoint descriptors
+            if (image.imageHandle && image.category == ImageCategory::texture && image.onEvicted &&
+                *image.imageView)
+            {
+                images.emplace(image.allocation, &image);
+            }
+        }
+
+        for (VmaDefragmentationMove& move : std::span(m_pass.pMoves, m_pass.moveCount))
+        {
+            bool moved = false;
+
+            if (auto it = buffers.find(move.srcAllocation); it != buffers.end())
+            {
+                moved = moveBuffer(*it->second, move.dstTmpAllocation);
+            }
+            else if (auto it = images.find(move.srcAllocation); it != images.end())
+            {
+                moved = moveImage(*it->second, move.dstTmpAllocation);
+            }
+
+            if (!moved)
+            {
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            }
+        }
+
+        recordCopies(cmdBuf);
+
+        m_passRunning = true;
+        m_passFrame   = m_frameNumber;
+    }
+
+    auto Defragmenter::moveBuffer(GPUBuffer& buffer, VmaAllocation dstAllocation) -> bool
+    {
+        vk::Device device = *m_device;
+
+        vk::Buffer newBuffer = device.createBuffer(vk::BufferCreateInfo {
+                                   .size  = buffer.size,
+                                   .usage = buffer.usage,
+                               }) >>
+                               ResultChecker();
+
+        if (vmaBindBufferMemory(*m_allocator, dstAllocation, newBuffer) != VK_SUCCESS)
+        {
+            device.destroyBuffer(newBuffer);
+
+            return false;
+        }
+
+        m_bufferMoves.push_back({
+            .accessor  = m_bufferManager->access(buffer.getHandle()),
+            .buffer    = &buffer,
+            .oldBuffer = std::exchange(buffer.vulkanHandle, static_cast<VkBuffer>(newBuffer)),
+        });
+
+        if (buffer.deviceAddress)
+        {
+            buffer.deviceAddress =
+                device.getBufferAddress(vk::BufferDeviceAddressInfo().setBuffer(newBuffer));
+        }
+
+        return true;
+    }
+
+    auto Defragmenter::moveImage(Image& image, VmaAllocation dstAllocation) -> bool
+    {
+        constexpr vk::ImageUsageFlags copyUsage =
+            vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+
+        if ((image.usageFlags & copyUsage) != copyUsage)
+        {
+            return false;
+        }
+
+        vk::Device device = *m_device;
+
+        vk::Image newImage = device.createImage(vk::ImageCreateInfo {
+                                 .imageType     = vk::ImageType::e2D,
+                                 .format        = image.format,
+                                 .extent        = { image.dimensions.width, image.dimensions.height, 1 },
+                                 .mipLevels     = image.mipLevels,
+                                 .arrayLayers   = 1,
+                                 .samples       = image.sampleCount,
+                                 .tiling        = vk::ImageTiling::eOptimal,
+                                 .usage         = image.usageFlags,
+                                 .sharingMode   = vk::SharingMode::eExclusive,
+                                 .initialLayout = vk::ImageLayout::eUndefined,
+                             }) >>
+                             ResultChecker();
+
+        if (vmaBindImageMemory(*m_allocator, dstAllocation, newImage) != VK_SUCCESS)
+        {
+            device.destroyImage(newImage);
+
+            return false;
+        }
+
+        m_imageMoves.push_back({
+            .accessor     = m_imageManager->access(image.getHandle()),
+            .image        = &image,
+            .oldImage     = std::exchange(image.imageHandle, static_cast<VkImage>(newImage)),
+            .oldImageView = std::move(image.imageView),
+        });
+
+        image.createImageView(image.format, image.aspectFlags, image.mipLevels);
+        image.moving = true;
+
+        // Descriptors still pointing at the old view keep working until the pass ends
+        image.onEvicted(image.getHandle(), ImageEviction::moved);
+
+        return true;
+    }
+
+    void Defragmenter::recordCopies(vk::CommandBuffer cmdBuf)
+    {
+        if (m_bufferMoves.empty() && m_imageMoves.empty())
+        {
+            return;
+        }
+
+        auto allLevels = [](Image const& image)
+        {
+            return vk::ImageSubresourceRange {
+                .aspectMask = image.aspectFlags,
+                .levelCount = vk::RemainingMipLevels,
+                .layerCount = 1,
+            };
+        };
+
+        std::vector<vk::ImageMemoryBarrier2> barriers;
+        barriers.reserve(m_imageMoves.size() * 2);
+
+        // The frames still in flight keep sampling the old images, the copy is ordered after them
+        for (ImageMove const& move : m_imageMoves)
+        {
+            barriers.push_back({
+                .srcStageMask     = vk::PipelineStageFlagBits2::eAllCommands,
+                .srcAccessMask    = vk::AccessFlagBits2::eMemoryWrite,
+                .dstStageMask     = vk::PipelineStageFlagBits2::eCopy,
+                .dstAccessMask    = vk::AccessFlagBits2::eTransferRead,
+                .oldLayout        = vk::ImageLayout::eShaderReadOnlyOptimal,
+                .newLayout        = vk::ImageLayout::eTransferSrcOptimal,
+                .image            = move.oldImage,
+                .subresourceRange = allLevels(*move.image),
+            });
+
+            barriers.push_back({
+                .srcStageMask     = vk::PipelineStageFlagBits2::eNone,
+                .srcAccessMask    = vk::AccessFlagBits2::eNone,
+                .dstStageMask     = vk::PipelineStageFlagBits2::eCopy,
+                .dstAccessMask    = vk::AccessFlagBits2::eTransferWrite,
+                .oldLayout        = vk::ImageLayout::eUndefined,
+                .newLayout        = vk::ImageLayout::eTransferDstOptimal,
+                .image            = move.image->imageHandle,
+                .subresourceRange = allLevels(*move.image),
+            });
+        }
+
+        vk::MemoryBarrier2 memoryBarrier {
+            .srcStageMask  = vk::PipelineStageFlagBits2::eAllCommands,
+            .srcAccessMask = vk::AccessFlagBits2::eMemoryWrite,
+            .dstStageMask  = vk::PipelineStageFlagBits2::eCopy,
+            .dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+        };
+
+        cmdBuf.pipelineBarrier2(
+            vk::DependencyInfo().setMemoryBarriers(memoryBarrier).setImageMemoryBarriers(barriers));
+
+        for (BufferMove const& move : m_bufferMoves)
+        {
+            cmdBuf.copyBuffer(
+                move.oldBuffer, move.buffer->vulkanHandle, vk::BufferCopy { .size = move.buffer->size });
+        }
+
+        std::vector<vk::ImageCopy> regions;
+
+        for (ImageMove const& move : m_imageMoves)
+        {
+            Image const& image = *move.image;
+
+            regions.clear();
+
+            for (uint32_t level : vi::iota(0u, image.mipLevels))
+            {
+                vk::ImageSubresourceLayers const subresource {
+                    .aspectMask = image.aspectFlags,
+                    .mipLevel   = level,
+                    .layerCount = 1,
+                };
+
+                regions.push_back(vk::ImageCopy {
+                    .srcSubresource = subresource,
+                    .dstSubresource = subresource,
+                    .extent         = { std::max(image.dimensions.width >> level, 1u),
+                                        std::max(image.dimensions.height >> level, 1u),
+                                        1 },
+                });
+            }
+
+            cmdBuf.copyImage(move.oldImage,
+                             vk::ImageLayout::eTransferSrcOptimal,
+                             image.imageHandle,
+                             vk::ImageLayout::eTransferDstOptimal,
+                             regions);
+        }
+
+        // This frame still samples the old images through descriptors that are only updated next frame
+        for (vk::ImageMemoryBarrier2& barrier : barriers)
+        {
+            barrier.srcStageMask  = vk::PipelineStageFlagBits2::eCopy;
+            barrier.srcAccessMask = barrier.dstAccessMask;
+            barrier.dstStageMask  = vk::PipelineStageFlagBits2::eAllCommands;
+            barrier.dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead;
+            barrier.oldLayout     = barrier.newLayout;
+            barrier.newLayout     = vk::ImageLayout::eShaderReadOnlyOptimal;
+        }
+
+        memoryBarrier.srcStageMask  = vk::PipelineStageFlagBits2::eCopy;
+        memoryBarrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+        memoryBarrier.dstStageMask  = vk::PipelineStageFlagBits2::eAllCommands;
+        memoryBarrier.dstAccessMask = vk::AccessFlagBits2::eMemoryRead;
+
+        cmdBuf.pipelineBarrier2(
+            vk::DependencyInfo().setMemoryBarriers(memoryBarrier).setImageMemoryBarriers(barriers));
+    }
+
+    void Defragmenter::endPass()
+    {
+        vk::Device device = *m_device;
+
+        for (BufferMove& move : m_bufferMoves)
+        {
+            device.destroyBuffer(move.oldBuffer);
+        }
+
+        for (ImageMove& move : m_imageMoves)
+        {
+            move.oldImageView.clear();
+            device.destroyImage(move.oldImage);
+
+            move.image->moving = false;
+        }
+
+        bool const madeProgress = !m_bufferMoves.empty() || !m_imageMoves.empty();
+
+        VkResult const result = vmaEndDefragmentationPass(*m_allocator, m_context, &m_pass);
+
+        // The original allocations now describe the memory their resources were moved to
+        for (BufferMove& move : m_bufferMoves)
+        {
+            vmaGetAllocationInfo(*m_allocator, move.buffer->allocation, &move.buffer->allocInfo);
+        }
+
+        m_bufferMoves.clear();
+        m_imageMoves.clear();
+
+        m_passRunning = false;
+
+        // A pass where everything had to be skipped would just be proposed again
+        if (result == VK_SUCCESS || !madeProgress)
+        {
+            finish();
+        }
+    }
+
+    void Defragmenter::finish()
+    {
+        VmaDefragmentationStats stats {};
+
+        vmaEndDefragmentation(*m_allocator, m_context, &stats);
+
+        m_context = nullptr;
+
+        m_bytesMoved += stats.bytesMoved;
+        m_bytesFreed += stats.bytesFreed;
+        m_numBlocksFreed += stats.deviceMemoryBlocksFreed;
+
+        logger::info("Defragmentation moved {} allocations ({}) and released {} of memory in {} blocks",
+                     stats.allocationsMoved,
+                     utils::largeSizeToHumanReadable(static_cast<float>(stats.bytesMoved)),
+                     utils::largeSizeToHumanReadable(static_cast<float>(stats.bytesFreed)),
+                     stats.deviceMemoryBlocksFreed);
+    }
+
+    auto Defragmenter::getUnusedBytes() const -> vk::DeviceSize
+    {
+        VmaTotalStatistics stats {};
+
+        vmaCalculateStatistics(*m_allocator, &stats);
+
+        return stats.total.statistics.blockBytes - stats.total.statistics.allocationBytes;
+    }
+}  // namespace renderer::backend
@@ -0,0 +1,207 @@
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/depth_pyramid.hpp>
+#include <mc/renderer/backend/shader.hpp>
+#include <mc/renderer/backend/vk_checker.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace renderer::backend
+{
+    namespace
+    {
+        // Matches the local size of depth_pyramid_init.comp and depth_pyramid_reduce.comp
+        constexpr uint32_t kWorkgroupSize = 8;
+
+        // Enough for a 32k render target
+        constexpr uint32_t kMaxLevels = 16;
+
+        auto divideRoundingUp(uint32_t value, uint32_t divisor) -> uint32_t
+        {
+            return (value + divisor - 1) / divisor;
+        }
+    }  // namespace
+
+    DepthPyramid::DepthPyramid(Device& device, ResourceManager<Image>& imageManager)
+        : m_device { &device }, m_imageManager { &imageManager }
+    {
+        m_sampler = device->createSampler({
+                        .magFilter    = vk::Filter::eNearest,
+                        .minFilter    = vk::Filter::eNearest,
+                        .mipmapMode   = vk::SamplerMipmapMode::eNearest,
+                        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+                        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+                        .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+                        .maxLod       = vk::LodClampNone,
+                    }) >>
+                    ResultChecker();
+
+        m_descriptorLayout =
+            DescriptorLayoutBuilder()
+                .setBinding(0, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute)
+                .setBinding(1, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute)
+                .build(device);
+
+        std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
+            { vk::DescriptorType::eCombinedImageSampler, 1 },
+            { vk::DescriptorType::eStorageImage,         1 },
+        };
+
+        m_descriptorAllocator = DescriptorAllocator(device, kMaxLevels, sizes);
+
+        m_pipelineLayout = PipelineLayout(
+            device,
+            PipelineLayoutConfig()
+                .setDescriptorSetLayouts({ m_descriptorLayout })
+                .setPushConstantSettings(sizeof(PushConstants), vk::ShaderStageFlagBits::eCompute));
+
+        ShaderManager initShader(device);
+        initShader.addShader("depth_pyramid_init.comp").build();
+
+        ShaderManager reduceShader(device);
+        reduceShader.addShader("depth_pyramid_reduce.comp").build();
+
+        m_initPipeline   = ComputePipeline(device, "depth_pyramid_init", m_pipelineLayout, initShader);
+        m_reducePipeline = ComputePipeline(device, "depth_pyramid_reduce", m_pipelineLayout, reduceShader);
+    }
+
+    void DepthPyramid::resize(vk::ImageView depthView, vk::Extent2D depthExtent)
+    {
+        uint32_t const numLevels = std::bit_width(std::max(depthExtent.width, depthExtent.height));
+
+        MC_ASSERT(numLevels <= kMaxLevels);
+
+        m_depthExtent = depthExtent;
+
+        m_levelDescriptors.clear();
+        m_levelViews.clear();
+        m_descriptorAllocator.clearDescriptors(*m_device);
+
+        m_pyramid = m_imageManager->create(
+            "depth pyramid",
+            depthExtent,
+            vk::Format::eR32Sfloat,
+            vk::SampleCountFlagBits::e1,
+            vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+            vk::ImageAspectFlagBits::eColor,
+            numLevels);
+
+        m_pyramid.setResidency(ImageCategory::renderTarget, false);
+
+        for (uint32_t level = 0; level < numLevels; ++level)
+        {
+            m_levelViews.push_back((*m_device)->createImageView({
+                                       .image            = m_pyramid.getVulkanHandle(),
+                                       .viewType         = vk::ImageViewType::e2D,
+                                       .format           = vk::Format::eR32Sfloat,
+                                       .subresourceRange = {
+                                           .aspectMask   = vk::ImageAspectFlagBits::eColor,
+                                           .baseMipLevel = level,
+                                           .levelCount   = 1,
+                                           .layerCount   = 1,
+                                       },
+                                   }) >>
+                                   ResultChecker());
+
+            vk::DescriptorSet set = m_descriptorAllocator.allocate(*m_device, m_descriptorLayout);
+
+            DescriptorWriter writer;
+
+            if (level == 0)
+            {
+                writer.writeImage(0,
+                                  depthView,
+                                  m_sampler,
+                                  vk::ImageLayout::eShaderReadOnlyOptimal,
+                                  vk::DescriptorType::eCombinedImageSampler);
+            }
+            else
+            {
+                writer.writeImage(0,
+                                  m_levelViews[level - 1],
+                                  m_sampler,
+                                  vk::ImageLayout::eGeneral,
+                                  vk::DescriptorType::eCombinedImageSampler);
+            }
+
+            writer.writeImage(1,
+                              m_levelViews[level],
+                              nullptr,
+                              vk::ImageLayout::eGeneral,
+                              vk::DescriptorType::eStorageImage);
+            writer.updateSet(*m_device, set);
+
+            m_levelDescriptors.push_back(set);
+        }
+    }
+
+    void DepthPyramid::record(vk::CommandBuffer cmdBuf)
+    {
+        MC_ASSERT_MSG(!m_levelDescriptors.empty(), "The depth pyramid was never sized");
+
+        // Last frame's culling pass is done reading the pyramid by the time this frame's pass starts
+        vk::ImageMemoryBarrier2 const beginBarrier {
+            .srcStageMask     = vk::PipelineStageFlagBits2::eComputeShader,
+            .srcAccessMask    = vk::AccessFlagBits2::eNone,
+            .dstStageMask     = vk::PipelineStageFlagBits2::eComputeShader,
+            .dstAccessMask    = vk::AccessFlagBits2::eShaderStorageWrite,
+            .oldLayout        = vk::ImageLayout::eUndefined,
+            .newLayout        = vk::ImageLayout::eGeneral,
+            .image            = m_pyramid.getVulkanHandle(),
+            .subresourceRange = {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .levelCount = vk::RemainingMipLevels,
+                .layerCount = 1,
+            },
+        };
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(beginBarrier));
+
+        vk::Extent2D srcExtent = m_depthExtent;
+        vk::Extent2D dstExtent = getExtent();
+
+        cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_initPipeline);
+
+        for (uint32_t level = 0; level < m_levelDescriptors.size(); ++level)
+        {
+            if (level == 1)
+            {
+                cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, m_reducePipeline);
+            }
+
+            PushConstants const pushConstants {
+                .srcWidth  = srcExtent.width,
+                .srcHeight = srcExtent.height,
+                .dstWidth  = dstExtent.width,
+                .dstHeight = dstExtent.height,
+            };
+
+            cmdBuf.bindDescriptorSets(
+                vk::PipelineBindPoint::eCompute, m_pipelineLayout, 0, m_levelDescriptors[level], {});
+            cmdBuf.pushConstants(m_pipelineLayout,
+                                 vk::ShaderStageFlagBits::eCompute,
+                                 0,
+                                 sizeof(PushConstants),
+                                 &pushConstants);
+            cmdBuf.dispatch(divideRoundingUp(dstExtent.width, kWorkgroupSize),
+                            divideRoundingUp(dstExtent.height, kWorkgroupSize),
+                            1);
+
+            // The next level and the culling pass read what was just written
+            vk::MemoryBarrier2 const levelBarrier {
+                .srcStageMask  = vk::PipelineStageFlagBits2::eComputeShader,
+                .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+                .dstStageMask  = vk::PipelineStageFlagBits2::eComputeShader,
+                .dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead,
+            };
+
+            cmdBuf.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(levelBarrier));
+
+            srcExtent = dstExtent;
+            dstExtent = {
+                .width  = std::max(dstExtent.width / 2, 1u),
+                .height = std::max(dstExtent.height / 2, 1u),
+            };
+        }
+    }
+}  // namespace renderer::backend
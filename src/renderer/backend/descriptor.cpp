@@ -19,7 +19,19 @@ namespace renderer::backend
     {
         std::vector bindings = m_bindings | vi::values | rn::to<std::vector>();
 
+        // Has to be in the same order as the bindings
+        std::vector bindingFlags = bindings |
+                                   vi::transform(
+                                       [this](vk::DescriptorSetLayoutBinding const& binding)
+                                       {
+                                           return m_bindingFlags.at(binding.binding);
+                                       }) |
+                                   rn::to<std::vector>();
+
+        auto flagsInfo = vk::DescriptorSetLayoutBindingFlagsCreateInfo().setBindingFlags(bindingFlags);
+
         vk::DescriptorSetLayoutCreateInfo info = {
+            .pNext        = &flagsInfo,
             .flags        = flags,
             .bindingCount = utils::size(m_bindings),
             .pBindings    = bindings.data(),
@@ -7,12 +7,15 @@
 #include <mc/renderer/backend/vk_checker.hpp>
 #include <mc/utils.hpp>
 
+#include <algorithm>
 #include <unordered_set>
 
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_enums.hpp>
 #include <vulkan/vulkan_raii.hpp>
 
+namespace rn = std::ranges;
+
 namespace
 {
     using namespace renderer::backend;
@@ -26,6 +29,12 @@ namespace
 #endif
     };
 
+    // Enabled whenever the device has them
+    constexpr std::array optionalExtensions
+    {
+        vk::EXTMemoryBudgetExtensionName,
+    };
+
     // clang-format on
 
     bool areAllQueueFamiliesPresent(QueueFamilyIndices const& indices)
@@ -270,18 +279,26 @@ namespace renderer::backend
                            vk::PhysicalDeviceVulkan13Features,vk::PhysicalDeviceShaderDrawParametersFeatures >
             chain {
                 {
-                 .features = { .sampleRateShading             = true,
-                               .multiDrawIndirect             = true, 
+                 // Geometry shaders aren't used, but fragment shaders need the capability for gl_PrimitiveID
+                 .features = { .geometryShader                = true,
+                               .sampleRateShading             = true,
+                               .multiDrawIndirect             = true,
+                               .drawIndirectFirstInstance     = true,
                                .fillModeNonSolid              = true,
                                .samplerAnisotropy             = true,
                                .shaderStorageImageMultisample = true, },
                  },
                 {
-                 .descriptorIndexing                        = true,
-                 .shaderSampledImageArrayNonUniformIndexing = true,
-                 .descriptorBindingPartiallyBound           = true,
-                 .runtimeDescriptorArray                    = true,
-                 .bufferDeviceAddress                       = true,
+                 .drawIndirectCount                            = true,
+                 .descriptorIndexing                           = true,
+                 .shaderSampledImageArrayNonUniformIndexing    = true,
+                 .descriptorBindingSampledImageUpdateAfterBind = true,
+                 .descriptorBindingUpdateUnusedWhilePending    = true,
+                 .descriptorBindingPartiallyBound              = true,
+                 .descriptorBindingVariableDescriptorCount     = true,
+                 .runtimeDescriptorArray                       = true,
+                 .timelineSemaphore                            = true,
+                 .bufferDeviceAddress                          = true,
                  },
 
                 {
@@ -293,11 +310,43 @@ namespace renderer::backend
                 },
         };
 
+        std::vector<char const*> extensions(requiredExtensions.begin(), requiredExtensions.end());
+
+        std::vector<vk::ExtensionProperties> availableExtensions =
+            m_physicalHandle.enumerateDeviceExtensionProperties() >> ResultChecker();
+
+        for (std::string_view extension : optionalExtensions)
+        {
+            bool const available = rn::contains(availableExtensions,
+                                                extension,
+                                                [](vk::ExtensionProperties const& properties)
+                                                {
+                                                    return std::string_view { properties.extensionName };
+                                                });
+
+            if (!available)
+            {
+                continue;
+            }
+
+            extensions.push_back(extension.data());
+
+            if (extension == vk::EXTMemoryBudgetExtensionName)
+            {
+                m_memoryBudgetSupported = true;
+            }
+        }
+
+        if (!m_memoryBudgetSupported)
+        {
+            logger::info("VK_EXT_memory_budget is not supported, memory budgets are estimated");
+        }
+
         m_logicalHandle =
             m_physicalHandle.createDevice(vk::DeviceCreateInfo()
                                               .setPNext(&chain.get<vk::PhysicalDeviceFeatures2>())
                                               .setQueueCreateInfos(queueCreateInfos)
-                                              .setPEnabledExtensionNames(requiredExtensions)) >>
+                                              .setPEnabledExtensionNames(extensions)) >>
             ResultChecker();
 
         // Already checked that these families exist, no error handling needed here
@@ -0,0 +1,76 @@
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/frame_allocator.hpp>
+
+#include <algorithm>
+
+namespace renderer::backend
+{
+    namespace
+    {
+        auto alignUp(vk::DeviceSize value, vk::DeviceSize alignment) -> vk::DeviceSize
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }  // namespace
+
+    FrameAllocator::FrameAllocator(Device& device,
+                                   ResourceManager<GPUBuffer>& bufferManager,
+                                   vk::DeviceSize regionSize)
+    {
+        vk::PhysicalDeviceLimits const limits = device.getDeviceProperties().limits;
+
+        m_minAlignment =
+            std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+        m_regionSize = alignUp(regionSize, m_minAlignment);
+
+        m_buffer = bufferManager.create(
+            "Per-frame data",
+            m_regionSize * kNumFramesInFlight,
+            vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+                vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+            // Sequential writes without a host preference put this in host visible VRAM when there is some
+            VMA_MEMORY_USAGE_AUTO,
+            VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+
+        m_data = static_cast<std::byte*>(m_buffer.getMappedData());
+
+        m_address = m_buffer.getDeviceAddress();
+    }
+
+    void FrameAllocator::beginFrame(uint32_t frameIndex)
+    {
+        MC_ASSERT(frameIndex < kNumFramesInFlight);
+
+        m_frameIndex = frameIndex;
+        m_head       = getRegionStart();
+    }
+
+    void FrameAllocator::endFrame()
+    {
+        if (vk::DeviceSize const used = getUsedSize(); used > 0)
+        {
+            m_buffer.flush(getRegionStart(), used);
+        }
+    }
+
+    auto FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) -> FrameAllocation
+    {
+        vk::DeviceSize const offset = alignUp(m_head, std::max(alignment, m_minAlignment));
+
+        MC_ASSERT_MSG(offset + size <= getRegionStart() + m_regionSize,
+                      "Per-frame allocator ran out of space ({} bytes requested, {} of {} used)",
+                      size,
+                      getUsedSize(),
+                      m_regionSize);
+
+        m_head = offset + size;
+
+        return {
+            .data    = m_data + offset,
+            .buffer  = m_buffer,
+            .offset  = offset,
+            .size    = size,
+            .address = m_address + offset,
+        };
+    }
+}  // namespace renderer::backend
@@ -132,10 +132,15 @@ namespace renderer::backend
 
     void Model::loadAnimations(tinygltf::Model& gltfModel)
     {
+        animations.reserve(gltfModel.animations.size());
+
         for (tinygltf::Animation& anim : gltfModel.animations)
         {
             Animation animation { .name = anim.name.empty() ? std::to_string(animations.size()) : anim.name };
 
+            animation.samplers.reserve(anim.samplers.size());
+            animation.channels.reserve(anim.channels.size());
+
             for (auto& samp : anim.samplers)
             {
                 AnimationSampler sampler {};
@@ -166,10 +171,7 @@ namespace renderer::backend
                     void const* dataPtr = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
                     float const* buf    = static_cast<float const*>(dataPtr);
 
-                    for (size_t index = 0; index < accessor.count; index++)
-                    {
-                        sampler.inputs.push_back(buf[index]);
-                    }
+                    sampler.inputs.assign(buf, buf + accessor.count);
 
                     for (auto input : sampler.inputs)
                     {
@@ -194,31 +196,29 @@ namespace renderer::backend
 
                     void const* dataPtr = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
 
+                    // The keyframes are tightly packed, `outputs` is a flat copy of them
                     switch (accessor.type)
                     {
                         case TINYGLTF_TYPE_VEC3:
                             {
                                 glm::vec3 const* buf = static_cast<glm::vec3 const*>(dataPtr);
+
+                                sampler.outputsVec4.resize(accessor.count);
+
                                 for (size_t index = 0; index < accessor.count; index++)
                                 {
-                                    sampler.outputsVec4.push_back(glm::vec4(buf[index], 0.0f));
-                                    sampler.outputs.push_back(buf[index][0]);
-                                    sampler.outputs.push_back(buf[index][1]);
-                                    sampler.outputs.push_back(buf[index][2]);
+                                    sampler.outputsVec4[index] = glm::vec4(buf[index], 0.0f);
                                 }
+
+                                sampler.outputs.assign(&buf[0][0], &buf[0][0] + accessor.count * 3);
                                 break;
                             }
                         case TINYGLTF_TYPE_VEC4:
                             {
                                 glm::vec4 const* buf = static_cast<glm::vec4 const*>(dataPtr);
-                                for (size_t index = 0; index < accessor.count; index++)
-                                {
-                                    sampler.outputsVec4.push_back(buf[index]);
-                                    sampler.outputs.push_back(buf[index][0]);
-                                    sampler.outputs.push_back(buf[index][1]);
-                                    sampler.outputs.push_back(buf[index][2]);
-                                    sampler.outputs.push_back(buf[index][3]);
-                                }
+
+                                sampler.outputsVec4.assign(buf, buf + accessor.count);
+                                sampler.outputs.assign(&buf[0][0], &buf[0][0] + accessor.count * 4);
                                 break;
                             }
                         default:
@@ -229,7 +229,7 @@ namespace renderer::backend
                     }
                 }
 
-                animation.samplers.push_back(sampler);
+                animation.samplers.push_back(std::move(sampler));
             }
 
             // Channels
@@ -269,7 +269,7 @@ namespace renderer::backend
                 animation.channels.push_back(channel);
             }
 
-            animations.push_back(animation);
+            animations.push_back(std::move(animation));
         }
     }
 
@@ -334,6 +334,15 @@ namespace renderer::backend
             {
                 node->update();
             }
+
+            std::vector<BoundingBox> const bounds = computePrimitiveBounds();
+
+            for (uint32_t primitive = 0; primitive < bounds.size(); ++primitive)
+            {
+                bvh.setBounds(primitive, bounds[primitive]);
+            }
+
+            bvh.refit();
         }
     }
 }  // namespace renderer::backend
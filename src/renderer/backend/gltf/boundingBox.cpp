@@ -3,7 +3,7 @@
 
 namespace renderer::backend
 {
-    BoundingBox BoundingBox::getAABB(glm::mat4 m)
+    BoundingBox BoundingBox::getAABB(glm::mat4 m) const
     {
         glm::vec3 min = glm::vec3(m[3]);
         glm::vec3 max = min;
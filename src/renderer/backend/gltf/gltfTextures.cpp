@@ -1,26 +1,223 @@
+#include <mc/arena.hpp>
 #include <mc/renderer/backend/constants.hpp>
 #include <mc/renderer/backend/gltf/gltfTextures.hpp>
 #include <mc/renderer/backend/gltf/loader.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory_resource>
 #include <ranges>
 
 #include "basisu_transcoder.h"
 
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace rn = std::ranges;
 namespace vi = std::ranges::views;
 
+namespace
+{
+    // The endpoints are the block's extremes, the 6 values in between are interpolated by the hardware
+    void encodeBC4Block(std::array<uint8_t, 16> const& values, uint8_t* block)
+    {
+        auto const [min, max] = rn::minmax(values);
+
+        block[0] = max;
+        block[1] = min;
+
+        uint64_t indices = 0;
+
+        if (max != min)
+        {
+            // With red0 > red1, index 0 and 1 are the endpoints and 2..7 step from red0 towards red1
+            std::array<int, 8> palette { max, min };
+
+            for (int i = 1; i < 7; ++i)
+            {
+                palette[i + 1] = ((7 - i) * max + i * min + 3) / 7;
+            }
+
+            for (auto [pixel, value] : vi::enumerate(values))
+            {
+                auto distance = [value](int entry) { return std::abs(entry - value); };
+
+                uint64_t const index = rn::distance(palette.begin(), rn::min_element(palette, {}, distance));
+
+                indices |= index << (3 * pixel);
+            }
+        }
+
+        for (int i = 0; i < 6; ++i)
+        {
+            block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+        }
+    }
+
+    // Appends the BC5 blocks of a two channel image, edge pixels are repeated for partial blocks
+    void encodeBC5(std::span<uint8_t const> texels, vk::Extent2D extent, std::vector<unsigned char>& out)
+    {
+        uint32_t const blocksX = (extent.width + 3) / 4;
+        uint32_t const blocksY = (extent.height + 3) / 4;
+
+        size_t const firstBlock = out.size();
+
+        out.resize(firstBlock + static_cast<size_t>(blocksX) * blocksY * 16);
+
+        for (uint32_t by = 0; by < blocksY; ++by)
+        {
+            for (uint32_t bx = 0; bx < blocksX; ++bx)
+            {
+                std::array<uint8_t, 16> red, green;
+
+                for (uint32_t p = 0; p < 16; ++p)
+                {
+                    uint32_t const x = std::min(bx * 4 + p % 4, extent.width - 1);
+                    uint32_t const y = std::min(by * 4 + p / 4, extent.height - 1);
+
+                    red[p]   = texels[(y * extent.width + x) * 2];
+                    green[p] = texels[(y * extent.width + x) * 2 + 1];
+                }
+
+                uint8_t* block = &out[firstBlock + (static_cast<size_t>(by) * blocksX + bx) * 16];
+
+                encodeBC4Block(red, block);
+                encodeBC4Block(green, block + 8);
+            }
+        }
+    }
+
+    auto decodeNormal(uint8_t x, uint8_t y) -> glm::vec3
+    {
+        glm::vec2 const xy = glm::vec2(x, y) / 127.5f - 1.0f;
+
+        return { xy, std::sqrt(std::max(1.0f - glm::dot(xy, xy), 0.0f)) };
+    }
+
+    // Box filters the normals instead of the encoded values so the next level stays unit length
+    void downsampleNormals(std::span<uint8_t const> texels,
+                           vk::Extent2D extent,
+                           std::pmr::vector<uint8_t>& result)
+    {
+        uint32_t const width  = std::max(extent.width / 2, 1u);
+        uint32_t const height = std::max(extent.height / 2, 1u);
+
+        result.resize(static_cast<size_t>(width) * height * 2);
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                glm::vec3 sum { 0.0f };
+
+                for (uint32_t i = 0; i < 4; ++i)
+                {
+                    uint32_t const srcX = std::min(x * 2 + i % 2, extent.width - 1);
+                    uint32_t const srcY = std::min(y * 2 + i / 2, extent.height - 1);
+
+                    size_t const src = (static_cast<size_t>(srcY) * extent.width + srcX) * 2;
+
+                    sum += decodeNormal(texels[src], texels[src + 1]);
+                }
+
+                glm::vec3 const normal =
+                    glm::dot(sum, sum) > 0.0f ? glm::normalize(sum) : glm::vec3 { 0.0f, 0.0f, 1.0f };
+
+                size_t const dst = (static_cast<size_t>(y) * width + x) * 2;
+
+                result[dst]     = static_cast<uint8_t>(std::round((normal.x * 0.5f + 0.5f) * 255.0f));
+                result[dst + 1] = static_cast<uint8_t>(std::round((normal.y * 0.5f + 0.5f) * 255.0f));
+            }
+        }
+    }
+
+    // 2x2 box filter, what a linear blit of the level above would produce
+    void downsampleRGBA(std::span<uint8_t const> texels,
+                        vk::Extent2D extent,
+                        std::pmr::vector<uint8_t>& result)
+    {
+        uint32_t const width  = std::max(extent.width / 2, 1u);
+        uint32_t const height = std::max(extent.height / 2, 1u);
+
+        result.resize(static_cast<size_t>(width) * height * 4);
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                for (uint32_t channel = 0; channel < 4; ++channel)
+                {
+                    uint32_t sum = 0;
+
+                    for (uint32_t i = 0; i < 4; ++i)
+                    {
+                        uint32_t const srcX = std::min(x * 2 + i % 2, extent.width - 1);
+                        uint32_t const srcY = std::min(y * 2 + i / 2, extent.height - 1);
+
+                        sum += texels[(static_cast<size_t>(srcY) * extent.width + srcX) * 4 + channel];
+                    }
+
+                    size_t const dst = (static_cast<size_t>(y) * width + x) * 4 + channel;
+
+                    result[dst] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+}  // namespace
+
 namespace renderer::backend
 {
     // Loads the image for this texture. Supports both glTF's web formats (jpg, png, embedded and external files) as well as external KTX2 files with basis universal texture compression
     GlTFTexture::GlTFTexture(Device& device,
-                             CommandManager& cmdManager,
-                             ResourceManager<GPUBuffer>& bufferManager,
+                             UploadManager& uploadManager,
                              ResourceManager<Image>& imageManager,
-                             tinygltf::Image& gltfimage,
-                             std::filesystem::path path,
-                             TextureSampler textureSampler)
-        : m_device { &device }, m_commandManager { &cmdManager }
+                             BindlessRegistry& bindlessRegistry,
+                             tinygltf::Image const& gltfimage,
+                             std::vector<TextureSource> sources,
+                             TextureSampler textureSampler,
+                             TextureEncoding requestedEncoding)
+        : m_sources { std::move(sources) },
+          m_requestedEncoding { requestedEncoding },
+          m_device { &device },
+          m_bindlessRegistry { &bindlessRegistry }
+    {
+        MipChain const mipChain = buildMipChain(device, gltfimage, requestedEncoding);
+
+        encoding = mipChain.encoding;
+        m_levels = mipChain.levels;
+        m_size   = mipChain.data.size();
+
+        // Batched with the rest of the model, the loader waits for the whole batch once
+        uploadMipChain(mipChain, uploadManager, imageManager, 0);
+
+        // The lod isn't clamped to the mip count so that textures with the same
+        // sampling state can share a sampler regardless of their size
+        sampler = bindlessRegistry.getSampler(vk::SamplerCreateInfo {
+            .magFilter        = textureSampler.magFilter,
+            .minFilter        = textureSampler.minFilter,
+            .mipmapMode       = vk::SamplerMipmapMode::eLinear,
+            .addressModeU     = textureSampler.addressModeU,
+            .addressModeV     = textureSampler.addressModeV,
+            .addressModeW     = textureSampler.addressModeW,
+            .anisotropyEnable = VK_TRUE,
+            .maxAnisotropy    = 8.0f,
+            .compareOp        = vk::CompareOp::eNever,
+            .maxLod           = vk::LodClampNone,
+            .borderColor      = vk::BorderColor::eFloatOpaqueWhite,
+        });
+
+        bindlessIndex = bindlessRegistry.registerTexture(texture.getImageView(), sampler);
+    }
+
+    auto GlTFTexture::buildMipChain(Device const& device,
+                                    tinygltf::Image const& gltfimage,
+                                    TextureEncoding requestedEncoding) -> MipChain
     {
+        MipChain mipChain { .encoding = TextureEncoding::automatic };
+
         // KTX2 files need to be handled explicitly
         bool isKtx2 = false;
 
@@ -36,41 +233,43 @@ namespace renderer::backend
 
         uint32_t width, height, mipLevels;
 
-        if (isKtx2)
-        {
-            // Image is KTX2 using basis universal compression. Those images need to be loaded from disk and will be transcoded to a native GPU format
+        // Only the final mip chain is returned, everything in between lives in the thread's scratch arena
+        memory::ArenaScope scratch;
+        std::pmr::memory_resource* const arena = &scratch.getArena();
 
-            basist::ktx2_transcoder ktxTranscoder;
+        auto formatSupported = [&device](vk::Format format)
+        {
+            vk::FormatProperties formatProperties = device.getFormatProperties(format);
 
-            std::filesystem::path const filename = path / gltfimage.uri;
+            return ((formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eTransferDst) &&
+                    (formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage));
+        };
 
-            std::ifstream ifs(filename, std::ios::binary | std::ios::in | std::ios::ate);
+        // BC5 is encoded from the decoded 8 bit pixels, anything else keeps the regular path
+        bool const encodeAsBC5 = !isKtx2 && requestedEncoding == TextureEncoding::normalMapBC5 &&
+                                 gltfimage.bits == 8 && gltfimage.component >= 2 &&
+                                 device.getDeviceFeatures().textureCompressionBC &&
+                                 formatSupported(vk::Format::eBc5UnormBlock);
 
-            MC_ASSERT_MSG(ifs.is_open(), "Could not load the requested image file {}", filename.string());
+        if (isKtx2)
+        {
+            // Image is KTX2 using basis universal compression. The loader already read the file (in one batch
+            // with every other image), it's kept as is and transcoded to a native GPU format here
 
-            uint32_t inputDataSize = static_cast<uint32_t>(ifs.tellg());
-            char* inputData        = new char[inputDataSize];
+            basist::ktx2_transcoder ktxTranscoder;
 
-            ifs.seekg(0, std::ios::beg);
-            ifs.read(inputData, inputDataSize);
+            MC_ASSERT_MSG(!gltfimage.image.empty(), "KTX2 image file {} was not loaded", gltfimage.uri);
 
-            MC_ASSERT_MSG(ktxTranscoder.init(inputData, inputDataSize),
-                          "Could not initialize ktx2 transcoder for image file {}",
-                          filename.string());
+            MC_ASSERT_MSG(
+                ktxTranscoder.init(gltfimage.image.data(), static_cast<uint32_t>(gltfimage.image.size())),
+                "Could not initialize ktx2 transcoder for image file {}",
+                gltfimage.uri);
 
             // Select target format based on device features (use uncompressed if none supported)
             auto targetFormat = basist::transcoder_texture_format::cTFRGBA32;
 
             auto deviceFeatures = device.getDeviceFeatures();
 
-            auto formatSupported = [&device](vk::Format format)
-            {
-                vk::FormatProperties formatProperties = device.getFormatProperties(format);
-
-                return ((formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eTransferDst) &&
-                        (formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage));
-            };
-
             if (deviceFeatures.textureCompressionBC)
             {
                 // BC7 is the preferred block compression if available
@@ -112,7 +311,7 @@ namespace renderer::backend
             bool const targetFormatIsUncompressed =
                 basist::basis_transcoder_format_is_uncompressed(targetFormat);
 
-            std::vector<basist::ktx2_image_level_info> levelInfos(ktxTranscoder.get_levels());
+            std::pmr::vector<basist::ktx2_image_level_info> levelInfos(ktxTranscoder.get_levels(), arena);
 
             mipLevels = ktxTranscoder.get_levels();
 
@@ -126,376 +325,297 @@ namespace renderer::backend
             width  = levelInfos[0].m_orig_width;
             height = levelInfos[0].m_orig_height;
 
-            // Create one staging buffer large enough to hold all uncompressed image levels
+            // Transcode all mip levels into one buffer that gets uploaded in a single go
             uint32_t const bytesPerBlockOrPixel = basist::basis_get_bytes_per_block_or_pixel(targetFormat);
-            uint32_t numBlocksOrPixels          = 0;
-            VkDeviceSize totalBufferSize        = 0;
-            for (uint32_t i = 0; i < mipLevels; i++)
+
+            auto numBlocksOrPixels = [&](uint32_t level) -> uint32_t
             {
                 // Size calculations differ for compressed/uncompressed formats
-                numBlocksOrPixels = targetFormatIsUncompressed
-                                        ? levelInfos[i].m_orig_width * levelInfos[i].m_orig_height
-                                        : levelInfos[i].m_total_blocks;
-                totalBufferSize += numBlocksOrPixels * bytesPerBlockOrPixel;
-            }
+                return targetFormatIsUncompressed
+                           ? levelInfos[level].m_orig_width * levelInfos[level].m_orig_height
+                           : levelInfos[level].m_total_blocks;
+            };
+
+            std::vector<MipLevel>& levels = mipChain.levels;
+            levels.resize(mipLevels);
+
+            vk::DeviceSize totalBufferSize = 0;
+
+            for (uint32_t i = 0; i < mipLevels; i++)
+            {
+                levels[i] = {
+                    .extent = { levelInfos[i].m_orig_width, levelInfos[i].m_orig_height },
+                    .offset = totalBufferSize,
+                };
 
-            auto stagingBuffer = bufferManager.create("Image staging buffer (compressed)",
-                                                      totalBufferSize,
-                                                      vk::BufferUsageFlagBits::eTransferSrc,
-                                                      VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                                                      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-                                                          VMA_ALLOCATION_CREATE_MAPPED_BIT);
+                totalBufferSize += numBlocksOrPixels(i) * bytesPerBlockOrPixel;
+            }
 
-            unsigned char* buffer    = new unsigned char[totalBufferSize];
-            unsigned char* bufferPtr = &buffer[0];
+            std::vector<unsigned char>& buffer = mipChain.data;
+            buffer.resize(totalBufferSize);
 
             MC_ASSERT_MSG(ktxTranscoder.start_transcoding(),
                           "Could not start transcoding for image file {}",
-                          filename.string());
+                          gltfimage.uri);
 
-            // Transcode all mip levels into the staging buffer
             for (uint32_t i = 0; i < mipLevels; i++)
             {
-                // Size calculations differ for compressed/uncompressed formats
-                numBlocksOrPixels = targetFormatIsUncompressed
-                                        ? levelInfos[i].m_orig_width * levelInfos[i].m_orig_height
-                                        : levelInfos[i].m_total_blocks;
-
                 MC_ASSERT_MSG(ktxTranscoder.transcode_image_level(
-                                  i, 0, 0, bufferPtr, numBlocksOrPixels, targetFormat, 0),
+                                  i, 0, 0, &buffer[levels[i].offset], numBlocksOrPixels(i), targetFormat, 0),
                               "Could not transcode the requested image file {}",
-                              filename.string());
-
-                bufferPtr += numBlocksOrPixels * bytesPerBlockOrPixel;
+                              gltfimage.uri);
             }
 
-            std::memcpy(stagingBuffer.getMappedData(), buffer, totalBufferSize);
-
-            // FIXME(aether) stop using imageManager here
-            // differ all this processing to the Texture class
-            texture = imageManager.create(std::format("Compressed gltf texture ({})", gltfimage.uri),
-                                          vk::Extent2D { width, height },
-                                          format,
-                                          vk::SampleCountFlagBits::e1,
-                                          vk::ImageUsageFlagBits::eTransferSrc |
-                                              vk::ImageUsageFlagBits::eTransferDst |
-                                              vk::ImageUsageFlagBits::eSampled,
-                                          vk::ImageAspectFlagBits::eColor,
-                                          mipLevels);
+            mipChain.name = std::format("Compressed gltf texture ({})", gltfimage.uri);
+        }
+        else if (encodeAsBC5)
+        {
+            // Normal maps only need two channels, BC5 keeps both at 8 bits in half the size of RGBA8
+            mipChain.encoding = TextureEncoding::normalMapBC5;
+            format            = vk::Format::eBc5UnormBlock;
 
-            ScopedCommandBuffer copyCmd(
-                device, cmdManager.getTransferCmdPool(), device.getTransferQueue(), true);
+            width     = gltfimage.width;
+            height    = gltfimage.height;
+            mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
 
-            vk::ImageSubresourceRange subresourceRange = {
-                .aspectMask = vk::ImageAspectFlagBits::eColor,
-                .levelCount = mipLevels,
-                .layerCount = 1,
-            };
+            // Each level is downsampled from the previous one, the two buffers swap roles every level
+            std::pmr::vector<uint8_t> normals(static_cast<size_t>(width) * height * 2, arena);
+            std::pmr::vector<uint8_t> downsampled(arena);
 
-            vk::ImageMemoryBarrier imageMemoryBarrier {
-                .srcAccessMask    = vk::AccessFlagBits::eNone,
-                .dstAccessMask    = vk::AccessFlagBits::eTransferWrite,
-                .oldLayout        = vk::ImageLayout::eUndefined,
-                .newLayout        = vk::ImageLayout::eTransferDstOptimal,
-                .image            = texture,
-                .subresourceRange = subresourceRange,
-            };
+            for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i)
+            {
+                normals[i * 2]     = gltfimage.image[i * gltfimage.component];
+                normals[i * 2 + 1] = gltfimage.image[i * gltfimage.component + 1];
+            }
 
-            copyCmd->pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
-                                     vk::PipelineStageFlagBits::eAllCommands,
-                                     {},
-                                     {},
-                                     {},
-                                     { imageMemoryBarrier });
+            std::vector<MipLevel>& levels       = mipChain.levels;
+            std::vector<unsigned char>& buffer = mipChain.data;
+            levels.resize(mipLevels);
 
-            // Transcode and copy all image levels
-            vk::DeviceSize bufferOffset = 0;
+            size_t totalBlocks = 0;
 
             for (uint32_t i = 0; i < mipLevels; i++)
             {
-                // Size calculations differ for compressed/uncompressed formats
-                numBlocksOrPixels   = targetFormatIsUncompressed
-                                          ? levelInfos[i].m_orig_width * levelInfos[i].m_orig_height
-                                          : levelInfos[i].m_total_blocks;
-                uint32_t outputSize = numBlocksOrPixels * bytesPerBlockOrPixel;
-
-                vk::BufferImageCopy bufferCopyRegion {
-                    .bufferOffset = bufferOffset,
-                    .imageSubresource {
-                                       .aspectMask     = vk::ImageAspectFlagBits::eColor,
-                                       .mipLevel       = i,
-                                       .baseArrayLayer = 0,
-                                       .layerCount     = 1,
-                                       },
-                    .imageExtent {
-                                       .width  = levelInfos[i].m_orig_width,
-                                       .height = levelInfos[i].m_orig_height,
-                                       .depth  = 1,
-                                       },
-                };
+                totalBlocks += static_cast<size_t>((std::max(width >> i, 1u) + 3) / 4) *
+                               ((std::max(height >> i, 1u) + 3) / 4);
+            }
 
-                copyCmd->copyBufferToImage(
-                    stagingBuffer, texture, vk::ImageLayout::eTransferDstOptimal, { bufferCopyRegion });
+            buffer.reserve(totalBlocks * 16);
 
-                bufferOffset += outputSize;
-            }
+            for (uint32_t i = 0; i < mipLevels; i++)
+            {
+                vk::Extent2D const extent { std::max(width >> i, 1u), std::max(height >> i, 1u) };
+
+                if (i > 0)
+                {
+                    downsampleNormals(normals, levels[i - 1].extent, downsampled);
+                    std::swap(normals, downsampled);
+                }
 
-            imageMemoryBarrier.oldLayout        = vk::ImageLayout::eTransferDstOptimal;
-            imageMemoryBarrier.newLayout        = vk::ImageLayout::eShaderReadOnlyOptimal;
-            imageMemoryBarrier.srcAccessMask    = vk::AccessFlagBits::eTransferWrite;
-            imageMemoryBarrier.dstAccessMask    = vk::AccessFlagBits::eShaderRead;
-            imageMemoryBarrier.image            = texture;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
+                levels[i] = { .extent = extent, .offset = buffer.size() };
 
-            copyCmd->pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
-                                     vk::PipelineStageFlagBits::eAllCommands,
-                                     {},
-                                     {},
-                                     {},
-                                     { imageMemoryBarrier });
+                encodeBC5(normals, extent, buffer);
+            }
 
-            delete[] buffer;
-            delete[] inputData;
+            mipChain.name = std::format("BC5 gltf normal map ({})", gltfimage.uri);
         }
         else
         {
-            // Image is a basic glTF format like png or jpg and can be loaded directly via tinyglTF
-            unsigned char* buffer     = nullptr;
-            vk::DeviceSize bufferSize = 0;
-            bool deleteBuffer         = false;
+            // Image is a basic glTF format like png or jpg and can be loaded directly via tinyglTF. The mip
+            // chain is box filtered on the CPU, evicted textures get reloaded from it at any level.
+            // Most devices don't support RGB only on Vulkan, those get expanded to RGBA first
+            width     = gltfimage.width;
+            height    = gltfimage.height;
+            mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+
+            // Each level is downsampled from the previous one, the two buffers swap roles every level
+            std::pmr::vector<uint8_t> texels(static_cast<size_t>(width) * height * 4, arena);
+            std::pmr::vector<uint8_t> downsampled(arena);
 
             if (gltfimage.component == 3)
             {
-                // Most devices don't support RGB only on Vulkan so convert if necessary
-                bufferSize          = gltfimage.width * gltfimage.height * 4;
-                buffer              = new unsigned char[bufferSize];
-                unsigned char* rgba = buffer;
-                unsigned char* rgb  = &gltfimage.image[0];
-                for (int32_t i = 0; i < gltfimage.width * gltfimage.height; ++i)
+                unsigned char const* rgb = gltfimage.image.data();
+                uint8_t* rgba            = texels.data();
+
+                for (int32_t i = 0; i < gltfimage.width * gltfimage.height; ++i, rgba += 4, rgb += 3)
                 {
-                    for (int32_t j = 0; j < 3; ++j)
-                    {
-                        rgba[j] = rgb[j];
-                    }
-                    rgba += 4;
-                    rgb += 3;
+                    rgba[0] = rgb[0];
+                    rgba[1] = rgb[1];
+                    rgba[2] = rgb[2];
+                    rgba[3] = 255;
                 }
-                deleteBuffer = true;
             }
             else
             {
-                buffer     = &gltfimage.image[0];
-                bufferSize = gltfimage.image.size();
+                std::memcpy(
+                    texels.data(), gltfimage.image.data(), std::min(texels.size(), gltfimage.image.size()));
             }
 
-            width     = gltfimage.width;
-            height    = gltfimage.height;
-            mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+            std::vector<MipLevel>& levels       = mipChain.levels;
+            std::vector<unsigned char>& buffer = mipChain.data;
+            levels.resize(mipLevels);
 
-            MC_ASSERT_MSG(device.getFormatProperties(format).optimalTilingFeatures &
-                              (vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst),
-                          "Blitting is not supported");
+            buffer.reserve(texels.size() * 4 / 3 + 4);
 
-            auto stagingBuffer =
-                bufferManager.create("Image staging buffer (uncompressed)",
-                                     bufferSize,
-                                     vk::BufferUsageFlagBits::eTransferSrc,
-                                     VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                                     VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-                                         // TODO(aether) maybe unmap it asap if thats gonna be benefitial
-                                         VMA_ALLOCATION_CREATE_MAPPED_BIT);
+            for (uint32_t i = 0; i < mipLevels; i++)
+            {
+                vk::Extent2D const extent { std::max(width >> i, 1u), std::max(height >> i, 1u) };
+
+                if (i > 0)
+                {
+                    downsampleRGBA(texels, levels[i - 1].extent, downsampled);
+                    std::swap(texels, downsampled);
+                }
 
-            uint8_t* data = reinterpret_cast<uint8_t*>(stagingBuffer.getMappedData());
-            std::memcpy(data, buffer, bufferSize);
+                levels[i] = { .extent = extent, .offset = buffer.size() };
 
-            if (deleteBuffer)
+                buffer.insert(buffer.end(), texels.begin(), texels.end());
+            }
+
+            mipChain.name = std::format("Uncompressed gltf texture ({})", gltfimage.uri);
+        }
+
+        mipChain.format = format;
+
+        return mipChain;
+    }
+
+    auto GlTFTexture::loadMipChain(TaskExecutor& executor) const -> Task<MipChain>
+    {
+        std::vector<std::filesystem::path> paths;
+
+        for (TextureSource const& source : m_sources)
+        {
+            if (!source.path.empty())
             {
-                delete[] buffer;
+                paths.push_back(source.path);
             }
+        }
 
-            texture = imageManager.create(std::format("Uncompressed gltf texture ({})", gltfimage.uri),
-                                          vk::Extent2D { width, height },
-                                          format,
-                                          vk::SampleCountFlagBits::e1,
-                                          vk::ImageUsageFlagBits::eTransferSrc |
-                                              vk::ImageUsageFlagBits::eTransferDst |
-                                              vk::ImageUsageFlagBits::eSampled,
-                                          vk::ImageAspectFlagBits::eColor,
-                                          mipLevels);
+        std::vector<std::optional<std::vector<std::byte>>> files;
 
-            ScopedCommandBuffer cmdBuf(device, cmdManager.getMainCmdPool(), device.getMainQueue(), true);
+        if (paths.empty())
+        {
+            co_await executor.schedule();
+        }
+        else
+        {
+            files = co_await readFiles(executor, std::move(paths));
+        }
 
-            vk::ImageSubresourceRange subresourceRange = {
-                .aspectMask = vk::ImageAspectFlagBits::eColor,
-                .levelCount = 1,
-                .layerCount = 1,
-            };
+        MC_ASSERT(!m_sources.empty());
+
+        std::vector<tinygltf::Image> images(m_sources.size());
+        auto file = files.begin();
 
+        for (auto [source, image] : vi::zip(m_sources, images))
+        {
+            std::span<std::byte const> encoded = source.embedded;
+
+            if (!source.path.empty())
             {
-                vk::ImageMemoryBarrier imageMemoryBarrier {
-                    .srcAccessMask    = vk::AccessFlagBits::eNone,
-                    .dstAccessMask    = vk::AccessFlagBits::eTransferWrite,
-                    .oldLayout        = vk::ImageLayout::eUndefined,
-                    .newLayout        = vk::ImageLayout::eTransferDstOptimal,
-                    .image            = texture,
-                    .subresourceRange = subresourceRange,
-                };
+                if (!*file)
+                {
+                    logger::error("Could not read the image file {} again", source.path.string());
+
+                    co_return MipChain {};
+                }
+
+                encoded = **file++;
+            }
+
+            std::string error;
+            std::string warning;
+
+            image.uri = source.uri;
+
+            if (!loadImageDataFunc(&image,
+                                   0,
+                                   &error,
+                                   &warning,
+                                   0,
+                                   0,
+                                   reinterpret_cast<unsigned char const*>(encoded.data()),
+                                   static_cast<int>(encoded.size()),
+                                   nullptr))
+            {
+                logger::error("Could not decode the image {} again: {}", source.uri, error);
 
-                cmdBuf->pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
-                                        vk::PipelineStageFlagBits::eAllCommands,
-                                        {},
-                                        {},
-                                        {},
-                                        { imageMemoryBarrier });
+                co_return MipChain {};
             }
+        }
+
+        if (images.size() == 2)
+        {
+            co_return buildMipChain(*m_device, packOrmImage(images[0], images[1]), m_requestedEncoding);
+        }
 
-            // clang-format off
-            vk::BufferImageCopy bufferCopyRegion = {
+        co_return buildMipChain(*m_device, images[0], m_requestedEncoding);
+    }
+
+    auto GlTFTexture::reload(MipChain const& mipChain,
+                             UploadManager& uploadManager,
+                             ResourceManager<Image>& imageManager) -> UploadToken
+    {
+        MC_ASSERT(!texture.isResident());
+
+        return uploadMipChain(mipChain, uploadManager, imageManager, firstMip);
+    }
+
+    auto GlTFTexture::getMipChainSize(uint32_t firstLevel) const -> vk::DeviceSize
+    {
+        return m_size - m_levels[firstLevel].offset;
+    }
+
+    auto GlTFTexture::uploadMipChain(MipChain const& mipChain,
+                                     UploadManager& uploadManager,
+                                     ResourceManager<Image>& imageManager,
+                                     uint32_t firstLevel) -> UploadToken
+    {
+        auto const levels           = std::span(mipChain.levels).subspan(firstLevel);
+        vk::DeviceSize const offset = levels[0].offset;
+
+        texture = imageManager.create(mipChain.name,
+                                      levels[0].extent,
+                                      mipChain.format,
+                                      vk::SampleCountFlagBits::e1,
+                                      vk::ImageUsageFlagBits::eTransferSrc |
+                                          vk::ImageUsageFlagBits::eTransferDst |
+                                          vk::ImageUsageFlagBits::eSampled,
+                                      vk::ImageAspectFlagBits::eColor,
+                                      static_cast<uint32_t>(levels.size()));
+
+        std::vector<vk::BufferImageCopy> copyRegions;
+        copyRegions.reserve(levels.size());
+
+        for (auto [level, mip] : vi::enumerate(levels))
+        {
+            copyRegions.push_back(vk::BufferImageCopy {
+                .bufferOffset = mip.offset - offset,
                 .imageSubresource {
-                    .aspectMask     = vk::ImageAspectFlagBits::eColor,
-                    .mipLevel       = 0,
-                    .baseArrayLayer = 0,
-                    .layerCount     = 1,
-                },
+                                   .aspectMask     = vk::ImageAspectFlagBits::eColor,
+                                   .mipLevel       = static_cast<uint32_t>(level),
+                                   .baseArrayLayer = 0,
+                                   .layerCount     = 1,
+                                   },
                 .imageExtent {
-                    .width = width,
-                    .height = height,
-                    .depth = 1
-                },
-            };
-            // clang-format on
-
-            cmdBuf->copyBufferToImage(
-                stagingBuffer, texture, vk::ImageLayout::eTransferDstOptimal, { bufferCopyRegion });
-
-            cmdBuf->pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
-                                    vk::PipelineStageFlagBits::eAllCommands,
-                                    {
-            },
-                                    {},
-                                    {},
-                                    { vk::ImageMemoryBarrier {
-                                        .srcAccessMask    = vk::AccessFlagBits::eTransferWrite,
-                                        .dstAccessMask    = vk::AccessFlagBits::eTransferRead,
-                                        .oldLayout        = vk::ImageLayout::eTransferDstOptimal,
-                                        .newLayout        = vk::ImageLayout::eTransferSrcOptimal,
-                                        .image            = texture,
-                                        .subresourceRange = subresourceRange,
-                                    } });
-
-            // Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-            for (uint32_t i = 1; i < mipLevels; i++)
-            {
-                // clang-format off
-                vk::ImageBlit imageBlit
-                {
-                    .srcSubresource {
-                        .aspectMask = vk::ImageAspectFlagBits::eColor,
-                        .mipLevel   = i - 1,
-                        .layerCount = 1,
-                    },
-
-                    .srcOffsets = std::array {
-                        vk::Offset3D(0, 0, 0),
-                        vk::Offset3D()
-                            .setX(width >> (i - 1))
-                            .setY(height >> (i - 1))
-                            .setZ(1)
-                    },
-
-                    .dstSubresource {
-                        .aspectMask = vk::ImageAspectFlagBits::eColor,
-                        .mipLevel   = i,
-                        .layerCount = 1,
-                    },
-
-                    .dstOffsets = std::array {
-                        vk::Offset3D(0, 0, 0),
-                        vk::Offset3D()
-                            .setX(width >> i)
-                            .setY(height >> i)
-                            .setZ(1)
-                    }
-                    // clang-format on
-                };
+                                   .width  = mip.extent.width,
+                                   .height = mip.extent.height,
+                                   .depth  = 1,
+                                   },
+            });
+        }
 
-                vk::ImageSubresourceRange mipSubRange {
-                    .aspectMask   = vk::ImageAspectFlagBits::eColor,
-                    .baseMipLevel = i,
-                    .levelCount   = 1,
-                    .layerCount   = 1,
-                };
+        return uploadManager.uploadImage(
+            texture, std::as_bytes(std::span(mipChain.data).subspan(offset)), copyRegions);
+    }
 
-                cmdBuf->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-                                        vk::PipelineStageFlagBits::eTransfer,
-                                        {
-                },
-                                        {},
-                                        {},
-                                        { vk::ImageMemoryBarrier {
-                                            .srcAccessMask    = vk::AccessFlagBits::eNone,
-                                            .dstAccessMask    = vk::AccessFlagBits::eTransferWrite,
-                                            .oldLayout        = vk::ImageLayout::eUndefined,
-                                            .newLayout        = vk::ImageLayout::eTransferDstOptimal,
-                                            .image            = texture,
-                                            .subresourceRange = mipSubRange,
-                                        } });
-
-                cmdBuf->blitImage(texture,
-                                  vk::ImageLayout::eTransferSrcOptimal,
-                                  texture,
-                                  vk::ImageLayout::eTransferDstOptimal,
-                                  { imageBlit },
-                                  vk::Filter::eLinear);
-
-                cmdBuf->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-                                        vk::PipelineStageFlagBits::eTransfer,
-                                        {
-                },
-                                        {},
-                                        {},
-                                        { vk::ImageMemoryBarrier {
-                                            .srcAccessMask    = vk::AccessFlagBits::eTransferWrite,
-                                            .dstAccessMask    = vk::AccessFlagBits::eTransferRead,
-                                            .oldLayout        = vk::ImageLayout::eTransferDstOptimal,
-                                            .newLayout        = vk::ImageLayout::eTransferSrcOptimal,
-                                            .image            = texture,
-                                            .subresourceRange = mipSubRange,
-                                        } });
-            }
-
-            subresourceRange.levelCount = mipLevels;
-
-            cmdBuf->pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
-                                    vk::PipelineStageFlagBits::eAllCommands,
-                                    {
-            },
-                                    {},
-                                    {},
-                                    { vk::ImageMemoryBarrier {
-                                        .srcAccessMask    = vk::AccessFlagBits::eTransferWrite,
-                                        .dstAccessMask    = vk::AccessFlagBits::eShaderRead,
-                                        .oldLayout        = vk::ImageLayout::eTransferSrcOptimal,
-                                        .newLayout        = vk::ImageLayout::eShaderReadOnlyOptimal,
-                                        .image            = texture,
-                                        .subresourceRange = subresourceRange,
-                                    } });
-        }
-
-        sampler = device->createSampler(vk::SamplerCreateInfo {
-                      .magFilter        = textureSampler.magFilter,
-                      .minFilter        = textureSampler.minFilter,
-                      .mipmapMode       = vk::SamplerMipmapMode::eLinear,
-                      .addressModeU     = textureSampler.addressModeU,
-                      .addressModeV     = textureSampler.addressModeV,
-                      .addressModeW     = textureSampler.addressModeW,
-                      .anisotropyEnable = VK_TRUE,
-                      .maxAnisotropy    = 8.0f,
-                      .compareOp        = vk::CompareOp::eNever,
-                      .maxLod           = static_cast<float>(mipLevels),
-                      .borderColor      = vk::BorderColor::eFloatOpaqueWhite,
-                  }) >>
-                  ResultChecker();
+    GlTFTexture::~GlTFTexture()
+    {
+        if (m_bindlessRegistry && bindlessIndex != BindlessRegistry::kInvalidIndex)
+        {
+            m_bindlessRegistry->releaseTexture(bindlessIndex);
+        }
     }
 
     vk::SamplerAddressMode Model::getVkWrapMode(int32_t wrapMode)
@@ -540,100 +660,191 @@ namespace renderer::backend
         return vk::Filter::eNearest;
     }
 
-    void Model::setupDescriptors()
+    auto Model::getMaterialTextures(Material const& material) const -> std::array<GlTFTexture*, 5>
     {
-        MC_ASSERT(materials.size() <= kMaxBindlessResources);
-
-        std::vector<DescriptorAllocator::PoolSizeRatio> sizes {
-            { vk::DescriptorType::eCombinedImageSampler, 5 }
+        std::array textures {
+            static_cast<GlTFTexture*>(nullptr),
+            static_cast<GlTFTexture*>(nullptr),
+            material.occlusionTexture,
+            material.emissiveTexture,
+            material.normalTexture,
         };
 
-        m_materialDescriptorAllocator = DescriptorAllocator(
-            *m_device, materials.size(), sizes, vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT);
+        if (material.pbrWorkflow == PBRWorkflows::metallicRoughness)
+        {
+            textures[0] = material.baseColorTexture;
+            textures[1] = material.metallicRoughnessTexture;
+        }
+        else
+        {
+            textures[0] = material.extension.diffuseTexture;
+            textures[1] = material.extension.specularGlossinessTexture;
+        }
+
+        return textures;
+    }
 
-        bindlessMaterialDescriptorSet =
-            m_materialDescriptorAllocator.allocate(*m_device, m_materialDescriptorSetLayout);
+    void Model::markTexturesUsed(std::span<uint32_t const> primitives)
+    {
+        std::vector<bool> marked(materials.size());
 
-        std::vector<vk::DescriptorImageInfo> imageInfos(materials.size() * 5);
+        m_reloadRequested.resize(textures.size());
 
-        // Per-Material descriptor sets
-        for (auto [materialIndex, material] : vi::enumerate(materials))
+        for (uint32_t primitive : primitives)
         {
-            std::array texturesToWrite {
-                static_cast<GlTFTexture*>(nullptr),
-                static_cast<GlTFTexture*>(nullptr),
-                material.occlusionTexture,
-                material.emissiveTexture,
-                material.normalTexture,
-            };
+            uint32_t const materialIndex = primitiveData[primitive].materialIndex;
 
-            if (material.pbrWorkflow == PBRWorkflows::metallicRoughness)
-            {
-                texturesToWrite[0] = material.baseColorTexture;
-                texturesToWrite[1] = material.metallicRoughnessTexture;
-            }
-            else
+            if (materialIndex >= materials.size() || marked[materialIndex])
             {
-                texturesToWrite[0] = material.extension.diffuseTexture;
-                texturesToWrite[1] = material.extension.specularGlossinessTexture;
+                continue;
             }
 
-            for (auto [texIndex, tex] : vi::enumerate(texturesToWrite))
+            marked[materialIndex] = true;
+
+            for (GlTFTexture* texture : getMaterialTextures(materials[materialIndex]))
             {
-                if (!tex)
+                // Textures that were folded into a packed one never got loaded
+                if (!texture || texture->bindlessIndex == BindlessRegistry::kInvalidIndex)
                 {
-                    imageInfos[(materialIndex * 5) + texIndex] = {
-                        .sampler     = m_dummySampler,
-                        .imageView   = m_dummyImage,
-                        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-                    };
                     continue;
                 }
 
-                ResourceAccessor<Image>& img = tex->texture;
-
-                if constexpr (kDebug)
+                if (texture->texture.isResident())
                 {
-                    std::string_view type;
+                    texture->texture.markUsed();
 
-                    switch (texIndex)
-                    {
-                        case 0:
-                            type = "diffuse";
-                            break;
-                        case 1:
-                            type = "metallic/roughness";
-                            break;
-                        case 2:
-                            type = "occlusion";
-                            break;
-                        case 3:
-                            type = "emissive";
-                            break;
-                        case 4:
-                            type = "normal";
-                            break;
-                    }
+                    continue;
+                }
+
+                auto const textureIndex = static_cast<uint32_t>(texture - textures.data());
 
-                    // TODO(aether) add more verbosity to the name of other buffers and images just like here
-                    img.setName(
-                        std::format("{} (Material #{} {} texture)", img.getName(), material.index, type));
+                if (!m_reloadRequested[textureIndex])
+                {
+                    m_reloadRequested[textureIndex] = true;
+                    m_requestedTextures.push_back(textureIndex);
                 }
+            }
+        }
+    }
 
-                imageInfos[(materialIndex * 5) + texIndex] = {
-                    .sampler     = tex->sampler,
-                    .imageView   = img.getImageView(),
-                    .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-                };
+    void Model::streamTextures()
+    {
+        // From the next frame on the descriptor points at the reloaded image, the frame that acquired the
+        // upload was submitted before it
+        std::erase_if(m_textureReloads,
+                      [this](TextureReload const& reload)
+                      {
+                          if (!m_uploadManager->isAcquired(reload.upload))
+                          {
+                              return false;
+                          }
+
+                          GlTFTexture& texture = textures[reload.texture];
+
+                          setTextureResidency(reload.texture);
+
+                          m_bindlessRegistry->updateTexture(
+                              texture.bindlessIndex, texture.texture.getImageView(), texture.sampler);
+
+                          std::erase(evictedTextures, reload.texture);
+
+                          return true;
+                      });
+
+        std::vector<LoadedTexture> loadedTextures;
+
+        {
+            std::lock_guard lock(m_loadedTexturesMutex);
+
+            std::swap(loadedTextures, m_loadedTextures);
+        }
+
+        for (auto& [textureIndex, mipChain] : loadedTextures)
+        {
+            GlTFTexture& texture = textures[textureIndex];
+
+            m_loadingTextureBytes -= texture.getMipChainSize(texture.firstMip);
+
+            // The texture stays on the placeholder, and requested so it isn't tried again every frame
+            if (mipChain.levels.empty())
+            {
+                continue;
             }
+
+            m_reloadRequested[textureIndex] = false;
+
+            m_textureReloads.push_back({
+                .texture = textureIndex,
+                .upload  = texture.reload(mipChain, *m_uploadManager, *m_imageManager),
+            });
+        }
+
+        vk::DeviceSize startedBytes = 0;
+
+        vk::DeviceSize const budget = m_imageManager->getBudget(ImageCategory::texture);
+        vk::DeviceSize const usage  = m_imageManager->getUsage(ImageCategory::texture);
+
+        while (!m_requestedTextures.empty() && startedBytes < kTextureReloadBytesPerFrame)
+        {
+            uint32_t const textureIndex = m_requestedTextures.back();
+            m_requestedTextures.pop_back();
+
+            GlTFTexture& texture = textures[textureIndex];
+
+            // Dropped levels only come back once the whole chain fits, otherwise the next frame's budget
+            // enforcement would drop them right away
+            if (texture.firstMip > 0 &&
+                (budget == 0 || usage + m_loadingTextureBytes + texture.getMipChainSize(0) <= budget))
+            {
+                texture.firstMip = 0;
+            }
+
+            vk::DeviceSize const size = texture.getMipChainSize(texture.firstMip);
+
+            startedBytes += size;
+            m_loadingTextureBytes += size;
+
+            m_numTextureLoads.fetch_add(1, std::memory_order_relaxed);
+
+            detach(loadTextureMipChain(textureIndex));
+        }
+    }
+
+    auto Model::loadTextureMipChain(uint32_t textureIndex) -> Task<void>
+    {
+        GlTFTexture::MipChain mipChain = co_await textures[textureIndex].loadMipChain(*m_executor);
+
+        {
+            std::lock_guard lock(m_loadedTexturesMutex);
+
+            m_loadedTextures.push_back({ .texture = textureIndex, .mipChain = std::move(mipChain) });
         }
 
-        DescriptorWriter()
-            .writeImages(0,
-                         vk::ImageLayout::eShaderReadOnlyOptimal,
-                         vk::DescriptorType::eCombinedImageSampler,
-                         imageInfos)
-            .updateSet(*m_device, bindlessMaterialDescriptorSet);
+        // Nothing may touch the model past this point
+        m_numTextureLoads.fetch_sub(1, std::memory_order_release);
+    }
+
+    void Model::onTextureEvicted(uint32_t textureIndex, ImageEviction eviction)
+    {
+        GlTFTexture& evictedTexture = textures[textureIndex];
+
+        // The image view is either gone, or was recreated with fewer mips or in other memory
+        if (eviction == ImageEviction::evicted)
+        {
+            evictedTextures.push_back(textureIndex);
+
+            m_bindlessRegistry->resetToPlaceholder(evictedTexture.bindlessIndex);
+        }
+        else
+        {
+            if (eviction == ImageEviction::droppedMip)
+            {
+                evictedTexture.firstMip++;
+            }
+
+            m_bindlessRegistry->updateTexture(
+                evictedTexture.bindlessIndex, evictedTexture.texture.getImageView(), evictedTexture.sampler);
+        }
     }
 
     void Model::loadTextureSamplers(tinygltf::Model& gltfModel)
@@ -650,10 +861,167 @@ namespace renderer::backend
         }
     }
 
-    void Model::loadTextures(tinygltf::Model& gltfModel)
+    auto Model::countTextureReferences(tinygltf::Model const& gltfModel) -> std::vector<uint32_t>
+    {
+        std::vector<uint32_t> references(gltfModel.textures.size(), 0);
+
+        auto addReference = [&references](tinygltf::Parameter const& param)
+        {
+            if (param.json_double_value.contains("index"))
+            {
+                references[param.TextureIndex()]++;
+            }
+        };
+
+        for (tinygltf::Material const& mat : gltfModel.materials)
+        {
+            rn::for_each(mat.values | vi::values, addReference);
+            rn::for_each(mat.additionalValues | vi::values, addReference);
+
+            if (auto ext = mat.extensions.find("KHR_materials_pbrSpecularGlossiness");
+                ext != mat.extensions.end())
+            {
+                for (auto const* name : { "specularGlossinessTexture", "diffuseTexture" })
+                {
+                    if (ext->second.Has(name))
+                    {
+                        references[ext->second.Get(name).Get("index").Get<int>()]++;
+                    }
+                }
+            }
+        }
+
+        return references;
+    }
+
+    auto Model::packOcclusionRoughnessMetallic(tinygltf::Model& gltfModel)
+        -> std::map<int, std::array<int, 2>>
     {
-        for (tinygltf::Texture& tex : gltfModel.textures)
+        std::map<int, std::array<int, 2>> packedImages;
+
+        // Already packed (occlusion, metallic/roughness) pairs share the same baked texture
+        std::map<std::pair<int, int>, int> packedTextures;
+
+        auto getImage = [&gltfModel](int textureIndex) -> tinygltf::Image*
+        {
+            tinygltf::Texture const& tex = gltfModel.textures[textureIndex];
+
+            // KTX2 images are only decoded at upload time, there's nothing to pack on the CPU
+            if (tex.source < 0 || tex.extensions.contains("KHR_texture_basisu"))
+            {
+                return nullptr;
+            }
+
+            tinygltf::Image& image = gltfModel.images[tex.source];
+
+            return image.image.empty() || image.bits != 8 ? nullptr : &image;
+        };
+
+        for (tinygltf::Material& mat : gltfModel.materials)
         {
+            auto metallicRoughness = mat.values.find("metallicRoughnessTexture");
+            auto occlusion         = mat.additionalValues.find("occlusionTexture");
+
+            if (metallicRoughness == mat.values.end() || occlusion == mat.additionalValues.end() ||
+                mat.extensions.contains("KHR_materials_pbrSpecularGlossiness"))
+            {
+                continue;
+            }
+
+            int const metallicRoughnessIndex = metallicRoughness->second.TextureIndex();
+            int const occlusionIndex         = occlusion->second.TextureIndex();
+
+            // Same texture (the usual ORM export) or sampled with different UVs, nothing to do either way
+            if (metallicRoughnessIndex == occlusionIndex ||
+                metallicRoughness->second.TextureTexCoord() != occlusion->second.TextureTexCoord())
+            {
+                continue;
+            }
+
+            auto [packed, inserted] =
+                packedTextures.try_emplace({ occlusionIndex, metallicRoughnessIndex }, -1);
+
+            if (inserted)
+            {
+                tinygltf::Image* metallicRoughnessImage = getImage(metallicRoughnessIndex);
+                tinygltf::Image* occlusionImage         = getImage(occlusionIndex);
+
+                if (!metallicRoughnessImage || !occlusionImage || metallicRoughnessImage->component < 3 ||
+                    metallicRoughnessImage->width != occlusionImage->width ||
+                    metallicRoughnessImage->height != occlusionImage->height)
+                {
+                    continue;
+                }
+
+                gltfModel.images.push_back(packOrmImage(*occlusionImage, *metallicRoughnessImage));
+
+                packedImages[static_cast<int>(gltfModel.images.size() - 1)] = {
+                    gltfModel.textures[occlusionIndex].source,
+                    gltfModel.textures[metallicRoughnessIndex].source,
+                };
+
+                tinygltf::Texture ormTexture;
+                ormTexture.source  = static_cast<int>(gltfModel.images.size() - 1);
+                ormTexture.sampler = gltfModel.textures[metallicRoughnessIndex].sampler;
+
+                gltfModel.textures.push_back(std::move(ormTexture));
+
+                packed->second = static_cast<int>(gltfModel.textures.size() - 1);
+            }
+
+            if (packed->second == -1)
+            {
+                continue;
+            }
+
+            metallicRoughness->second.json_double_value["index"] = packed->second;
+            occlusion->second.json_double_value["index"]         = packed->second;
+        }
+
+        logger::debug("Packed {} occlusion/roughness/metallic textures",
+                      rn::count_if(packedTextures | vi::values, [](int index) { return index != -1; }));
+
+        return packedImages;
+    }
+
+    void Model::loadTextures(tinygltf::Model& gltfModel,
+                             bool bakeMaterialTextures,
+                             std::span<TextureSource const> imageSources)
+    {
+        std::vector<uint32_t> referencesBefore = countTextureReferences(gltfModel);
+
+        std::map<int, std::array<int, 2>> packedImages;
+
+        if (bakeMaterialTextures)
+        {
+            packedImages = packOcclusionRoughnessMetallic(gltfModel);
+        }
+
+        std::vector<uint32_t> references = countTextureReferences(gltfModel);
+
+        // Normal maps get their own encoding unless the texture is shared with some other slot
+        std::vector<uint32_t> normalReferences(gltfModel.textures.size(), 0);
+
+        for (tinygltf::Material const& mat : gltfModel.materials)
+        {
+            if (auto normal = mat.additionalValues.find("normalTexture");
+                normal != mat.additionalValues.end())
+            {
+                normalReferences[normal->second.TextureIndex()]++;
+            }
+        }
+
+        for (auto [textureIndex, tex] : vi::enumerate(gltfModel.textures))
+        {
+            // Sources that were folded into a packed texture aren't referenced by any material anymore
+            if (references[textureIndex] == 0 && textureIndex < std::ssize(referencesBefore) &&
+                referencesBefore[textureIndex] > 0)
+            {
+                textures.emplace_back();
+
+                continue;
+            }
+
             int source = tex.source;
 
             // If this texture uses the KHR_texture_basisu, we need to get the source index from the extension structure
@@ -663,7 +1031,7 @@ namespace renderer::backend
                 auto value = ext->second.Get("source");
                 source     = value.Get<int>();
             }
-            tinygltf::Image image = gltfModel.images[source];
+            tinygltf::Image& image = gltfModel.images[source];
             TextureSampler textureSampler;
 
             if (tex.sampler == -1)
@@ -679,16 +1047,74 @@ namespace renderer::backend
                 textureSampler = textureSamplers[tex.sampler];
             }
 
-            textures.push_back(GlTFTexture(*m_device,
-                                           *m_cmdManager,
-                                           *m_bufferManager,
-                                           *m_imageManager,
-                                           image,
-                                           filePath,
-                                           textureSampler));
+            bool const isNormalMap = normalReferences[textureIndex] > 0 &&
+                                     normalReferences[textureIndex] == references[textureIndex];
+
+            TextureEncoding const encoding = bakeMaterialTextures && isNormalMap ? TextureEncoding::normalMapBC5
+                                                                                 : TextureEncoding::automatic;
+
+            std::vector<TextureSource> sources;
+
+            if (auto packed = packedImages.find(source); packed != packedImages.end())
+            {
+                sources.push_back(imageSources[packed->second[0]]);
+                sources.push_back(imageSources[packed->second[1]]);
+            }
+            else
+            {
+                sources.push_back(imageSources[source]);
+            }
+
+            textures.emplace_back(*m_device,
+                                  *m_uploadManager,
+                                  *m_imageManager,
+                                  *m_bindlessRegistry,
+                                  image,
+                                  std::move(sources),
+                                  textureSampler,
+                                  encoding);
+
+            setTextureResidency(static_cast<uint32_t>(textures.size() - 1));
         }
     }
 
+    void Model::setTextureResidency(uint32_t textureIndex)
+    {
+        textures[textureIndex].texture.setResidency(
+            ImageCategory::texture,
+            true,
+            [this, textureIndex](ResourceHandle const&, ImageEviction eviction)
+            {
+                onTextureEvicted(textureIndex, eviction);
+            });
+    }
+
+    auto packOrmImage(tinygltf::Image const& occlusion, tinygltf::Image const& metallicRoughness)
+        -> tinygltf::Image
+    {
+        tinygltf::Image orm;
+        orm.uri        = std::format("{}+{}", occlusion.uri, metallicRoughness.uri);
+        orm.width      = metallicRoughness.width;
+        orm.height     = metallicRoughness.height;
+        orm.component  = 4;
+        orm.bits       = 8;
+        orm.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+        orm.image.resize(static_cast<size_t>(orm.width) * orm.height * 4);
+
+        size_t const occlusionStride         = occlusion.component;
+        size_t const metallicRoughnessStride = metallicRoughness.component;
+
+        for (size_t i = 0; i < static_cast<size_t>(orm.width) * orm.height; ++i)
+        {
+            orm.image[i * 4]     = occlusion.image[i * occlusionStride];
+            orm.image[i * 4 + 1] = metallicRoughness.image[i * metallicRoughnessStride + 1];
+            orm.image[i * 4 + 2] = metallicRoughness.image[i * metallicRoughnessStride + 2];
+            orm.image[i * 4 + 3] = 255;
+        }
+
+        return orm;
+    }
+
     bool loadImageDataFunc(tinygltf::Image* image,
                            int const imageIndex,
                            std::string* error,
@@ -699,11 +1125,13 @@ namespace renderer::backend
                            int size,
                            void* userData)
     {
-        // KTX files will be handled by our own code
+        // KTX files will be handled by our own code, the container is kept as is for the transcoder
         if (image->uri.find_last_of(".") != std::string::npos)
         {
             if (image->uri.substr(image->uri.find_last_of(".") + 1) == "ktx2")
             {
+                image->image.assign(bytes, bytes + size);
+
                 return true;
             }
         }
@@ -4,19 +4,150 @@
 #include <mc/renderer/backend/gltf/gltfTextures.hpp>
 #include <mc/renderer/backend/gltf/loader.hpp>
 #include <mc/renderer/backend/image.hpp>
+#include <mc/file_reader.hpp>
 #include <mc/renderer/backend/renderer_backend.hpp>
 #include <mc/utils.hpp>
 
+#include <algorithm>
+#include <charconv>
 #include <cstring>
+#include <iterator>
+#include <ranges>
+#include <thread>
+#include <unordered_map>
 
 #include <glm/gtc/type_ptr.hpp>
 #include <vulkan/vulkan_enums.hpp>
 #include <vulkan/vulkan_structs.hpp>
 
+namespace vi = std::ranges::views;
+
+namespace
+{
+    // Reads buffers (and the glTF file itself) through the batched file reader, straight into tinygltf's
+    // own vector
+    bool readWholeFile(std::vector<unsigned char>* out,
+                       std::string* error,
+                       std::string const& filepath,
+                       void* userData)
+    {
+        std::error_code sizeError;
+
+        auto const fileSize = std::filesystem::file_size(filepath, sizeError);
+
+        if (!sizeError)
+        {
+            out->resize(fileSize);
+
+            auto result = static_cast<io::FileReader*>(userData)->read(
+                { { .path = filepath, .destination = std::as_writable_bytes(std::span(*out)) } });
+
+            if (result[0])
+            {
+                out->resize(result[0].bytesRead);
+
+                return true;
+            }
+        }
+
+        if (error)
+        {
+            *error += std::format("File read error : {}\n", filepath);
+        }
+
+        return false;
+    }
+
+    // Embedded images are only copied out while tinygltf parses the file, they get decoded in parallel later
+    bool deferImageData(tinygltf::Image*,
+                        int const imageIndex,
+                        std::string*,
+                        std::string*,
+                        int,
+                        int,
+                        unsigned char const* bytes,
+                        int size,
+                        void* userData)
+    {
+        auto const* data = reinterpret_cast<std::byte const*>(bytes);
+
+        (*static_cast<std::unordered_map<int, std::vector<std::byte>>*>(userData))[imageIndex].assign(
+            data, data + size);
+
+        return true;
+    }
+
+    // glTF URIs are percent encoded
+    auto decodeUri(std::string_view uri) -> std::string
+    {
+        std::string decoded;
+        decoded.reserve(uri.size());
+
+        for (size_t i = 0; i < uri.size(); ++i)
+        {
+            unsigned char value = 0;
+
+            if (uri[i] == '%' && i + 2 < uri.size() &&
+                std::from_chars(&uri[i + 1], &uri[i + 3], value, 16).ptr == &uri[i + 3])
+            {
+                decoded.push_back(static_cast<char>(value));
+
+                i += 2;
+            }
+            else
+            {
+                decoded.push_back(uri[i]);
+            }
+        }
+
+        return decoded;
+    }
+
+    auto isEmbedded(tinygltf::Image const& image) -> bool
+    {
+        return image.uri.empty() || image.uri.starts_with("data:");
+    }
+
+    // Evicted textures read their external images again, embedded ones keep their encoded bytes around
+    auto getImageSources(tinygltf::Model const& gltfModel,
+                         std::string const& filePath,
+                         std::unordered_map<int, std::vector<std::byte>> const& encodedImages)
+        -> std::vector<renderer::backend::TextureSource>
+    {
+        std::vector<renderer::backend::TextureSource> sources(gltfModel.images.size());
+
+        for (auto [i, image] : vi::enumerate(gltfModel.images))
+        {
+            sources[i].uri = image.uri;
+
+            if (isEmbedded(image))
+            {
+                if (auto encoded = encodedImages.find(static_cast<int>(i)); encoded != encodedImages.end())
+                {
+                    sources[i].embedded = encoded->second;
+                }
+            }
+            else
+            {
+                sources[i].path = std::filesystem::path(filePath) / decodeUri(image.uri);
+            }
+        }
+
+        return sources;
+    }
+}  // namespace
+
 namespace renderer::backend
 {
-    void Model::loadFromFile(std::string filename, float scale)
+    auto Model::loadFromFile(TaskExecutor& executor,
+                             std::string filename,
+                             float scale,
+                             bool bakeMaterialTextures) -> Task<void>
     {
+        co_await executor.schedule();
+
+        m_executor = &executor;
+
         tinygltf::Model gltfModel;
         tinygltf::TinyGLTF gltfContext;
 
@@ -37,8 +168,27 @@ namespace renderer::backend
         }
         filePath = filename.substr(0, pos);
 
-        // @todo
-        gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+        std::unordered_map<int, std::vector<std::byte>> encodedImages;
+
+        gltfContext.SetImageLoader(deferImageData, &encodedImages);
+
+        tinygltf::FsCallbacks fsCallbacks {};
+        fsCallbacks.FileExists     = &tinygltf::FileExists;
+        fsCallbacks.ExpandFilePath = &tinygltf::ExpandFilePath;
+        fsCallbacks.ReadWholeFile  = &readWholeFile;
+        fsCallbacks.WriteWholeFile = &tinygltf::WriteWholeFile;
+        fsCallbacks.user_data      = &io::FileReader::get();
+
+        // Newer tinygltf versions also want a file size callback
+        [](auto& callbacks)
+        {
+            if constexpr (requires { callbacks.GetFileSizeInBytes; })
+            {
+                callbacks.GetFileSizeInBytes = &tinygltf::GetFileSizeInBytes;
+            }
+        }(fsCallbacks);
+
+        gltfContext.SetFsCallbacks(fsCallbacks);
 
         bool fileLoaded = binary
                               ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename.c_str())
@@ -46,10 +196,6 @@ namespace renderer::backend
 
         MC_ASSERT_MSG(fileLoaded, "Could not load gltf file {}", filename);
 
-        LoaderInfo loaderInfo {};
-        size_t vertexCount = 0;
-        size_t indexCount  = 0;
-
         extensions = gltfModel.extensionsUsed;
         for (auto& extension : extensions)
         {
@@ -62,126 +208,61 @@ namespace renderer::backend
             }
         }
 
-        loadTextureSamplers(gltfModel);
-        loadTextures(gltfModel);
-        loadMaterials(gltfModel);
+        co_await readExternalImages(executor, gltfModel, encodedImages);
 
-        tinygltf::Scene const& scene =
-            gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+        std::vector<TextureSource> const imageSources = getImageSources(gltfModel, filePath, encodedImages);
 
-        // Get vertex and index buffer sizes up-front
-        for (size_t i = 0; i < scene.nodes.size(); i++)
-        {
-            getNodeProps(gltfModel.nodes[scene.nodes[i]], gltfModel, vertexCount, indexCount);
-        }
-        loaderInfo.vertexBuffer = new Vertex[vertexCount];
-        loaderInfo.indexBuffer  = new uint32_t[indexCount];
+        // Transient data of this load, only ever used by one task at a time and released in one go at the end
+        memory::Arena arena;
 
-        // TODO: scene handling with no default scene
-        for (size_t i = 0; i < scene.nodes.size(); i++)
-        {
-            tinygltf::Node const node = gltfModel.nodes[scene.nodes[i]];
-            loadNode(nullptr, node, scene.nodes[i], gltfModel, loaderInfo, scale);
-        }
-
-        if (gltfModel.animations.size() > 0)
-        {
-            loadAnimations(gltfModel);
-        }
+        LoaderInfo loaderInfo {};
+        size_t vertexCount = 0;
+        size_t indexCount  = 0;
 
-        loadSkins(gltfModel);
+        // Images decode while the meshes convert, the mesh conversion is the only one of these that touches
+        // the resource managers
+        std::vector<Task<void>> tasks;
+        tasks.reserve(encodedImages.size() + 1);
 
-        for (auto node : linearNodes)
+        for (auto& [imageIndex, encoded] : encodedImages)
         {
-            // Assign skins
-            if (node->skinIndex > -1)
-            {
-                node->skin = skins[node->skinIndex];
-            }
-
-            // Initial pose and matrix update
-            if (node->mesh)
-            {
-                node->update();
-            }
+            tasks.push_back(decodeImage(gltfModel.images[imageIndex], imageIndex, std::move(encoded)));
         }
 
-        primitiveData.reserve(linearNodes.size());
-        drawIndirectCommands.reserve(linearNodes.size());
+        tasks.push_back(loadMeshes(gltfModel, scale, arena, loaderInfo, vertexCount, indexCount));
 
-        for (Node* node : nodes)
-        {
-            preparePrimitiveIndirectData(node);
-        }
+        co_await whenAll(executor, std::move(tasks));
 
-        primitiveData.shrink_to_fit();
-        drawIndirectCommands.shrink_to_fit();
-
-        ScopedCommandBuffer cmdBuf(
-            *m_device, m_cmdManager->getTransferCmdPool(), m_device->getTransferQueue(), true);
-
-        // TODO(aether) this is getting trivial
-        auto stagingIndirectBuffer = m_bufferManager->create(
-            "Draw indirect buffer (staging)",
-            drawIndirectCommands.size() * sizeof(decltype(drawIndirectCommands)::value_type),
-            vk::BufferUsageFlagBits::eTransferSrc,
-            VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
-
-        auto stagingPrimitiveBuffer = m_bufferManager->create(
-            "Primitive data buffer (staging)",
-            primitiveData.size() * sizeof(decltype(primitiveData)::value_type),
-            vk::BufferUsageFlagBits::eTransferSrc,
-            VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
-
-        std::memcpy(stagingIndirectBuffer.getMappedData(),
-                    drawIndirectCommands.data(),
-                    stagingIndirectBuffer.getSize());
+        // Textures and materials need every image, they upload through the (single threaded) managers
+        loadTextureSamplers(gltfModel);
+        loadTextures(gltfModel, bakeMaterialTextures, imageSources);
+        loadMaterials(gltfModel);
 
-        std::memcpy(
-            stagingPrimitiveBuffer.getMappedData(), primitiveData.data(), stagingPrimitiveBuffer.getSize());
+        sortDrawsIntoBuckets();
 
         drawIndirectBuffer = m_bufferManager->create(
             "Draw indirect buffer",
             drawIndirectCommands.size() * sizeof(decltype(drawIndirectCommands)::value_type),
-            vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer,
+            vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer |
+                vk::BufferUsageFlagBits::eShaderDeviceAddress,
             VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+            VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | kDirectUploadAllocFlags);
 
         primitiveDataBuffer = m_bufferManager->create(
             "Primitive data buffer",
             primitiveData.size() * sizeof(decltype(primitiveData)::value_type),
             vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress,
             VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
-
-        cmdBuf->copyBuffer(stagingIndirectBuffer,
-                           drawIndirectBuffer,
-                           vk::BufferCopy().setSize(drawIndirectCommands.size() *
-                                                    sizeof(decltype(drawIndirectCommands)::value_type)));
-        cmdBuf->copyBuffer(
-            stagingPrimitiveBuffer,
-            primitiveDataBuffer,
-            vk::BufferCopy().setSize(primitiveData.size() * sizeof(decltype(primitiveData)::value_type)));
+            VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | kDirectUploadAllocFlags);
 
-        primitiveDataBufferAddress =
-            m_device->get().getBufferAddress(vk::BufferDeviceAddressInfo().setBuffer(primitiveDataBuffer));
+        m_uploadManager->uploadBuffer(drawIndirectBuffer, std::as_bytes(std::span(drawIndirectCommands)));
+        m_uploadManager->uploadBuffer(primitiveDataBuffer, std::as_bytes(std::span(primitiveData)));
 
         size_t vertexBufferSize = vertexCount * sizeof(Vertex);
         size_t indexBufferSize  = indexCount * sizeof(uint32_t);
 
         MC_ASSERT(vertexBufferSize > 0);
 
-        auto vertexStaging = m_bufferManager->create(
-            "Vertex staging",
-            vertexBufferSize,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            VMA_MEMORY_USAGE_AUTO,
-            VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-
-        std::memcpy(vertexStaging.getMappedData(), loaderInfo.vertexBuffer, vertexBufferSize);
-
         vertices = m_bufferManager->create("Main vertex buffer",
                                            vertexBufferSize,
                                            vk::BufferUsageFlagBits::eTransferDst |
@@ -189,47 +270,58 @@ namespace renderer::backend
                                            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
                                            VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
 
-        vertexBufferAddress =
-            m_device->get().getBufferAddress(vk::BufferDeviceAddressInfo().setBuffer(vertices));
+        m_uploadManager->uploadBuffer(vertices, std::as_bytes(loaderInfo.vertexBuffer));
 
-        cmdBuf->copyBuffer(vertexStaging, vertices, vk::BufferCopy().setSize(vertexBufferSize));
+        // Depth only passes fetch 12 bytes per vertex instead of a whole `Vertex`
+        std::vector<glm::vec3> vertexPositions;
+        vertexPositions.reserve(loaderInfo.vertexBuffer.size());
+        std::ranges::transform(loaderInfo.vertexBuffer, std::back_inserter(vertexPositions), &Vertex::pos);
 
-        if (indexBufferSize > 0)
-        {
-            auto indexStaging = m_bufferManager->create(
-                "Index staging",
-                indexBufferSize,
-                vk::BufferUsageFlagBits::eTransferSrc,
-                VMA_MEMORY_USAGE_AUTO,
-                VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+        positions = m_bufferManager->create("Position buffer",
+                                            vertexPositions.size() * sizeof(glm::vec3),
+                                            vk::BufferUsageFlagBits::eTransferDst |
+                                                vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+                                            VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
 
-            std::memcpy(indexStaging.getMappedData(), loaderInfo.indexBuffer, indexBufferSize);
+        m_uploadManager->uploadBuffer(positions, std::as_bytes(std::span(vertexPositions)));
 
+        if (indexBufferSize > 0)
+        {
             indices = m_bufferManager->create("Main index buffer",
                                               indexBufferSize,
                                               vk::BufferUsageFlagBits::eTransferDst |
-                                                  vk::BufferUsageFlagBits::eIndexBuffer,
+                                                  vk::BufferUsageFlagBits::eIndexBuffer |
+                                                  vk::BufferUsageFlagBits::eShaderDeviceAddress,
                                               VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
                                               VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
 
-            cmdBuf->copyBuffer(indexStaging, indices, vk::BufferCopy().setSize(indexBufferSize));
-
-            cmdBuf.flush();
+            m_uploadManager->uploadBuffer(indices, std::as_bytes(loaderInfo.indexBuffer));
         }
 
-        delete[] loaderInfo.vertexBuffer;
-        delete[] loaderInfo.indexBuffer;
+        selectOccluders(loaderInfo);
+
+        // The upload manager copied the geometry into its staging ring already
+        arena.release();
+
+        createMaterialBuffer();
 
         auto bbDimensions = BoundingBox::calcNodeHeirarchyBB(linearNodes);
         dimensions        = std::get<BoundingBox::Dimensions>(bbDimensions);
         aabb              = std::get<glm::mat4>(bbDimensions);
 
-        createMaterialBuffer();
-        setupDescriptors();
+        // Textures, materials and geometry all went into the same batches, waiting on the last one is enough
+        co_await m_uploadManager->waitAsync(executor, m_uploadManager->flush());
     }
 
     Model::~Model()
     {
+        // The loads reference the textures and hand their results to the model
+        while (m_numTextureLoads.load(std::memory_order_acquire) > 0)
+        {
+            std::this_thread::yield();
+        }
+
         for (auto node : nodes)
         {
             delete node;
@@ -240,4 +332,123 @@ namespace renderer::backend
             delete skin;
         }
     };
+
+    auto Model::loadMeshes(tinygltf::Model const& gltfModel,
+                           float scale,
+                           memory::Arena& arena,
+                           LoaderInfo& loaderInfo,
+                           size_t& vertexCount,
+                           size_t& indexCount) -> Task<void>
+    {
+        tinygltf::Scene const& scene =
+            gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+
+        // Get vertex and index buffer sizes up-front
+        for (size_t i = 0; i < scene.nodes.size(); i++)
+        {
+            getNodeProps(gltfModel.nodes[scene.nodes[i]], gltfModel, vertexCount, indexCount);
+        }
+        loaderInfo.vertexBuffer = arena.allocate<Vertex>(vertexCount);
+        loaderInfo.indexBuffer  = arena.allocate<uint32_t>(indexCount);
+
+        // TODO: scene handling with no default scene
+        for (int nodeIndex : scene.nodes)
+        {
+            loadNode(nullptr, gltfModel.nodes[nodeIndex], nodeIndex, gltfModel, loaderInfo, scale);
+        }
+
+        if (gltfModel.animations.size() > 0)
+        {
+            loadAnimations(gltfModel);
+        }
+
+        loadSkins(gltfModel);
+
+        for (auto node : linearNodes)
+        {
+            // Assign skins
+            if (node->skinIndex > -1)
+            {
+                node->skin = skins[node->skinIndex];
+            }
+
+            // Initial pose and matrix update
+            if (node->mesh)
+            {
+                node->update();
+            }
+        }
+
+        primitiveData.reserve(linearNodes.size());
+        drawIndirectCommands.reserve(linearNodes.size());
+
+        for (Node* node : nodes)
+        {
+            preparePrimitiveIndirectData(node);
+        }
+
+        primitiveData.shrink_to_fit();
+        drawIndirectCommands.shrink_to_fit();
+
+        bvh.build(computePrimitiveBounds());
+
+        co_return;
+    }
+
+    auto Model::decodeImage(tinygltf::Image& image, int imageIndex, std::vector<std::byte> encoded)
+        -> Task<void>
+    {
+        std::string error;
+        std::string warning;
+
+        bool const decoded = loadImageDataFunc(&image,
+                                               imageIndex,
+                                               &error,
+                                               &warning,
+                                               0,
+                                               0,
+                                               reinterpret_cast<unsigned char const*>(encoded.data()),
+                                               static_cast<int>(encoded.size()),
+                                               nullptr);
+
+        MC_ASSERT_MSG(decoded, "Could not decode image {} ({}): {}", imageIndex, image.uri, error);
+
+        co_return;
+    }
+
+    auto Model::readExternalImages(TaskExecutor& executor,
+                                   tinygltf::Model const& gltfModel,
+                                   std::unordered_map<int, std::vector<std::byte>>& encodedImages)
+        -> Task<void>
+    {
+        std::vector<int> imageIndices;
+        std::vector<std::filesystem::path> paths;
+
+        imageIndices.reserve(gltfModel.images.size());
+        paths.reserve(gltfModel.images.size());
+
+        for (auto [i, image] : vi::enumerate(gltfModel.images))
+        {
+            // Embedded images were already handed over by tinygltf
+            if (encodedImages.contains(static_cast<int>(i)) || isEmbedded(image))
+            {
+                continue;
+            }
+
+            imageIndices.push_back(static_cast<int>(i));
+            paths.push_back(std::filesystem::path(filePath) / decodeUri(image.uri));
+        }
+
+        // On a cold page cache loading is bound by I/O latency, so every image is requested at once
+        auto files = co_await readFiles(executor, paths);
+
+        for (auto [i, imageIndex] : vi::enumerate(imageIndices))
+        {
+            MC_ASSERT_MSG(files[i], "Could not load the requested image file {}", paths[i].string());
+
+            encodedImages[imageIndex] = std::move(*files[i]);
+        }
+
+        logger::debug("Read {} external images", imageIndices.size());
+    }
 }  // namespace renderer::backend
@@ -1,7 +1,11 @@
 #include <mc/renderer/backend/gltf/loader.hpp>
 
+#include <ranges>
+
 #include <glm/gtc/type_ptr.hpp>
 
+namespace vi = std::ranges::views;
+
 namespace renderer::backend
 {
     void Model::loadMaterials(tinygltf::Model& gltfModel)
@@ -220,33 +224,76 @@ namespace renderer::backend
                 shaderMaterial.specularFactor = glm::vec4(material.extension.specularFactor, 1.0f);
             }
 
+            std::array materialTextures = getMaterialTextures(material);
+
+            std::array textureIndices {
+                &shaderMaterial.colorTextureIndex,    &shaderMaterial.physicalDescriptorTextureIndex,
+                &shaderMaterial.occlusionTextureIndex, &shaderMaterial.emissiveTextureIndex,
+                &shaderMaterial.normalTextureIndex,
+            };
+
+            constexpr std::array features {
+                MaterialFeatures_ColorTexture,    MaterialFeatures_RoughnessTexture,
+                MaterialFeatures_OcclusionTexture, MaterialFeatures_EmissiveTexture,
+                MaterialFeatures_NormalTexture,
+            };
+
+            for (auto [texIndex, tex] : vi::enumerate(materialTextures))
+            {
+                if (tex)
+                {
+                    shaderMaterial.flags |= features[texIndex];
+                }
+            }
+
+            if (material.occlusionTexture && material.occlusionTexture == material.metallicRoughnessTexture &&
+                material.pbrWorkflow == PBRWorkflows::metallicRoughness &&
+                material.texCoordSets.occlusion == material.texCoordSets.metallicRoughness)
+            {
+                shaderMaterial.flags |= MaterialFeatures_PackedOcclusion;
+            }
+
+            if (material.normalTexture && material.normalTexture->encoding == TextureEncoding::normalMapBC5)
+            {
+                shaderMaterial.flags |= MaterialFeatures_NormalTextureBC5;
+            }
+
+            for (auto [texIndex, tex] : vi::enumerate(materialTextures))
+            {
+                *textureIndices[texIndex] = tex ? tex->bindlessIndex : BindlessRegistry::kPlaceholderIndex;
+
+                if constexpr (kDebug)
+                {
+                    if (!tex)
+                    {
+                        continue;
+                    }
+
+                    constexpr std::array types {
+                        "diffuse", "metallic/roughness", "occlusion", "emissive", "normal",
+                    };
+
+                    // TODO(aether) add more verbosity to the name of other buffers and images just like here
+                    tex->texture.setName(std::format("{} (Material #{} {} texture)",
+                                                     tex->texture.getName(),
+                                                     material.index,
+                                                     types[texIndex]));
+                }
+            }
+
             shaderMaterials.push_back(shaderMaterial);
         }
 
         vk::DeviceSize bufferSize = shaderMaterials.size() * sizeof(ShaderMaterial);
 
-        auto stagingBufferAccessor = m_bufferManager->create(
-            "Material staging buffer",
-            bufferSize,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
-
-        std::memcpy(stagingBufferAccessor.getMappedData(), shaderMaterials.data(), bufferSize);
-
         materialBuffer = m_bufferManager->create("Material buffer",
                                                  bufferSize,
                                                  vk::BufferUsageFlagBits::eShaderDeviceAddress |
                                                      vk::BufferUsageFlagBits::eTransferDst,
                                                  VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-                                                 VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
-
-        materialBufferAddress =
-            m_device->get().getBufferAddress(vk::BufferDeviceAddressInfo().setBuffer(materialBuffer));
+                                                 VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT |
+                                                     kDirectUploadAllocFlags);
 
-        // TODO(aether) the deconstructor will block until the copy is over
-        // not the most performant approach
-        ScopedCommandBuffer(*m_device, m_cmdManager->getTransferCmdPool(), m_device->getTransferQueue(), true)
-            ->copyBuffer(stagingBufferAccessor, materialBuffer, vk::BufferCopy().setSize(bufferSize));
+        m_uploadManager->uploadBuffer(materialBuffer, std::as_bytes(std::span(shaderMaterials)));
     }
 }  // namespace renderer::backend
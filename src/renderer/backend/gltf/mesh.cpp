@@ -1,8 +1,52 @@
 #include <mc/renderer/backend/gltf/loader.hpp>
 #include <mc/renderer/backend/gltf/mesh.hpp>
 
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/constants.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include <glm/matrix.hpp>
+
 namespace renderer::backend
 {
+    namespace
+    {
+        // The node of every primitive, in the order `preparePrimitiveIndirectData` emits them
+        void collectDrawNodes(Node const* node, std::vector<Node const*>& drawNodes)
+        {
+            drawNodes.insert(drawNodes.end(), node->mesh->primitives.size(), node);
+
+            for (Node const* child : node->children)
+            {
+                collectDrawNodes(child, drawNodes);
+            }
+        }
+
+        void collectPrimitiveBounds(Node const* node, std::vector<BoundingBox>& bounds)
+        {
+            glm::mat4 const matrix = node->mesh->uniformBlock.matrix * node->matrix;
+
+            for (Primitive const& primitive : node->mesh->primitives)
+            {
+                BoundingBox& primitiveBounds = bounds.emplace_back();
+
+                if (primitive.bb.valid)
+                {
+                    primitiveBounds       = primitive.bb.getAABB(matrix);
+                    primitiveBounds.valid = true;
+                }
+            }
+
+            for (Node const* child : node->children)
+            {
+                collectPrimitiveBounds(child, bounds);
+            }
+        }
+    }  // namespace
+
     Primitive::Primitive(uint32_t firstIndex,
                          uint32_t indexCount,
                          uint32_t vertexCount,
@@ -24,27 +68,24 @@ namespace renderer::backend
         bb.valid = true;
     }
 
-    Mesh::Mesh(ResourceManager<GPUBuffer>& bufferManager, glm::mat4 matrix)
+    Mesh::Mesh(ResourceManager<GPUBuffer>& bufferManager,
+               BufferPool& uniformPool,
+               glm::mat4 matrix,
+               bool skinned)
     {
         uniformBlock.matrix = matrix;
 
-        // TODO(aether) maybe use REBAR?
-        // https://gpuopen-librariesandsdks.github.io/VulkanMemoryAllocator/html/usage_patterns.html#usage_patterns_advanced_data_uploading
-        // We'll need to create a separate copying mechanism in GPUBuffer where we check if the memory
-        // resides in a device local + host visible memory, and if not, make sure we flush any writes and
-        // also copy the staging buffer to the device local one.
-        uniformBuffer.buffer = bufferManager.create(
-            "Uniform buffer",
-            sizeof(uniformBlock),
-            vk::BufferUsageFlagBits::eUniformBuffer,
-            VMA_MEMORY_USAGE_AUTO,
-            VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+        size_t const uniformSize = skinned ? sizeof(UniformBlock) : sizeof(glm::mat4);
+
+        uniformBuffer.buffer = bufferManager.create("Uniform buffer", uniformPool, uniformSize);
 
         uniformBuffer.mapped = uniformBuffer.buffer.getMappedData();
 
-        std::memcpy(uniformBuffer.mapped, &uniformBlock, sizeof(UniformBlock));
+        uniformBuffer.buffer.write(std::as_bytes(std::span(&uniformBlock, 1)).first(uniformSize));
 
-        uniformBuffer.descriptor = { uniformBuffer.buffer.getVulkanHandle(), 0, sizeof(uniformBlock) };
+        uniformBuffer.descriptor = {
+            uniformBuffer.buffer.getVulkanHandle(), uniformBuffer.buffer.getOffset(), uniformSize
+        };
     };
 
     void Mesh::setBoundingBox(glm::vec3 min, glm::vec3 max)
@@ -56,21 +97,34 @@ namespace renderer::backend
 
     void Model::preparePrimitiveIndirectData(Node* node)
     {
+        glm::mat4 const matrix = node->mesh->uniformBlock.matrix * node->matrix;
+
         for (Primitive& primitive : node->mesh->primitives)
         {
+            // The vertex shader finds its primitive through the instance index, which stays intact when the
+            // culling pass compacts the draws
             drawIndirectCommands.push_back({
                 .indexCount    = primitive.indexCount,
                 .instanceCount = 1,
                 .firstIndex    = primitive.firstIndex,
                 .vertexOffset  = 0,
-                .firstInstance = 0,
+                .firstInstance = static_cast<uint32_t>(primitiveData.size()),
             });
 
             triangleCount += primitive.indexCount / 3;
 
+            // Primitives without bounds are never culled
+            BoundingBox const bounds =
+                primitive.bb.valid ? primitive.bb.getAABB(matrix)
+                                   : BoundingBox(glm::vec3(std::numeric_limits<float>::lowest()),
+                                                 glm::vec3(std::numeric_limits<float>::max()));
+
             primitiveData.push_back({
-                .matrix        = node->mesh->uniformBlock.matrix * node->matrix,
+                .matrix        = matrix,
+                .boundsMin     = bounds.min,
                 .materialIndex = primitive.materialIndex,
+                .boundsMax     = bounds.max,
+                .firstIndex    = primitive.firstIndex,
             });
         }
 
@@ -79,4 +133,131 @@ namespace renderer::backend
             preparePrimitiveIndirectData(n);
         }
     };
+
+    void Model::sortDrawsIntoBuckets()
+    {
+        // glTF's default material is opaque and single-sided
+        Material const fallback {};
+
+        auto bucketOf = [&](vk::DrawIndexedIndirectCommand const& command)
+        {
+            PrimitiveShaderData const& primitive = primitiveData[command.firstInstance];
+
+            Material const& material =
+                primitive.materialIndex < materials.size() ? materials[primitive.materialIndex] : fallback;
+
+            uint32_t const alphaBucket = material.alphaMode == Material::ALPHAMODE_BLEND  ? 2
+                                         : material.alphaMode == Material::ALPHAMODE_MASK ? 1
+                                                                                          : 0;
+            bool const mirrored    = glm::determinant(glm::mat3(primitive.matrix)) < 0.f;
+            bool const doubleSided = material.doubleSided || mirrored;
+
+            return static_cast<DrawBucket>(alphaBucket * 2 + (doubleSided ? 1 : 0));
+        };
+
+        std::vector<DrawBucket> buckets;
+        buckets.reserve(drawIndirectCommands.size());
+
+        for (vk::DrawIndexedIndirectCommand const& command : drawIndirectCommands)
+        {
+            buckets.push_back(bucketOf(command));
+        }
+
+        // Keeps the scene order within a bucket
+        std::vector<uint32_t> order(drawIndirectCommands.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::ranges::stable_sort(order, {}, [&](uint32_t draw) { return buckets[draw]; });
+
+        std::vector<vk::DrawIndexedIndirectCommand> sorted;
+        sorted.reserve(drawIndirectCommands.size());
+
+        drawBuckets = {};
+
+        for (uint32_t draw : order)
+        {
+            DrawRange& range = drawBuckets[static_cast<uint32_t>(buckets[draw])];
+
+            if (range.count == 0)
+            {
+                range.first = static_cast<uint32_t>(sorted.size());
+            }
+
+            ++range.count;
+
+            sorted.push_back(drawIndirectCommands[draw]);
+        }
+
+        // Empty buckets still get a place in the order, draws are looked up by range
+        for (uint32_t bucket = 1; bucket < kNumDrawBuckets; ++bucket)
+        {
+            if (drawBuckets[bucket].count == 0)
+            {
+                drawBuckets[bucket].first = drawBuckets[bucket - 1].first + drawBuckets[bucket - 1].count;
+            }
+        }
+
+        drawIndirectCommands = std::move(sorted);
+    }
+
+    void Model::selectOccluders(LoaderInfo const& loaderInfo)
+    {
+        std::vector<Node const*> drawNodes;
+        drawNodes.reserve(drawIndirectCommands.size());
+
+        for (Node const* node : nodes)
+        {
+            collectDrawNodes(node, drawNodes);
+        }
+
+        MC_ASSERT(drawNodes.size() == drawIndirectCommands.size());
+
+        // One candidate per draw
+        std::vector<OccluderCandidate> candidates;
+        candidates.reserve(drawIndirectCommands.size());
+
+        for (vk::DrawIndexedIndirectCommand const& command : drawIndirectCommands)
+        {
+            PrimitiveShaderData const& primitive = primitiveData[command.firstInstance];
+            Node const* node                     = drawNodes[command.firstInstance];
+
+            bool const opaque = primitive.materialIndex < materials.size() &&
+                                materials[primitive.materialIndex].alphaMode == Material::ALPHAMODE_OPAQUE;
+
+            candidates.push_back({
+                .numTriangles = command.indexCount / 3,
+                .boundsMin    = primitive.boundsMin,
+                .boundsMax    = primitive.boundsMax,
+                .opaque       = opaque,
+                .skinned      = node->skinIndex > -1,
+                .designated   = node->name.contains("occluder"),
+            });
+        }
+
+        for (uint32_t draw : backend::selectOccluders(candidates))
+        {
+            vk::DrawIndexedIndirectCommand const& command = drawIndirectCommands[draw];
+
+            occluders.push_back(
+                makeOccluderMesh(std::span<uint32_t const>(loaderInfo.indexBuffer)
+                                     .subspan(command.firstIndex, command.indexCount),
+                                 std::span<Vertex const>(loaderInfo.vertexBuffer),
+                                 primitiveData[command.firstInstance].matrix,
+                                 &Vertex::pos));
+        }
+    }
+
+    auto Model::computePrimitiveBounds() const -> std::vector<BoundingBox>
+    {
+        std::vector<BoundingBox> bounds;
+        bounds.reserve(primitiveData.size());
+
+        for (Node const* node : nodes)
+        {
+            collectPrimitiveBounds(node, bounds);
+        }
+
+        MC_ASSERT(bounds.size() == primitiveData.size());
+
+        return bounds;
+    }
 }  // namespace renderer::backend
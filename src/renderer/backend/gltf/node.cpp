@@ -72,11 +72,11 @@ namespace renderer::backend
                 }
 
                 mesh->uniformBlock.jointcount = static_cast<uint32_t>(numJoints);
-                std::memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
+                mesh->uniformBuffer.buffer.write(std::as_bytes(std::span(&mesh->uniformBlock, 1)));
             }
             else
             {
-                std::memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
+                mesh->uniformBuffer.buffer.write(std::as_bytes(std::span(&m, 1)));
             }
         }
 
@@ -143,11 +143,8 @@ namespace renderer::backend
 
         if (node.mesh > -1)
         {
-            tinygltf::Mesh const mesh = model.meshes[node.mesh];
-
-            for (size_t i = 0; i < mesh.primitives.size(); i++)
+            for (tinygltf::Primitive const& primitive : model.meshes[node.mesh].primitives)
             {
-                auto primitive = mesh.primitives[i];
                 vertexCount += model.accessors[primitive.attributes.find("POSITION")->second].count;
 
                 if (primitive.indices > -1)
@@ -245,8 +242,9 @@ namespace renderer::backend
         // Node contains mesh data
         if (node.mesh > -1)
         {
-            tinygltf::Mesh const mesh     = model.meshes[node.mesh];
-            std::unique_ptr<Mesh> newMesh = std::make_unique<Mesh>(*m_bufferManager, newNode->matrix);
+            tinygltf::Mesh const& mesh    = model.meshes[node.mesh];
+            std::unique_ptr<Mesh> newMesh =
+                std::make_unique<Mesh>(*m_bufferManager, *m_uniformPool, newNode->matrix, node.skin > -1);
 
             for (size_t j = 0; j < mesh.primitives.size(); j++)
             {
@@ -531,7 +529,7 @@ namespace renderer::backend
                     }
                 }
 
-                Primitive newPrimitive =
+                Primitive& newPrimitive =
                     newMesh->primitives.emplace_back(indexStart,
                                                      indexCount,
                                                      vertexCount,
@@ -3,8 +3,13 @@
 #include <mc/renderer/backend/allocator.hpp>
 #include <mc/renderer/backend/buffer.hpp>
 #include <mc/renderer/backend/command.hpp>
+#include <mc/renderer/backend/constants.hpp>
 #include <mc/renderer/backend/image.hpp>
 #include <mc/renderer/backend/vk_checker.hpp>
+#include <mc/utils.hpp>
+
+#include <algorithm>
+#include <ranges>
 
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_core.h>
@@ -57,7 +62,7 @@ namespace renderer::backend
         if ((usageFlags & (vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst)) <
             usageFlags)
         {
-            createImageView(format, aspectFlags, 1);
+            createImageView(format, aspectFlags, mipLevels);
         }
     }
 
@@ -72,6 +77,7 @@ namespace renderer::backend
         vmaDestroyImage(*allocator, imageHandle, allocation);
 
         imageHandle = nullptr;
+        memorySize  = 0;
     }
 
     void Image::setName(std::string const& newName)
@@ -101,11 +107,57 @@ namespace renderer::backend
                                          vk::Image dst,
                                          vk::Extent2D dstSize,
                                          vk::Extent2D offset)
+    {
+        Image::blit(cmdBuf, get().imageHandle, offset, dst, dstSize);
+    };
+
+    void ResourceAccessor<Image>::setResidency(ImageCategory category,
+                                               bool evictable,
+                                               ImageEvictionCallback onEvicted)
+    {
+        Image& image = get();
+
+        m_manager->setCategory(image, category);
+
+        image.evictable     = evictable;
+        image.onEvicted     = std::move(onEvicted);
+        image.lastUsedFrame = m_manager->getCurrentFrame();
+    }
+
+    void ResourceAccessor<Image>::markUsed()
+    {
+        get().lastUsedFrame = m_manager->getCurrentFrame();
+    }
+
+    void ResourceAccessor<Image>::resize(VkExtent2D dimensions)
+    {
+        m_manager->resize(get(), dimensions);
+    }
+
+    void ResourceAccessor<Image>::restore()
+    {
+        m_manager->restore(get());
+    }
+
+    auto ResourceAccessor<Image>::getName() const -> std::string_view
+    {
+#if DEBUG
+        return get().name;
+#else
+        return "";
+#endif
+    }
+
+    void Image::blit(vk::CommandBuffer cmdBuf,
+                     vk::Image src,
+                     vk::Extent2D srcSize,
+                     vk::Image dst,
+                     vk::Extent2D dstSize)
     {
         vk::ImageBlit2 blitRegion {};
 
-        blitRegion.srcOffsets[1].x = static_cast<int32_t>(offset.width);
-        blitRegion.srcOffsets[1].y = static_cast<int32_t>(offset.height);
+        blitRegion.srcOffsets[1].x = static_cast<int32_t>(srcSize.width);
+        blitRegion.srcOffsets[1].y = static_cast<int32_t>(srcSize.height);
         blitRegion.srcOffsets[1].z = 1;
 
         blitRegion.dstOffsets[1].x = static_cast<int32_t>(dstSize.width);
@@ -127,7 +179,7 @@ namespace renderer::backend
         blitInfo.dstImage       = dst;
         blitInfo.dstImageLayout = vk::ImageLayout::eTransferDstOptimal;
 
-        blitInfo.srcImage       = get().imageHandle;
+        blitInfo.srcImage       = src;
         blitInfo.srcImageLayout = vk::ImageLayout::eTransferSrcOptimal;
 
         blitInfo.filter      = vk::Filter::eLinear;
@@ -137,49 +189,6 @@ namespace renderer::backend
         cmdBuf.blitImage2(blitInfo);
     };
 
-    auto ResourceAccessor<Image>::getName() const -> std::string_view
-    {
-#if DEBUG
-        return get().name;
-#else
-        return "";
-#endif
-    }
-
-    void Image::transition(vk::CommandBuffer cmdBuf,
-                           vk::Image image,
-                           vk::ImageLayout currentLayout,
-                           vk::ImageLayout newLayout)
-    {
-        // TODO(aether) Those stage masks will cause the pipeline to stall
-        // figure out the appropriate stages based on a new parameter or the ones already given
-        vk::ImageMemoryBarrier2 imageBarrier {
-            .srcStageMask     = vk::PipelineStageFlagBits2::eAllCommands,
-            .srcAccessMask    = vk::AccessFlagBits2::eMemoryWrite,
-            .dstStageMask     = vk::PipelineStageFlagBits2::eAllCommands,
-            .dstAccessMask    = vk::AccessFlagBits2::eMemoryWrite | vk::AccessFlagBits2::eMemoryRead,
-            .oldLayout        = currentLayout,
-            .newLayout        = newLayout,
-            .image            = image,
-            .subresourceRange = {
-                .aspectMask     = (newLayout == vk::ImageLayout::eDepthAttachmentOptimal)
-                                  ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor,
-                .baseMipLevel   = 0,
-                .levelCount     = vk::RemainingMipLevels,
-                .baseArrayLayer = 0,
-                .layerCount     = vk::RemainingArrayLayers,
-            },
-
-        };
-
-        vk::DependencyInfo depInfo {
-            .imageMemoryBarrierCount = 1,
-            .pImageMemoryBarriers    = &imageBarrier,
-        };
-
-        cmdBuf.pipelineBarrier2(depInfo);
-    };
-
     void Image::createImage(vk::Format format,
                             vk::ImageTiling tiling,
                             vk::ImageUsageFlags usage,
@@ -205,12 +214,16 @@ namespace renderer::backend
             .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         };
 
+        VmaAllocationInfo allocInfo {};
+
         vmaCreateImage(*allocator,
                        &static_cast<VkImageCreateInfo&>(imageInfo),
                        &imageAllocInfo,
                        &imageHandle,
                        &allocation,
-                       nullptr);
+                       &allocInfo);
+
+        memorySize = allocInfo.size;
     }
 
     void Image::createImageView(vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels)
@@ -231,6 +244,328 @@ namespace renderer::backend
         imageView = device->get().createImageView(viewInfo) >> ResultChecker();
     }
 
+    void ResourceManager<Image>::setBudget(ImageCategory category, float fractionOfHeap)
+    {
+        m_budgetFractions[static_cast<size_t>(category)] = fractionOfHeap;
+
+        updateBudgets();
+    }
+
+    void ResourceManager<Image>::updateBudgets()
+    {
+        Allocator const& allocator = std::get<std::reference_wrapper<Allocator>>(m_extraConstructionParams);
+
+        VkPhysicalDeviceMemoryProperties const* memoryProperties = nullptr;
+        vmaGetMemoryProperties(allocator, &memoryProperties);
+
+        std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> heapBudgets {};
+        vmaGetHeapBudgets(allocator, heapBudgets.data());
+
+        vk::DeviceSize deviceLocalBudget = 0;
+
+        for (uint32_t heap : vi::iota(0u, memoryProperties->memoryHeapCount))
+        {
+            if (memoryProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            {
+                deviceLocalBudget = std::max(deviceLocalBudget, heapBudgets[heap].budget);
+            }
+        }
+
+        for (auto [budget, fraction] : vi::zip(m_budgets, m_budgetFractions))
+        {
+            budget = static_cast<vk::DeviceSize>(static_cast<double>(deviceLocalBudget) * fraction);
+        }
+    }
+
+    void ResourceManager<Image>::beginFrame(uint64_t frameNumber)
+    {
+        m_currentFrame = frameNumber;
+
+        collectGarbage(frameNumber);
+
+        updateBudgets();
+        enforceBudgets();
+    }
+
+    void ResourceManager<Image>::enforceBudgets()
+    {
+        for (auto [i, budget] : vi::enumerate(m_budgets))
+        {
+            auto category = static_cast<ImageCategory>(i);
+
+            if (budget == 0)
+            {
+                continue;
+            }
+
+            vk::DeviceSize usage = getUsage(category);
+
+            if (usage <= budget)
+            {
+                continue;
+            }
+
+            usage -= evict(category, usage - budget);
+
+            if (usage > budget)
+            {
+                logger::error("Image category #{} is over its budget ({} / {}), nothing else can be evicted",
+                              i,
+                              utils::largeSizeToHumanReadable(usage),
+                              utils::largeSizeToHumanReadable(budget));
+            }
+        }
+    }
+
+    auto ResourceManager<Image>::evict(ImageCategory category, vk::DeviceSize bytesToFree) -> vk::DeviceSize
+    {
+        // Only consider images that the frames in flight can't be referencing anymore
+        auto isCandidate = [this, category](Image const& image)
+        {
+            return image.imageHandle && image.evictable && !image.moving && image.category == category &&
+                   image.lastUsedFrame + kNumFramesInFlight <= m_currentFrame;
+        };
+
+        std::vector<Image*> candidates = getLiveResources() | vi::filter(isCandidate) |
+                                         vi::transform(
+                                             [](Image& image)
+                                             {
+                                                 return &image;
+                                             }) |
+                                         rn::to<std::vector>();
+
+        rn::sort(candidates, rn::less {}, &Image::lastUsedFrame);
+
+        vk::DeviceSize freed = 0;
+
+        // Degrade gracefully first by dropping a mip level from each of the least recently used images,
+        // only then start releasing whole images
+        for (Image* image : candidates)
+        {
+            if (freed >= bytesToFree)
+            {
+                return freed;
+            }
+
+            if (image->mipLevels > 1)
+            {
+                freed += dropTopMip(*image);
+
+                if (image->onEvicted)
+                {
+                    image->onEvicted(image->getHandle(), ImageEviction::droppedMip);
+                }
+            }
+        }
+
+        for (Image* image : candidates)
+        {
+            if (freed >= bytesToFree)
+            {
+                break;
+            }
+
+            // The owner must stop referencing the image view before the memory goes away
+            if (image->onEvicted)
+            {
+                image->onEvicted(image->getHandle(), ImageEviction::evicted);
+            }
+
+            freed += image->memorySize;
+            retireMemory(*image);
+
+            ++m_numEvicted;
+        }
+
+        return freed;
+    }
+
+    auto ResourceManager<Image>::dropTopMip(Image& image) -> vk::DeviceSize
+    {
+        MC_ASSERT(image.mipLevels > 1);
+
+        Image smaller;
+
+        smaller.device        = image.device;
+        smaller.allocator     = image.allocator;
+        smaller.format        = image.format;
+        smaller.sampleCount   = image.sampleCount;
+        smaller.usageFlags    = image.usageFlags;
+        smaller.aspectFlags   = image.aspectFlags;
+        smaller.mipLevels     = image.mipLevels - 1;
+        smaller.name          = image.name;
+        smaller.category      = image.category;
+        smaller.evictable     = image.evictable;
+        smaller.lastUsedFrame = image.lastUsedFrame;
+        smaller.onEvicted     = image.onEvicted;
+        smaller.dimensions    = vk::Extent2D {
+            .width  = std::max(image.dimensions.width >> 1, 1u),
+            .height = std::max(image.dimensions.height >> 1, 1u),
+        };
+
+        smaller.create();
+
+        m_mipDrops.push_back({
+            .src           = image.imageHandle,
+            .dst           = smaller.imageHandle,
+            .srcDimensions = image.dimensions,
+            .srcMipLevels  = image.mipLevels,
+            .aspectFlags   = image.aspectFlags,
+        });
+
+        vk::DeviceSize const freed = image.memorySize - smaller.memorySize;
+
+        // The old image ends up in `smaller`, frames in flight may still be sampling it and the frame
+        // being recorded copies from it
+        removeUsage(image);
+        swap(image, smaller);
+        addUsage(image);
+
+        retire(std::move(smaller));
+
+        return freed;
+    }
+
+    void ResourceManager<Image>::recordMipDrops(vk::CommandBuffer cmdBuf)
+    {
+        if (m_mipDrops.empty())
+        {
+            return;
+        }
+
+        std::vector<vk::ImageMemoryBarrier2> barriers;
+        barriers.reserve(m_mipDrops.size() * 2);
+
+        for (MipDrop const& drop : m_mipDrops)
+        {
+            vk::ImageSubresourceRange const allLevels {
+                .aspectMask = drop.aspectFlags,
+                .levelCount = vk::RemainingMipLevels,
+                .layerCount = 1,
+            };
+
+            barriers.push_back({
+                .srcStageMask     = vk::PipelineStageFlagBits2::eFragmentShader,
+                .srcAccessMask    = vk::AccessFlagBits2::eNone,
+                .dstStageMask     = vk::PipelineStageFlagBits2::eCopy,
+                .dstAccessMask    = vk::AccessFlagBits2::eTransferRead,
+                .oldLayout        = vk::ImageLayout::eShaderReadOnlyOptimal,
+                .newLayout        = vk::ImageLayout::eTransferSrcOptimal,
+                .image            = drop.src,
+                .subresourceRange = allLevels,
+            });
+
+            barriers.push_back({
+                .srcStageMask     = vk::PipelineStageFlagBits2::eNone,
+                .srcAccessMask    = vk::AccessFlagBits2::eNone,
+                .dstStageMask     = vk::PipelineStageFlagBits2::eCopy,
+                .dstAccessMask    = vk::AccessFlagBits2::eTransferWrite,
+                .oldLayout        = vk::ImageLayout::eUndefined,
+                .newLayout        = vk::ImageLayout::eTransferDstOptimal,
+                .image            = drop.dst,
+                .subresourceRange = allLevels,
+            });
+        }
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(barriers));
+
+        std::vector<vk::ImageCopy> regions;
+
+        for (MipDrop const& drop : m_mipDrops)
+        {
+            regions.clear();
+
+            for (uint32_t level : vi::iota(1u, drop.srcMipLevels))
+            {
+                regions.push_back(vk::ImageCopy {
+                    .srcSubresource = { .aspectMask = drop.aspectFlags, .mipLevel = level, .layerCount = 1 },
+                    .dstSubresource = { .aspectMask = drop.aspectFlags,
+                                       .mipLevel   = level - 1,
+                                       .layerCount = 1 },
+                    .extent         = { std::max(drop.srcDimensions.width >> level, 1u),
+                                        std::max(drop.srcDimensions.height >> level, 1u),
+                                        1 },
+                });
+            }
+
+            cmdBuf.copyImage(drop.src,
+                             vk::ImageLayout::eTransferSrcOptimal,
+                             drop.dst,
+                             vk::ImageLayout::eTransferDstOptimal,
+                             regions);
+        }
+
+        // The descriptors already point at the new images, the old ones are only kept alive for the
+        // frames in flight and never sampled again
+        barriers.clear();
+
+        for (MipDrop const& drop : m_mipDrops)
+        {
+            barriers.push_back({
+                .srcStageMask     = vk::PipelineStageFlagBits2::eCopy,
+                .srcAccessMask    = vk::AccessFlagBits2::eTransferWrite,
+                .dstStageMask     = vk::PipelineStageFlagBits2::eFragmentShader,
+                .dstAccessMask    = vk::AccessFlagBits2::eShaderSampledRead,
+                .oldLayout        = vk::ImageLayout::eTransferDstOptimal,
+                .newLayout        = vk::ImageLayout::eShaderReadOnlyOptimal,
+                .image            = drop.dst,
+                .subresourceRange = {
+                    .aspectMask = drop.aspectFlags,
+                    .levelCount = vk::RemainingMipLevels,
+                    .layerCount = 1,
+                },
+            });
+        }
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(barriers));
+
+        m_mipDrops.clear();
+    }
+
+    void ResourceManager<Image>::resize(Image& image, vk::Extent2D dimensions)
+    {
+        retireMemory(image);
+
+        image.dimensions = dimensions;
+        image.create();
+
+        addUsage(image);
+    }
+
+    void ResourceManager<Image>::restore(Image& image)
+    {
+        if (!image.imageHandle)
+        {
+            image.create();
+
+            addUsage(image);
+        }
+    }
+
+    void ResourceManager<Image>::setCategory(Image& image, ImageCategory category)
+    {
+        removeUsage(image);
+        image.category = category;
+        addUsage(image);
+    }
+
+    void ResourceManager<Image>::retireMemory(Image& image)
+    {
+        removeUsage(image);
+
+        Image old;
+
+        old.device    = image.device;
+        old.allocator = image.allocator;
+
+        std::swap(old.imageHandle, image.imageHandle);
+        std::swap(old.allocation, image.allocation);
+        std::swap(old.imageView, image.imageView);
+        std::swap(old.memorySize, image.memorySize);
+
+        retire(std::move(old));
+    }
+
     void generateMipmaps(ScopedCommandBuffer& commandBuffer,
                          vk::Image image,
                          vk::Extent2D dimensions,
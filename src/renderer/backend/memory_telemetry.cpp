@@ -0,0 +1,256 @@
+#include <mc/logger.hpp>
+#include <mc/renderer/backend/constants.hpp>
+#include <mc/renderer/backend/memory_telemetry.hpp>
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#include <vk_mem_alloc.h>
+
+#ifdef __linux__
+#    include <unistd.h>
+#endif
+
+namespace renderer::backend
+{
+    namespace
+    {
+        auto toMemoryCategory(ImageCategory category) -> MemoryCategory
+        {
+            switch (category)
+            {
+                case ImageCategory::texture:
+                    return MemoryCategory::textures;
+                case ImageCategory::renderTarget:
+                    return MemoryCategory::renderTargets;
+                default:
+                    return MemoryCategory::other;
+            }
+        }
+    }  // namespace
+
+    MemoryTelemetry::MemoryTelemetry(Allocator& allocator,
+                                     ResourceManager<GPUBuffer>& bufferManager,
+                                     ResourceManager<Image>& imageManager,
+                                     std::filesystem::path dumpPath)
+        : m_allocator { &allocator },
+          m_bufferManager { &bufferManager },
+          m_imageManager { &imageManager },
+          m_dumpPath { std::move(dumpPath) },
+          m_lastDump { std::chrono::steady_clock::now() }
+    {
+        VkPhysicalDeviceMemoryProperties const* memoryProperties = nullptr;
+
+        vmaGetMemoryProperties(allocator, &memoryProperties);
+
+        m_heaps.resize(memoryProperties->memoryHeapCount);
+
+        for (auto const& [index, heap] : vi::enumerate(m_heaps))
+        {
+            VkMemoryHeap const& properties = memoryProperties->memoryHeaps[index];
+
+            heap.size        = properties.size;
+            heap.deviceLocal = properties.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        }
+
+        if (m_dumpPath.has_parent_path() && !std::filesystem::exists(m_dumpPath.parent_path()))
+        {
+            std::filesystem::create_directories(m_dumpPath.parent_path());
+        }
+    }
+
+    void MemoryTelemetry::update(uint64_t frameNumber)
+    {
+        m_frameNumber = frameNumber;
+
+        // Lets VMA refresh the budget from the driver instead of only estimating it from its own allocations
+        vmaSetCurrentFrameIndex(*m_allocator, static_cast<uint32_t>(frameNumber));
+
+        sampleHeaps();
+
+        if (frameNumber % kMemoryTelemetrySampleInterval == 0)
+        {
+            sampleCategories();
+            sampleHostMemory();
+        }
+
+        auto const now = std::chrono::steady_clock::now();
+
+        if (now - m_lastDump >= kMemoryTelemetryDumpInterval)
+        {
+            m_lastDump = now;
+
+            dump();
+        }
+    }
+
+    void MemoryTelemetry::dump()
+    {
+        std::ofstream stream(m_dumpPath, std::ios::app);
+
+        if (!stream)
+        {
+            logger::warn("Could not open {} to dump memory telemetry", m_dumpPath.string());
+
+            return;
+        }
+
+        stream << toJson() << '\n';
+    }
+
+    auto MemoryTelemetry::getCategoryName(MemoryCategory category) -> std::string_view
+    {
+        switch (category)
+        {
+            case MemoryCategory::geometry:
+                return "geometry";
+            case MemoryCategory::textures:
+                return "textures";
+            case MemoryCategory::staging:
+                return "staging";
+            case MemoryCategory::renderTargets:
+                return "renderTargets";
+            default:
+                return "other";
+        }
+    }
+
+    void MemoryTelemetry::sampleHeaps()
+    {
+        std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets {};
+
+        vmaGetHeapBudgets(*m_allocator, budgets.data());
+
+        for (auto const& [heap, budget] : vi::zip(m_heaps, budgets))
+        {
+            heap.usage           = budget.usage;
+            heap.budget          = budget.budget;
+            heap.peakUsage       = std::max(heap.peakUsage, budget.usage);
+            heap.blockBytes      = budget.statistics.blockBytes;
+            heap.allocationBytes = budget.statistics.allocationBytes;
+            heap.blockCount      = budget.statistics.blockCount;
+            heap.allocationCount = budget.statistics.allocationCount;
+        }
+    }
+
+    void MemoryTelemetry::sampleCategories()
+    {
+        for (CategoryUsage& usage : m_categories)
+        {
+            usage.bytes = 0;
+            usage.count = 0;
+        }
+
+        for (GPUBuffer const& buffer : m_bufferManager->getLiveResources())
+        {
+            if (!buffer.vulkanHandle)
+            {
+                continue;
+            }
+
+            CategoryUsage& usage = m_categories[static_cast<size_t>(buffer.category)];
+
+            // Suballocations only own their range of the pool's block
+            usage.bytes += buffer.pool ? buffer.size : buffer.allocInfo.size;
+            usage.count++;
+        }
+
+        for (Image const& image : m_imageManager->getLiveResources())
+        {
+            // Evicted images don't hold any memory
+            if (!image.imageHandle)
+            {
+                continue;
+            }
+
+            CategoryUsage& usage = m_categories[static_cast<size_t>(toMemoryCategory(image.category))];
+
+            usage.bytes += image.memorySize;
+            usage.count++;
+        }
+
+        for (auto const& [category, external] : vi::enumerate(m_imageManager->m_externalUsage))
+        {
+            CategoryUsage& usage =
+                m_categories[static_cast<size_t>(toMemoryCategory(static_cast<ImageCategory>(category)))];
+
+            usage.bytes += external.bytes;
+            usage.count += external.count;
+        }
+
+        for (CategoryUsage& usage : m_categories)
+        {
+            usage.peakBytes = std::max(usage.peakBytes, usage.bytes);
+        }
+    }
+
+    void MemoryTelemetry::sampleHostMemory()
+    {
+#ifdef __linux__
+        // The second field is the resident set in pages
+        std::ifstream stream("/proc/self/statm");
+
+        uint64_t size {}, resident {};
+
+        if (stream >> size >> resident)
+        {
+            m_hostMemory = resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        }
+#endif
+
+        m_peakHostMemory = std::max(m_peakHostMemory, m_hostMemory);
+    }
+
+    auto MemoryTelemetry::toJson() const -> std::string
+    {
+        auto const timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+
+        std::string json;
+        auto out = std::back_inserter(json);
+
+        std::format_to(out, R"({{"time":{},"frame":{},"heaps":[)", timestamp.count(), m_frameNumber);
+
+        for (auto const& [index, heap] : vi::enumerate(m_heaps))
+        {
+            std::format_to(out,
+                           R"({}{{"index":{},"deviceLocal":{},"size":{},)"
+                           R"("usage":{},"budget":{},"peakUsage":{},)"
+                           R"("blockBytes":{},"allocationBytes":{},"blocks":{},"allocations":{}}})",
+                           index > 0 ? "," : "",
+                           index,
+                           heap.deviceLocal,
+                           heap.size,
+                           heap.usage,
+                           heap.budget,
+                           heap.peakUsage,
+                           heap.blockBytes,
+                           heap.allocationBytes,
+                           heap.blockCount,
+                           heap.allocationCount);
+        }
+
+        std::format_to(out, R"(],"categories":{{)");
+
+        for (auto const& [index, usage] : vi::enumerate(m_categories))
+        {
+            std::format_to(out,
+                           R"({}"{}":{{"bytes":{},"peakBytes":{},"count":{}}})",
+                           index > 0 ? "," : "",
+                           getCategoryName(static_cast<MemoryCategory>(index)),
+                           usage.bytes,
+                           usage.peakBytes,
+                           usage.count);
+        }
+
+        std::format_to(out,
+                       R"(}},"host":{{"residentBytes":{},"peakResidentBytes":{}}}}})",
+                       m_hostMemory,
+                       m_peakHostMemory);
+
+        return json;
+    }
+}  // namespace renderer::backend
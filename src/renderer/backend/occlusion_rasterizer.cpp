@@ -0,0 +1,446 @@
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/constants.hpp>
+#include <mc/renderer/backend/occlusion_rasterizer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <glm/glm.hpp>
+#include <immintrin.h>
+#include <tracy/Tracy.hpp>
+
+namespace renderer::backend
+{
+    namespace
+    {
+        static_assert(kOcclusionBufferWidth % 8 == 0, "Rows are rasterized 8 texels at a time");
+
+        constexpr uint32_t kBandHeight = 8;
+        constexpr uint32_t kNumBands   = (kOcclusionBufferHeight + kBandHeight - 1) / kBandHeight;
+
+        // Triangles a worker sets up at once
+        constexpr uint32_t kSetupBatchSize = 256;
+
+        // Geometry closer to the camera plane than this would need clipping, it is left out instead
+        constexpr float kMinClipW = 1e-5f;
+
+        // Bounds this large belong to primitives that are never culled
+        constexpr float kUnboundedExtent = 1e30f;
+
+        // Keeps far off screen coordinates representable as texel indices
+        auto clampToScreen(glm::vec2 screen) -> glm::vec2
+        {
+            return glm::clamp(screen,
+                              glm::vec2(-1.f),
+                              glm::vec2(kOcclusionBufferWidth + 1, kOcclusionBufferHeight + 1));
+        }
+
+        // Coefficients of the function that is positive left of a -> b
+        auto edgeFunction(glm::vec3 a, glm::vec3 b) -> glm::vec3
+        {
+            return { a.y - b.y, b.x - a.x, a.x * b.y - a.y * b.x };
+        }
+
+        // Clip space to texel coordinates, depth stays as is
+        auto toScreen(glm::vec4 clip) -> glm::vec3
+        {
+            glm::vec3 const ndc = glm::vec3(clip) / clip.w;
+
+            return {
+                (ndc.x * 0.5f + 0.5f) * kOcclusionBufferWidth,
+                (ndc.y * 0.5f + 0.5f) * kOcclusionBufferHeight,
+                ndc.z,
+            };
+        }
+    }  // namespace
+
+    OcclusionRasterizer::OcclusionRasterizer(enki::TaskScheduler& scheduler) : m_scheduler { &scheduler }
+    {
+        m_setupTask.rasterizer  = this;
+        m_rasterTask.rasterizer = this;
+
+        m_depth.assign(kOcclusionBufferWidth * kOcclusionBufferHeight, 0.f);
+    }
+
+    void OcclusionRasterizer::setOccluders(std::span<OccluderMesh const> occluders)
+    {
+        m_positions.clear();
+        m_indices.clear();
+
+        for (OccluderMesh const& occluder : occluders)
+        {
+            MC_ASSERT(occluder.indices.size() % 3 == 0);
+
+            auto const firstVertex = static_cast<uint32_t>(m_positions.size());
+
+            m_positions.insert(m_positions.end(), occluder.positions.begin(), occluder.positions.end());
+
+            for (uint32_t index : occluder.indices)
+            {
+                m_indices.push_back(firstVertex + index);
+            }
+        }
+
+        m_triangles.resize(getNumTriangles());
+    }
+
+    void OcclusionRasterizer::render(glm::mat4 const& viewProj)
+    {
+        ZoneScopedN("Occlusion rasterization");
+
+        auto timerStart = std::chrono::high_resolution_clock::now();
+
+        m_viewProj = viewProj;
+
+        // Workers only know their thread number, each of them gets bins of its own
+        m_bins.resize(m_scheduler->GetNumTaskThreads());
+
+        for (auto& threadBins : m_bins)
+        {
+            threadBins.resize(kNumBands);
+
+            for (std::vector<uint32_t>& bin : threadBins)
+            {
+                bin.clear();
+            }
+        }
+
+        if (uint32_t const numTriangles = getNumTriangles(); numTriangles > 0)
+        {
+            m_setupTask.m_SetSize  = numTriangles;
+            m_setupTask.m_MinRange = kSetupBatchSize;
+
+            m_scheduler->AddTaskSetToPipe(&m_setupTask);
+            m_scheduler->WaitforTask(&m_setupTask);
+        }
+
+        // Bands are cleared by their own task, so this runs even without occluders
+        m_rasterTask.m_SetSize  = kNumBands;
+        m_rasterTask.m_MinRange = 1;
+
+        m_scheduler->AddTaskSetToPipe(&m_rasterTask);
+        m_scheduler->WaitforTask(&m_rasterTask);
+
+        m_lastRenderTime =
+            std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - timerStart)
+                .count();
+    }
+
+    void OcclusionRasterizer::SetupTask::ExecuteRange(enki::TaskSetPartition range, uint32_t threadNum)
+    {
+        rasterizer->setupTriangles(range.start, range.end, threadNum);
+    }
+
+    void OcclusionRasterizer::RasterTask::ExecuteRange(enki::TaskSetPartition range, uint32_t)
+    {
+        for (uint32_t band = range.start; band < range.end; ++band)
+        {
+            rasterizer->rasterizeBand(band);
+        }
+    }
+
+    void OcclusionRasterizer::setupTriangles(uint32_t first, uint32_t last, uint32_t threadNum)
+    {
+        std::vector<std::vector<uint32_t>>& bins = m_bins[threadNum];
+
+        for (uint32_t t = first; t < last; ++t)
+        {
+            std::array<glm::vec3, 3> screen;
+            bool clipped = false;
+
+            for (uint32_t v = 0; v < 3; ++v)
+            {
+                glm::vec4 const clip = m_viewProj * glm::vec4(m_positions[m_indices[t * 3 + v]], 1.f);
+
+                // Leaving out an occluder only makes culling less effective, never wrong
+                if (clip.w < kMinClipW)
+                {
+                    clipped = true;
+                    break;
+                }
+
+                screen[v] = toScreen(clip);
+            }
+
+            if (clipped)
+            {
+                continue;
+            }
+
+            Triangle& triangle = m_triangles[t];
+
+            // Edge i is the one opposite of vertex i, it weighs that vertex' attributes
+            triangle.edges = {
+                edgeFunction(screen[1], screen[2]),
+                edgeFunction(screen[2], screen[0]),
+                edgeFunction(screen[0], screen[1]),
+            };
+
+            float area = glm::dot(triangle.edges[2], glm::vec3(screen[2].x, screen[2].y, 1.f));
+
+            if (std::abs(area) < 1e-6f)
+            {
+                continue;
+            }
+
+            // Both windings occlude, flip the back facing ones so that inside is always positive
+            if (area < 0.f)
+            {
+                for (glm::vec3& edge : triangle.edges)
+                {
+                    edge = -edge;
+                }
+
+                area = -area;
+            }
+
+            triangle.depth = (triangle.edges[0] * screen[0].z + triangle.edges[1] * screen[1].z +
+                              triangle.edges[2] * screen[2].z) /
+                             area;
+
+            // Moving the edges in by half a texel leaves only the texels the triangle covers entirely, and
+            // the depth at their centers becomes the farthest one within them. Occluder edges thus never
+            // hide a box that is only partly behind them
+            for (glm::vec3& edge : triangle.edges)
+            {
+                edge.z -= 0.5f * (std::abs(edge.x) + std::abs(edge.y));
+            }
+
+            triangle.depth.z -= 0.5f * (std::abs(triangle.depth.x) + std::abs(triangle.depth.y));
+
+            glm::vec2 const screenMin = clampToScreen(
+                glm::min(glm::min(glm::vec2(screen[0]), glm::vec2(screen[1])), glm::vec2(screen[2])));
+            glm::vec2 const screenMax = clampToScreen(
+                glm::max(glm::max(glm::vec2(screen[0]), glm::vec2(screen[1])), glm::vec2(screen[2])));
+
+            // Texels the triangle may cover
+            triangle.minX = std::max(static_cast<int32_t>(std::ceil(screenMin.x - 0.5f)), 0);
+            triangle.minY = std::max(static_cast<int32_t>(std::ceil(screenMin.y - 0.5f)), 0);
+            triangle.maxX = std::min(static_cast<int32_t>(std::floor(screenMax.x - 0.5f)),
+                                     static_cast<int32_t>(kOcclusionBufferWidth) - 1);
+            triangle.maxY = std::min(static_cast<int32_t>(std::floor(screenMax.y - 0.5f)),
+                                     static_cast<int32_t>(kOcclusionBufferHeight) - 1);
+
+            if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            {
+                continue;
+            }
+
+            for (uint32_t band = triangle.minY / kBandHeight; band <= triangle.maxY / kBandHeight; ++band)
+            {
+                bins[band].push_back(t);
+            }
+        }
+    }
+
+    void OcclusionRasterizer::rasterizeBand(uint32_t band)
+    {
+        int32_t const bandFirst = band * kBandHeight;
+        int32_t const bandLast  = std::min((band + 1) * kBandHeight, kOcclusionBufferHeight) - 1;
+
+        std::fill(m_depth.begin() + bandFirst * kOcclusionBufferWidth,
+                  m_depth.begin() + (bandLast + 1) * kOcclusionBufferWidth,
+                  0.f);
+
+        __m256 const laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+
+        for (std::vector<std::vector<uint32_t>> const& threadBins : m_bins)
+        {
+            for (uint32_t t : threadBins[band])
+            {
+                Triangle const& triangle = m_triangles[t];
+
+                __m256 const edgeX0 = _mm256_set1_ps(triangle.edges[0].x);
+                __m256 const edgeX1 = _mm256_set1_ps(triangle.edges[1].x);
+                __m256 const edgeX2 = _mm256_set1_ps(triangle.edges[2].x);
+                __m256 const depthX = _mm256_set1_ps(triangle.depth.x);
+
+                int32_t const firstRow = std::max(triangle.minY, bandFirst);
+                int32_t const lastRow  = std::min(triangle.maxY, bandLast);
+
+                // Rows are a multiple of 8 texels wide, the last block never crosses into the next row
+                int32_t const firstColumn = triangle.minX & ~7;
+
+                for (int32_t y = firstRow; y <= lastRow; ++y)
+                {
+                    float const centerY = static_cast<float>(y) + 0.5f;
+
+                    // The y terms are the same along the row
+                    __m256 const rowEdge0 =
+                        _mm256_set1_ps(triangle.edges[0].y * centerY + triangle.edges[0].z);
+                    __m256 const rowEdge1 =
+                        _mm256_set1_ps(triangle.edges[1].y * centerY + triangle.edges[1].z);
+                    __m256 const rowEdge2 =
+                        _mm256_set1_ps(triangle.edges[2].y * centerY + triangle.edges[2].z);
+                    __m256 const rowDepth = _mm256_set1_ps(triangle.depth.y * centerY + triangle.depth.z);
+
+                    float* row = m_depth.data() + y * kOcclusionBufferWidth;
+
+                    for (int32_t x = firstColumn; x <= triangle.maxX; x += 8)
+                    {
+                        __m256 const centerX =
+                            _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+
+                        __m256 const edge0 = _mm256_add_ps(_mm256_mul_ps(edgeX0, centerX), rowEdge0);
+                        __m256 const edge1 = _mm256_add_ps(_mm256_mul_ps(edgeX1, centerX), rowEdge1);
+                        __m256 const edge2 = _mm256_add_ps(_mm256_mul_ps(edgeX2, centerX), rowEdge2);
+
+                        // The sign bit is set where any of the edge functions is negative
+                        __m256 const outside = _mm256_or_ps(edge0, _mm256_or_ps(edge1, edge2));
+
+                        __m256 const depth    = _mm256_add_ps(_mm256_mul_ps(depthX, centerX), rowDepth);
+                        __m256 const previous = _mm256_loadu_ps(row + x);
+
+                        // Reverse-Z, the nearer depth is the larger one
+                        __m256 const nearest = _mm256_max_ps(previous, depth);
+
+                        _mm256_storeu_ps(row + x, _mm256_blendv_ps(nearest, previous, outside));
+                    }
+                }
+            }
+        }
+    }
+
+    auto OcclusionRasterizer::isVisible(glm::vec3 boundsMin, glm::vec3 boundsMax) const -> bool
+    {
+        if (glm::any(glm::greaterThan(boundsMax - boundsMin, glm::vec3(kUnboundedExtent))))
+        {
+            return true;
+        }
+
+        glm::vec2 screenMin { std::numeric_limits<float>::max() };
+        glm::vec2 screenMax { std::numeric_limits<float>::lowest() };
+        float nearestDepth = 0.f;
+
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            glm::vec3 const corner {
+                (i & 1) != 0 ? boundsMax.x : boundsMin.x,
+                (i & 2) != 0 ? boundsMax.y : boundsMin.y,
+                (i & 4) != 0 ? boundsMax.z : boundsMin.z,
+            };
+
+            glm::vec4 const clip = m_viewProj * glm::vec4(corner, 1.f);
+
+            // Crosses the camera plane, its screen rectangle is unbounded
+            if (clip.w < kMinClipW)
+            {
+                return true;
+            }
+
+            glm::vec3 const screen = toScreen(clip);
+
+            screenMin    = glm::min(screenMin, glm::vec2(screen));
+            screenMax    = glm::max(screenMax, glm::vec2(screen));
+            nearestDepth = std::max(nearestDepth, screen.z);
+        }
+
+        screenMin = clampToScreen(screenMin);
+        screenMax = clampToScreen(screenMax);
+
+        // Every texel the rectangle touches
+        int32_t const firstX = std::max(static_cast<int32_t>(std::floor(screenMin.x)), 0);
+        int32_t const firstY = std::max(static_cast<int32_t>(std::floor(screenMin.y)), 0);
+        int32_t const lastX  = std::min(static_cast<int32_t>(std::floor(screenMax.x)),
+                                       static_cast<int32_t>(kOcclusionBufferWidth) - 1);
+        int32_t const lastY = std::min(static_cast<int32_t>(std::floor(screenMax.y)),
+                                       static_cast<int32_t>(kOcclusionBufferHeight) - 1);
+
+        // Off screen, the frustum test is responsible for these
+        if (firstX > lastX || firstY > lastY)
+        {
+            return true;
+        }
+
+        __m256 const boxDepth = _mm256_set1_ps(nearestDepth);
+
+        for (int32_t y = firstY; y <= lastY; ++y)
+        {
+            float const* row = m_depth.data() + y * kOcclusionBufferWidth;
+
+            for (int32_t x = firstX & ~7; x <= lastX; x += 8)
+            {
+                // Lanes of this block that are inside the rectangle
+                uint32_t const lowLanes  = 0xFFu << std::max(firstX - x, 0);
+                uint32_t const highLanes = 0xFFu >> (7 - std::min(lastX - x, 7));
+
+                __m256 const hidden = _mm256_cmp_ps(_mm256_loadu_ps(row + x), boxDepth, _CMP_GT_OQ);
+
+                uint32_t const hiddenLanes = static_cast<uint32_t>(_mm256_movemask_ps(hidden));
+
+                if ((~hiddenLanes & lowLanes & highLanes & 0xFFu) != 0)
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    auto selectOccluders(std::span<OccluderCandidate const> candidates) -> std::vector<uint32_t>
+    {
+        struct Ranked
+        {
+            uint32_t candidate;
+            float area;
+        };
+
+        std::vector<Ranked> ranked;
+
+        for (uint32_t i = 0; i < candidates.size(); ++i)
+        {
+            OccluderCandidate const& candidate = candidates[i];
+
+            if (candidate.numTriangles == 0 || !candidate.opaque || candidate.skinned)
+            {
+                continue;
+            }
+
+            glm::vec3 const extent = candidate.boundsMax - candidate.boundsMin;
+
+            // Unbounded primitives can't be ranked
+            if (!candidate.designated && (candidate.numTriangles > kMaxOccluderTriangles ||
+                                          extent.x > std::numeric_limits<float>::max() / 4))
+            {
+                continue;
+            }
+
+            ranked.push_back({
+                .candidate = i,
+                .area      = 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x),
+            });
+        }
+
+        std::ranges::sort(ranked,
+                          [&](Ranked const& a, Ranked const& b)
+                          {
+                              bool const designatedA = candidates[a.candidate].designated;
+                              bool const designatedB = candidates[b.candidate].designated;
+
+                              return designatedA != designatedB ? designatedA : a.area > b.area;
+                          });
+
+        std::vector<uint32_t> selected;
+
+        uint32_t remainingTriangles = kOccluderTriangleBudget;
+
+        for (Ranked const& entry : ranked)
+        {
+            OccluderCandidate const& candidate = candidates[entry.candidate];
+
+            if (!candidate.designated && candidate.numTriangles > remainingTriangles)
+            {
+                continue;
+            }
+
+            remainingTriangles -= std::min(candidate.numTriangles, remainingTriangles);
+
+            selected.push_back(entry.candidate);
+        }
+
+        return selected;
+    }
+}  // namespace renderer::backend
@@ -12,6 +12,94 @@
 
 namespace renderer::backend
 {
+    namespace
+    {
+        // On-disk pipeline cache at cache/{name}.pcache, rebuilt whenever it was made by another device
+        // TODO(aether) improve pipeline caching using methods mentioned here
+        // https://zeux.io/2019/07/17/serializing-pipeline-cache/
+        class PipelineCache
+        {
+        public:
+            PipelineCache(Device const& device, std::string_view name)
+                : m_path { std::format("cache/{}.pcache", name) }
+            {
+                MC_ASSERT_MSG(!name.contains(' '), "Pipeline name must not contain a space");
+
+                if (!std::filesystem::exists(m_path.parent_path()))
+                {
+                    std::filesystem::create_directory(m_path.parent_path());
+                }
+
+                vk::PipelineCacheCreateInfo cacheCreateInfo {};
+
+                // TODO(aether) default it to uchar?
+                std::vector<char> cacheBlob;
+
+                if (std::filesystem::exists(m_path))
+                {
+                    cacheBlob = utils::readBytes(m_path);
+
+                    MC_ASSERT(cacheBlob.size() >= sizeof(vk::PipelineCacheHeaderVersion));
+
+                    vk::PipelineCacheHeaderVersionOne* cacheHeader =
+                        reinterpret_cast<vk::PipelineCacheHeaderVersionOne*>(cacheBlob.data());
+
+                    vk::PhysicalDeviceProperties deviceProperties = device.getDeviceProperties();
+
+                    if (cacheHeader->deviceID == deviceProperties.deviceID &&
+                        cacheHeader->vendorID == deviceProperties.vendorID &&
+                        std::memcmp(cacheHeader->pipelineCacheUUID,
+                                    deviceProperties.pipelineCacheUUID,
+                                    vk::UuidSize) == 0)
+                    {
+                        cacheCreateInfo.setPInitialData(cacheBlob.data())
+                            .setInitialDataSize(cacheBlob.size());
+
+                        m_new = false;
+                    }
+                    else
+                    {
+                        logger::debug("Found a cache file for pipeline {}, but rebuilding due to header "
+                                      "mismatch",
+                                      name);
+                    }
+                }
+
+                m_cache = device->createPipelineCache(cacheCreateInfo) >> ResultChecker();
+            }
+
+            [[nodiscard]] auto get() const -> vk::PipelineCache { return m_cache; }
+
+            [[nodiscard]] auto isNew() const -> bool { return m_new; }
+
+            // Writes the cache to disk if it didn't come from there
+            void store() const
+            {
+                if (!m_new)
+                {
+                    return;
+                }
+
+                std::vector<uint8_t> cacheData = m_cache.getData();
+
+                std::ofstream stream(m_path, std::ios::trunc);
+
+                MC_ASSERT(stream.is_open());
+
+                stream.write(reinterpret_cast<char const*>(cacheData.data()), cacheData.size());
+
+                stream.close();
+            }
+
+        private:
+            std::filesystem::path m_path;
+
+            vk::raii::PipelineCache m_cache { nullptr };
+
+            bool m_new { true };
+        };
+    }  // namespace
+
     auto PipelineLayoutConfig::setPushConstantSettings(uint32_t size, vk::ShaderStageFlags shaderStage)
         -> PipelineLayoutConfig&
     {
@@ -48,7 +136,8 @@ namespace renderer::backend
 
     auto GraphicsPipelineConfig::blendingSetAlphaBlend() -> GraphicsPipelineConfig&
     {
-        srcColorBlendFactor = vk::BlendFactor::eOneMinusDstAlpha;
+        srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+        dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
 
         return *this;
     }
@@ -56,12 +145,13 @@ namespace renderer::backend
     auto GraphicsPipelineConfig::blendingSetAdditiveBlend() -> GraphicsPipelineConfig&
     {
         srcColorBlendFactor = vk::BlendFactor::eOne;
+        dstColorBlendFactor = vk::BlendFactor::eDstAlpha;
 
         return *this;
     }
 
     auto
-    GraphicsPipelineConfig::setBlendingWriteMask(vk::ColorComponentFlagBits mask) -> GraphicsPipelineConfig&
+    GraphicsPipelineConfig::setBlendingWriteMask(vk::ColorComponentFlags mask) -> GraphicsPipelineConfig&
     {
         blendingColorWriteMask = mask;
 
@@ -218,7 +308,7 @@ namespace renderer::backend
         vk::PipelineColorBlendAttachmentState colorBlendAttachment {
             .blendEnable         = config.blendingEnable,
             .srcColorBlendFactor = config.srcColorBlendFactor,
-            .dstColorBlendFactor = vk::BlendFactor::eDstAlpha,
+            .dstColorBlendFactor = config.dstColorBlendFactor,
             .colorBlendOp        = vk::BlendOp::eAdd,
             .srcAlphaBlendFactor = vk::BlendFactor::eOne,
             .dstAlphaBlendFactor = vk::BlendFactor::eZero,
@@ -295,55 +385,11 @@ namespace renderer::backend
                 .setDepthAttachmentFormat(config.depthAttachmentFormat.value()),
         };
 
-        MC_ASSERT_MSG(!name.contains(' '), "Pipeline name must not contain a space");
-
-        std::filesystem::path cachePath = std::format("cache/{}.pcache", name);
-
-        if (!std::filesystem::exists(cachePath.parent_path()))
-        {
-            std::filesystem::create_directory(cachePath.parent_path());
-        }
-
-        vk::raii::PipelineCache pipelineCache { nullptr };
-        vk::PipelineCacheCreateInfo cacheCreateInfo {};
-
-        // TODO(aether) default it to uchar?
-        std::vector<char> cacheBlob;
-
-        bool newCache = true;
-
-        if (std::filesystem::exists(cachePath))
-        {
-            cacheBlob = utils::readBytes(cachePath);
-
-            MC_ASSERT(cacheBlob.size() >= sizeof(vk::PipelineCacheHeaderVersion));
-
-            vk::PipelineCacheHeaderVersionOne* cacheHeader =
-                reinterpret_cast<vk::PipelineCacheHeaderVersionOne*>(cacheBlob.data());
-
-            vk::PhysicalDeviceProperties deviceProperties = device.getDeviceProperties();
-
-            if (cacheHeader->deviceID == deviceProperties.deviceID &&
-                cacheHeader->vendorID == deviceProperties.vendorID &&
-                std::memcmp(
-                    cacheHeader->pipelineCacheUUID, deviceProperties.pipelineCacheUUID, vk::UuidSize) == 0)
-            {
-                cacheCreateInfo.setPInitialData(cacheBlob.data()).setInitialDataSize(cacheBlob.size());
-
-                newCache = false;
-            }
-            else
-            {
-                logger::debug("Found a cache file for pipeline {}, but rebuilding due to header mismatch",
-                              name);
-            }
-        }
-
-        pipelineCache = device->createPipelineCache(cacheCreateInfo) >> ResultChecker();
+        PipelineCache cache(device, name);
 
         auto timerStart = std::chrono::high_resolution_clock::now();
 
-        m_pipeline = device->createGraphicsPipeline(pipelineCache,
+        m_pipeline = device->createGraphicsPipeline(cache.get(),
                                                     pipelineChain.get<vk::GraphicsPipelineCreateInfo>()) >>
                      ResultChecker();
 
@@ -351,42 +397,36 @@ namespace renderer::backend
             std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - timerStart)
                 .count();
 
-        logger::debug(
-            "Took {:.2f}ms to create pipeline {} {} a cache", timeTaken, name, newCache ? "without" : "with");
-
-        if (newCache)
-        {
-            std::vector<uint8_t> cacheData = pipelineCache.getData();
-
-            std::ofstream stream(cachePath, std::ios::trunc);
-
-            MC_ASSERT(stream.is_open());
+        logger::debug("Took {:.2f}ms to create pipeline {} {} a cache",
+                      timeTaken,
+                      name,
+                      cache.isNew() ? "without" : "with");
 
-            stream.write(reinterpret_cast<char const*>(cacheData.data()), cacheData.size());
-
-            stream.close();
-        }
-
-        // TODO(aether) improve pipeline caching using methods mentioned here
-        // https://zeux.io/2019/07/17/serializing-pipeline-cache/
+        cache.store();
     };
 
     ComputePipeline::ComputePipeline(Device const& device,
+                                     std::string_view name,
                                      PipelineLayout const& layout,
-                                     std::filesystem::path const& path,
-                                     std::string_view entryPoint)
+                                     ShaderManager const& shaders)
     {
-        MC_ASSERT_MSG(false, "This code has been dead for a while. Implement pipeline caches first.");
+        std::vector<vk::PipelineShaderStageCreateInfo> const& stages = shaders.getShaderStages();
 
-        vk::raii::ShaderModule shaderModule = createShaderModule(device.get(), path);
+        MC_ASSERT_MSG(stages.size() == 1 && stages.front().stage == vk::ShaderStageFlagBits::eCompute,
+                      "Compute pipeline {} needs exactly one compute shader",
+                      name);
+
+        PipelineCache cache(device, name);
 
         vk::ComputePipelineCreateInfo pipelineCreateInfo {
-            .stage  = { .stage  = vk::ShaderStageFlagBits::eCompute,
-                       .module = shaderModule,
-                       .pName  = entryPoint.data() },
+            .stage  = stages.front(),
             .layout = layout,
         };
 
-        m_pipeline = device->createComputePipeline({ nullptr }, pipelineCreateInfo) >> ResultChecker();
+        m_pipeline = device->createComputePipeline(cache.get(), pipelineCreateInfo) >> ResultChecker();
+
+        logger::debug("Created compute pipeline {} {} a cache", name, cache.isNew() ? "without" : "with");
+
+        cache.store();
     }
 }  // namespace renderer::backend
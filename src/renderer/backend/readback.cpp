@@ -0,0 +1,267 @@
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/readback.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+
+namespace renderer::backend
+{
+    namespace
+    {
+        // Copies land at offsets that suit any texel format and the optimal buffer copy alignment
+        constexpr vk::DeviceSize kReadbackAlignment = 16;
+
+        auto alignUp(vk::DeviceSize value, vk::DeviceSize alignment) -> vk::DeviceSize
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        constexpr VmaAllocationCreateFlags kReadbackAllocFlags =
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        // Size of a texel of `aspect` in the buffer, the aspects of depth/stencil formats are copied out on
+        // their own and are laid out differently than in the image
+        auto getTexelSize(vk::Format format, vk::ImageAspectFlags aspect) -> vk::DeviceSize
+        {
+            if (aspect == vk::ImageAspectFlagBits::eStencil)
+            {
+                return 1;
+            }
+
+            if (aspect != vk::ImageAspectFlagBits::eDepth)
+            {
+                return vk::blockSize(format);
+            }
+
+            switch (format)
+            {
+                case vk::Format::eD16Unorm:
+                case vk::Format::eD16UnormS8Uint:
+                    return 2;
+                // D24 is copied out as the low 24 bits of 32
+                case vk::Format::eX8D24UnormPack32:
+                case vk::Format::eD24UnormS8Uint:
+                case vk::Format::eD32Sfloat:
+                case vk::Format::eD32SfloatS8Uint:
+                    return 4;
+                default:
+                    MC_ASSERT_MSG(false, "{} has no depth aspect", vk::to_string(format));
+                    return 0;
+            }
+        }
+    }  // namespace
+
+    ReadbackManager::ReadbackManager(ResourceManager<GPUBuffer>& bufferManager, vk::DeviceSize regionSize)
+        : m_bufferManager { &bufferManager },
+          m_regionSize { alignUp(regionSize, kReadbackAlignment) }
+    {
+        // Random access makes VMA pick cached host memory, reading from write-combined memory is very slow
+        m_buffer = bufferManager.create("Readback ring",
+                                        m_regionSize * kNumFramesInFlight,
+                                        vk::BufferUsageFlagBits::eTransferDst,
+                                        VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+                                        kReadbackAllocFlags);
+
+        m_data = static_cast<std::byte const*>(m_buffer.getMappedData());
+    }
+
+    void ReadbackManager::beginFrame(uint32_t frameIndex)
+    {
+        MC_ASSERT(frameIndex < kNumFramesInFlight);
+
+        m_frameIndex = frameIndex;
+        m_head       = 0;
+
+        for (Pending& pending : m_pending[frameIndex])
+        {
+            std::byte const* data = nullptr;
+
+            if (pending.dedicated)
+            {
+                pending.dedicated->invalidate(0, pending.size);
+
+                data = static_cast<std::byte const*>(pending.dedicated->getMappedData());
+            }
+            else
+            {
+                m_buffer.invalidate(pending.offset, pending.size);
+
+                data = m_data + pending.offset;
+            }
+
+            pending.state->data.assign(data, data + pending.size);
+
+            if (pending.callback)
+            {
+                pending.callback(pending.state->data);
+            }
+
+            pending.state->ready.store(true, std::memory_order_release);
+        }
+
+        m_pending[frameIndex].clear();
+    }
+
+    auto ReadbackManager::readBuffer(vk::CommandBuffer cmdBuf,
+                                     vk::Buffer src,
+                                     vk::DeviceSize offset,
+                                     vk::DeviceSize size,
+                                     ReadbackCallback callback) -> Readback
+    {
+        Pending pending {
+            .state    = std::make_shared<Readback::State>(),
+            .callback = std::move(callback),
+            .size     = size,
+        };
+
+        Destination const dst = allocate(pending);
+
+        vk::MemoryBarrier2 const barrier {
+            .srcStageMask  = vk::PipelineStageFlagBits2::eAllCommands,
+            .srcAccessMask = vk::AccessFlagBits2::eMemoryWrite,
+            .dstStageMask  = vk::PipelineStageFlagBits2::eCopy,
+            .dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+        };
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(barrier));
+
+        cmdBuf.copyBuffer(src,
+                          dst.buffer,
+                          vk::BufferCopy {
+                              .srcOffset = offset,
+                              .dstOffset = dst.offset,
+                              .size      = size,
+                          });
+
+        recordHostBarrier(cmdBuf);
+
+        Readback readback;
+        readback.m_state = pending.state;
+
+        m_pending[m_frameIndex].push_back(std::move(pending));
+
+        return readback;
+    }
+
+    auto ReadbackManager::readImage(vk::CommandBuffer cmdBuf,
+                                    vk::Image src,
+                                    vk::ImageLayout layout,
+                                    vk::Extent2D extent,
+                                    vk::Format format,
+                                    vk::ImageAspectFlags aspect,
+                                    ReadbackCallback callback) -> Readback
+    {
+        MC_ASSERT_MSG(layout != vk::ImageLayout::eUndefined, "Reading back an image with undefined contents");
+        MC_ASSERT_MSG(!vk::isCompressed(format), "Block compressed images can't be read back");
+        MC_ASSERT_MSG(std::has_single_bit(static_cast<uint32_t>(aspect)), "Aspects are copied one at a time");
+
+        vk::DeviceSize const texelSize = getTexelSize(format, aspect);
+
+        auto state    = std::make_shared<Readback::State>();
+        state->extent = extent;
+        state->format = format;
+
+        Pending pending {
+            .state    = std::move(state),
+            .callback = std::move(callback),
+            .size     = static_cast<vk::DeviceSize>(extent.width) * extent.height * texelSize,
+        };
+
+        Destination const dst = allocate(pending);
+
+        vk::ImageMemoryBarrier2 barrier {
+            .srcStageMask     = vk::PipelineStageFlagBits2::eAllCommands,
+            .srcAccessMask    = vk::AccessFlagBits2::eMemoryWrite,
+            .dstStageMask     = vk::PipelineStageFlagBits2::eCopy,
+            .dstAccessMask    = vk::AccessFlagBits2::eTransferRead,
+            .oldLayout        = layout,
+            .newLayout        = vk::ImageLayout::eTransferSrcOptimal,
+            .image            = src,
+            .subresourceRange = {
+                .aspectMask = aspect,
+                .levelCount = 1,
+                .layerCount = 1,
+            },
+        };
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(barrier));
+
+        cmdBuf.copyImageToBuffer(src,
+                                 vk::ImageLayout::eTransferSrcOptimal,
+                                 dst.buffer,
+                                 vk::BufferImageCopy {
+                                     .bufferOffset     = dst.offset,
+                                     .imageSubresource = {
+                                         .aspectMask = aspect,
+                                         .layerCount = 1,
+                                     },
+                                     .imageExtent = { extent.width, extent.height, 1 },
+                                 });
+
+        // Whatever used the image before gets it back the way it left it
+        std::swap(barrier.srcStageMask, barrier.dstStageMask);
+        std::swap(barrier.oldLayout, barrier.newLayout);
+        barrier.srcAccessMask = vk::AccessFlagBits2::eNone;
+        barrier.dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite;
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(barrier));
+
+        recordHostBarrier(cmdBuf);
+
+        Readback readback;
+        readback.m_state = pending.state;
+
+        m_pending[m_frameIndex].push_back(std::move(pending));
+
+        return readback;
+    }
+
+    auto ReadbackManager::getNumPending() const -> size_t
+    {
+        size_t count = 0;
+
+        for (std::vector<Pending> const& pending : m_pending)
+        {
+            count += pending.size();
+        }
+
+        return count;
+    }
+
+    auto ReadbackManager::allocate(Pending& pending) -> Destination
+    {
+        vk::DeviceSize const offset = alignUp(m_head, kReadbackAlignment);
+
+        if (offset + pending.size <= m_regionSize)
+        {
+            m_head = offset + pending.size;
+
+            pending.offset = m_frameIndex * m_regionSize + offset;
+
+            return { m_buffer, pending.offset };
+        }
+
+        // Screenshots of big render targets end up here, they are rare enough to pay for an allocation
+        pending.dedicated = m_bufferManager->create("Readback buffer",
+                                                    pending.size,
+                                                    vk::BufferUsageFlagBits::eTransferDst,
+                                                    VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+                                                    kReadbackAllocFlags);
+
+        return { *pending.dedicated, 0 };
+    }
+
+    void ReadbackManager::recordHostBarrier(vk::CommandBuffer cmdBuf)
+    {
+        vk::MemoryBarrier2 const barrier {
+            .srcStageMask  = vk::PipelineStageFlagBits2::eCopy,
+            .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+            .dstStageMask  = vk::PipelineStageFlagBits2::eHost,
+            .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+        };
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(barrier));
+    }
+}  // namespace renderer::backend
@@ -5,6 +5,9 @@
 #include <mc/renderer/backend/info_structs.hpp>
 #include <mc/renderer/backend/vk_checker.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
 #include <glm/glm.hpp>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
@@ -17,6 +20,12 @@
 #include <vulkan/vulkan_handles.hpp>
 #include <vulkan/vulkan_structs.hpp>
 
+namespace
+{
+    // The visibility resolve leaves it wherever nothing was drawn
+    constexpr std::array kClearColor { 107.f / 255.f, 102.f / 255.f, 198.f / 255.f, 1.f };
+}  // namespace
+
 namespace renderer::backend
 {
     void RendererBackend::render()
@@ -33,6 +42,22 @@ namespace renderer::backend
             ResultChecker();
         m_device->resetFences({ frame.inFlightFence });
 
+        // Every resource that the GPU was using in this frame slot is now safe to evict or destroy,
+        // textures go first since destroying them retires their images
+        m_textures.collectGarbage(m_frameCount);
+        m_images.beginFrame(m_frameCount);
+        m_buffers.collectGarbage(m_frameCount);
+        m_uploads.beginFrame();
+        m_scene.streamTextures();
+        m_defragmenter.beginFrame(m_frameCount);
+        m_memoryTelemetry.update(m_frameCount);
+        m_bindlessRegistry.beginFrame(m_frameCount);
+
+        m_frameData.beginFrame(m_currentFrame);
+        m_readbacks.beginFrame(m_currentFrame);
+        updateDescriptors(
+            m_sceneView.cameraPos, glm::identity<glm::mat4>(), m_sceneView.view, m_sceneView.projection);
+
         uint32_t imageIndex {};
 
         {
@@ -60,12 +85,20 @@ namespace renderer::backend
 
         recordCommandBuffer(imageIndex);
 
+        m_frameData.endFrame();
+
         auto cmdinfo = vk::CommandBufferSubmitInfo().setCommandBuffer(cmdBuf);
 
-        auto waitInfo = vk::SemaphoreSubmitInfo()
-                            .setValue(1)
-                            .setStageMask(vk::PipelineStageFlagBits2::eColorAttachmentOutput)
-                            .setSemaphore(frame.imageAvailableSemaphore);
+        std::array waitInfos {
+            vk::SemaphoreSubmitInfo()
+                .setValue(1)
+                .setStageMask(vk::PipelineStageFlagBits2::eColorAttachmentOutput)
+                .setSemaphore(frame.imageAvailableSemaphore),
+            vk::SemaphoreSubmitInfo()
+                .setValue(m_acquiredUploads.value)
+                .setStageMask(vk::PipelineStageFlagBits2::eAllCommands)
+                .setSemaphore(m_uploads.getSemaphore()),
+        };
 
         auto signalInfo = vk::SemaphoreSubmitInfo()
                               .setValue(1)
@@ -74,7 +107,8 @@ namespace renderer::backend
 
         auto submit = vk::SubmitInfo2()
                           .setCommandBufferInfos(cmdinfo)
-                          .setWaitSemaphoreInfos(waitInfo)
+                          .setWaitSemaphoreInfoCount(m_acquiredUploads ? 2u : 1u)
+                          .setPWaitSemaphoreInfos(waitInfos.data())
                           .setSignalSemaphoreInfos(signalInfo);
 
         {
@@ -107,25 +141,45 @@ namespace renderer::backend
         ++m_frameCount;
     }
 
-    void RendererBackend::drawGeometry(vk::CommandBuffer primaryBuf)
+    void RendererBackend::drawGeometry(vk::CommandBuffer primaryBuf, CullPhase phase, GeometryPass pass)
     {
-        vk::Extent2D imageExtent = m_drawImage.getDimensions();
+        vk::Extent2D imageExtent = m_swapchain.getImageExtent();
+
+        bool const visibility = pass == GeometryPass::visibility;
+
+        // The CPU culler has no late phase, its single pass resolves right away. With the visibility buffer
+        // the blended pass comes last and draws over the resolve
+        bool const firstPass = phase == CullPhase::early && pass != GeometryPass::blended;
+        bool const lastPass  = (phase == CullPhase::late || m_cpuCulling) && !visibility;
+
+        vk::AttachmentLoadOp const loadOp =
+            firstPass ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
 
         auto colorAttachment = vk::RenderingAttachmentInfo()
-                                   .setImageView(m_drawImage.getImageView())
-                                   .setImageLayout(vk::ImageLayout::eGeneral)
-                                   .setLoadOp(vk::AttachmentLoadOp::eClear)
-                                   .setClearValue(vk::ClearValue(vk::ClearColorValue(
-                                       std::array { 107.f / 255.f, 102.f / 255.f, 198.f / 255.f, 1.f })))
-                                   .setStoreOp(vk::AttachmentStoreOp::eStore)
-                                   .setResolveImageView(m_drawImageResolve.getImageView())
-                                   .setResolveImageLayout(vk::ImageLayout::eGeneral)
-                                   .setResolveMode(vk::ResolveModeFlagBits::eAverage);
+                                   .setImageView(m_renderGraph.getImageView(m_frameTargets.drawImage))
+                                   .setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+                                   .setLoadOp(loadOp)
+                                   .setClearValue(vk::ClearValue(vk::ClearColorValue(kClearColor)))
+                                   .setStoreOp(vk::AttachmentStoreOp::eStore);
+
+        if (visibility)
+        {
+            // Zero IDs mark the samples nothing was drawn to
+            colorAttachment.setImageView(m_renderGraph.getImageView(m_frameTargets.visibilityImage))
+                .setClearValue(vk::ClearValue(vk::ClearColorValue(std::array<uint32_t, 4> {})));
+        }
+
+        if (lastPass)
+        {
+            colorAttachment.setResolveImageView(m_renderGraph.getImageView(m_frameTargets.drawImageResolve))
+                .setResolveImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+                .setResolveMode(vk::ResolveModeFlagBits::eAverage);
+        }
 
         auto depthAttachment = vk::RenderingAttachmentInfo()
-                                   .setImageView(m_depthImage.getImageView())
+                                   .setImageView(m_renderGraph.getImageView(m_frameTargets.depthImage))
                                    .setImageLayout(vk::ImageLayout::eDepthAttachmentOptimal)
-                                   .setLoadOp(vk::AttachmentLoadOp::eClear)
+                                   .setLoadOp(loadOp)
                                    .setStoreOp(vk::AttachmentStoreOp::eStore)
                                    .setClearValue({ .depthStencil = { .depth = 0.f } });
 
@@ -138,59 +192,126 @@ namespace renderer::backend
 
         primaryBuf.beginRendering(renderInfo);
 
-        auto colorFormat = m_drawImage.getFormat();
+        auto colorFormat = visibility ? VisibilityBuffer::kFormat : kDrawImageFormat;
         auto inheritance = vk::StructureChain(vk::CommandBufferInheritanceInfo(),
                                               vk::CommandBufferInheritanceRenderingInfo()
                                                   .setColorAttachmentFormats(colorFormat)
                                                   .setDepthAttachmentFormat(kDepthStencilFormat)
                                                   .setRasterizationSamples(kMaxSamples));
 
-        auto beginInfo = vk::CommandBufferBeginInfo()
+        if (firstPass)
+        {
+            m_stats.drawCount     = 0;
+            m_stats.triangleCount = 0;
+        }
+
+        // The GPU culler's draws are one indirect draw per bucket, there is nothing to split
+        uint32_t numChunks = 1;
+        uint32_t numDraws  = 0;
+
+        if (m_cpuCulling)
+        {
+            numDraws  = phase == CullPhase::early ? m_cpuCullResult.numVisible : 0;
+            numChunks = std::min((numDraws + kMinDrawsPerRecordChunk - 1) / kMinDrawsPerRecordChunk,
+                                 kMaxDrawRecordChunks);
+        }
+
+        m_drawRecording = {
+            .phase     = phase,
+            .pass      = pass,
+            .beginInfo = vk::CommandBufferBeginInfo()
                              .setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue)
-                             .setPInheritanceInfo(&inheritance.get<vk::CommandBufferInheritanceInfo>());
+                             .setPInheritanceInfo(&inheritance.get<vk::CommandBufferInheritanceInfo>()),
+            .extent        = imageExtent,
+            .numDraws      = numDraws,
+            .drawsPerChunk = numChunks > 0 ? (numDraws + numChunks - 1) / numChunks : 0,
+            .numChunks     = numChunks,
+            .depthPrePass  = m_depthPrePass && pass == GeometryPass::forward,
+        };
+
+        // The pre-pass chunks execute first, within one rendering their depth writes are ordered before
+        // the shading chunks' tests
+        uint32_t const numRecordedChunks = m_drawRecording.depthPrePass ? 2 * numChunks : numChunks;
+
+        if (numRecordedChunks == 1)
+        {
+            recordDrawChunk(0, m_scheduler.GetThreadNum());
+        }
+        else if (numRecordedChunks > 1)
+        {
+            m_drawRecordTask.m_SetSize = numRecordedChunks;
+
+            m_scheduler.AddTaskSetToPipe(&m_drawRecordTask);
+            m_scheduler.WaitforTask(&m_drawRecordTask);
+        }
+
+        {
+            TracyVkZone(m_frameResources[m_currentFrame].tracyContext, primaryBuf, "Indirect draw call");
+
+            if (numRecordedChunks > 0)
+            {
+                primaryBuf.executeCommands({ numRecordedChunks, m_drawChunks.data() });
+            }
+        }
+
+        primaryBuf.endRendering();
+    }
+
+    void RendererBackend::DrawRecordTask::ExecuteRange(enki::TaskSetPartition range, uint32_t threadNum)
+    {
+        for (uint32_t chunk = range.start; chunk < range.end; ++chunk)
+        {
+            backend->recordDrawChunk(chunk, threadNum);
+        }
+    }
+
+    void RendererBackend::recordDrawChunk(uint32_t chunk, uint32_t threadIndex)
+    {
+        ZoneScopedN("Record draws");
 
-        auto scb = m_commandManager.getSecondaryCommandBuffer(m_currentFrame, 0);
+        DrawRecording const& recording = m_drawRecording;
 
-        scb.begin(beginInfo) >> ResultChecker();
+        bool const prePass       = recording.depthPrePass && chunk < recording.numChunks;
+        uint32_t const drawChunk = chunk % recording.numChunks;
+
+        vk::CommandBuffer scb = m_commandManager.getSecondaryCommandBuffer(m_currentFrame, threadIndex);
+
+        scb.begin(recording.beginInfo) >> ResultChecker();
 
         vk::Viewport viewport = {
             .x        = 0,
             .y        = 0,
-            .width    = static_cast<float>(imageExtent.width),
-            .height   = static_cast<float>(imageExtent.height),
+            .width    = static_cast<float>(recording.extent.width),
+            .height   = static_cast<float>(recording.extent.height),
             .minDepth = 0.f,
             .maxDepth = 1.f,
         };
 
         scb.setViewport(0, viewport);
 
-        auto scissor = vk::Rect2D().setExtent(imageExtent).setOffset({ 0, 0 });
+        auto scissor = vk::Rect2D().setExtent(recording.extent).setOffset({ 0, 0 });
 
         scb.setScissor(0, scissor);
 
-        m_stats.drawCount     = 0;
-        m_stats.triangleCount = 0;
-
         if (m_scene.indices)
         {
             scb.bindIndexBuffer(m_scene.indices, 0, vk::IndexType::eUint32);
         }
 
-        scb.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipeline);
-
         scb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
                                m_pipelineLayout,
                                0,
                                {
                                    m_sceneDataDescriptors,
-                                   m_scene.bindlessMaterialDescriptorSet,
+                                   m_bindlessRegistry.getDescriptorSet(),
                                },
-                               {});
+                               m_sceneDataOffset);
 
         GPUDrawPushConstants pushConstants {
-            .vertexBuffer    = m_scene.vertexBufferAddress,
-            .materialBuffer  = m_scene.materialBufferAddress,
-            .primitiveBuffer = m_scene.primitiveDataBufferAddress,
+            .vertexBuffer    = m_scene.vertices.getDeviceAddress(),
+            .positionBuffer  = m_scene.positions.getDeviceAddress(),
+            .materialBuffer  = m_scene.materialBuffer.getDeviceAddress(),
+            .primitiveBuffer = m_scene.primitiveDataBuffer.getDeviceAddress(),
         };
 
         scb.pushConstants(m_pipelineLayout,
@@ -199,22 +320,125 @@ namespace renderer::backend
                           sizeof(GPUDrawPushConstants),
                           &pushConstants);
 
+        // The CPU culler's visible draws are split into chunks regardless of buckets
+        uint32_t const chunkFirst = drawChunk * recording.drawsPerChunk;
+        uint32_t const chunkEnd   = std::min(chunkFirst + recording.drawsPerChunk, recording.numDraws);
+
+        for (uint32_t i = 0; i < kNumDrawBuckets; ++i)
         {
-            uint64_t numDraws = m_scene.drawIndirectCommands.size();
+            auto const bucket = static_cast<DrawBucket>(i);
 
-            TracyVkZone(m_frameResources[m_currentFrame].tracyContext, primaryBuf, "Indirect draw call");
+            // The pre-pass only has positions, masked draws can't alpha test there and blended ones must not
+            // occlude anything, both are drawn with their regular depth test and write afterwards. The
+            // visibility passes leave the blended buckets to the pass after the resolve
+            bool const skipped = (prePass && !isOpaque(bucket)) ||
+                                 (recording.pass == GeometryPass::visibility && isBlended(bucket)) ||
+                                 (recording.pass == GeometryPass::blended && !isBlended(bucket));
+
+            if (skipped)
+            {
+                continue;
+            }
+
+            vk::Pipeline const pipeline = prePass ? m_depthPrePassPipelines[i].get()
+                                          : recording.pass == GeometryPass::visibility
+                                              ? m_visibilityPipelines[i].get()
+                                          : recording.depthPrePass && isOpaque(bucket)
+                                              ? m_equalDepthPipelines[i].get()
+                                              : m_bucketPipelines[i].get();
+
+            if (!m_cpuCulling)
+            {
+                scb.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+
+                m_drawCuller.draw(scb, recording.phase, bucket);
 
-            scb.drawIndexedIndirect(m_scene.drawIndirectBuffer,
-                                    0,
-                                    numDraws,
-                                    sizeof(decltype(m_scene.drawIndirectCommands)::value_type));
+                continue;
+            }
+
+            DrawRange const range = m_cpuCullResult.buckets[i];
+
+            uint32_t const first = std::max(range.first, chunkFirst);
+            uint32_t const end   = std::min(range.first + range.count, chunkEnd);
+
+            if (first >= end)
+            {
+                continue;
+            }
+
+            scb.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+
+            scb.drawIndexedIndirect(m_cpuCullResult.buffer,
+                                    m_cpuCullResult.offset + (first * sizeof(vk::DrawIndexedIndirectCommand)),
+                                    end - first,
+                                    sizeof(vk::DrawIndexedIndirectCommand));
         }
 
         scb.end() >> ResultChecker();
 
-        primaryBuf.executeCommands(scb);
+        m_drawChunks[chunk] = scb;
+    }
+
+    void RendererBackend::resolveVisibility(vk::CommandBuffer cmdBuf)
+    {
+        vk::Extent2D imageExtent = m_swapchain.getImageExtent();
 
-        primaryBuf.endRendering();
+        // The shader only writes the covered samples, the rest keep the clear color
+        auto colorAttachment = vk::RenderingAttachmentInfo()
+                                   .setImageView(m_renderGraph.getImageView(m_frameTargets.drawImage))
+                                   .setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+                                   .setLoadOp(vk::AttachmentLoadOp::eClear)
+                                   .setClearValue(vk::ClearValue(vk::ClearColorValue(kClearColor)))
+                                   .setStoreOp(vk::AttachmentStoreOp::eStore);
+
+        auto renderInfo = vk::RenderingInfo()
+                              .setRenderArea({ .extent = imageExtent })
+                              .setColorAttachments(colorAttachment)
+                              .setLayerCount(1);
+
+        cmdBuf.beginRendering(renderInfo);
+
+        vk::Viewport viewport = {
+            .x        = 0,
+            .y        = 0,
+            .width    = static_cast<float>(imageExtent.width),
+            .height   = static_cast<float>(imageExtent.height),
+            .minDepth = 0.f,
+            .maxDepth = 1.f,
+        };
+
+        cmdBuf.setViewport(0, viewport);
+        cmdBuf.setScissor(0, vk::Rect2D().setExtent(imageExtent));
+
+        cmdBuf.bindPipeline(vk::PipelineBindPoint::eGraphics, m_visibilityResolvePipeline);
+
+        cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                  m_visibilityResolveLayout,
+                                  0,
+                                  {
+                                      m_sceneDataDescriptors,
+                                      m_bindlessRegistry.getDescriptorSet(),
+                                      m_visibilityBuffer.getDescriptorSet(),
+                                  },
+                                  m_sceneDataOffset);
+
+        GPUDrawPushConstants pushConstants {
+            .vertexBuffer    = m_scene.vertices.getDeviceAddress(),
+            .positionBuffer  = m_scene.positions.getDeviceAddress(),
+            .materialBuffer  = m_scene.materialBuffer.getDeviceAddress(),
+            .primitiveBuffer = m_scene.primitiveDataBuffer.getDeviceAddress(),
+            .indexBuffer     = m_scene.indices ? m_scene.indices.getDeviceAddress() : 0,
+        };
+
+        cmdBuf.pushConstants(m_visibilityResolveLayout,
+                             vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+                             0,
+                             sizeof(GPUDrawPushConstants),
+                             &pushConstants);
+
+        cmdBuf.draw(3, 1, 0, 0);
+
+        cmdBuf.endRendering();
     }
 
     void RendererBackend::recordCommandBuffer(uint32_t imageIndex)
@@ -231,49 +455,292 @@ namespace renderer::backend
             vk::Image swapchainImage = m_swapchain.getImages()[imageIndex];
             vk::Extent2D imageExtent = m_swapchain.getImageExtent();
 
-            Image::transition(primaryBuf,
-                              m_depthImage,
-                              vk::ImageLayout::eUndefined,
-                              vk::ImageLayout::eDepthAttachmentOptimal);
+            m_acquiredUploads = m_uploads.recordAcquireBarriers(primaryBuf);
 
-            Image::transition(primaryBuf,
-                              m_drawImage,
-                              vk::ImageLayout::eUndefined,
-                              vk::ImageLayout::eColorAttachmentOptimal);
+            m_images.recordMipDrops(primaryBuf);
 
+            m_defragmenter.recordMoves(primaryBuf);
+
+            m_drawSorter.sort(m_sceneView.cameraPos);
+
+            glm::mat4 const viewProj = m_sceneView.projection * m_sceneView.view;
+
+            m_visiblePrimitives.clear();
+
+            if (m_cpuCulling)
             {
-                TracyVkZone(tracyCtx, primaryBuf, "Geometry render");
+                bool const occlusion     = m_softwareOcclusion && m_occlusionRasterizer.hasOccluders();
+
+                if (occlusion)
+                {
+                    m_occlusionRasterizer.render(viewProj);
+                }
+
+                m_cpuCullResult = m_cpuDrawCuller.cull(
+                    viewProj, m_drawSorter, occlusion ? &m_occlusionRasterizer : nullptr);
 
-                drawGeometry(primaryBuf);
+                m_stats.visibleDrawCount = m_cpuCullResult.numVisible;
+
+                // Exactly the draws recorded below
+                m_cpuDrawCuller.getVisiblePrimitives(m_visiblePrimitives);
+            }
+            else
+            {
+                // The GPU culler only draws what passes its frustum test of the same primitive bounds,
+                // occlusion culling only ever removes draws from that
+                m_scene.bvh.queryFrustum(extractFrustumPlanes(viewProj), m_visiblePrimitives);
             }
 
+            // Textures only count as used while a recorded draw may sample them
+            m_scene.markTexturesUsed(m_visiblePrimitives);
+
+            vk::SampleCountFlagBits const samples = m_device.getMaxUsableSampleCount();
+
+            m_renderGraph.reset();
+
+            m_frameTargets.drawImage =
+                m_renderGraph.createImage("draw image", { imageExtent, kDrawImageFormat, samples });
+            m_frameTargets.drawImageResolve =
+                m_renderGraph.createImage("draw image resolve", { imageExtent, kDrawImageFormat });
+            m_frameTargets.depthImage =
+                m_renderGraph.createImage("depth image", { imageExtent, kDepthStencilFormat, samples });
+
+            if (m_visibilityRendering)
+            {
+                m_frameTargets.visibilityImage = m_renderGraph.createImage(
+                    "visibility buffer", { imageExtent, VisibilityBuffer::kFormat, samples });
+            }
+
+            // The first barrier chains onto the acquire semaphore's wait
+            RenderGraphResource const swapchainTarget = m_renderGraph.importImage(
+                "swapchain image",
+                {
+                    .image       = swapchainImage,
+                    .view        = *m_swapchain.getImageViews()[imageIndex],
+                    .waitStages  = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+                    .finalLayout = vk::ImageLayout::ePresentSrcKHR,
+                });
+
+            RenderGraphResource const visibleDraws =
+                m_renderGraph.importBuffer("visible draws", m_drawCuller.getVisibleDrawBuffer());
+            RenderGraphResource const drawCounts =
+                m_renderGraph.importBuffer("draw counts", m_drawCuller.getDrawCountBuffer());
+
+            RenderGraphResource const depthTarget = m_frameTargets.depthImage;
+            RenderGraphResource const colorTarget =
+                m_visibilityRendering ? m_frameTargets.visibilityImage : m_frameTargets.drawImage;
+
+            GeometryPass const geometryPass =
+                m_visibilityRendering ? GeometryPass::visibility : GeometryPass::forward;
+
+            // The GPU culler's draws are read by every geometry pass, the CPU culler's come from the host
+            auto const geometryAccesses = [&](std::initializer_list<ResourceAccess> targets)
             {
-                TracyVkZone(tracyCtx, primaryBuf, "Draw image copy");
+                std::vector<ResourceAccess> accesses = targets;
+
+                if (!m_cpuCulling)
+                {
+                    accesses.push_back({ visibleDraws, ResourceUsage::indirectRead });
+                    accesses.push_back({ drawCounts, ResourceUsage::indirectRead });
+                }
 
-                Image::transition(primaryBuf,
-                                  m_drawImageResolve,
-                                  vk::ImageLayout::eUndefined,
-                                  vk::ImageLayout::eTransferSrcOptimal);
+                return accesses;
+            };
 
-                Image::transition(primaryBuf,
-                                  swapchainImage,
-                                  vk::ImageLayout::eUndefined,
-                                  vk::ImageLayout::eTransferDstOptimal);
+            auto const recordCulling = [&](vk::CommandBuffer cmdBuf, CullPhase phase)
+            {
+                m_drawCuller.record(cmdBuf,
+                                    phase,
+                                    m_currentFrame,
+                                    m_sceneView.projection * m_sceneView.view,
+                                    m_scene.primitiveDataBuffer.getDeviceAddress(),
+                                    m_scene.drawIndirectBuffer.getDeviceAddress(),
+                                    m_drawSorter);
+            };
 
-                m_drawImageResolve.copyTo(
-                    primaryBuf, swapchainImage, imageExtent, m_drawImage.getDimensions());
+            if (!m_cpuCulling)
+            {
+                // The counts are cleared before the shader writes them
+                m_renderGraph.addPass("Early culling",
+                                      {
+                                          { visibleDraws, ResourceUsage::computeStorageWrite },
+                                          { drawCounts, ResourceUsage::transferDst },
+                                          { drawCounts, ResourceUsage::computeStorageWrite },
+                                      },
+                                      [&](vk::CommandBuffer cmdBuf)
+                                      {
+                                          TracyVkZone(tracyCtx, cmdBuf, "Early culling");
+
+                                          recordCulling(cmdBuf, CullPhase::early);
+                                      });
             }
 
+            // The CPU culler has no late phase, its forward pass resolves right away
+            std::vector<ResourceAccess> earlyAccesses = geometryAccesses({
+                { depthTarget, ResourceUsage::depthAttachment },
+                { colorTarget, ResourceUsage::colorAttachment },
+            });
+
+            if (m_cpuCulling && !m_visibilityRendering)
             {
-                TracyVkZone(tracyCtx, primaryBuf, "ImGui render");
+                earlyAccesses.push_back({ m_frameTargets.drawImageResolve, ResourceUsage::colorAttachment });
+            }
 
-                renderImgui(primaryBuf, *m_swapchain.getImageViews()[imageIndex]);
+            m_renderGraph.addPass("Geometry render",
+                                  std::move(earlyAccesses),
+                                  [&](vk::CommandBuffer cmdBuf)
+                                  {
+                                      TracyVkZone(tracyCtx, cmdBuf, "Geometry render");
+
+                                      drawGeometry(cmdBuf, CullPhase::early, geometryPass);
+                                  });
+
+            if (!m_cpuCulling)
+            {
+                // The pyramid stays outside the graph, it synchronizes its own levels with the culling pass
+                m_renderGraph.addPass("Depth pyramid",
+                                      { { depthTarget, ResourceUsage::computeSampled } },
+                                      [&](vk::CommandBuffer cmdBuf)
+                                      {
+                                          TracyVkZone(tracyCtx, cmdBuf, "Depth pyramid");
+
+                                          m_depthPyramid.record(cmdBuf);
+                                      },
+                                      true);
+
+                m_renderGraph.addPass("Late culling",
+                                      {
+                                          { visibleDraws, ResourceUsage::computeStorageWrite },
+                                          { drawCounts, ResourceUsage::computeStorageWrite },
+                                      },
+                                      [&](vk::CommandBuffer cmdBuf)
+                                      {
+                                          TracyVkZone(tracyCtx, cmdBuf, "Late culling");
+
+                                          recordCulling(cmdBuf, CullPhase::late);
+                                      });
+
+                std::vector<ResourceAccess> lateAccesses = geometryAccesses({
+                    { depthTarget, ResourceUsage::depthAttachment },
+                    { colorTarget, ResourceUsage::colorAttachment },
+                });
+
+                if (!m_visibilityRendering)
+                {
+                    lateAccesses.push_back(
+                        { m_frameTargets.drawImageResolve, ResourceUsage::colorAttachment });
+                }
+
+                m_renderGraph.addPass("Late geometry render",
+                                      std::move(lateAccesses),
+                                      [&](vk::CommandBuffer cmdBuf)
+                                      {
+                                          TracyVkZone(tracyCtx, cmdBuf, "Late geometry render");
+
+                                          drawGeometry(cmdBuf, CullPhase::late, geometryPass);
+                                      });
+
+                // Every bucket's count of both phases, adjacent
+                m_renderGraph.addPass(
+                    "Draw count readback",
+                    { { drawCounts, ResourceUsage::transferSrc } },
+                    [&](vk::CommandBuffer cmdBuf)
+                    {
+                        m_readbacks.readBuffer(cmdBuf,
+                                               m_drawCuller.getDrawCountBuffer(),
+                                               m_drawCuller.getDrawCountOffset(),
+                                               DrawCuller::getDrawCountSize(),
+                                               [this](std::span<std::byte const> data)
+                                               {
+                                                   std::array<uint32_t, 2 * kNumDrawBuckets> counts {};
+                                                   std::memcpy(counts.data(), data.data(), sizeof(counts));
+
+                                                   m_stats.visibleDrawCount =
+                                                       std::accumulate(counts.begin(), counts.end(), 0u);
+                                               });
+                    },
+                    true);
+            }
+
+            if (m_visibilityRendering)
+            {
+                m_renderGraph.addPass("Visibility resolve",
+                                      {
+                                          { m_frameTargets.visibilityImage, ResourceUsage::fragmentSampled },
+                                          { m_frameTargets.drawImage, ResourceUsage::colorAttachment },
+                                      },
+                                      [&](vk::CommandBuffer cmdBuf)
+                                      {
+                                          TracyVkZone(tracyCtx, cmdBuf, "Visibility resolve");
+
+                                          resolveVisibility(cmdBuf);
+                                      });
+
+                // The GPU culler only outputs the blended draws in its late phase
+                m_renderGraph.addPass("Blended geometry render",
+                                      geometryAccesses({
+                                          { depthTarget, ResourceUsage::depthAttachment },
+                                          { m_frameTargets.drawImage, ResourceUsage::colorAttachment },
+                                          { m_frameTargets.drawImageResolve, ResourceUsage::colorAttachment },
+                                      }),
+                                      [&](vk::CommandBuffer cmdBuf)
+                                      {
+                                          TracyVkZone(tracyCtx, cmdBuf, "Blended geometry render");
+
+                                          drawGeometry(cmdBuf,
+                                                       m_cpuCulling ? CullPhase::early : CullPhase::late,
+                                                       GeometryPass::blended);
+                                      });
             }
 
-            Image::transition(primaryBuf,
-                              swapchainImage,
-                              vk::ImageLayout::eTransferDstOptimal,
-                              vk::ImageLayout::ePresentSrcKHR);
+            m_renderGraph.addPass("Draw image copy",
+                                  {
+                                      { m_frameTargets.drawImageResolve, ResourceUsage::transferSrc },
+                                      { swapchainTarget, ResourceUsage::transferDst },
+                                  },
+                                  [&](vk::CommandBuffer cmdBuf)
+                                  {
+                                      TracyVkZone(tracyCtx, cmdBuf, "Draw image copy");
+
+                                      Image::blit(cmdBuf,
+                                                  m_renderGraph.getImage(m_frameTargets.drawImageResolve),
+                                                  imageExtent,
+                                                  swapchainImage,
+                                                  imageExtent);
+                                  });
+
+            m_renderGraph.addPass("ImGui render",
+                                  { { swapchainTarget, ResourceUsage::colorAttachment } },
+                                  [&](vk::CommandBuffer cmdBuf)
+                                  {
+                                      TracyVkZone(tracyCtx, cmdBuf, "ImGui render");
+
+                                      renderImgui(cmdBuf, *m_swapchain.getImageViews()[imageIndex]);
+                                  });
+
+            // New images are only ever created with the device idle. The depth image is only sampleable
+            // while the pyramid pass reads it
+            if (m_renderGraph.compile())
+            {
+                if (!m_cpuCulling)
+                {
+                    m_depthPyramid.resize(m_renderGraph.getImageView(depthTarget), imageExtent);
+                    m_drawCuller.setDepthPyramid(m_depthPyramid);
+                }
+
+                if (m_visibilityRendering)
+                {
+                    m_visibilityBuffer.setImageView(
+                        m_renderGraph.getImageView(m_frameTargets.visibilityImage));
+                }
+
+                // The frame targets live in the graph's blocks, they still count as render targets
+                m_images.setExternalUsage(ImageCategory::renderTarget,
+                                          m_renderGraph.getTransientMemory(),
+                                          m_renderGraph.getNumMemoryBlocks());
+            }
+
+            m_renderGraph.execute(primaryBuf);
         }
 
         TracyVkCollect(tracyCtx, primaryBuf);
@@ -302,7 +769,7 @@ namespace renderer::backend
 
         auto colorAttachment = vk::RenderingAttachmentInfo()
                                    .setImageView(targetImage)
-                                   .setImageLayout(vk::ImageLayout::eGeneral)
+                                   .setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
                                    .setLoadOp(vk::AttachmentLoadOp::eLoad)
                                    .setStoreOp(vk::AttachmentStoreOp::eStore);
 
@@ -350,8 +817,43 @@ namespace renderer::backend
                                "%s triangles",
                                humanReadableTriCount.data());
             ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
-                               "%lu draws",
-                               m_scene.drawIndirectCommands.size());
+                               "%lu / %lu draws visible (%lu culled)",
+                               m_stats.visibleDrawCount,
+                               m_scene.drawIndirectCommands.size(),
+                               m_scene.drawIndirectCommands.size() - m_stats.visibleDrawCount);
+
+            if (m_cpuCulling)
+            {
+                ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                                   "CPU culling: %.3f ms",
+                                   m_cpuDrawCuller.getLastCullTime());
+
+                if (m_softwareOcclusion)
+                {
+                    ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                                       "Occluders: %u triangles in %.3f ms",
+                                       m_occlusionRasterizer.getNumTriangles(),
+                                       m_occlusionRasterizer.getLastRenderTime());
+                }
+            }
+            else
+            {
+                ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                                   "GPU frustum and occlusion culling");
+            }
+
+            ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                               "Shading: %s",
+                               m_visibilityRendering ? "visibility buffer"
+                               : m_depthPrePass      ? "forward after a depth pre-pass"
+                                                     : "forward");
+
+            std::string const picked = m_pickedPrimitive ? std::to_string(*m_pickedPrimitive) : "none";
+
+            ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                               "%u BVH nodes, picked primitive: %s",
+                               m_scene.bvh.getNumNodes(),
+                               picked.data());
 
             ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
                                "%lu images (+ %lu inactive)",
@@ -363,6 +865,49 @@ namespace renderer::backend
                                m_textures.getNumActiveResources(),
                                m_textures.getNumResources() - m_textures.getNumActiveResources());
 
+            for (auto [category, label] : {
+                     std::pair { ImageCategory::texture, "Texture memory" },
+                     std::pair { ImageCategory::renderTarget, "Render target memory" },
+                 })
+            {
+                std::string usage  = utils::largeSizeToHumanReadable(m_images.getUsage(category));
+                std::string budget = m_images.getBudget(category) > 0
+                                         ? utils::largeSizeToHumanReadable(m_images.getBudget(category))
+                                         : "unbounded";
+
+                ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                                   "%s: %s / %s",
+                                   label,
+                                   usage.data(),
+                                   budget.data());
+            }
+
+            std::string const transientMemory =
+                utils::largeSizeToHumanReadable(m_renderGraph.getTransientMemory());
+            std::string const unaliasedMemory =
+                utils::largeSizeToHumanReadable(m_renderGraph.getUnaliasedMemory());
+
+            ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                               "Transient render targets: %s (%s unaliased)",
+                               transientMemory.data(),
+                               unaliasedMemory.data());
+
+            ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                               "%u barriers, %u passes culled",
+                               m_renderGraph.getNumBarriers(),
+                               m_renderGraph.getNumCulledPasses());
+
+            ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                               "%u / %u bindless textures, %lu samplers",
+                               m_bindlessRegistry.getNumTextures(),
+                               m_bindlessRegistry.getCapacity(),
+                               m_bindlessRegistry.getNumSamplers());
+
+            ImGui::TextColored(ImVec4(147.f / 255.f, 210.f / 255.f, 2.f / 255.f, 1.f),
+                               "%lu images evicted (%lu textures on the placeholder)",
+                               m_images.getNumEvicted(),
+                               m_scene.evictedTextures.size());
+
             ImGui::End();
         }
 
@@ -380,9 +925,24 @@ namespace renderer::backend
             prevWindowSize = ImGui::GetWindowSize();
 
             ImGui::TextColored(ImVec4(0.f, 220.f / 255.f, 190.f / 255.f, 1.f),
-                               "%lu buffers (+ %lu inactive)",
+                               "%lu buffers (+ %lu inactive, %lu retired)",
                                m_buffers.getNumActiveResources(),
-                               m_buffers.getNumResources() - m_buffers.getNumActiveResources());
+                               m_buffers.getNumResources() - m_buffers.getNumActiveResources(),
+                               m_buffers.getNumRetiredResources());
+
+            ImGui::TextColored(ImVec4(0.f, 170.f / 255.f, 220.f / 255.f, 1.f),
+                               "%s: %lu buffers in %lu blocks of %s",
+                               m_uniformPool.getName().data(),
+                               m_uniformPool.getNumSuballocations(),
+                               m_uniformPool.getNumBlocks(),
+                               utils::largeSizeToHumanReadable(m_uniformPool.getBlockSize()).data());
+
+            ImGui::TextColored(ImVec4(0.f, 220.f / 255.f, 190.f / 255.f, 1.f),
+                               "Defragmentation %s, %s released in %lu blocks (%s moved)",
+                               m_defragmenter.isRunning() ? "running" : "idle",
+                               utils::largeSizeToHumanReadable(m_defragmenter.getBytesFreed()).data(),
+                               m_defragmenter.getNumBlocksFreed(),
+                               utils::largeSizeToHumanReadable(m_defragmenter.getBytesMoved()).data());
 
             for (auto const& [name, size] : m_buffers.getAllActiveBuffersInfo())
             {
@@ -397,6 +957,55 @@ namespace renderer::backend
             ImGui::End();
         }
 
+        {
+            ImGui::SetNextWindowPos(
+                ImVec2(prevWindowPos.x, prevWindowPos.y + prevWindowSize.y + windowPadding));
+
+            ImGui::Begin("Memory",
+                         nullptr,
+                         ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize |
+                             ImGuiWindowFlags_NoCollapse);
+
+            prevWindowPos  = ImGui::GetWindowPos();
+            prevWindowSize = ImGui::GetWindowSize();
+
+            for (auto const& [index, heap] : vi::enumerate(m_memoryTelemetry.getHeaps()))
+            {
+                // Turns red once the heap gets close to its budget, the driver starts paging past it
+                ImVec4 const color = heap.usage * 10 > heap.budget * 9
+                                         ? ImVec4(1.f, 80.f / 255.f, 80.f / 255.f, 1.f)
+                                         : ImVec4(0.f, 220.f / 255.f, 190.f / 255.f, 1.f);
+
+                ImGui::TextColored(color,
+                                   "Heap %ld (%s): %s / %s (peak %s)",
+                                   index,
+                                   heap.deviceLocal ? "device local" : "host",
+                                   utils::largeSizeToHumanReadable(heap.usage).data(),
+                                   utils::largeSizeToHumanReadable(heap.budget).data(),
+                                   utils::largeSizeToHumanReadable(heap.peakUsage).data());
+            }
+
+            for (size_t i = 0; i < static_cast<size_t>(MemoryCategory::count); ++i)
+            {
+                auto const category        = static_cast<MemoryCategory>(i);
+                CategoryUsage const& usage = m_memoryTelemetry.getCategory(category);
+
+                ImGui::TextColored(ImVec4(0.f, 170.f / 255.f, 220.f / 255.f, 1.f),
+                                   "%s: %s in %u resources (peak %s)",
+                                   MemoryTelemetry::getCategoryName(category).data(),
+                                   utils::largeSizeToHumanReadable(usage.bytes).data(),
+                                   usage.count,
+                                   utils::largeSizeToHumanReadable(usage.peakBytes).data());
+            }
+
+            ImGui::TextColored(ImVec4(0.f, 170.f / 255.f, 220.f / 255.f, 1.f),
+                               "Process resident memory: %s (peak %s)",
+                               utils::largeSizeToHumanReadable(m_memoryTelemetry.getHostMemory()).data(),
+                               utils::largeSizeToHumanReadable(m_memoryTelemetry.getPeakHostMemory()).data());
+
+            ImGui::End();
+        }
+
         ImGui::Render();
         ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmdBuf);
 
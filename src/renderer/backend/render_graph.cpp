@@ -0,0 +1,700 @@
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/render_graph.hpp>
+#include <mc/renderer/backend/vk_checker.hpp>
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <numeric>
+#include <ranges>
+#include <utility>
+
+#include <tracy/Tracy.hpp>
+
+namespace renderer::backend
+{
+    namespace
+    {
+        struct UsageInfo
+        {
+            vk::PipelineStageFlags2 stages;
+            vk::AccessFlags2 readAccess;
+            vk::AccessFlags2 writeAccess;
+            // Undefined for buffer-only usages
+            vk::ImageLayout layout;
+            vk::ImageUsageFlags imageUsage;
+        };
+
+        // Indexed by `ResourceUsage`
+        constexpr std::array kUsageInfos {
+            UsageInfo {
+                .stages      = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+                .readAccess  = vk::AccessFlagBits2::eColorAttachmentRead,
+                .writeAccess = vk::AccessFlagBits2::eColorAttachmentWrite,
+                .layout      = vk::ImageLayout::eColorAttachmentOptimal,
+                .imageUsage  = vk::ImageUsageFlagBits::eColorAttachment,
+            },
+            UsageInfo {
+                .stages = vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+                          vk::PipelineStageFlagBits2::eLateFragmentTests,
+                .readAccess  = vk::AccessFlagBits2::eDepthStencilAttachmentRead,
+                .writeAccess = vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+                .layout      = vk::ImageLayout::eDepthAttachmentOptimal,
+                .imageUsage  = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+            },
+            UsageInfo {
+                .stages     = vk::PipelineStageFlagBits2::eFragmentShader,
+                .readAccess = vk::AccessFlagBits2::eShaderSampledRead,
+                .layout     = vk::ImageLayout::eShaderReadOnlyOptimal,
+                .imageUsage = vk::ImageUsageFlagBits::eSampled,
+            },
+            UsageInfo {
+                .stages     = vk::PipelineStageFlagBits2::eComputeShader,
+                .readAccess = vk::AccessFlagBits2::eShaderSampledRead,
+                .layout     = vk::ImageLayout::eShaderReadOnlyOptimal,
+                .imageUsage = vk::ImageUsageFlagBits::eSampled,
+            },
+            UsageInfo {
+                .stages     = vk::PipelineStageFlagBits2::eComputeShader,
+                .readAccess = vk::AccessFlagBits2::eShaderStorageRead,
+                .layout     = vk::ImageLayout::eGeneral,
+                .imageUsage = vk::ImageUsageFlagBits::eStorage,
+            },
+            UsageInfo {
+                .stages      = vk::PipelineStageFlagBits2::eComputeShader,
+                .readAccess  = vk::AccessFlagBits2::eShaderStorageRead,
+                .writeAccess = vk::AccessFlagBits2::eShaderStorageWrite,
+                .layout      = vk::ImageLayout::eGeneral,
+                .imageUsage  = vk::ImageUsageFlagBits::eStorage,
+            },
+            UsageInfo {
+                .stages     = vk::PipelineStageFlagBits2::eDrawIndirect,
+                .readAccess = vk::AccessFlagBits2::eIndirectCommandRead,
+            },
+            UsageInfo {
+                .stages     = vk::PipelineStageFlagBits2::eAllTransfer,
+                .readAccess = vk::AccessFlagBits2::eTransferRead,
+                .layout     = vk::ImageLayout::eTransferSrcOptimal,
+                .imageUsage = vk::ImageUsageFlagBits::eTransferSrc,
+            },
+            UsageInfo {
+                .stages      = vk::PipelineStageFlagBits2::eAllTransfer,
+                .writeAccess = vk::AccessFlagBits2::eTransferWrite,
+                .layout      = vk::ImageLayout::eTransferDstOptimal,
+                .imageUsage  = vk::ImageUsageFlagBits::eTransferDst,
+            },
+        };
+
+        static_assert(kUsageInfos.size() == static_cast<size_t>(ResourceUsage::transferDst) + 1);
+
+        auto getUsageInfo(ResourceUsage usage) -> UsageInfo const&
+        {
+            return kUsageInfos[static_cast<size_t>(usage)];
+        }
+
+        // Stencil isn't handled, nothing renders with one
+        auto isDepthFormat(vk::Format format) -> bool
+        {
+            return format == vk::Format::eD16Unorm || format == vk::Format::eX8D24UnormPack32 ||
+                   format == vk::Format::eD32Sfloat;
+        }
+
+        // Attachments and sampling need an image, indirect commands a buffer
+        auto fitsResource(ResourceUsage usage, bool isBuffer) -> bool
+        {
+            UsageInfo const& info = getUsageInfo(usage);
+
+            if (!isBuffer)
+            {
+                return info.layout != vk::ImageLayout::eUndefined;
+            }
+
+            return !(info.imageUsage & (vk::ImageUsageFlagBits::eColorAttachment |
+                                        vk::ImageUsageFlagBits::eDepthStencilAttachment |
+                                        vk::ImageUsageFlagBits::eSampled));
+        }
+
+        auto overlap(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) -> bool
+        {
+            return firstA <= lastB && firstB <= lastA;
+        }
+    }  // namespace
+
+    RenderGraph::RenderGraph(Device& device, Allocator& allocator)
+        : m_device { &device }, m_allocator { &allocator }
+    {
+    }
+
+    RenderGraph::~RenderGraph()
+    {
+        releaseTransients();
+    }
+
+    void RenderGraph::reset()
+    {
+        m_resources.clear();
+        m_passes.clear();
+        m_numTransients = 0;
+    }
+
+    auto RenderGraph::createImage(std::string_view name, TransientImageDesc const& desc)
+        -> RenderGraphResource
+    {
+        m_resources.push_back({
+            .name      = std::string(name),
+            .desc      = desc,
+            .aspect    = isDepthFormat(desc.format) ? vk::ImageAspectFlagBits::eDepth
+                                                    : vk::ImageAspectFlagBits::eColor,
+            .transient = m_numTransients++,
+        });
+
+        return static_cast<RenderGraphResource>(m_resources.size() - 1);
+    }
+
+    auto RenderGraph::importImage(std::string_view name, ImportedImage const& image) -> RenderGraphResource
+    {
+        // The stages to wait for act like a write without anything to make visible
+        m_resources.push_back({
+            .name        = std::string(name),
+            .isImported  = true,
+            .image       = image.image,
+            .view        = image.view,
+            .aspect      = image.aspect,
+            .finalLayout = image.finalLayout,
+            .state       = {
+                .layout      = image.layout,
+                .writeStages = image.waitStages,
+            },
+        });
+
+        return static_cast<RenderGraphResource>(m_resources.size() - 1);
+    }
+
+    auto RenderGraph::importBuffer(std::string_view name, vk::Buffer buffer) -> RenderGraphResource
+    {
+        m_resources.push_back({
+            .name       = std::string(name),
+            .isBuffer   = true,
+            .isImported = true,
+            .buffer     = buffer,
+        });
+
+        return static_cast<RenderGraphResource>(m_resources.size() - 1);
+    }
+
+    void RenderGraph::addPass(std::string_view name,
+                              std::vector<ResourceAccess> accesses,
+                              std::function<void(vk::CommandBuffer)> record,
+                              bool hasSideEffects)
+    {
+        for (ResourceAccess const& access : accesses)
+        {
+            MC_ASSERT_MSG(access.resource < m_resources.size(), "Pass {} uses an undeclared resource", name);
+            MC_ASSERT_MSG(fitsResource(access.usage, m_resources[access.resource].isBuffer),
+                          "Pass {} can't use {} like that",
+                          name,
+                          m_resources[access.resource].name);
+        }
+
+        m_passes.push_back({
+            .name           = std::string(name),
+            .accesses       = std::move(accesses),
+            .record         = std::move(record),
+            .hasSideEffects = hasSideEffects,
+            .culled         = false,
+        });
+    }
+
+    auto RenderGraph::compile() -> bool
+    {
+        ZoneScopedN("Render graph compile");
+
+        cullPasses();
+        computeLifetimes();
+
+        std::vector<TransientKey> keys;
+        keys.reserve(m_numTransients);
+
+        for (Resource const& resource : m_resources)
+        {
+            if (!resource.isImported)
+            {
+                keys.push_back({
+                    .desc      = resource.desc,
+                    .usage     = resource.usage,
+                    .firstPass = resource.firstPass,
+                    .lastPass  = resource.lastPass,
+                });
+            }
+        }
+
+        bool const reallocate = keys != m_transientKeys;
+
+        if (reallocate)
+        {
+            // Frames in flight may still be rendering into the old images
+            (*m_device)->waitIdle();
+
+            releaseTransients();
+            allocateTransients(keys);
+
+            m_transientKeys = std::move(keys);
+        }
+
+        for (Resource& resource : m_resources)
+        {
+            if (!resource.isImported)
+            {
+                resource.image = *m_transients[resource.transient].image;
+                resource.view  = *m_transients[resource.transient].view;
+            }
+        }
+
+        return reallocate;
+    }
+
+    void RenderGraph::cullPasses()
+    {
+        // Imported resources are seen outside the graph, anything read by a live pass has to be written
+        std::vector<bool> needed(m_resources.size());
+
+        for (size_t i = 0; i < m_resources.size(); ++i)
+        {
+            needed[i] = m_resources[i].isImported;
+        }
+
+        m_numCulledPasses = 0;
+
+        for (Pass& pass : std::views::reverse(m_passes))
+        {
+            pass.culled = !pass.hasSideEffects &&
+                          std::ranges::none_of(pass.accesses,
+                                               [&](ResourceAccess const& access)
+                                               {
+                                                   return getUsageInfo(access.usage).writeAccess &&
+                                                          needed[access.resource];
+                                               });
+
+            if (pass.culled)
+            {
+                ++m_numCulledPasses;
+
+                continue;
+            }
+
+            for (ResourceAccess const& access : pass.accesses)
+            {
+                if (getUsageInfo(access.usage).readAccess)
+                {
+                    needed[access.resource] = true;
+                }
+            }
+        }
+    }
+
+    void RenderGraph::computeLifetimes()
+    {
+        for (uint32_t passIndex = 0; passIndex < m_passes.size(); ++passIndex)
+        {
+            for (ResourceAccess const& access : m_passes[passIndex].accesses)
+            {
+                Resource& resource = m_resources[access.resource];
+
+                // Images only used by culled passes still get created, their views may be in descriptors
+                resource.usage |= getUsageInfo(access.usage).imageUsage;
+
+                if (!m_passes[passIndex].culled)
+                {
+                    resource.firstPass = std::min(resource.firstPass, passIndex);
+                    resource.lastPass  = std::max(resource.lastPass, passIndex);
+                }
+            }
+        }
+
+        // Descriptors may be read at any point of the frame, so images no live pass uses get the whole frame
+        // and never share their memory
+        for (Resource& resource : m_resources)
+        {
+            if (resource.firstPass == ~0u)
+            {
+                resource.firstPass = 0;
+                resource.lastPass  = static_cast<uint32_t>(m_passes.size());
+            }
+        }
+    }
+
+    void RenderGraph::allocateTransients(std::vector<TransientKey> const& keys)
+    {
+        m_transients.resize(keys.size());
+
+        std::vector<vk::MemoryRequirements> requirements(keys.size());
+
+        for (Resource const& resource : m_resources)
+        {
+            if (resource.isImported)
+            {
+                continue;
+            }
+
+            TransientKey const& key = keys[resource.transient];
+            Transient& transient    = m_transients[resource.transient];
+
+            transient.image = (*m_device)->createImage({
+                                  .imageType     = vk::ImageType::e2D,
+                                  .format        = key.desc.format,
+                                  .extent        = { key.desc.extent.width, key.desc.extent.height, 1 },
+                                  .mipLevels     = 1,
+                                  .arrayLayers   = 1,
+                                  .samples       = key.desc.samples,
+                                  .tiling        = vk::ImageTiling::eOptimal,
+                                  .usage         = key.usage,
+                                  .sharingMode   = vk::SharingMode::eExclusive,
+                                  .initialLayout = vk::ImageLayout::eUndefined,
+                              }) >>
+                              ResultChecker();
+
+            requirements[resource.transient] = transient.image.getMemoryRequirements();
+        }
+
+        // Biggest images first, each goes into the first block whose images all live in other passes
+        std::vector<uint32_t> order(keys.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::ranges::sort(order, std::ranges::greater {}, [&](uint32_t i) { return requirements[i].size; });
+
+        std::vector<vk::MemoryRequirements> blockRequirements;
+        std::vector<std::vector<uint32_t>> blockImages;
+
+        m_unaliasedMemory = 0;
+
+        for (uint32_t i : order)
+        {
+            vk::MemoryRequirements const& imageRequirements = requirements[i];
+
+            auto const fits = [&](uint32_t block)
+            {
+                return (blockRequirements[block].memoryTypeBits & imageRequirements.memoryTypeBits) != 0 &&
+                       std::ranges::none_of(blockImages[block],
+                                            [&](uint32_t other)
+                                            {
+                                                return overlap(keys[i].firstPass,
+                                                               keys[i].lastPass,
+                                                               keys[other].firstPass,
+                                                               keys[other].lastPass);
+                                            });
+            };
+
+            auto block = static_cast<uint32_t>(blockImages.size());
+
+            for (uint32_t candidate = 0; candidate < blockImages.size(); ++candidate)
+            {
+                if (fits(candidate))
+                {
+                    block = candidate;
+
+                    break;
+                }
+            }
+
+            if (block == blockImages.size())
+            {
+                blockRequirements.push_back(imageRequirements);
+                blockImages.emplace_back();
+            }
+
+            vk::MemoryRequirements& shared = blockRequirements[block];
+
+            shared.size            = std::max(shared.size, imageRequirements.size);
+            shared.alignment       = std::max(shared.alignment, imageRequirements.alignment);
+            shared.memoryTypeBits &= imageRequirements.memoryTypeBits;
+
+            blockImages[block].push_back(i);
+            m_transients[i].block  = block;
+            m_unaliasedMemory     += imageRequirements.size;
+        }
+
+        m_blocks.resize(blockRequirements.size());
+        m_transientMemory = 0;
+
+        VmaAllocationCreateInfo const allocInfo {
+            .flags         = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+            .usage         = VMA_MEMORY_USAGE_GPU_ONLY,
+            .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        };
+
+        for (uint32_t block = 0; block < m_blocks.size(); ++block)
+        {
+            vmaAllocateMemory(*m_allocator,
+                              &static_cast<VkMemoryRequirements const&>(blockRequirements[block]),
+                              &allocInfo,
+                              &m_blocks[block].allocation,
+                              nullptr) >>
+                ResultChecker();
+
+            std::string const name = std::format("render graph block {}", block);
+            vmaSetAllocationName(*m_allocator, m_blocks[block].allocation, name.c_str());
+
+            for (uint32_t i : blockImages[block])
+            {
+                vmaBindImageMemory(*m_allocator,
+                                   m_blocks[block].allocation,
+                                   static_cast<VkImage>(*m_transients[i].image)) >>
+                    ResultChecker();
+            }
+
+            m_transientMemory += blockRequirements[block].size;
+        }
+
+        for (Resource const& resource : m_resources)
+        {
+            if (resource.isImported)
+            {
+                continue;
+            }
+
+            Transient& transient = m_transients[resource.transient];
+
+            transient.view = (*m_device)->createImageView({
+                                 .image            = *transient.image,
+                                 .viewType         = vk::ImageViewType::e2D,
+                                 .format           = resource.desc.format,
+                                 .subresourceRange = {
+                                     .aspectMask = resource.aspect,
+                                     .levelCount = 1,
+                                     .layerCount = 1,
+                                 },
+                             }) >>
+                             ResultChecker();
+        }
+    }
+
+    void RenderGraph::releaseTransients()
+    {
+        // The images go before the memory they are bound to
+        m_transients.clear();
+
+        for (MemoryBlock const& block : m_blocks)
+        {
+            vmaFreeMemory(*m_allocator, block.allocation);
+        }
+
+        m_blocks.clear();
+        m_transientKeys.clear();
+
+        m_transientMemory = 0;
+        m_unaliasedMemory = 0;
+    }
+
+    auto RenderGraph::getState(Resource& resource) -> ResourceState&
+    {
+        if (resource.isImported)
+        {
+            return resource.state;
+        }
+
+        return m_blocks[m_transients[resource.transient].block].state;
+    }
+
+    void RenderGraph::execute(vk::CommandBuffer cmdBuf)
+    {
+        ZoneScopedN("Render graph execute");
+
+        std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+        std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+
+        // A pass's accesses of the same resource, merged
+        std::vector<std::pair<RenderGraphResource, UsageInfo>> usages;
+
+        std::vector<bool> started(m_resources.size());
+
+        uint32_t numBarriers = 0;
+
+        for (Pass const& pass : m_passes)
+        {
+            if (pass.culled)
+            {
+                continue;
+            }
+
+            usages.clear();
+
+            for (ResourceAccess const& access : pass.accesses)
+            {
+                UsageInfo const& info = getUsageInfo(access.usage);
+
+                auto it = std::ranges::find(usages, access.resource, &decltype(usages)::value_type::first);
+
+                if (it == usages.end())
+                {
+                    usages.emplace_back(access.resource, info);
+
+                    continue;
+                }
+
+                MC_ASSERT_MSG(m_resources[access.resource].isBuffer || it->second.layout == info.layout,
+                              "Pass {} uses {} in two layouts",
+                              pass.name,
+                              m_resources[access.resource].name);
+
+                it->second.stages      |= info.stages;
+                it->second.readAccess  |= info.readAccess;
+                it->second.writeAccess |= info.writeAccess;
+            }
+
+            imageBarriers.clear();
+            bufferBarriers.clear();
+
+            for (auto const& [index, usage] : usages)
+            {
+                Resource& resource   = m_resources[index];
+                ResourceState& state = getState(resource);
+
+                // Whatever the block held before belongs to another image or an earlier frame
+                if (!resource.isImported && !started[index])
+                {
+                    state.layout = vk::ImageLayout::eUndefined;
+                }
+
+                started[index] = true;
+
+                vk::AccessFlags2 const access = usage.readAccess | usage.writeAccess;
+
+                bool const writes       = static_cast<bool>(usage.writeAccess);
+                bool const written      = static_cast<bool>(state.writeStages);
+                bool const layoutChange = !resource.isBuffer && state.layout != usage.layout;
+                bool const visible =
+                    !(usage.stages & ~state.visibleStages) && !(access & ~state.visibleAccess);
+
+                // Reads after reads need nothing, writes wait for every earlier access
+                bool const needsBarrier =
+                    layoutChange || (written && (writes || !visible)) || (writes && state.readStages);
+
+                if (needsBarrier && resource.isBuffer && resource.buffer)
+                {
+                    bufferBarriers.push_back({
+                        .srcStageMask  = state.writeStages | state.readStages,
+                        .srcAccessMask = state.writeAccess,
+                        .dstStageMask  = usage.stages,
+                        .dstAccessMask = access,
+                        .buffer        = resource.buffer,
+                        .size          = vk::WholeSize,
+                    });
+                }
+                else if (needsBarrier && !resource.isBuffer)
+                {
+                    imageBarriers.push_back({
+                        .srcStageMask     = state.writeStages | state.readStages,
+                        .srcAccessMask    = state.writeAccess,
+                        .dstStageMask     = usage.stages,
+                        .dstAccessMask    = access,
+                        .oldLayout        = state.layout,
+                        .newLayout        = usage.layout,
+                        .image            = resource.image,
+                        .subresourceRange = {
+                            .aspectMask = resource.aspect,
+                            .levelCount = vk::RemainingMipLevels,
+                            .layerCount = vk::RemainingArrayLayers,
+                        },
+                    });
+                }
+
+                if (writes)
+                {
+                    state.writeStages   = usage.stages;
+                    state.writeAccess   = usage.writeAccess;
+                    state.visibleStages = {};
+                    state.visibleAccess = {};
+                    state.readStages    = {};
+                }
+                else if (layoutChange)
+                {
+                    // The transition is a write of its own, ordered before the stages that waited for it
+                    state.writeStages   = usage.stages;
+                    state.writeAccess   = {};
+                    state.visibleStages = usage.stages;
+                    state.visibleAccess = access;
+                    state.readStages    = {};
+                }
+                else
+                {
+                    if (needsBarrier)
+                    {
+                        state.visibleStages |= usage.stages;
+                        state.visibleAccess |= access;
+                    }
+
+                    state.readStages |= usage.stages;
+                }
+
+                if (!resource.isBuffer)
+                {
+                    state.layout = usage.layout;
+                }
+            }
+
+            if (!imageBarriers.empty() || !bufferBarriers.empty())
+            {
+                cmdBuf.pipelineBarrier2(vk::DependencyInfo()
+                                            .setImageMemoryBarriers(imageBarriers)
+                                            .setBufferMemoryBarriers(bufferBarriers));
+
+                ++numBarriers;
+            }
+
+            pass.record(cmdBuf);
+        }
+
+        imageBarriers.clear();
+
+        // Whatever comes after the graph, e.g. presentation, is synchronized by a semaphore
+        for (Resource& resource : m_resources)
+        {
+            if (!resource.isImported || resource.finalLayout == vk::ImageLayout::eUndefined ||
+                resource.state.layout == resource.finalLayout)
+            {
+                continue;
+            }
+
+            imageBarriers.push_back({
+                .srcStageMask     = resource.state.writeStages | resource.state.readStages,
+                .srcAccessMask    = resource.state.writeAccess,
+                .dstStageMask     = vk::PipelineStageFlagBits2::eNone,
+                .dstAccessMask    = vk::AccessFlagBits2::eNone,
+                .oldLayout        = resource.state.layout,
+                .newLayout        = resource.finalLayout,
+                .image            = resource.image,
+                .subresourceRange = {
+                    .aspectMask = resource.aspect,
+                    .levelCount = vk::RemainingMipLevels,
+                    .layerCount = vk::RemainingArrayLayers,
+                },
+            });
+
+            resource.state.layout = resource.finalLayout;
+        }
+
+        if (!imageBarriers.empty())
+        {
+            cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(imageBarriers));
+
+            ++numBarriers;
+        }
+
+        m_numBarriers = numBarriers;
+    }
+
+    auto RenderGraph::getImage(RenderGraphResource resource) const -> vk::Image
+    {
+        MC_ASSERT_MSG(
+            m_resources[resource].image, "{} isn't an image or wasn't compiled", m_resources[resource].name);
+
+        return m_resources[resource].image;
+    }
+
+    auto RenderGraph::getImageView(RenderGraphResource resource) const -> vk::ImageView
+    {
+        MC_ASSERT_MSG(
+            m_resources[resource].view, "{} isn't an image or wasn't compiled", m_resources[resource].name);
+
+        return m_resources[resource].view;
+    }
+}  // namespace renderer::backend
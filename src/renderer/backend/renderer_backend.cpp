@@ -18,6 +18,8 @@
 
 #include <chrono>
 #include <filesystem>
+#include <format>
+#include <string>
 
 #include <glm/ext.hpp>
 #include <glslang/Public/ShaderLang.h>
@@ -34,6 +36,16 @@ namespace
 {
     using namespace renderer::backend;
 
+    // Threads enkiTS hands out thread numbers to: its workers, the thread that initialized it and the file
+    // reader's and the GPU waiter's external threads. Each of them records into command pools of its own
+    constexpr uint32_t kNumSchedulerThreads =
+        kNumThreads + 1 + io::FileReader::kNumFallbackThreads + TaskExecutor::kNumExternalThreads;
+
+    // Indexed by `DrawBucket`, these name the pipeline caches
+    constexpr std::array<std::string_view, kNumDrawBuckets> kDrawBucketNames {
+        "opaque", "opaque_double_sided", "mask", "mask_double_sided", "blend", "blend_double_sided",
+    };
+
     [[maybe_unused]] void imguiCheckerFn(vk::Result result,
                                          std::source_location location = std::source_location::current())
     {
@@ -52,40 +64,64 @@ namespace renderer::backend
 
           m_allocator { m_instance, m_device },
 
-          m_commandManager { m_device, kNumThreads },
+          m_commandManager { m_device, kNumSchedulerThreads },
+
+          m_bindlessRegistry { m_device },
+
+          m_uniformPool { m_device,
+                          m_allocator,
+                          "Pooled uniform buffers",
+                          kUniformPoolBlockSize,
+                          m_device.getDeviceProperties().limits.minUniformBufferOffsetAlignment,
+                          vk::BufferUsageFlagBits::eUniformBuffer,
+                          // Lands in host visible VRAM when the device has it, written to directly either way
+                          VMA_MEMORY_USAGE_AUTO,
+                          VMA_ALLOCATION_CREATE_MAPPED_BIT |
+                              VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
 
           m_buffers { m_device, m_allocator },
 
+          m_uploads { m_device, m_buffers },
+
           m_images { m_device, m_allocator },
 
-          m_textures { m_device, m_commandManager, m_images, m_buffers }
+          m_textures { m_uploads, m_images },
+
+          m_frameData { m_device, m_buffers, kFrameDataRegionSize },
+
+          m_readbacks { m_buffers, kReadbackRegionSize },
+
+          m_depthPyramid { m_device, m_images },
+
+          m_visibilityBuffer { m_device },
+
+          m_renderGraph { m_device, m_allocator },
+
+          m_drawCuller { m_device, m_buffers, m_frameData },
+
+          m_occlusionRasterizer { m_scheduler },
+
+          m_cpuDrawCuller { m_scheduler, m_frameData },
+
+          m_defragmenter { m_device, m_allocator, m_uploads, m_buffers, m_images },
+
+          m_memoryTelemetry { m_allocator, m_buffers, m_images, "logs/memory_telemetry.jsonl" },
+
+          m_scene {
+              m_device, m_commandManager, m_images, m_buffers, m_uniformPool, m_uploads, m_bindlessRegistry
+          }
     {
-        m_drawImage = m_images.create("draw image",
-                                      m_surface.getFramebufferExtent(),
-                                      vk::Format::eR16G16B16A16Sfloat,
-                                      m_device.getMaxUsableSampleCount(),
-                                      vk::ImageUsageFlagBits::eTransferSrc |
-                                          vk::ImageUsageFlagBits::eTransferDst |  // maybe remove?
-                                          vk::ImageUsageFlagBits::eColorAttachment,
-                                      vk::ImageAspectFlagBits::eColor);
-
-        m_drawImageResolve =
-            m_images.create("draw image resolve",
-                            m_drawImage.getDimensions(),
-                            m_drawImage.getFormat(),
-                            vk::SampleCountFlagBits::e1,
-                            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc |
-                                vk::ImageUsageFlagBits::eTransferDst,
-                            vk::ImageAspectFlagBits::eColor);
-
-        m_depthImage = m_images.create("depth image",
-                                       m_drawImage.getDimensions(),
-                                       kDepthStencilFormat,
-                                       m_device.getMaxUsableSampleCount(),
-                                       vk::ImageUsageFlagBits::eDepthStencilAttachment,
-                                       vk::ImageAspectFlagBits::eDepth);
-
-        m_scheduler.Initialize({ .numTaskThreadsToCreate = kNumThreads });
+        m_images.setBudget(ImageCategory::texture, kTextureMemoryBudget);
+        m_images.setBudget(ImageCategory::renderTarget, kRenderTargetMemoryBudget);
+
+        // The file reader's threads and the executor's GPU waiter resume coroutines on the scheduler
+        m_scheduler.Initialize({ .numTaskThreadsToCreate = kNumThreads,
+                                 .numExternalTaskThreads =
+                                     io::FileReader::kNumFallbackThreads + TaskExecutor::kNumExternalThreads });
+
+        MC_ASSERT(m_scheduler.GetNumTaskThreads() <= kNumSchedulerThreads);
+
+        m_drawRecordTask.backend = this;
 
         glslang::InitializeProcess();
 
@@ -125,21 +161,38 @@ namespace renderer::backend
 
             m_dummyTexture = m_textures.create(
                 "dummy texture", vk::Extent2D { 32, 32 }, pixels.data(), sizeof(float) * pixels.size());
-        }
 
-        m_gpuSceneDataBuffer = m_buffers.create("GPU Scene Data",
-                                                sizeof(GPUSceneData),
-                                                vk::BufferUsageFlagBits::eUniformBuffer,
-                                                VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                                                VMA_ALLOCATION_CREATE_MAPPED_BIT |
-                                                    VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+            m_bindlessRegistry.setPlaceholder(m_dummyTexture.getImage().getImageView(), m_dummySampler);
+        }
 
         ShaderManager shaders(m_device);
         shaders.addShader("fs.frag").addShader("vs.vert");
 
+        ShaderManager maskedShaders(m_device);
+        maskedShaders.addShader("fs.frag").addShader("vs.vert").addDefine("ALPHA_TEST");
+
+        ShaderManager prePassShaders(m_device);
+        prePassShaders.addShader("depth_prepass.vert");
+
+        ShaderManager visibilityShaders(m_device);
+        visibilityShaders.addShader("visibility.frag").addShader("visibility.vert");
+
+        ShaderManager maskedVisibilityShaders(m_device);
+        maskedVisibilityShaders.addShader("visibility.frag")
+            .addShader("visibility.vert")
+            .addDefine("ALPHA_TEST");
+
+        ShaderManager resolveShaders(m_device);
+        resolveShaders.addShader("visibility_resolve.frag").addShader("fullscreen.vert");
+
         auto timerStart = std::chrono::high_resolution_clock::now();
 
         shaders.build();
+        maskedShaders.build();
+        prePassShaders.build();
+        visibilityShaders.build();
+        maskedVisibilityShaders.build();
+        resolveShaders.build();
 
         auto timeTaken = std::chrono::duration<double, std::ratio<1, 1>>(
                              std::chrono::high_resolution_clock::now() - timerStart)
@@ -151,27 +204,116 @@ namespace renderer::backend
 
         auto pipelineLayoutConfig =
             PipelineLayoutConfig()
-                .setDescriptorSetLayouts({ m_sceneDataDescriptorLayout, m_textureArrayDescriptorLayout })
+                .setDescriptorSetLayouts({ m_sceneDataDescriptorLayout, m_bindlessRegistry.getLayout() })
                 .setPushConstantSettings(sizeof(GPUDrawPushConstants),
                                          vk::ShaderStageFlagBits::eVertex |
                                              vk::ShaderStageFlagBits::eFragment);
 
         m_pipelineLayout = PipelineLayout(m_device, pipelineLayoutConfig);
 
+        for (uint32_t i = 0; i < kNumDrawBuckets; ++i)
         {
+            auto const bucket = static_cast<DrawBucket>(i);
+
+            // glTF front faces wind counter-clockwise, the flipped projection keeps them that way on screen
+            vk::CullModeFlags const cullMode =
+                isDoubleSided(bucket) ? vk::CullModeFlagBits::eNone : vk::CullModeFlagBits::eBack;
+
+            // Blended surfaces are tested against the depth but don't hide what's drawn after them
             auto pipelineConfig =
                 GraphicsPipelineConfig()
-                    .setShaderManager(shaders)
-                    .setColorAttachmentFormat(m_drawImage.getFormat())
+                    .setShaderManager(isMasked(bucket) ? maskedShaders : shaders)
+                    .setColorAttachmentFormat(kDrawImageFormat)
                     .setDepthAttachmentFormat(kDepthStencilFormat)
-                    .setDepthStencilSettings(true, vk::CompareOp::eGreaterOrEqual)
-                    // .setCullingSettings(vk::CullModeFlagBits::eBack, vk::FrontFace::eCounterClockwise)
+                    .setDepthStencilSettings(
+                        true, vk::CompareOp::eGreaterOrEqual, false, false, !isBlended(bucket))
+                    .setCullingSettings(cullMode, vk::FrontFace::eCounterClockwise)
                     .setSampleCount(m_device.getMaxUsableSampleCount())
-                    .setSampleShadingSettings(true, 0.1f);
+                    .setSampleShadingSettings(true, 0.1f)
+                    .enableBlending(isBlended(bucket));
+
+            if (isBlended(bucket))
+            {
+                pipelineConfig.blendingSetAlphaBlend();
+            }
+
+            std::string const name = std::format("main_pipeline_{}", kDrawBucketNames[i]);
+
+            m_bucketPipelines[i] = GraphicsPipeline(m_device, name, m_pipelineLayout, pipelineConfig);
+
+            if (isBlended(bucket))
+            {
+                continue;
+            }
 
-            m_pipeline = GraphicsPipeline(m_device, "main_pipeline", m_pipelineLayout, pipelineConfig);
+            // Flat IDs are the same for every sample of a pixel, shading them per sample would be wasted
+            auto visibilityConfig =
+                GraphicsPipelineConfig()
+                    .setShaderManager(isMasked(bucket) ? maskedVisibilityShaders : visibilityShaders)
+                    .setColorAttachmentFormat(VisibilityBuffer::kFormat)
+                    .setDepthAttachmentFormat(kDepthStencilFormat)
+                    .setDepthStencilSettings(true, vk::CompareOp::eGreaterOrEqual)
+                    .setCullingSettings(cullMode, vk::FrontFace::eCounterClockwise)
+                    .setSampleCount(m_device.getMaxUsableSampleCount());
+
+            std::string const visibilityName = std::format("visibility_{}", kDrawBucketNames[i]);
+
+            m_visibilityPipelines[i] =
+                GraphicsPipeline(m_device, visibilityName, m_pipelineLayout, visibilityConfig);
+
+            // Masked and blended surfaces need their textures for coverage, only opaque ones get a pre-pass
+            if (!isOpaque(bucket))
+            {
+                continue;
+            }
+
+            // After the depth pre-pass only the visible surface is shaded, it wrote the depth already
+            pipelineConfig.setDepthStencilSettings(true, vk::CompareOp::eEqual, false, false, false);
+
+            m_equalDepthPipelines[i] =
+                GraphicsPipeline(m_device, name + "_equal_depth", m_pipelineLayout, pipelineConfig);
+
+            // No fragment shader and no color writes, the color format only has to match the rendering info
+            auto prePassConfig = GraphicsPipelineConfig()
+                                     .setShaderManager(prePassShaders)
+                                     .setColorAttachmentFormat(kDrawImageFormat)
+                                     .setDepthAttachmentFormat(kDepthStencilFormat)
+                                     .setDepthStencilSettings(true, vk::CompareOp::eGreaterOrEqual)
+                                     .setCullingSettings(cullMode, vk::FrontFace::eCounterClockwise)
+                                     .setBlendingWriteMask({})
+                                     .setSampleCount(m_device.getMaxUsableSampleCount());
+
+            std::string const prePassName = std::format("depth_prepass_{}", kDrawBucketNames[i]);
+
+            m_depthPrePassPipelines[i] =
+                GraphicsPipeline(m_device, prePassName, m_pipelineLayout, prePassConfig);
         }
 
+        m_visibilityResolveLayout = PipelineLayout(
+            m_device,
+            PipelineLayoutConfig()
+                .setDescriptorSetLayouts({
+                    m_sceneDataDescriptorLayout,
+                    m_bindlessRegistry.getLayout(),
+                    m_visibilityBuffer.getDescriptorLayout(),
+                })
+                .setPushConstantSettings(sizeof(GPUDrawPushConstants),
+                                         vk::ShaderStageFlagBits::eVertex |
+                                             vk::ShaderStageFlagBits::eFragment));
+
+        // Runs once per pixel over the multisampled draw image, the shader averages the samples itself and
+        // masks off the uncovered ones
+        auto resolveConfig =
+            GraphicsPipelineConfig()
+                .setShaderManager(resolveShaders)
+                .setColorAttachmentFormat(kDrawImageFormat)
+                .setDepthAttachmentFormat(vk::Format::eUndefined)
+                .setCullingSettings(vk::CullModeFlagBits::eNone, vk::FrontFace::eCounterClockwise)
+                .setSampleCount(m_device.getMaxUsableSampleCount());
+
+        m_visibilityResolvePipeline =
+            GraphicsPipeline(m_device, "visibility_resolve", m_visibilityResolveLayout, resolveConfig);
+
         loadGltfScene();
 
 #if PROFILED
@@ -223,14 +365,6 @@ namespace renderer::backend
 
     void RendererBackend::loadGltfScene()
     {
-        m_scene = Model(m_device,
-                        m_commandManager,
-                        m_images,
-                        m_buffers,
-                        m_textureArrayDescriptorLayout,
-                        m_dummyTexture.getImage().getImageView(),
-                        m_dummySampler);
-
         auto glTFFile =
             std::filesystem::path(std::format("../../gltfSampleAssets/Models/{0}/glTF/{0}.gltf", "Sponza"));
 
@@ -239,7 +373,7 @@ namespace renderer::backend
 
         auto timerStart = std::chrono::high_resolution_clock::now();
 
-        m_scene.loadFromFile(glTFFile);
+        syncWait(m_scene.loadFromFile(m_taskExecutor, glTFFile));
 
         auto timeTaken = std::chrono::duration<double, std::ratio<1, 1>>(
                              std::chrono::high_resolution_clock::now() - timerStart)
@@ -247,6 +381,15 @@ namespace renderer::backend
 
         logger::debug("{} took {:.2f}s to load", glTFFile.string(), timeTaken);
 
+        m_drawCuller.reserve(static_cast<uint32_t>(m_scene.drawIndirectCommands.size()));
+        m_cpuDrawCuller.setScene(m_scene.drawIndirectCommands, m_scene.primitiveData);
+        m_drawSorter.setScene(m_scene.drawIndirectCommands, m_scene.primitiveData, m_scene.drawBuckets);
+        m_occlusionRasterizer.setOccluders(m_scene.occluders);
+
+        logger::debug("Picked {} occluders with {} triangles",
+                      m_scene.occluders.size(),
+                      m_occlusionRasterizer.getNumTriangles());
+
         // Check and list unsupported extensions
         std::stringstream unsupportedExts;
 
@@ -275,16 +418,16 @@ namespace renderer::backend
     void RendererBackend::initDescriptors()
     {
         std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
-            { vk::DescriptorType::eUniformBuffer, 1 },
+            { vk::DescriptorType::eUniformBufferDynamic, 1 },
         };
 
         m_descriptorAllocator = DescriptorAllocator(m_device, 1, sizes);
 
         m_sceneDataDescriptorLayout =
             DescriptorLayoutBuilder()
-                // The scene data buffer
+                // The scene data, lives in the per-frame allocator and is bound with a dynamic offset
                 .setBinding(0,
-                            vk::DescriptorType::eUniformBuffer,
+                            vk::DescriptorType::eUniformBufferDynamic,
                             vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
                 .build(m_device);
 
@@ -293,16 +436,8 @@ namespace renderer::backend
         DescriptorWriter writer;
 
         writer.writeBuffer(
-            0, m_gpuSceneDataBuffer, sizeof(GPUSceneData), 0, vk::DescriptorType::eUniformBuffer);
+            0, m_frameData.getBuffer(), sizeof(GPUSceneData), 0, vk::DescriptorType::eUniformBufferDynamic);
         writer.updateSet(m_device, m_sceneDataDescriptors);
-
-        m_textureArrayDescriptorLayout =
-            DescriptorLayoutBuilder()
-                .setBinding(0,
-                            vk::DescriptorType::eCombinedImageSampler,
-                            vk::ShaderStageFlagBits::eFragment,
-                            kMaxBindlessResources)
-                .build(m_device, vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool);
     }
 
     void RendererBackend::initImgui(GLFWwindow* window)
@@ -356,7 +491,7 @@ namespace renderer::backend
             .UseDynamicRendering         = true,
             .PipelineRenderingCreateInfo = vk::PipelineRenderingCreateInfo()
                                                .setColorAttachmentFormats(m_surface.getDetails().format)
-                                               .setDepthAttachmentFormat(m_depthImage.getFormat()),
+                                               .setDepthAttachmentFormat(kDepthStencilFormat),
             .CheckVkResultFn = kDebug ? reinterpret_cast<void (*)(VkResult)>(&imguiCheckerFn) : nullptr,
         };
 
@@ -398,7 +533,37 @@ namespace renderer::backend
         //                  glm::translate(glm::identity<glm::mat4>(), m_light.position);
         // }
 
-        updateDescriptors(cameraPos, glm::identity<glm::mat4>(), view, projection);
+        // Written into the frame's own region once its fence signalled, see `render`
+        m_sceneView = {
+            .cameraPos  = cameraPos,
+            .view       = view,
+            .projection = projection,
+        };
+    }
+
+    void RendererBackend::pickPrimitive(glm::vec2 cursor)
+    {
+        glm::vec2 const ndc = cursor / glm::vec2(getFramebufferSize()) * 2.f - 1.f;
+
+        // Any depth in front of the camera does, the ray starts at the camera anyway
+        glm::vec4 const target =
+            glm::inverse(m_sceneView.projection * m_sceneView.view) * glm::vec4(ndc, 0.5f, 1.f);
+
+        glm::vec3 const origin    = m_sceneView.cameraPos;
+        glm::vec3 const direction = glm::normalize(glm::vec3(target) / target.w - origin);
+
+        std::optional<SceneBvh::RayHit> const hit = m_scene.bvh.raycast(origin, direction);
+
+        if (!hit)
+        {
+            m_pickedPrimitive.reset();
+
+            return;
+        }
+
+        m_pickedPrimitive = hit->item;
+
+        logger::debug("Picked primitive {} at a distance of {:.2f}", hit->item, hit->distance);
     }
 
     void RendererBackend::createSyncObjects()
@@ -420,13 +585,10 @@ namespace renderer::backend
 
     void RendererBackend::handleSurfaceResize()
     {
+        // The render targets follow the new extent once the render graph sees it
         m_device->waitIdle();
 
         m_swapchain = Swapchain(m_device, m_surface);
-
-        m_drawImage.resize(m_surface.getFramebufferExtent());
-        m_drawImageResolve.resize(m_surface.getFramebufferExtent());
-        m_depthImage.resize(m_surface.getFramebufferExtent());
     }
 
     void RendererBackend::updateDescriptors(glm::vec3 cameraPos,
@@ -434,18 +596,18 @@ namespace renderer::backend
                                             glm::mat4 view,
                                             glm::mat4 projection)
     {
-        auto& sceneUniformData = *static_cast<GPUSceneData*>(m_gpuSceneDataBuffer.getMappedData());
-
-        sceneUniformData = GPUSceneData {
+        FrameAllocation const sceneData = m_frameData.push(GPUSceneData {
             .view              = view,
             .proj              = projection,
             .viewproj          = projection * view,
             .ambientColor      = glm::vec4(.1f),
             .cameraPos         = cameraPos,
-            .screenWeight      = static_cast<float>(m_drawImage.getDimensions().width),
+            .screenWeight      = static_cast<float>(m_swapchain.getImageExtent().width),
             .sunlightDirection = glm::vec3 { -0.2f, -1.0f, -0.3f },
-            .screenHeight      = static_cast<float>(m_drawImage.getDimensions().height),
-        };
+            .screenHeight      = static_cast<float>(m_swapchain.getImageExtent().height),
+        });
+
+        m_sceneDataOffset = static_cast<uint32_t>(sceneData.offset);
     }
 
     void RendererBackend::queueTextureUpdate(ResourceHandle const& texture)
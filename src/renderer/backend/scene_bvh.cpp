@@ -0,0 +1,503 @@
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/scene_bvh.hpp>
+
+#include <algorithm>
+#include <utility>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+#include <tracy/Tracy.hpp>
+
+namespace renderer::backend
+{
+    namespace
+    {
+        constexpr uint32_t kNumBins = 12;
+
+        // Nodes with this few items are never split
+        constexpr uint32_t kMinSplitItems = 3;
+
+        enum class Overlap
+        {
+            outside,
+            partial,
+            inside,
+        };
+
+        auto surfaceArea(glm::vec3 min, glm::vec3 max) -> float
+        {
+            glm::vec3 const extent = glm::max(max - min, glm::vec3(0.f));
+
+            return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+        }
+
+        auto overlaps(BoundingBox const& box, glm::vec3 min, glm::vec3 max) -> bool
+        {
+            return glm::all(glm::lessThanEqual(box.min, max)) && glm::all(glm::lessThanEqual(min, box.max));
+        }
+
+        auto overlapFrustum(std::array<glm::vec4, 6> const& planes, glm::vec3 min, glm::vec3 max) -> Overlap
+        {
+            Overlap result = Overlap::inside;
+
+            for (glm::vec4 const& plane : planes)
+            {
+                glm::vec3 const normal = glm::vec3(plane);
+
+                // The corners furthest along and against the normal
+                glm::vec3 const positive = glm::mix(min, max, glm::greaterThan(normal, glm::vec3(0.f)));
+                glm::vec3 const negative = glm::mix(max, min, glm::greaterThan(normal, glm::vec3(0.f)));
+
+                if (glm::dot(normal, positive) + plane.w < 0.f)
+                {
+                    return Overlap::outside;
+                }
+
+                if (glm::dot(normal, negative) + plane.w < 0.f)
+                {
+                    result = Overlap::partial;
+                }
+            }
+
+            return result;
+        }
+
+        auto overlapSphere(glm::vec3 center, float radius, glm::vec3 min, glm::vec3 max) -> Overlap
+        {
+            glm::vec3 const closest = glm::clamp(center, min, max);
+
+            if (glm::dot(closest - center, closest - center) > radius * radius)
+            {
+                return Overlap::outside;
+            }
+
+            // Inside if the farthest corner is
+            glm::vec3 const farthest = glm::max(glm::abs(min - center), glm::abs(max - center));
+
+            return glm::dot(farthest, farthest) <= radius * radius ? Overlap::inside : Overlap::partial;
+        }
+
+        // Entry distance of the ray into the box, negative if it misses or enters past `maxDistance`
+        auto intersectRay(glm::vec3 origin,
+                          glm::vec3 inverseDirection,
+                          float maxDistance,
+                          glm::vec3 min,
+                          glm::vec3 max) -> float
+        {
+            glm::vec3 const t0 = (min - origin) * inverseDirection;
+            glm::vec3 const t1 = (max - origin) * inverseDirection;
+
+            glm::vec3 const tNear = glm::min(t0, t1);
+            glm::vec3 const tFar  = glm::max(t0, t1);
+
+            float const enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+            float const exit  = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+
+            return enter <= exit ? enter : -1.f;
+        }
+
+        auto contains(glm::vec3 min, glm::vec3 max, glm::vec3 point) -> bool
+        {
+            return glm::all(glm::lessThanEqual(min, point)) && glm::all(glm::lessThanEqual(point, max));
+        }
+    }  // namespace
+
+    void SceneBvh::build(std::span<BoundingBox const> bounds)
+    {
+        ZoneScopedN("BVH build");
+
+        m_bounds.assign(bounds.begin(), bounds.end());
+        m_items.clear();
+        m_unboundedItems.clear();
+        m_nodes.clear();
+
+        for (uint32_t item = 0; item < m_bounds.size(); ++item)
+        {
+            (m_bounds[item].valid ? m_items : m_unboundedItems).push_back(item);
+        }
+
+        if (m_items.empty())
+        {
+            return;
+        }
+
+        // A binary tree has fewer than twice as many nodes as it has leaves
+        m_nodes.reserve(m_items.size() * 2);
+        m_nodes.push_back({ .first = 0, .count = static_cast<uint32_t>(m_items.size()) });
+
+        updateNodeBounds(m_nodes.front());
+
+        std::vector<uint32_t> stack { 0 };
+
+        while (!stack.empty())
+        {
+            uint32_t const nodeIndex = stack.back();
+            stack.pop_back();
+
+            subdivide(nodeIndex);
+
+            if (m_nodes[nodeIndex].count == 0)
+            {
+                stack.push_back(m_nodes[nodeIndex].first);
+                stack.push_back(m_nodes[nodeIndex].first + 1);
+            }
+        }
+    }
+
+    void SceneBvh::setBounds(uint32_t item, BoundingBox const& bounds)
+    {
+        MC_ASSERT(item < m_bounds.size());
+
+        // Keeps the item in the tree or out of it
+        bool const valid = m_bounds[item].valid;
+
+        m_bounds[item]       = bounds;
+        m_bounds[item].valid = valid;
+    }
+
+    void SceneBvh::refit()
+    {
+        ZoneScopedN("BVH refit");
+
+        // Children come after their parents, walking backwards visits them first
+        for (size_t i = m_nodes.size(); i-- > 0;)
+        {
+            Node& node = m_nodes[i];
+
+            if (node.count > 0)
+            {
+                updateNodeBounds(node);
+
+                continue;
+            }
+
+            Node const& left  = m_nodes[node.first];
+            Node const& right = m_nodes[node.first + 1];
+
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+
+    void SceneBvh::updateNodeBounds(Node& node) const
+    {
+        node.min = glm::vec3(std::numeric_limits<float>::max());
+        node.max = glm::vec3(std::numeric_limits<float>::lowest());
+
+        for (uint32_t i = node.first; i < node.first + node.count; ++i)
+        {
+            BoundingBox const& bounds = m_bounds[m_items[i]];
+
+            node.min = glm::min(node.min, bounds.min);
+            node.max = glm::max(node.max, bounds.max);
+        }
+    }
+
+    void SceneBvh::subdivide(uint32_t nodeIndex)
+    {
+        Node node = m_nodes[nodeIndex];
+
+        if (node.count < kMinSplitItems)
+        {
+            return;
+        }
+
+        // Items are binned by their centers, the bins span the centers' bounds
+        glm::vec3 centerMin { std::numeric_limits<float>::max() };
+        glm::vec3 centerMax { std::numeric_limits<float>::lowest() };
+
+        for (uint32_t i = node.first; i < node.first + node.count; ++i)
+        {
+            BoundingBox const& bounds = m_bounds[m_items[i]];
+            glm::vec3 const center    = (bounds.min + bounds.max) * 0.5f;
+
+            centerMin = glm::min(centerMin, center);
+            centerMax = glm::max(centerMax, center);
+        }
+
+        struct Bin
+        {
+            glm::vec3 min { std::numeric_limits<float>::max() };
+            glm::vec3 max { std::numeric_limits<float>::lowest() };
+            uint32_t count { 0 };
+        };
+
+        auto const binOf = [&](uint32_t item, int axis) -> uint32_t
+        {
+            BoundingBox const& bounds = m_bounds[item];
+            float const center        = (bounds.min[axis] + bounds.max[axis]) * 0.5f;
+            float const scale         = kNumBins / (centerMax[axis] - centerMin[axis]);
+
+            return std::min(static_cast<uint32_t>((center - centerMin[axis]) * scale), kNumBins - 1);
+        };
+
+        float bestCost     = std::numeric_limits<float>::max();
+        int bestAxis       = -1;
+        uint32_t bestSplit = 0;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (centerMax[axis] <= centerMin[axis])
+            {
+                continue;
+            }
+
+            std::array<Bin, kNumBins> bins {};
+
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                BoundingBox const& bounds = m_bounds[m_items[i]];
+                Bin& bin                  = bins[binOf(m_items[i], axis)];
+
+                bin.min = glm::min(bin.min, bounds.min);
+                bin.max = glm::max(bin.max, bounds.max);
+                ++bin.count;
+            }
+
+            // Cost of every split plane between two bins, swept from both sides
+            std::array<float, kNumBins - 1> leftCosts {};
+            Bin left {};
+
+            for (uint32_t split = 0; split < kNumBins - 1; ++split)
+            {
+                left.min   = glm::min(left.min, bins[split].min);
+                left.max   = glm::max(left.max, bins[split].max);
+                left.count += bins[split].count;
+
+                leftCosts[split] = left.count * surfaceArea(left.min, left.max);
+            }
+
+            Bin right {};
+
+            for (uint32_t split = kNumBins - 1; split > 0; --split)
+            {
+                right.min   = glm::min(right.min, bins[split].min);
+                right.max   = glm::max(right.max, bins[split].max);
+                right.count += bins[split].count;
+
+                float const cost = leftCosts[split - 1] + right.count * surfaceArea(right.min, right.max);
+
+                if (cost < bestCost)
+                {
+                    bestCost  = cost;
+                    bestAxis  = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        // Testing every item of a leaf is as expensive as testing both children and their items
+        if (bestAxis < 0 || bestCost >= node.count * surfaceArea(node.min, node.max))
+        {
+            return;
+        }
+
+        auto const middle = std::partition(m_items.begin() + node.first,
+                                           m_items.begin() + node.first + node.count,
+                                           [&](uint32_t item) { return binOf(item, bestAxis) < bestSplit; });
+
+        auto const leftCount = static_cast<uint32_t>(middle - (m_items.begin() + node.first));
+
+        if (leftCount == 0 || leftCount == node.count)
+        {
+            return;
+        }
+
+        auto const leftIndex = static_cast<uint32_t>(m_nodes.size());
+
+        m_nodes.push_back({ .first = node.first, .count = leftCount });
+        m_nodes.push_back({ .first = node.first + leftCount, .count = node.count - leftCount });
+
+        updateNodeBounds(m_nodes[leftIndex]);
+        updateNodeBounds(m_nodes[leftIndex + 1]);
+
+        m_nodes[nodeIndex].first = leftIndex;
+        m_nodes[nodeIndex].count = 0;
+    }
+
+    void SceneBvh::appendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& items) const
+    {
+        // Subtrees of a binned build are contiguous in `m_items`, but refits don't have to keep track of
+        // that, so the leaves are walked
+        std::vector<uint32_t> stack { nodeIndex };
+
+        while (!stack.empty())
+        {
+            Node const& node = m_nodes[stack.back()];
+            stack.pop_back();
+
+            if (node.count > 0)
+            {
+                items.insert(
+                    items.end(), m_items.begin() + node.first, m_items.begin() + node.first + node.count);
+            }
+            else
+            {
+                stack.push_back(node.first);
+                stack.push_back(node.first + 1);
+            }
+        }
+    }
+
+    template <typename NodeTest>
+    void SceneBvh::query(NodeTest&& nodeTest, std::vector<uint32_t>& items) const
+    {
+        items.insert(items.end(), m_unboundedItems.begin(), m_unboundedItems.end());
+
+        if (m_nodes.empty())
+        {
+            return;
+        }
+
+        std::vector<uint32_t> stack { 0 };
+
+        while (!stack.empty())
+        {
+            uint32_t const nodeIndex = stack.back();
+            stack.pop_back();
+
+            Node const& node = m_nodes[nodeIndex];
+
+            switch (nodeTest(node.min, node.max))
+            {
+                case Overlap::outside:
+                    continue;
+                case Overlap::inside:
+                    appendSubtree(nodeIndex, items);
+                    continue;
+                case Overlap::partial:
+                    break;
+            }
+
+            if (node.count == 0)
+            {
+                stack.push_back(node.first);
+                stack.push_back(node.first + 1);
+
+                continue;
+            }
+
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                BoundingBox const& bounds = m_bounds[m_items[i]];
+
+                if (nodeTest(bounds.min, bounds.max) != Overlap::outside)
+                {
+                    items.push_back(m_items[i]);
+                }
+            }
+        }
+    }
+
+    void SceneBvh::queryFrustum(std::array<glm::vec4, 6> const& planes, std::vector<uint32_t>& items) const
+    {
+        query([&](glm::vec3 min, glm::vec3 max) { return overlapFrustum(planes, min, max); }, items);
+    }
+
+    void SceneBvh::queryBox(glm::vec3 boundsMin, glm::vec3 boundsMax, std::vector<uint32_t>& items) const
+    {
+        BoundingBox const box(boundsMin, boundsMax);
+
+        query(
+            [&](glm::vec3 min, glm::vec3 max)
+            {
+                if (!overlaps(box, min, max))
+                {
+                    return Overlap::outside;
+                }
+
+                bool const contained = glm::all(glm::lessThanEqual(boundsMin, min)) &&
+                                       glm::all(glm::lessThanEqual(max, boundsMax));
+
+                return contained ? Overlap::inside : Overlap::partial;
+            },
+            items);
+    }
+
+    void SceneBvh::querySphere(glm::vec3 center, float radius, std::vector<uint32_t>& items) const
+    {
+        query([&](glm::vec3 min, glm::vec3 max) { return overlapSphere(center, radius, min, max); }, items);
+    }
+
+    auto SceneBvh::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance) const
+        -> std::optional<RayHit>
+    {
+        if (m_nodes.empty())
+        {
+            return std::nullopt;
+        }
+
+        // Infinite where the direction is 0, the slabs of that axis then either contain the ray or don't
+        glm::vec3 const inverseDirection = 1.f / direction;
+
+        std::optional<RayHit> hit;
+        float closest = maxDistance;
+
+        std::vector<uint32_t> stack { 0 };
+
+        while (!stack.empty())
+        {
+            Node const& node = m_nodes[stack.back()];
+            stack.pop_back();
+
+            if (intersectRay(origin, inverseDirection, closest, node.min, node.max) < 0.f)
+            {
+                continue;
+            }
+
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                {
+                    BoundingBox const& bounds = m_bounds[m_items[i]];
+
+                    // A box around the origin would always be hit at a distance of 0 (e.g the room the camera
+                    // stands in), only boxes the ray enters from the outside count
+                    if (contains(bounds.min, bounds.max, origin))
+                    {
+                        continue;
+                    }
+
+                    float const distance =
+                        intersectRay(origin, inverseDirection, closest, bounds.min, bounds.max);
+
+                    if (distance >= 0.f)
+                    {
+                        closest = distance;
+                        hit     = RayHit { .item = m_items[i], .distance = distance };
+                    }
+                }
+
+                continue;
+            }
+
+            // The nearer child goes on top of the stack, its hits shorten the search in the other one
+            Node const& left  = m_nodes[node.first];
+            Node const& right = m_nodes[node.first + 1];
+
+            float const leftDistance  = intersectRay(origin, inverseDirection, closest, left.min, left.max);
+            float const rightDistance = intersectRay(origin, inverseDirection, closest, right.min, right.max);
+
+            std::array children {
+                std::pair { leftDistance, node.first },
+                std::pair { rightDistance, node.first + 1 },
+            };
+
+            if (children[0].first < children[1].first)
+            {
+                std::swap(children[0], children[1]);
+            }
+
+            for (auto [distance, child] : children)
+            {
+                if (distance >= 0.f)
+                {
+                    stack.push_back(child);
+                }
+            }
+        }
+
+        return hit;
+    }
+}  // namespace renderer::backend
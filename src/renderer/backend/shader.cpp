@@ -62,6 +62,11 @@ namespace renderer::backend
 
         options.SetIncluder(std::make_unique<Includer>());
 
+        for (auto const& [name, value] : m_defines)
+        {
+            options.AddMacroDefinition(name, value);
+        }
+
         shaderc::SpvCompilationResult spirvBinaryResult =
             compiler.CompileGlslToSpv(source, kind, source_name.c_str(), entrypoint.data(), options);
 
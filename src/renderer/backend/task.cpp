@@ -0,0 +1,150 @@
+#include <mc/asserts.hpp>
+#include <mc/logger.hpp>
+#include <mc/renderer/backend/task.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+namespace renderer::backend
+{
+    void TaskExecutor::resumeOnWorker(std::coroutine_handle<> handle)
+    {
+        MC_ASSERT(m_scheduler);
+
+        // I/O completions arrive on the file reader's threads, enkiTS only accepts tasks from its own threads
+        // and from registered external ones
+        if (m_scheduler->GetThreadNum() == enki::NO_THREAD_NUM && !m_scheduler->RegisterExternalTaskThread())
+        {
+            logger::warn("No external task thread slot left, resuming the task on the calling thread");
+
+            handle.resume();
+
+            return;
+        }
+
+        ResumeTask* task = nullptr;
+
+        {
+            std::lock_guard lock(m_mutex);
+
+            for (auto& candidate : m_tasks)
+            {
+                if (!candidate->pending.load(std::memory_order_acquire) && candidate->GetIsComplete())
+                {
+                    task = candidate.get();
+
+                    break;
+                }
+            }
+
+            if (!task)
+            {
+                task = m_tasks.emplace_back(std::make_unique<ResumeTask>()).get();
+            }
+
+            task->handle = handle;
+            task->pending.store(true, std::memory_order_release);
+        }
+
+        m_scheduler->AddTaskSetToPipe(task);
+    }
+
+    void TaskExecutor::resumeAfter(GpuWait wait, std::coroutine_handle<> handle, vk::Result& result)
+    {
+        {
+            std::lock_guard lock(m_gpuWaitMutex);
+
+            if (!m_gpuWaiter.joinable())
+            {
+                m_gpuWaiter = std::jthread([this](std::stop_token stop) { runGpuWaits(stop); });
+            }
+
+            m_newGpuWaits.push_back({ std::move(wait), handle, &result });
+        }
+
+        m_gpuWaitCondition.notify_one();
+    }
+
+    void TaskExecutor::runGpuWaits(std::stop_token stop)
+    {
+        // Long enough not to spin, short enough for new waits to be picked up quickly
+        constexpr uint64_t kTimeout = 1'000'000;
+
+        std::vector<PendingWait> waits;
+
+        while (true)
+        {
+            {
+                std::unique_lock lock(m_gpuWaitMutex);
+
+                // Only sleeps here when nothing is in flight, otherwise the oldest wait does the sleeping
+                m_gpuWaitCondition.wait(
+                    lock, stop, [&] { return !waits.empty() || !m_newGpuWaits.empty(); });
+
+                if (stop.stop_requested())
+                {
+                    return;
+                }
+
+                std::ranges::move(m_newGpuWaits, std::back_inserter(waits));
+                m_newGpuWaits.clear();
+            }
+
+            for (size_t i = 0; i < waits.size();)
+            {
+                vk::Result const result = waits[i].wait(i == 0 ? kTimeout : 0);
+
+                if (result == vk::Result::eTimeout)
+                {
+                    ++i;
+
+                    continue;
+                }
+
+                *waits[i].result = result;
+
+                resumeOnWorker(waits[i].handle);
+
+                waits.erase(waits.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+        }
+    }
+
+    void TaskExecutor::ResumeTask::ExecuteRange(enki::TaskSetPartition, uint32_t)
+    {
+        std::coroutine_handle<> const resumed = handle;
+
+        // The task only becomes reusable once enkiTS marks it complete after this returns
+        pending.store(false, std::memory_order_release);
+
+        resumed.resume();
+    }
+
+    void ReadFilesAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        io::FileReader::get().readFilesAsync(std::move(paths),
+                                             [this, handle](auto readFiles)
+                                             {
+                                                 files = std::move(readFiles);
+
+                                                 executor.resumeOnWorker(handle);
+                                             });
+    }
+
+    auto waitForFence(TaskExecutor& executor, vk::Device device, vk::Fence fence) -> Task<vk::Result>
+    {
+        co_return co_await GpuWaitAwaiter { executor,
+                                            [device, fence](uint64_t timeout)
+                                            { return device.waitForFences(fence, true, timeout); } };
+    }
+
+    auto submitAndWait(TaskExecutor& executor, Device const& device, ScopedCommandBuffer cmdBuf)
+        -> Task<void>
+    {
+        vk::raii::Fence fence = cmdBuf.submit();
+
+        [[maybe_unused]] vk::Result const result = co_await waitForFence(executor, *device.get(), *fence);
+
+        MC_ASSERT(result == vk::Result::eSuccess);
+    }
+}  // namespace renderer::backend
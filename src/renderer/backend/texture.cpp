@@ -7,99 +7,25 @@ using namespace renderer::backend;
 
 Texture::Texture(ResourceHandle const& handle,
                  std::string const& name,
-                 Device& device,
-                 CommandManager& commandManager,
+                 UploadManager& uploadManager,
                  ResourceManager<Image>& imageManager,
-                 ResourceManager<GPUBuffer>& bufferManager,
                  StbiWrapper const& stbiImage)
-    : ResourceBase { handle },
-      image { imageManager.create(name,
-                                  stbiImage.getDimensions(),
-                                  vk::Format::eR8G8B8A8Unorm,
-                                  vk::SampleCountFlagBits::e1,
-                                  vk::ImageUsageFlagBits::eTransferSrc |
-                                      vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-                                  vk::ImageAspectFlagBits::eColor,
-                                  static_cast<uint32_t>(std::floor(std::log2(std::max(
-                                      stbiImage.getDimensions().width, stbiImage.getDimensions().height)))) +
-                                      1) }
+    : Texture(handle,
+              name,
+              uploadManager,
+              imageManager,
+              stbiImage.getDimensions(),
+              stbiImage.getData(),
+              stbiImage.getDataSize())
 {
-    vk::Extent2D dimensions = stbiImage.getDimensions();
-
-    auto uploadBuffer = bufferManager.create(std::format("Upload buffer for texture '{}'", name),
-                                             stbiImage.getDataSize(),
-                                             vk::BufferUsageFlagBits::eTransferSrc,
-                                             VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                                             VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-                                                 VMA_ALLOCATION_CREATE_MAPPED_BIT);
-
-    std::memcpy(uploadBuffer.getMappedData(), stbiImage.getData(), stbiImage.getDataSize());
-
-    {
-        ScopedCommandBuffer commandBuffer(device, commandManager.getMainCmdPool(), device.getMainQueue());
-
-        Image::transition(commandBuffer,
-                          image.getVulkanHandle(),
-                          vk::ImageLayout::eUndefined,
-                          vk::ImageLayout::eTransferDstOptimal);
-
-        vk::BufferImageCopy region {
-                .bufferOffset      = 0,
-                .bufferRowLength   = 0,
-                .bufferImageHeight = 0,
-                .imageSubresource  = {
-                    .aspectMask     = vk::ImageAspectFlagBits::eColor,
-                    .mipLevel       = 0,
-                    .baseArrayLayer = 0,
-                    .layerCount     = 1,
-                },
-                .imageOffset = { 0, 0, 0 },
-                .imageExtent = { dimensions.width, dimensions.height, 1 },
-            };
-
-        commandBuffer->copyBufferToImage(
-            uploadBuffer, image.getVulkanHandle(), vk::ImageLayout::eTransferDstOptimal, { region });
-
-        //transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL here
-        // generateMipmaps(commandBuffer,
-        //                 m_image,
-        //                 { dimensions.width, dimensions.height },
-        //                 vk::Format::eR8G8B8A8Unorm,
-        //                 mipLevels);
-
-        commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-                                           vk::PipelineStageFlagBits::eFragmentShader,
-                                           vk::DependencyFlags { 0 },
-                                           {},
-                                           {},
-                                           {
-                {
-                    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
-                    .dstAccessMask = vk::AccessFlagBits::eShaderRead,
-                    .oldLayout     = vk::ImageLayout::eTransferDstOptimal,
-                    .newLayout     = vk::ImageLayout::eShaderReadOnlyOptimal,
-                    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
-                    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
-                    .image = image.getVulkanHandle(),
-                    .subresourceRange = {
-                        .aspectMask     = vk::ImageAspectFlagBits::eColor,
-                        .levelCount     = 1,
-                        .baseArrayLayer = 0,
-                        .layerCount     = 1,
-                    },
-                }
-            });
-    }
 }
 
 Texture::Texture(ResourceHandle const& handle,
                  std::string const& name,
-                 Device& device,
-                 CommandManager& commandManager,
+                 UploadManager& uploadManager,
                  ResourceManager<Image>& imageManager,
-                 ResourceManager<GPUBuffer>& bufferManager,
                  vk::Extent2D dimensions,
-                 void* data,
+                 void const* data,
                  size_t dataSize)
     : ResourceBase { handle },
       image { imageManager.create(
@@ -112,71 +38,10 @@ Texture::Texture(ResourceHandle const& handle,
           vk::ImageAspectFlagBits::eColor,
           static_cast<uint32_t>(std::floor(std::log2(std::max(dimensions.width, dimensions.height)))) + 1) }
 {
-    auto uploadBuffer = bufferManager.create(std::format("Upload buffer for texture '{}'", name),
-                                             dataSize,
-                                             vk::BufferUsageFlagBits::eTransferSrc,
-                                             VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                                             VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-                                                 VMA_ALLOCATION_CREATE_MAPPED_BIT);
-
-    std::memcpy(uploadBuffer.getMappedData(), data, dataSize);
-
-    {
-        // TODO(aether) graphics or transfer?
-        ScopedCommandBuffer commandBuffer(device, commandManager.getMainCmdPool(), device.getMainQueue());
-
-        Image::transition(commandBuffer,
-                          image.getVulkanHandle(),
-                          vk::ImageLayout::eUndefined,
-                          vk::ImageLayout::eTransferDstOptimal);
-
-        vk::BufferImageCopy region {
-                .bufferOffset      = 0,
-                .bufferRowLength   = 0,
-                .bufferImageHeight = 0,
-                .imageSubresource  = {
-                    .aspectMask     = vk::ImageAspectFlagBits::eColor,
-                    .mipLevel       = 0,
-                    .baseArrayLayer = 0,
-                    .layerCount     = 1,
-                },
-                .imageOffset = { 0, 0, 0 },
-                .imageExtent = { dimensions.width, dimensions.height, 1 },
-            };
-
-        commandBuffer->copyBufferToImage(
-            uploadBuffer, image.getVulkanHandle(), vk::ImageLayout::eTransferDstOptimal, { region });
-
-        // transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL here
-        // generateMipmaps(commandBuffer,
-        //                 m_image,
-        //                 { dimensions.width, dimensions.height },
-        //                 vk::Format::eR8G8B8A8Unorm,
-        //                 mipLevels);
-
-        commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-                                           vk::PipelineStageFlagBits::eFragmentShader,
-                                           vk::DependencyFlags { 0 },
-                                           {},
-                                           {},
-                                           {
-                {
-                    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
-                    .dstAccessMask = vk::AccessFlagBits::eShaderRead,
-                    .oldLayout     = vk::ImageLayout::eTransferDstOptimal,
-                    .newLayout     = vk::ImageLayout::eShaderReadOnlyOptimal,
-                    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
-                    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
-                    .image = image.getVulkanHandle(),
-                    .subresourceRange = {
-                        .aspectMask     = vk::ImageAspectFlagBits::eColor,
-                        .levelCount     = 1,
-                        .baseArrayLayer = 0,
-                        .layerCount     = 1,
-                    },
-                }
-            });
-    }
+    uploadToken = uploadManager.uploadImageMipChain(image.getVulkanHandle(),
+                                                    dimensions,
+                                                    image.getMipLevels(),
+                                                    { static_cast<std::byte const*>(data), dataSize });
 }
 
 StbiWrapper::StbiWrapper(std::string_view const& path)
@@ -0,0 +1,710 @@
+#include <mc/asserts.hpp>
+#include <mc/renderer/backend/constants.hpp>
+#include <mc/renderer/backend/upload.hpp>
+#include <mc/renderer/backend/vk_checker.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace renderer::backend
+{
+    namespace
+    {
+        auto alignUp(uint64_t value, uint64_t alignment) -> uint64_t
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }  // namespace
+
+    UploadManager::UploadManager(Device& device, ResourceManager<GPUBuffer>& bufferManager)
+        : m_device { &device }, m_bufferManager { &bufferManager }
+    {
+        QueueFamilyIndices const& families = device.getQueueFamilyIndices();
+
+        m_transferFamily    = families.transferFamily;
+        m_mainFamily        = families.mainFamily;
+        m_transferOwnership = m_transferFamily != m_mainFamily;
+
+        m_stagingRing = bufferManager.create(
+            "Upload staging ring",
+            kStagingRingSize,
+            vk::BufferUsageFlagBits::eTransferSrc,
+            VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        m_ringData = static_cast<std::byte*>(m_stagingRing.getMappedData());
+
+        m_commandPool = device->createCommandPool({
+                            .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+                            .queueFamilyIndex = m_transferFamily,
+                        }) >>
+                        ResultChecker();
+
+        vk::SemaphoreTypeCreateInfo timelineInfo {
+            .semaphoreType = vk::SemaphoreType::eTimeline,
+            .initialValue  = 0,
+        };
+
+        m_timeline = device->createSemaphore({ .pNext = &timelineInfo }) >> ResultChecker();
+    }
+
+    UploadManager::~UploadManager()
+    {
+        if (!m_device)
+        {
+            return;
+        }
+
+        // Nothing waits on uploads that never got submitted, they are simply dropped
+        m_currentBatch.reset();
+
+        if (m_lastSubmittedValue > 0)
+        {
+            vk::Semaphore semaphore = m_timeline;
+
+            vk::Device(*m_device).waitSemaphores(
+                {
+                    .semaphoreCount = 1,
+                    .pSemaphores    = &semaphore,
+                    .pValues        = &m_lastSubmittedValue,
+                },
+                std::numeric_limits<uint64_t>::max()) >>
+                ResultChecker();
+        }
+
+        m_inFlight.clear();
+    }
+
+    auto UploadManager::uploadBuffer(vk::Buffer dst,
+                                     std::span<std::byte const> data,
+                                     vk::DeviceSize dstOffset) -> UploadToken
+    {
+        MC_ASSERT(!data.empty());
+
+        std::unique_lock lock(m_mutex);
+
+        Staging const staging = stage(lock, data);
+        Batch& batch          = getCurrentBatch();
+
+        vk::CommandBuffer(batch.cmdBuf)
+            .copyBuffer(staging.buffer,
+                        dst,
+                        vk::BufferCopy {
+                            .srcOffset = staging.offset,
+                            .dstOffset = dstOffset,
+                            .size      = data.size(),
+                        });
+
+        // Same family buffers are made visible by the semaphore wait alone
+        if (m_transferOwnership)
+        {
+            batch.bufferTransfers.push_back({
+                .srcStageMask        = vk::PipelineStageFlagBits2::eTransfer,
+                .srcAccessMask       = vk::AccessFlagBits2::eTransferWrite,
+                .srcQueueFamilyIndex = m_transferFamily,
+                .dstQueueFamilyIndex = m_mainFamily,
+                .buffer              = dst,
+                .offset              = dstOffset,
+                .size                = data.size(),
+            });
+        }
+
+        return { batch.value };
+    }
+
+    auto UploadManager::uploadBuffer(ResourceAccessor<GPUBuffer> const& dst,
+                                     std::span<std::byte const> data,
+                                     vk::DeviceSize dstOffset) -> UploadToken
+    {
+        if (dst.isHostVisible() && dst.getMappedData())
+        {
+            dst.write(data, dstOffset);
+
+            return {};
+        }
+
+        return uploadBuffer(dst.getVulkanHandle(), data, dst.getOffset() + dstOffset);
+    }
+
+    auto UploadManager::uploadImage(vk::Image dst,
+                                    std::span<std::byte const> data,
+                                    std::span<vk::BufferImageCopy const> regions) -> UploadToken
+    {
+        MC_ASSERT(!data.empty() && !regions.empty());
+
+        std::unique_lock lock(m_mutex);
+
+        Staging const staging = stage(lock, data);
+        Batch& batch          = getCurrentBatch();
+
+        vk::ImageSubresourceRange const subresourceRange {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .levelCount = vk::RemainingMipLevels,
+            .layerCount = vk::RemainingArrayLayers,
+        };
+
+        vk::ImageMemoryBarrier2 toTransferDst {
+            .srcStageMask        = vk::PipelineStageFlagBits2::eNone,
+            .srcAccessMask       = vk::AccessFlagBits2::eNone,
+            .dstStageMask        = vk::PipelineStageFlagBits2::eTransfer,
+            .dstAccessMask       = vk::AccessFlagBits2::eTransferWrite,
+            .oldLayout           = vk::ImageLayout::eUndefined,
+            .newLayout           = vk::ImageLayout::eTransferDstOptimal,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image               = dst,
+            .subresourceRange    = subresourceRange,
+        };
+
+        vk::CommandBuffer cmdBuf = batch.cmdBuf;
+
+        cmdBuf.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &toTransferDst });
+
+        std::vector<vk::BufferImageCopy> copyRegions(regions.begin(), regions.end());
+
+        for (vk::BufferImageCopy& region : copyRegions)
+        {
+            region.bufferOffset += staging.offset;
+        }
+
+        cmdBuf.copyBufferToImage(staging.buffer, dst, vk::ImageLayout::eTransferDstOptimal, copyRegions);
+
+        // The layout transition happens on the transfer queue either way, with distinct families it doubles
+        // as the release of the ownership transfer
+        batch.imageTransfers.push_back({
+            .srcStageMask        = vk::PipelineStageFlagBits2::eTransfer,
+            .srcAccessMask       = vk::AccessFlagBits2::eTransferWrite,
+            .dstStageMask        = m_transferOwnership ? vk::PipelineStageFlagBits2::eNone
+                                                       : vk::PipelineStageFlagBits2::eAllCommands,
+            .dstAccessMask       = m_transferOwnership ? vk::AccessFlagBits2::eNone
+                                                       : vk::AccessFlagBits2::eMemoryRead,
+            .oldLayout           = vk::ImageLayout::eTransferDstOptimal,
+            .newLayout           = vk::ImageLayout::eShaderReadOnlyOptimal,
+            .srcQueueFamilyIndex = m_transferOwnership ? m_transferFamily : vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = m_transferOwnership ? m_mainFamily : vk::QueueFamilyIgnored,
+            .image               = dst,
+            .subresourceRange    = subresourceRange,
+        });
+
+        return { batch.value };
+    }
+
+    auto UploadManager::uploadImageMipChain(vk::Image dst,
+                                            vk::Extent2D dimensions,
+                                            uint32_t mipLevels,
+                                            std::span<std::byte const> data) -> UploadToken
+    {
+        MC_ASSERT(!data.empty() && mipLevels > 0);
+
+        std::unique_lock lock(m_mutex);
+
+        Staging const staging = stage(lock, data);
+        Batch& batch          = getCurrentBatch();
+
+        // Only the first level is touched here, the others stay undefined until the main queue writes them
+        vk::ImageSubresourceRange const firstLevel {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .levelCount = 1,
+            .layerCount = 1,
+        };
+
+        vk::ImageMemoryBarrier2 toTransferDst {
+            .srcStageMask        = vk::PipelineStageFlagBits2::eNone,
+            .srcAccessMask       = vk::AccessFlagBits2::eNone,
+            .dstStageMask        = vk::PipelineStageFlagBits2::eTransfer,
+            .dstAccessMask       = vk::AccessFlagBits2::eTransferWrite,
+            .oldLayout           = vk::ImageLayout::eUndefined,
+            .newLayout           = vk::ImageLayout::eTransferDstOptimal,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image               = dst,
+            .subresourceRange    = firstLevel,
+        };
+
+        vk::CommandBuffer cmdBuf = batch.cmdBuf;
+
+        cmdBuf.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &toTransferDst });
+
+        cmdBuf.copyBufferToImage(staging.buffer,
+                                 dst,
+                                 vk::ImageLayout::eTransferDstOptimal,
+                                 vk::BufferImageCopy {
+                                     .bufferOffset     = staging.offset,
+                                     .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                                                           .mipLevel   = 0,
+                                                           .layerCount = 1 },
+                                     .imageExtent      = { dimensions.width, dimensions.height, 1 },
+                                 });
+
+        // The first level is left as the source of the blits
+        batch.imageTransfers.push_back({
+            .srcStageMask        = vk::PipelineStageFlagBits2::eTransfer,
+            .srcAccessMask       = vk::AccessFlagBits2::eTransferWrite,
+            .dstStageMask        = m_transferOwnership ? vk::PipelineStageFlagBits2::eNone
+                                                       : vk::PipelineStageFlagBits2::eAllCommands,
+            .dstAccessMask       = m_transferOwnership ? vk::AccessFlagBits2::eNone
+                                                       : vk::AccessFlagBits2::eMemoryRead,
+            .oldLayout           = vk::ImageLayout::eTransferDstOptimal,
+            .newLayout           = vk::ImageLayout::eTransferSrcOptimal,
+            .srcQueueFamilyIndex = m_transferOwnership ? m_transferFamily : vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = m_transferOwnership ? m_mainFamily : vk::QueueFamilyIgnored,
+            .image               = dst,
+            .subresourceRange    = firstLevel,
+        });
+
+        batch.mipChains.push_back({ .image = dst, .dimensions = dimensions, .mipLevels = mipLevels });
+
+        return { batch.value };
+    }
+
+    auto UploadManager::flush() -> UploadToken
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (m_currentBatch)
+        {
+            submitCurrentBatch();
+        }
+
+        return { m_lastSubmittedValue };
+    }
+
+    auto UploadManager::isComplete(UploadToken token) const -> bool
+    {
+        return token.value <= getCompletedValue();
+    }
+
+    auto UploadManager::isIdle() -> bool
+    {
+        std::unique_lock lock(m_mutex, std::try_to_lock);
+
+        if (!lock || m_currentBatch || !m_inFlight.empty())
+        {
+            return false;
+        }
+
+        std::lock_guard acquireLock(m_acquireMutex);
+
+        return m_readyBufferAcquires.empty() && m_readyImageAcquires.empty() && m_readyValue == 0;
+    }
+
+    void UploadManager::submitUpTo(UploadToken token)
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (token.value > m_lastSubmittedValue)
+        {
+            MC_ASSERT(m_currentBatch && m_currentBatch->value == token.value);
+
+            submitCurrentBatch();
+        }
+    }
+
+    void UploadManager::wait(UploadToken token)
+    {
+        if (!token)
+        {
+            return;
+        }
+
+        submitUpTo(token);
+
+        vk::Semaphore semaphore = m_timeline;
+
+        vk::Device(*m_device).waitSemaphores(
+            {
+                .semaphoreCount = 1,
+                .pSemaphores    = &semaphore,
+                .pValues        = &token.value,
+            },
+            std::numeric_limits<uint64_t>::max()) >>
+            ResultChecker();
+
+        std::lock_guard lock(m_mutex);
+
+        retireCompletedBatches();
+    }
+
+    auto UploadManager::waitAsync(TaskExecutor& executor, UploadToken token) -> Task<void>
+    {
+        if (isComplete(token))
+        {
+            co_return;
+        }
+
+        submitUpTo(token);
+
+        vk::Device const device { *m_device };
+        vk::Semaphore const semaphore { m_timeline };
+
+        [[maybe_unused]] vk::Result const result = co_await GpuWaitAwaiter {
+            executor,
+            [device, semaphore, value = token.value](uint64_t timeout)
+            {
+                return device.waitSemaphores(
+                    {
+                        .semaphoreCount = 1,
+                        .pSemaphores    = &semaphore,
+                        .pValues        = &value,
+                    },
+                    timeout);
+            }
+        };
+
+        MC_ASSERT(result == vk::Result::eSuccess);
+
+        std::lock_guard lock(m_mutex);
+
+        retireCompletedBatches();
+    }
+
+    void UploadManager::beginFrame()
+    {
+        // Whoever is uploading right now will submit or retire soon enough, the frame doesn't wait for them
+        std::unique_lock lock(m_mutex, std::try_to_lock);
+
+        if (!lock)
+        {
+            return;
+        }
+
+        if (m_currentBatch)
+        {
+            submitCurrentBatch();
+        }
+
+        retireCompletedBatches();
+    }
+
+    auto UploadManager::recordAcquireBarriers(vk::CommandBuffer cmdBuf) -> UploadToken
+    {
+        std::lock_guard lock(m_acquireMutex);
+
+        if (!m_readyBufferAcquires.empty() || !m_readyImageAcquires.empty())
+        {
+            cmdBuf.pipelineBarrier2(vk::DependencyInfo()
+                                        .setBufferMemoryBarriers(m_readyBufferAcquires)
+                                        .setImageMemoryBarriers(m_readyImageAcquires));
+
+            m_readyBufferAcquires.clear();
+            m_readyImageAcquires.clear();
+        }
+
+        if (!m_readyMipChains.empty())
+        {
+            recordMipChains(cmdBuf, m_readyMipChains);
+
+            m_readyMipChains.clear();
+        }
+
+        if (m_readyValue > 0)
+        {
+            m_acquiredValue.store(m_readyValue, std::memory_order_release);
+        }
+
+        return { std::exchange(m_readyValue, 0) };
+    }
+
+    void UploadManager::recordMipChains(vk::CommandBuffer cmdBuf, std::span<MipChain const> mipChains)
+    {
+        std::vector<vk::ImageMemoryBarrier2> barriers;
+        barriers.reserve(mipChains.size());
+
+        uint32_t maxMipLevels = 1;
+
+        for (MipChain const& chain : mipChains)
+        {
+            maxMipLevels = std::max(maxMipLevels, chain.mipLevels);
+
+            if (chain.mipLevels > 1)
+            {
+                barriers.push_back({
+                    .srcStageMask     = vk::PipelineStageFlagBits2::eNone,
+                    .srcAccessMask    = vk::AccessFlagBits2::eNone,
+                    .dstStageMask     = vk::PipelineStageFlagBits2::eBlit,
+                    .dstAccessMask    = vk::AccessFlagBits2::eTransferWrite,
+                    .oldLayout        = vk::ImageLayout::eUndefined,
+                    .newLayout        = vk::ImageLayout::eTransferDstOptimal,
+                    .image            = chain.image,
+                    .subresourceRange = { .aspectMask     = vk::ImageAspectFlagBits::eColor,
+                                          .baseMipLevel   = 1,
+                                          .levelCount     = vk::RemainingMipLevels,
+                                          .layerCount     = 1 },
+                });
+            }
+        }
+
+        if (!barriers.empty())
+        {
+            cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(barriers));
+        }
+
+        // Each level is blitted from the previous one for every image at once,
+        // then becomes the source of the next
+        for (uint32_t level : vi::iota(1u, maxMipLevels))
+        {
+            barriers.clear();
+
+            for (MipChain const& chain : mipChains)
+            {
+                if (level >= chain.mipLevels)
+                {
+                    continue;
+                }
+
+                auto mipSize = [&chain](uint32_t mip)
+                {
+                    return vk::Offset3D { static_cast<int32_t>(std::max(chain.dimensions.width >> mip, 1u)),
+                                          static_cast<int32_t>(std::max(chain.dimensions.height >> mip, 1u)),
+                                          1 };
+                };
+
+                vk::ImageBlit2 region {
+                    .srcSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                                        .mipLevel   = level - 1,
+                                        .layerCount = 1 },
+                    .srcOffsets     = std::array { vk::Offset3D {}, mipSize(level - 1) },
+                    .dstSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                                        .mipLevel   = level,
+                                        .layerCount = 1 },
+                    .dstOffsets     = std::array { vk::Offset3D {}, mipSize(level) },
+                };
+
+                cmdBuf.blitImage2({
+                    .srcImage       = chain.image,
+                    .srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+                    .dstImage       = chain.image,
+                    .dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+                    .regionCount    = 1,
+                    .pRegions       = &region,
+                    .filter         = vk::Filter::eLinear,
+                });
+
+                barriers.push_back({
+                    .srcStageMask     = vk::PipelineStageFlagBits2::eBlit,
+                    .srcAccessMask    = vk::AccessFlagBits2::eTransferWrite,
+                    .dstStageMask     = vk::PipelineStageFlagBits2::eBlit,
+                    .dstAccessMask    = vk::AccessFlagBits2::eTransferRead,
+                    .oldLayout        = vk::ImageLayout::eTransferDstOptimal,
+                    .newLayout        = vk::ImageLayout::eTransferSrcOptimal,
+                    .image            = chain.image,
+                    .subresourceRange = { .aspectMask   = vk::ImageAspectFlagBits::eColor,
+                                          .baseMipLevel = level,
+                                          .levelCount   = 1,
+                                          .layerCount   = 1 },
+                });
+            }
+
+            cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(barriers));
+        }
+
+        barriers.clear();
+
+        for (MipChain const& chain : mipChains)
+        {
+            barriers.push_back({
+                .srcStageMask     = vk::PipelineStageFlagBits2::eBlit,
+                .srcAccessMask    = vk::AccessFlagBits2::eTransferWrite,
+                .dstStageMask     = vk::PipelineStageFlagBits2::eAllCommands,
+                .dstAccessMask    = vk::AccessFlagBits2::eShaderSampledRead,
+                .oldLayout        = vk::ImageLayout::eTransferSrcOptimal,
+                .newLayout        = vk::ImageLayout::eShaderReadOnlyOptimal,
+                .image            = chain.image,
+                .subresourceRange = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                                      .levelCount = vk::RemainingMipLevels,
+                                      .layerCount = 1 },
+            });
+        }
+
+        cmdBuf.pipelineBarrier2(vk::DependencyInfo().setImageMemoryBarriers(barriers));
+    }
+
+    auto UploadManager::stage(std::unique_lock<std::mutex>& lock, std::span<std::byte const> data) -> Staging
+    {
+        uint64_t const ringSize = m_stagingRing.getSize();
+        uint64_t const size     = data.size();
+
+        if (size > ringSize)
+        {
+            ResourceAccessor<GPUBuffer>& buffer = getCurrentBatch().dedicatedStaging.emplace_back(
+                m_bufferManager->create("Upload staging (dedicated)",
+                                        size,
+                                        vk::BufferUsageFlagBits::eTransferSrc,
+                                        VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+                                        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                            VMA_ALLOCATION_CREATE_MAPPED_BIT));
+
+            std::memcpy(buffer.getMappedData(), data.data(), size);
+
+            buffer.flush(0, size);
+
+            return { .buffer = buffer, .offset = 0 };
+        }
+
+        while (true)
+        {
+            // Nothing references the ring, start over at its beginning so any size fits
+            if (m_ringTail == m_ringHead)
+            {
+                m_ringHead = m_ringTail = alignUp(m_ringHead, ringSize);
+            }
+
+            uint64_t start = alignUp(m_ringHead, kStagingAlignment);
+
+            // Allocations never straddle the end of the ring
+            if (start % ringSize + size > ringSize)
+            {
+                start = alignUp(start, ringSize);
+            }
+
+            if (start + size - m_ringTail <= ringSize)
+            {
+                m_ringHead                = start + size;
+                getCurrentBatch().ringEnd = m_ringHead;
+
+                vk::DeviceSize const offset = start % ringSize;
+
+                std::memcpy(m_ringData + offset, data.data(), size);
+
+                m_stagingRing.flush(offset, size);
+
+                return { .buffer = m_stagingRing, .offset = offset };
+            }
+
+            // Out of space, what's recorded so far goes out and the oldest batch gets waited on
+            if (m_currentBatch)
+            {
+                submitCurrentBatch();
+            }
+
+            retireCompletedBatches();
+
+            if (!m_inFlight.empty() && m_ringTail != m_ringHead)
+            {
+                uint64_t const value = m_inFlight.front().value;
+
+                vk::Semaphore semaphore = m_timeline;
+
+                lock.unlock();
+
+                vk::Device(*m_device).waitSemaphores(
+                    {
+                        .semaphoreCount = 1,
+                        .pSemaphores    = &semaphore,
+                        .pValues        = &value,
+                    },
+                    std::numeric_limits<uint64_t>::max()) >>
+                    ResultChecker();
+
+                lock.lock();
+
+                retireCompletedBatches();
+            }
+        }
+    }
+
+    auto UploadManager::getCurrentBatch() -> Batch&
+    {
+        if (!m_currentBatch)
+        {
+            Batch& batch = m_currentBatch.emplace();
+
+            batch.cmdBuf = std::move((m_device->get().allocateCommandBuffers({
+                                          .commandPool        = m_commandPool,
+                                          .level              = vk::CommandBufferLevel::ePrimary,
+                                          .commandBufferCount = 1,
+                                      }) >>
+                                      ResultChecker())[0]);
+
+            batch.cmdBuf.begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit }) >>
+                ResultChecker();
+
+            batch.value   = m_nextValue++;
+            batch.ringEnd = m_ringHead;
+        }
+
+        return *m_currentBatch;
+    }
+
+    void UploadManager::submitCurrentBatch()
+    {
+        Batch& batch = *m_currentBatch;
+
+        if (!batch.bufferTransfers.empty() || !batch.imageTransfers.empty())
+        {
+            batch.cmdBuf.pipelineBarrier2(vk::DependencyInfo()
+                                              .setBufferMemoryBarriers(batch.bufferTransfers)
+                                              .setImageMemoryBarriers(batch.imageTransfers));
+        }
+
+        batch.cmdBuf.end() >> ResultChecker();
+
+        auto cmdInfo    = vk::CommandBufferSubmitInfo().setCommandBuffer(batch.cmdBuf);
+        auto signalInfo = vk::SemaphoreSubmitInfo()
+                              .setSemaphore(m_timeline)
+                              .setValue(batch.value)
+                              .setStageMask(vk::PipelineStageFlagBits2::eAllCommands);
+
+        m_device->getTransferQueue().submit2(
+            vk::SubmitInfo2().setCommandBufferInfos(cmdInfo).setSignalSemaphoreInfos(signalInfo)) >>
+            ResultChecker();
+
+        m_lastSubmittedValue = batch.value;
+
+        m_inFlight.push_back(std::move(batch));
+        m_currentBatch.reset();
+    }
+
+    void UploadManager::retireCompletedBatches()
+    {
+        uint64_t const completedValue = getCompletedValue();
+
+        std::lock_guard lock(m_acquireMutex);
+
+        while (!m_inFlight.empty() && m_inFlight.front().value <= completedValue)
+        {
+            Batch& batch = m_inFlight.front();
+
+            // The acquiring half repeats the release with the main queue's side of the dependency
+            for (vk::BufferMemoryBarrier2 barrier : batch.bufferTransfers)
+            {
+                m_readyBufferAcquires.push_back(barrier.setSrcStageMask(vk::PipelineStageFlagBits2::eNone)
+                                                    .setSrcAccessMask(vk::AccessFlagBits2::eNone)
+                                                    .setDstStageMask(vk::PipelineStageFlagBits2::eAllCommands)
+                                                    .setDstAccessMask(vk::AccessFlagBits2::eMemoryRead));
+            }
+
+            if (m_transferOwnership)
+            {
+                for (vk::ImageMemoryBarrier2 barrier : batch.imageTransfers)
+                {
+                    m_readyImageAcquires.push_back(
+                        barrier.setSrcStageMask(vk::PipelineStageFlagBits2::eNone)
+                            .setSrcAccessMask(vk::AccessFlagBits2::eNone)
+                            .setDstStageMask(vk::PipelineStageFlagBits2::eAllCommands)
+                            .setDstAccessMask(vk::AccessFlagBits2::eMemoryRead));
+                }
+            }
+
+            m_readyMipChains.insert(m_readyMipChains.end(), batch.mipChains.begin(), batch.mipChains.end());
+
+            m_readyValue = std::max(m_readyValue, batch.value);
+            m_ringTail   = std::max(m_ringTail, batch.ringEnd);
+
+            m_inFlight.pop_front();
+        }
+
+        if (m_inFlight.empty() && !m_currentBatch)
+        {
+            m_ringTail = m_ringHead;
+        }
+    }
+
+    auto UploadManager::getCompletedValue() const -> uint64_t
+    {
+        return vk::Device(*m_device).getSemaphoreCounterValue(*m_timeline) >> ResultChecker();
+    }
+}  // namespace renderer::backend
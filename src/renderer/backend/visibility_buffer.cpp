@@ -0,0 +1,48 @@
+#include <mc/renderer/backend/visibility_buffer.hpp>
+#include <mc/renderer/backend/vk_checker.hpp>
+
+#include <vector>
+
+namespace renderer::backend
+{
+    VisibilityBuffer::VisibilityBuffer(Device& device) : m_device { &device }
+    {
+        // Only ever read with texelFetch, the sampler is there because the image is a combined one
+        m_sampler = device->createSampler({
+                        .magFilter    = vk::Filter::eNearest,
+                        .minFilter    = vk::Filter::eNearest,
+                        .mipmapMode   = vk::SamplerMipmapMode::eNearest,
+                        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+                        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+                        .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+                    }) >>
+                    ResultChecker();
+
+        m_descriptorLayout =
+            DescriptorLayoutBuilder()
+                .setBinding(0, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment)
+                .build(device);
+
+        std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
+            { vk::DescriptorType::eCombinedImageSampler, 1 },
+        };
+
+        m_descriptorAllocator = DescriptorAllocator(device, 1, sizes);
+    }
+
+    void VisibilityBuffer::setImageView(vk::ImageView view)
+    {
+        m_descriptorAllocator.clearDescriptors(*m_device);
+
+        m_descriptorSet = m_descriptorAllocator.allocate(*m_device, m_descriptorLayout);
+
+        DescriptorWriter writer;
+
+        writer.writeImage(0,
+                          view,
+                          m_sampler,
+                          vk::ImageLayout::eShaderReadOnlyOptimal,
+                          vk::DescriptorType::eCombinedImageSampler);
+        writer.updateSet(*m_device, m_descriptorSet);
+    }
+}  // namespace renderer::backend
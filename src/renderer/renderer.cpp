@@ -6,19 +6,21 @@
 
 #include <glm/fwd.hpp>
 #include <glm/trigonometric.hpp>
+#include <imgui.h>
 #include <tracy/Tracy.hpp>
 
 namespace renderer
 {
     Renderer::Renderer(EventManager& eventManager, window::Window& window, Camera& camera)
-        : m_camera { camera }, m_backend { backend::RendererBackend(window) }
+        : m_window { window }, m_camera { camera }, m_backend { backend::RendererBackend(window) }
 
     {
         eventManager.subscribe(this,
                                &Renderer::onRender,
                                &Renderer::onUpdate,
                                &Renderer::onFramebufferResize,
-                               &Renderer::onKeyPress);
+                               &Renderer::onKeyPress,
+                               &Renderer::onMouseButton);
 
         camera.setLens(glm::radians(45.0f), m_backend.getFramebufferSize(), 1000.f, 0.1f);
     }
@@ -51,9 +53,49 @@ namespace renderer
                     m_backend.toggleVsync();
                     break;
                 }
+            case Key::C:
+                {
+                    m_backend.toggleCpuCulling();
+                    break;
+                }
+            case Key::O:
+                {
+                    m_backend.toggleSoftwareOcclusion();
+                    break;
+                }
+            case Key::Z:
+                {
+                    m_backend.toggleDepthPrePass();
+                    break;
+                }
+            case Key::B:
+                {
+                    m_backend.toggleVisibilityBuffer();
+                    break;
+                }
         }
     }
 
+    void Renderer::onMouseButton(MouseButtonEvent const& event)
+    {
+        if (event.button != MouseButton::Left || event.action != MouseButtonEvent::Action::Pressed)
+        {
+            return;
+        }
+
+        // Clicks on the UI are ImGui's, a captured cursor only steers the camera
+        if (ImGui::GetIO().WantCaptureMouse || m_window.isCursorDisabled())
+        {
+            return;
+        }
+
+        // The cursor is in window coordinates, which are not framebuffer pixels on HiDPI displays
+        glm::vec2 const scale =
+            glm::vec2(m_window.getFramebufferDimensions()) / glm::vec2(m_window.getWindowDimensions());
+
+        m_backend.pickPrimitive((glm::vec2(event.position) + 0.5f) * scale);
+    }
+
     void Renderer::onFramebufferResize(WindowFramebufferResizeEvent const& /* event */)
     {
         m_backend.scheduleSwapchainUpdate();
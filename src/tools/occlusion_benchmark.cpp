@@ -0,0 +1,349 @@
+// Times the software occlusion rasterizer on the occluders of a glTF scene, no GPU involved. Loading a
+// `Model` needs a device, so the geometry is read with tinygltf here, the occluders are then picked by the
+// same `selectOccluders` the renderer uses.
+// Usage: occlusion_benchmark <scene.gltf|scene.glb> [frames]
+
+#include <mc/logger.hpp>
+#include <mc/renderer/backend/constants.hpp>
+#include <mc/renderer/backend/occlusion_rasterizer.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <TaskScheduler.h>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <tiny_gltf.h>
+
+using namespace renderer::backend;
+
+namespace
+{
+    struct Bounds
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // Geometry of a triangle primitive, positions are local to its node
+    struct Primitive
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+        glm::mat4 matrix;
+    };
+
+    struct Scene
+    {
+        std::vector<Primitive> primitives;
+        // One for every primitive
+        std::vector<OccluderCandidate> candidates;
+
+        std::vector<OccluderMesh> occluders;
+        // World space bounds of every primitive, these are the boxes tested against the occluders
+        std::vector<Bounds> boxes;
+        Bounds bounds { glm::vec3(std::numeric_limits<float>::max()),
+                        glm::vec3(std::numeric_limits<float>::lowest()) };
+    };
+
+    // Only the geometry is needed, images are left alone
+    bool skipImageData(
+        tinygltf::Image*, int const, std::string*, std::string*, int, int, unsigned char const*, int, void*)
+    {
+        return true;
+    }
+
+    auto getLocalMatrix(tinygltf::Node const& node) -> glm::mat4
+    {
+        if (node.matrix.size() == 16)
+        {
+            return glm::mat4(glm::make_mat4x4(node.matrix.data()));
+        }
+
+        glm::mat4 matrix { 1.f };
+
+        if (node.translation.size() == 3)
+        {
+            matrix = glm::translate(matrix, glm::vec3(glm::make_vec3(node.translation.data())));
+        }
+
+        if (node.rotation.size() == 4)
+        {
+            matrix *= glm::mat4(glm::quat(glm::make_quat(node.rotation.data())));
+        }
+
+        if (node.scale.size() == 3)
+        {
+            matrix = glm::scale(matrix, glm::vec3(glm::make_vec3(node.scale.data())));
+        }
+
+        return matrix;
+    }
+
+    // Address of element `i` of a non-sparse accessor
+    auto getElement(tinygltf::Model const& model, tinygltf::Accessor const& accessor, size_t i)
+        -> unsigned char const*
+    {
+        tinygltf::BufferView const& view = model.bufferViews[accessor.bufferView];
+        int const stride                 = accessor.ByteStride(view);
+
+        return model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset + i * stride;
+    }
+
+    auto getIndex(tinygltf::Model const& model, tinygltf::Accessor const& accessor, size_t i) -> uint32_t
+    {
+        unsigned char const* element = getElement(model, accessor, i);
+
+        switch (accessor.componentType)
+        {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return *element;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            {
+                uint16_t index;
+                std::memcpy(&index, element, sizeof(index));
+                return index;
+            }
+            default:
+            {
+                uint32_t index;
+                std::memcpy(&index, element, sizeof(index));
+                return index;
+            }
+        }
+    }
+
+    // Materials default to opaque, like the glTF default material
+    auto isOpaque(tinygltf::Model const& model, tinygltf::Primitive const& primitive) -> bool
+    {
+        return primitive.material < 0 || model.materials[primitive.material].alphaMode == "OPAQUE";
+    }
+
+    void addMesh(Scene& scene,
+                 tinygltf::Model const& model,
+                 tinygltf::Node const& node,
+                 glm::mat4 const& matrix)
+    {
+        tinygltf::Mesh const& mesh = model.meshes[node.mesh];
+
+        for (tinygltf::Primitive const& primitive : mesh.primitives)
+        {
+            auto const position = primitive.attributes.find("POSITION");
+
+            if (primitive.mode != TINYGLTF_MODE_TRIANGLES || position == primitive.attributes.end())
+            {
+                continue;
+            }
+
+            tinygltf::Accessor const& positions = model.accessors[position->second];
+
+            if (positions.bufferView < 0 || positions.sparse.isSparse ||
+                positions.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
+            {
+                continue;
+            }
+
+            Primitive& geometry = scene.primitives.emplace_back();
+            geometry.matrix     = matrix;
+            geometry.positions.reserve(positions.count);
+
+            Bounds box { glm::vec3(std::numeric_limits<float>::max()),
+                         glm::vec3(std::numeric_limits<float>::lowest()) };
+
+            for (size_t i = 0; i < positions.count; ++i)
+            {
+                glm::vec3 local;
+                std::memcpy(&local, getElement(model, positions, i), sizeof(local));
+
+                glm::vec3 const world = matrix * glm::vec4(local, 1.f);
+
+                geometry.positions.push_back(local);
+
+                box.min = glm::min(box.min, world);
+                box.max = glm::max(box.max, world);
+            }
+
+            if (primitive.indices > -1)
+            {
+                tinygltf::Accessor const& indices = model.accessors[primitive.indices];
+
+                geometry.indices.reserve(indices.count);
+
+                for (size_t i = 0; i < indices.count; ++i)
+                {
+                    geometry.indices.push_back(getIndex(model, indices, i));
+                }
+            }
+            else
+            {
+                for (uint32_t i = 0; i < positions.count; ++i)
+                {
+                    geometry.indices.push_back(i);
+                }
+            }
+
+            geometry.indices.resize(geometry.indices.size() / 3 * 3);
+
+            scene.candidates.push_back({
+                .numTriangles = static_cast<uint32_t>(geometry.indices.size() / 3),
+                .boundsMin    = box.min,
+                .boundsMax    = box.max,
+                .opaque       = isOpaque(model, primitive),
+                .skinned      = node.skin > -1,
+                .designated   = node.name.contains("occluder"),
+            });
+
+            scene.boxes.push_back(box);
+            scene.bounds.min = glm::min(scene.bounds.min, box.min);
+            scene.bounds.max = glm::max(scene.bounds.max, box.max);
+        }
+    }
+
+    void addNode(Scene& scene, tinygltf::Model const& model, int nodeIndex, glm::mat4 const& parentMatrix)
+    {
+        tinygltf::Node const& node = model.nodes[nodeIndex];
+        glm::mat4 const matrix     = parentMatrix * getLocalMatrix(node);
+
+        if (node.mesh > -1)
+        {
+            addMesh(scene, model, node, matrix);
+        }
+
+        for (int child : node.children)
+        {
+            addNode(scene, model, child, matrix);
+        }
+    }
+
+    auto loadScene(std::string const& filename) -> Scene
+    {
+        tinygltf::Model model;
+        tinygltf::TinyGLTF context;
+
+        context.SetImageLoader(skipImageData, nullptr);
+
+        std::string error;
+        std::string warning;
+
+        bool const loaded = filename.ends_with(".glb")
+                                ? context.LoadBinaryFromFile(&model, &error, &warning, filename)
+                                : context.LoadASCIIFromFile(&model, &error, &warning, filename);
+
+        Scene scene;
+
+        if (!loaded)
+        {
+            logger::error("Could not load {}: {}", filename, error);
+
+            return scene;
+        }
+
+        int const sceneIndex = model.defaultScene > -1 ? model.defaultScene : 0;
+
+        if (sceneIndex < model.scenes.size())
+        {
+            for (int node : model.scenes[sceneIndex].nodes)
+            {
+                addNode(scene, model, node, glm::mat4(1.f));
+            }
+        }
+
+        for (uint32_t index : selectOccluders(scene.candidates))
+        {
+            Primitive const& primitive = scene.primitives[index];
+
+            scene.occluders.push_back(makeOccluderMesh(std::span<uint32_t const>(primitive.indices),
+                                                       std::span<glm::vec3 const>(primitive.positions),
+                                                       primitive.matrix));
+        }
+
+        return scene;
+    }
+}  // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    logger::Logger::init();
+
+    if (argc < 2)
+    {
+        logger::error("Usage: occlusion_benchmark <scene.gltf|scene.glb> [frames]");
+
+        return EXIT_FAILURE;
+    }
+
+    uint32_t const numFrames = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 1000;
+
+    Scene const scene = loadScene(argv[1]);
+
+    if (scene.occluders.empty() || numFrames == 0)
+    {
+        logger::error("Nothing to rasterize in {}", argv[1]);
+
+        return EXIT_FAILURE;
+    }
+
+    enki::TaskScheduler scheduler;
+    scheduler.Initialize(kNumThreads);
+
+    OcclusionRasterizer rasterizer { scheduler };
+    rasterizer.setOccluders(scene.occluders);
+
+    // The same lens as the renderer, reverse-Z with near and far swapped
+    glm::mat4 projection = glm::perspectiveFovRH(glm::radians(45.f), 1920.f, 1080.f, 1000.f, 0.1f);
+    projection[1][1] *= -1.f;
+
+    glm::vec3 const center = (scene.bounds.min + scene.bounds.max) * 0.5f;
+    float const radius     = glm::length(scene.bounds.max - scene.bounds.min) * 0.5f;
+
+    double renderTime  = 0.0;
+    double testTime    = 0.0;
+    uint64_t numHidden = 0;
+
+    for (uint32_t frame = 0; frame < numFrames; ++frame)
+    {
+        // Circles the scene from inside its bounds, so the occluders actually hide something
+        float const angle = glm::two_pi<float>() * static_cast<float>(frame) / static_cast<float>(numFrames);
+
+        glm::vec3 const eye = center + glm::vec3(std::cos(angle), 0.1f, std::sin(angle)) * radius * 0.5f;
+
+        glm::mat4 const viewProj = projection * glm::lookAt(eye, center, glm::vec3(0.f, 1.f, 0.f));
+
+        rasterizer.render(viewProj);
+        renderTime += rasterizer.getLastRenderTime();
+
+        auto testStart = std::chrono::high_resolution_clock::now();
+
+        for (Bounds const& box : scene.boxes)
+        {
+            numHidden += rasterizer.isVisible(box.min, box.max) ? 0 : 1;
+        }
+
+        testTime +=
+            std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - testStart)
+                .count();
+    }
+
+    uint64_t const numTests = static_cast<uint64_t>(numFrames) * scene.boxes.size();
+
+    logger::info("{} triangles, {} boxes, {} frames",
+                 rasterizer.getNumTriangles(),
+                 scene.boxes.size(),
+                 numFrames);
+    logger::info("render: {:.3f} ms per frame", renderTime / numFrames);
+    logger::info("isVisible: {:.1f} ns per box, {:.1f}% hidden",
+                 testTime * 1e6 / static_cast<double>(numTests),
+                 100.0 * static_cast<double>(numHidden) / static_cast<double>(numTests));
+
+    scheduler.WaitforAllAndShutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,14 @@
+#include <mc/file_reader.hpp>
 #include <mc/utils.hpp>
 
 namespace utils
 {
+    auto readFileIntoString(std::filesystem::path const& path) -> std::string
+    {
+        auto file = io::FileReader::get().readFile(path);
+
+        MC_ASSERT_MSG(file, "Failed to read file '{}'", path.string());
+
+        return { reinterpret_cast<char const*>(file->data()), file->size() };
+    }
 }  // namespace utils